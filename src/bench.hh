@@ -0,0 +1,126 @@
+// Microbenchmark helpers
+//
+// Include from exactly one translation unit of a benchmark binary: it
+// replaces the global allocation functions to count allocations.
+//
+// Results are printed as a table on stdout and, with -o <file>, written
+// as JSON lines so runs from different commits can be compared.
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <unistd.h>
+
+static uint64_t bench_allocations = 0;
+
+void *operator new(size_t size) {
+  ++bench_allocations;
+  void *p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+// Keep the compiler from optimizing away a computed value
+template <typename T>
+static inline void bench_keep(T &&value) { asm volatile("" : : "g"(&value) : "memory"); }
+
+struct bench_result {
+  std::string name;
+  uint64_t iterations;
+  double ns_per_op;
+  double allocs_per_op;
+};
+
+struct bench {
+  double min_time_in_s = 0.2;
+  const char *filter = NULL;
+  FILE *json = NULL;
+  std::vector<bench_result> results;
+
+  // Usage: <binary> [-t seconds] [-o results.json] [name filter substring]
+  bench(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "t:o:")) != -1) {
+      switch (opt) {
+      case 't': min_time_in_s = atof(optarg); break;
+      case 'o':
+	json = fopen(optarg, "w");
+	if (!json) { perror(optarg); exit(1); }
+	break;
+      default:
+	fprintf(stderr, "Usage: %s [-t seconds] [-o results.json] [filter]\n", argv[0]);
+	exit(1);
+      }
+    }
+    if (optind < argc)
+      filter = argv[optind];
+    printf("%-56s %12s %12s %12s\n", "benchmark", "iterations", "ns/op", "allocs/op");
+  }
+  ~bench() {
+    if (json)
+      fclose(json);
+  }
+
+  bool enabled(const std::string &name) const { return !filter || name.find(filter) != std::string::npos; }
+
+  void report(const std::string &name, uint64_t iterations, double ns, uint64_t allocs) {
+    bench_result r = { name, iterations, ns / iterations, (double)allocs / iterations };
+    printf("%-56s %12llu %12.1f %12.2f\n", name.c_str(), (unsigned long long)iterations, r.ns_per_op, r.allocs_per_op);
+    fflush(stdout);
+    if (json) {
+      fprintf(json, "{\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, \"allocs_per_op\": %.3f}\n",
+	      name.c_str(), (unsigned long long)iterations, r.ns_per_op, r.allocs_per_op);
+    }
+    results.push_back(r);
+  }
+
+  // Time fn() in batches, doubling the batch until min_time_in_s is reached
+  void run(const std::string &name, std::function<void()> fn) {
+    if (!enabled(name))
+      return;
+    typedef std::chrono::steady_clock clock;
+    fn(); // Warm up
+    for (uint64_t batch = 1; ; batch *= 2) {
+      uint64_t allocs_before = bench_allocations;
+      auto start = clock::now();
+      for (uint64_t i = 0; i < batch; ++i)
+	fn();
+      double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+      if (ns >= min_time_in_s * 1e9 || batch >= (1ull << 40)) {
+	report(name, batch, ns, bench_allocations - allocs_before);
+	return;
+      }
+    }
+  }
+
+  // For operations that consume their input: setup() is run before every
+  // fn() and is excluded from both timing and allocation counts.
+  void run(const std::string &name, std::function<void()> setup, std::function<void()> fn) {
+    if (!enabled(name))
+      return;
+    typedef std::chrono::steady_clock clock;
+    double ns = 0;
+    uint64_t allocs = 0, iterations = 0;
+    setup(); fn(); // Warm up
+    while (ns < min_time_in_s * 1e9) {
+      setup();
+      uint64_t allocs_before = bench_allocations;
+      auto start = clock::now();
+      fn();
+      ns += std::chrono::duration<double, std::nano>(clock::now() - start).count();
+      allocs += bench_allocations - allocs_before;
+      ++iterations;
+    }
+    report(name, iterations, ns, allocs);
+  }
+};
@@ -2,6 +2,8 @@
 #include <functional>
 #include <cstdint>
 #include <cassert>
+#include <algorithm>
+#include <boost/range/numeric.hpp>
 
 // A fixed precision unsigned integer field. operator+ is concatenation
 template <unsigned Width, typename = typename std::enable_if<Width<=8*sizeof(unsigned)>::type>
@@ -25,7 +27,15 @@ struct bits {
     data[write_offset/8] |= (!!bit)<<(7-write_offset%8);
     ++write_offset;
   }
-  void push_bits(unsigned n_bits, unsigned value) { while(n_bits) { push_bit((value >> --n_bits)&1); } }
+  // As many bits at a time as fit in the current octet
+  void push_bits(unsigned n_bits, unsigned value) {
+    while (n_bits) {
+      unsigned n = std::min(n_bits, 8 - write_offset%8);
+      n_bits -= n;
+      data[write_offset/8] |= ((value >> n_bits) & ((1u<<n)-1)) << (8-write_offset%8-n);
+      write_offset += n;
+    }
+  }
   template <unsigned WidthInBits> void push_bits(unsigned value) { push_bits(WidthInBits, value); }
   void push(unsigned n_bits, unsigned value) { while(n_bits) { push_bit((value >> --n_bits)&1); } }
   template <unsigned WidthInBits> void push(unsigned value) { push_bits(WidthInBits, value); }
@@ -36,17 +46,22 @@ struct bits {
 
   unsigned operator/(unsigned n_bits) {
     unsigned value = 0;
-    while (n_bits--) { value = (value<<1) | read_bit(); }
+    while (n_bits) {
+      unsigned n = std::min(n_bits, 8 - read_offset%8);
+      n_bits -= n;
+      value = (value<<n) | ((data[read_offset/8] >> (8-read_offset%8-n)) & ((1u<<n)-1));
+      read_offset += n;
+    }
     return value;
   }
 };
 
 
-void bits_add_bit(struct bits &self, bool bit) {
+inline void bits_add_bit(struct bits &self, bool bit) {
   self.data[self.write_offset/8] |= (!!bit)<<((8-self.write_offset%8)-1);
   ++self.write_offset;
 }
-void bits_add_int(struct bits &self, unsigned n_bits, int value) {
+inline void bits_add_int(struct bits &self, unsigned n_bits, int value) {
   assert(value >= 0 && value <= (1<<n_bits));
   unsigned i = (unsigned)value;
   while(n_bits) {
@@ -54,7 +69,7 @@ void bits_add_int(struct bits &self, unsigned n_bits, int value) {
   }
 }
 
-void bits_pad_to_octet(struct bits &self) {
+inline void bits_pad_to_octet(struct bits &self) {
   bits_add_int(self, (8 - self.write_offset % 8) % 8, 0);
 }
 
@@ -102,7 +117,7 @@ namespace std {
   };
 }
 
-static unsigned bits_to_bytes(int bits) { return (bits + 7) / 8; }
+static inline unsigned bits_to_bytes(int bits) { return (bits + 7) / 8; }
 
 template <class Container, typename T>
 static auto
@@ -0,0 +1,26 @@
+// Run time selection of instruction set extensions. Code is built for the
+// baseline x86-64, and functions for newer CPUs are compiled with
+// __attribute__((target(...))) and only called when cpu_has() says so.
+#pragma once
+
+#include <cstdint>
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CPU_X86 1
+#include <immintrin.h>
+#endif
+
+enum cpu_feature { CPU_AVX2, CPU_PCLMUL };
+
+static inline bool
+cpu_has(cpu_feature feature) {
+#ifdef CPU_X86
+  static const bool avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+  static const bool pclmul = __builtin_cpu_supports("pclmul");
+  switch (feature) {
+  case CPU_AVX2: return avx2;
+  case CPU_PCLMUL: return pclmul;
+  }
+#endif
+  (void)feature;
+  return false;
+}
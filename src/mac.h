@@ -0,0 +1,228 @@
+// 3GPP LTE MAC: 4G Medium Access Control interface
+//
+// Logical channels are attached as callbacks so that any rlc.h
+// implementation (or something else entirely) can sit on top.
+#ifndef MAC_H
+#define MAC_H
+
+#include "rlc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /******** Logical channel identifiers *********/
+#define MAC_LCID_CCCH 0
+#define MAC_LCID_MAX_LOGICAL_CHANNEL 10
+  /* Downlink control elements */
+#define MAC_LCID_DL_ACTIVATION 27
+#define MAC_LCID_DL_CONTENTION_RESOLUTION 28
+#define MAC_LCID_DL_TIMING_ADVANCE 29
+#define MAC_LCID_DL_DRX_COMMAND 30
+#define MAC_LCID_DL_LONG_DRX_COMMAND 26
+  /* Uplink control elements */
+#define MAC_LCID_UL_EXTENDED_PHR 25
+#define MAC_LCID_UL_PHR 26
+#define MAC_LCID_UL_CRNTI 27
+#define MAC_LCID_UL_TRUNCATED_BSR 28
+#define MAC_LCID_UL_SHORT_BSR 29
+#define MAC_LCID_UL_LONG_BSR 30
+#define MAC_LCID_PADDING 31
+
+  // Most MAC SDUs and control elements in one transport block
+#define MAC_MAX_SUBHEADERS 64
+
+  /******** Multiplexer *********/
+  // Builds the transport blocks of one UE in one direction
+  struct mac_mux;
+  typedef struct mac_mux MAC_MUX;
+
+  // Same contract as rlc_pdus_send_opportunity(), which can be attached
+  // directly with an RLC * as arg
+  typedef int (*mac_pdus_send_opportunity_fn)(void *arg, unsigned time_in_ms, void *buffer, int size, int *pdu_sizes, int max_pdus);
+
+  DLL_PUBLIC MAC_MUX *mac_mux_init();
+  DLL_PUBLIC void    mac_mux_free(MAC_MUX *mux);
+  // Channels with a lower priority value are served first.
+  // Returns -1 and sets errno if lcid is not a logical channel.
+  DLL_PUBLIC int     mac_mux_add_channel(MAC_MUX *mux, int lcid, int priority, void *arg, mac_pdus_send_opportunity_fn send);
+  DLL_PUBLIC int     mac_mux_remove_channel(MAC_MUX *mux, int lcid);
+  // Queue a fixed size control element for the next transport blocks.
+  // Returns -1 and sets errno if it doesn't fit in the queue.
+  DLL_PUBLIC int     mac_mux_add_control_element(MAC_MUX *mux, int lcid, const void *data, int size);
+  // Fill a whole transport block: padding subheaders, subheaders, control
+  // elements, MAC SDUs and zero padding. Returns the number of control
+  // elements and MAC SDUs in it, 0 if it's all padding.
+  DLL_PUBLIC int     mac_mux_transport_block(MAC_MUX *mux, unsigned time_in_ms, void *transport_block, int size);
+
+  /******** Demultiplexer *********/
+  // Parses received transport blocks of one UE in one direction and hands
+  // out pointers into them: payload is never copied.
+  struct mac_demux;
+  typedef struct mac_demux MAC_DEMUX;
+
+  // Same contract as rlc_pdu_received(), which can be attached directly
+  // with an RLC * as arg
+  typedef void (*mac_pdu_received_fn)(void *arg, unsigned time_in_ms, const void *buffer, int size);
+  // Every control element, after any BSR or PHR in it has been recorded
+  typedef void (*mac_control_element_received_fn)(void *arg, unsigned time_in_ms, int lcid, const void *data, int size);
+
+  // uplink selects which control elements to expect
+  DLL_PUBLIC MAC_DEMUX *mac_demux_init(int uplink);
+  DLL_PUBLIC void    mac_demux_free(MAC_DEMUX *demux);
+  // MAC SDUs of logical channels without a receiver are dropped
+  DLL_PUBLIC int     mac_demux_add_channel(MAC_DEMUX *demux, int lcid, void *arg, mac_pdu_received_fn received);
+  DLL_PUBLIC int     mac_demux_remove_channel(MAC_DEMUX *demux, int lcid);
+  DLL_PUBLIC void    mac_demux_set_control_element_callback(MAC_DEMUX *demux, void *arg, mac_control_element_received_fn received);
+  // Returns the number of control elements and MAC SDUs in the block.
+  // A malformed block is dropped as a whole: returns -1 with errno EBADMSG.
+  DLL_PUBLIC int     mac_demux_transport_block(MAC_DEMUX *demux, unsigned time_in_ms, const void *transport_block, int size);
+
+  // All transport blocks decoded in one TTI, possibly of many UEs
+  struct mac_received_transport_block {
+    MAC_DEMUX  *demux;
+    const void *data;
+    int         size;
+    int         result; // Set as returned by mac_demux_transport_block()
+  };
+  // Returns the number of malformed blocks
+  DLL_PUBLIC int     mac_demux_transport_blocks(unsigned time_in_ms, struct mac_received_transport_block *blocks, int n_blocks);
+
+  /******** Buffer status and power headroom reports *********/
+
+#define MAC_LOGICAL_CHANNEL_GROUPS 4
+
+  // Latest uplink reports seen by a demultiplexer
+  struct mac_ue_reports {
+    // Upper bounds in bytes per logical channel group
+    uint32_t buffer_size[MAC_LOGICAL_CHANNEL_GROUPS];
+    int      power_headroom_db;
+    unsigned bsr_time_in_ms, phr_time_in_ms;
+    uint32_t bsrs_received, phrs_received;
+  };
+  DLL_PUBLIC void    mac_demux_get_reports(MAC_DEMUX *demux, struct mac_ue_reports *reports);
+  // Buffer Size field of a BSR for bytes, and the bytes it stands for
+  DLL_PUBLIC int     mac_bsr_index(uint32_t bytes);
+  DLL_PUBLIC uint32_t mac_bsr_buffer_size(int index);
+
+  /******** Scheduler *********/
+  // Sizes the grants of all UEs in a cell for one TTI, one scheduler per
+  // direction. Logical channels first get their prioritised bit rate
+  // in priority order over all UEs; the rest of the capacity is then
+  // shared by the policy.
+  struct mac_scheduler;
+  typedef struct mac_scheduler MAC_SCHEDULER;
+
+#define MAC_SCHEDULER_ROUND_ROBIN 0
+#define MAC_SCHEDULER_PROPORTIONAL_FAIR 1
+#define MAC_PRIORITY_MAX 16
+#define MAC_PBR_INFINITY -1
+
+  // Same contract as rlc_get_buffer_status(), which can be attached directly
+  // with an RLC * as arg. Add what the upper layer has queued to
+  // new_data_bytes, or in uplink report the latest BSR.
+  typedef void (*mac_buffer_status_fn)(void *arg, struct rlc_buffer_status *status);
+
+  struct mac_grant {
+    int   ue;
+    void *arg;  // As given to mac_scheduler_add_ue()
+    int   size; // Bytes including MAC headers
+  };
+
+  DLL_PUBLIC MAC_SCHEDULER *mac_scheduler_init(int policy);
+  DLL_PUBLIC void    mac_scheduler_free(MAC_SCHEDULER *scheduler);
+  // Returns the UE number used in the rest of the calls and in grants
+  DLL_PUBLIC int     mac_scheduler_add_ue(MAC_SCHEDULER *scheduler, void *arg);
+  DLL_PUBLIC int     mac_scheduler_remove_ue(MAC_SCHEDULER *scheduler, int ue);
+  // Most bytes the UE can receive in a TTI given its channel quality.
+  // 0, the default, means no limit.
+  DLL_PUBLIC int     mac_scheduler_set_ue_rate(MAC_SCHEDULER *scheduler, int ue, int bytes_per_tti);
+  // priority 1..MAC_PRIORITY_MAX, 1 is served first. prioritised_bit_rate
+  // in kB/s and bucket_size_duration in ms as in RRC LogicalChannelConfig.
+  DLL_PUBLIC int     mac_scheduler_add_bearer(MAC_SCHEDULER *scheduler, int ue, int lcid, int priority,
+					      int prioritised_bit_rate, int bucket_size_duration,
+					      void *arg, mac_buffer_status_fn buffer_status);
+  DLL_PUBLIC int     mac_scheduler_remove_bearer(MAC_SCHEDULER *scheduler, int ue, int lcid);
+  // Only bearers that had data on the previous TTI or have been woken up
+  // since are looked at. Wake a bearer when an SDU is queued on it or a
+  // PDU is received on it, which may call for a STATUS or retransmissions.
+  DLL_PUBLIC int     mac_scheduler_wake(MAC_SCHEDULER *scheduler, int ue, int lcid);
+  // Share capacity bytes between up to max_grants UEs.
+  // Returns the number of grants.
+  DLL_PUBLIC int     mac_scheduler_run(MAC_SCHEDULER *scheduler, unsigned time_in_ms, int capacity,
+				       struct mac_grant *grants, int max_grants);
+
+  /******** HARQ *********/
+  // One HARQ entity per UE and direction, holding transport blocks until
+  // they are acknowledged on the transmitting side and combining soft
+  // bits of retransmissions on the receiving side. Soft buffers are lent
+  // out of a pool shared by the cell, only while a block is being received.
+
+#define MAC_HARQ_MAX_PROCESSES 16
+  // FDD: ACK/NACK comes 4 subframes after a transmission and the
+  // retransmission at the earliest 8 subframes after it
+#define MAC_HARQ_FEEDBACK_DELAY 4
+#define MAC_HARQ_RTT 8
+
+  struct mac_harq_pool;
+  typedef struct mac_harq_pool MAC_HARQ_POOL;
+  struct mac_harq;
+  typedef struct mac_harq MAC_HARQ;
+
+  struct mac_harq_stats {
+    uint64_t new_transmissions, retransmissions;
+    // Feedback missing when a retransmission was due counts as a NACK.
+    // Feedback for another subframe than the one due is ignored.
+    uint64_t acks, nacks, missing_feedback, mistimed_feedback;
+    uint64_t failures; // Given up after max transmissions
+    uint64_t rx_new, rx_retransmissions, rx_duplicates;
+    uint64_t rx_ok, rx_failed;
+    uint64_t rx_no_soft_buffer;
+    uint64_t rx_feedback_missed; // Not collected in its subframe, dropped
+  };
+
+  // What to send: on a new transmission and each retransmission
+  struct mac_harq_tx {
+    int process;
+    int new_data_indicator;
+    int redundancy_version;
+    int transmission;  // 1 for the first
+    const void *data;
+    int size;
+  };
+
+  DLL_PUBLIC MAC_HARQ_POOL *mac_harq_pool_init(int n_buffers, int soft_bits_per_buffer);
+  DLL_PUBLIC void    mac_harq_pool_free(MAC_HARQ_POOL *pool);
+  // pool may be NULL for a transmit only entity
+  DLL_PUBLIC MAC_HARQ *mac_harq_init(MAC_HARQ_POOL *pool, int n_processes, int max_transmissions, int max_tb_size);
+  DLL_PUBLIC void    mac_harq_free(MAC_HARQ *harq);
+  DLL_PUBLIC void    mac_harq_get_stats(MAC_HARQ *harq, struct mac_harq_stats *stats);
+
+  // Transmitter. Returns an idle process or -1.
+  DLL_PUBLIC int     mac_harq_tx_idle_process(MAC_HARQ *harq);
+  // Keeps a copy of the transport block. Returns -1 and sets errno if the
+  // process is busy or the block too large.
+  DLL_PUBLIC int     mac_harq_tx_new(MAC_HARQ *harq, unsigned time_in_ms, int process, const void *transport_block, int size, struct mac_harq_tx *tx);
+  DLL_PUBLIC void    mac_harq_tx_feedback(MAC_HARQ *harq, unsigned time_in_ms, int process, int ack);
+  // Returns 1 and fills in tx when the oldest NACKed block is due, else 0.
+  // Redundancy versions go 0, 2, 3, 1.
+  DLL_PUBLIC int     mac_harq_tx_retransmission(MAC_HARQ *harq, unsigned time_in_ms, struct mac_harq_tx *tx);
+
+  // Receiver. Returns the soft buffer to combine the received soft bits
+  // into, cleared if new_data_indicator says this is new data. Returns NULL
+  // with errno EALREADY for a retransmission of a block that already
+  // decoded, which is ACKed again and must not be delivered, or ENOBUFS when
+  // no soft buffer is available and the block can't be combined.
+  DLL_PUBLIC int16_t *mac_harq_rx_soft_buffer(MAC_HARQ *harq, unsigned time_in_ms, int process, int new_data_indicator, int n_soft_bits);
+  // Decoding result: schedules the ACK/NACK and frees the soft buffer when done
+  DLL_PUBLIC void    mac_harq_rx_result(MAC_HARQ *harq, unsigned time_in_ms, int process, int crc_ok);
+  // ACK (1) or NACK (0) to send this subframe, -1 if none. Call it every
+  // subframe: feedback whose subframe has passed is dropped.
+  DLL_PUBLIC int     mac_harq_rx_feedback(MAC_HARQ *harq, unsigned time_in_ms, int *process);
+  // Saturating addition of received LLRs into a soft buffer
+  DLL_PUBLIC void    mac_harq_soft_combine(int16_t *soft_bits, const int8_t *llrs, int n);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
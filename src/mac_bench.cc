@@ -0,0 +1,502 @@
+/*
+   Microbenchmarks for the MAC layer: transport block multiplexer and
+   demultiplexer, scheduler and HARQ, with a small scheduler simulation
+
+   Usage: mac_bench [-t seconds] [-o results.json] [name filter]
+*/
+#include "mac.h"
+#include "bench.hh"
+
+#include <cerrno>
+#include <vector>
+#include <boost/format.hpp>
+
+using boost::str;
+using boost::format;
+using std::vector;
+
+// From the smallest to the largest single layer transport block
+static const int tb_sizes[] = { 2, 16, 128, 1500, 9422 };
+
+// Logical channel that always has PDUs of pdu_size, cutting the last one
+// short to fill the grant
+struct synthetic_channel {
+  int pdu_size;
+  uint8_t fill;
+};
+
+static int
+synthetic_send(void *arg, unsigned time_in_ms, void *buffer, int size, int *pdu_sizes, int max_pdus) {
+  synthetic_channel *channel = (synthetic_channel *)arg;
+  uint8_t *p = (uint8_t *)buffer;
+  int n = 0;
+  while (n < max_pdus && size > 3) {
+    int pdu_size = channel->pdu_size;
+    if (pdu_size + (pdu_size < 128 ? 2 : 3) > size)
+      pdu_size = size - (size - 2 < 128 ? 2 : 3);
+    memset(p, channel->fill, pdu_size);
+    p += pdu_size;
+    size -= pdu_size + (pdu_size < 128 ? 2 : 3);
+    pdu_sizes[n++] = pdu_size;
+  }
+  return n;
+}
+
+// Walk the subheader chain and check that the transport block is exactly
+// filled and every MAC SDU holds its channel's fill byte
+static bool
+check_transport_block(const uint8_t *tb, int size) {
+  struct { int lcid, size; } elements[MAC_MAX_SUBHEADERS + 2];
+  int n = 0, offset = 0;
+  bool more = true;
+  while (more) {
+    if (offset >= size || n == MAC_MAX_SUBHEADERS + 2)
+      return false;
+    more = tb[offset] & 0x20;
+    int lcid = tb[offset++] & 0x1f, length = 0;
+    if (lcid <= MAC_LCID_MAX_LOGICAL_CHANNEL && more) {
+      length = tb[offset++];
+      if (length & 0x80)
+	length = ((length & 0x7f) << 8) | tb[offset++];
+    } else if (lcid <= MAC_LCID_MAX_LOGICAL_CHANNEL || (lcid == MAC_LCID_PADDING && !more)) {
+      length = -1; // Rest of the transport block
+    } else if (lcid == MAC_LCID_DL_TIMING_ADVANCE) {
+      length = 1;
+    }
+    elements[n++] = { lcid, length };
+  }
+  for (int i = 0; i < n; ++i) {
+    int length = elements[i].size;
+    if (length == -1)
+      length = size - offset;
+    if (offset + length > size)
+      return false;
+    if (elements[i].lcid <= MAC_LCID_MAX_LOGICAL_CHANNEL)
+      for (int j = 0; j < length; ++j)
+	if (tb[offset + j] != elements[i].lcid)
+	  return false;
+    if (elements[i].lcid == MAC_LCID_PADDING && elements[i].size == -1)
+      for (int j = offset; j < size; ++j)
+	if (tb[j] != 0)
+	  return false;
+    offset += length;
+  }
+  return offset == size;
+}
+
+static void
+add_channels(MAC_MUX *mux, vector<synthetic_channel> &channels) {
+  for (size_t i = 0; i < channels.size(); ++i)
+    mac_mux_add_channel(mux, channels[i].fill, channels[i].fill, &channels[i], synthetic_send);
+}
+
+static void
+bench_transport_block(bench &b) {
+  static const int shapes[][3] = { { 1, 1400, 0 }, { 1, 40, 0 }, { 3, 100, 1 } };
+  for (auto &shape : shapes) {
+    vector<synthetic_channel> channels;
+    for (int c = 1; c <= shape[0]; ++c)
+      channels.push_back(synthetic_channel { shape[1] * c, (uint8_t)c });
+    MAC_MUX *mux = mac_mux_init();
+    add_channels(mux, channels);
+    bool with_ce = shape[2];
+    uint8_t timing_advance = 31;
+    for (int size : tb_sizes) {
+      vector<uint8_t> tb(size);
+      if (with_ce)
+	mac_mux_add_control_element(mux, MAC_LCID_DL_TIMING_ADVANCE, &timing_advance, 1);
+      mac_mux_transport_block(mux, 0, tb.data(), size);
+      if (!check_transport_block(tb.data(), size)) {
+	fprintf(stderr, "Malformed transport block of %d bytes\n", size);
+	exit(1);
+      }
+      b.run(str(format("transport_block/channels=%d/pdu_size=%d/ce=%d/tb=%d") % shape[0] % shape[1] % with_ce % size),
+	    [&]() {
+	      if (with_ce)
+		mac_mux_add_control_element(mux, MAC_LCID_DL_TIMING_ADVANCE, &timing_advance, 1);
+	      mac_mux_transport_block(mux, 0, tb.data(), size);
+	      bench_keep(tb);
+	    });
+    }
+    mac_mux_free(mux);
+  }
+}
+
+// One TTI of a busy cell: a transport block for each UE with SRB1, SRB2
+// and a DRB, all backed up
+static void
+bench_tti(bench &b) {
+  static const int ue_counts[] = { 1, 16, 128 };
+  for (int n_ues : ue_counts) {
+    vector<MAC_MUX *> muxes;
+    vector<synthetic_channel> channels = {
+      { 60, MAC_LCID_CCCH + 1 }, { 100, MAC_LCID_CCCH + 2 }, { 1400, MAC_LCID_CCCH + 3 } };
+    for (int u = 0; u < n_ues; ++u) {
+      muxes.push_back(mac_mux_init());
+      add_channels(muxes.back(), channels);
+    }
+    vector<uint8_t> tbs(n_ues * 1500);
+    b.run(str(format("tti/ues=%d/tb=1500") % n_ues), [&]() {
+	for (int u = 0; u < n_ues; ++u)
+	  mac_mux_transport_block(muxes[u], 0, &tbs[u * 1500], 1500);
+	bench_keep(tbs);
+      });
+    for (MAC_MUX *mux : muxes)
+      mac_mux_free(mux);
+  }
+}
+
+// RLC AM over the multiplexer, the peer acknowledging everything at once
+struct rlc_loopback {
+  RLC *rlc, *peer;
+  uint8_t status[64];
+};
+
+static int
+rlc_sdu_send(void *arg, unsigned time_in_ms, void *buffer, size_t size) {
+  memset(buffer, 0x55, std::min(size, (size_t)300));
+  return std::min(size, (size_t)300);
+}
+
+static int
+rlc_loopback_send(void *arg, unsigned time_in_ms, void *buffer, int size, int *pdu_sizes, int max_pdus) {
+  rlc_loopback *l = (rlc_loopback *)arg;
+  int n = rlc_pdus_send_opportunity(l->rlc, time_in_ms, buffer, size, pdu_sizes, max_pdus);
+  const uint8_t *p = (const uint8_t *)buffer;
+  for (int i = 0; i < n; p += pdu_sizes[i++])
+    rlc_pdu_received(l->peer, time_in_ms, p, pdu_sizes[i]);
+  int status_size = rlc_pdu_send_opportunity(l->peer, time_in_ms, l->status, sizeof(l->status));
+  if (status_size > 0)
+    rlc_pdu_received(l->rlc, time_in_ms, l->status, status_size);
+  return n;
+}
+
+static void
+bench_rlc(bench &b) {
+  for (int size : tb_sizes) {
+    rlc_loopback l;
+    l.rlc = rlc_init();
+    l.peer = rlc_init();
+    rlc_set_parameters(l.rlc, NULL, 0);
+    rlc_set_parameters(l.peer, NULL, 0);
+    rlc_am_set_callbacks(l.rlc, NULL, rlc_sdu_send, NULL, NULL, NULL);
+    MAC_MUX *mux = mac_mux_init();
+    mac_mux_add_channel(mux, 3, 10, &l, rlc_loopback_send);
+    vector<uint8_t> tb(size);
+    unsigned time_in_ms = 0;
+    b.run(str(format("rlc_am_loopback/sdu_size=300/tb=%d") % size), [&]() {
+	mac_mux_transport_block(mux, ++time_in_ms, tb.data(), size);
+	bench_keep(tb);
+      });
+    mac_mux_free(mux);
+    rlc_free(l.rlc);
+    rlc_free(l.peer);
+  }
+}
+
+// Receiver checking every MAC SDU holds its logical channel's fill byte
+struct counting_receiver {
+  int lcid;
+  uint64_t sdus, bytes, errors;
+};
+
+static void
+counting_received(void *arg, unsigned time_in_ms, const void *buffer, int size) {
+  counting_receiver *r = (counting_receiver *)arg;
+  const uint8_t *p = (const uint8_t *)buffer;
+  r->sdus++;
+  r->bytes += size;
+  if (size && (p[0] != r->lcid || p[size - 1] != r->lcid))
+    r->errors++;
+}
+
+static void
+bench_demux(bench &b) {
+  vector<synthetic_channel> channels = {
+    { 60, MAC_LCID_CCCH + 1 }, { 100, MAC_LCID_CCCH + 2 }, { 1400, MAC_LCID_CCCH + 3 } };
+  vector<counting_receiver> receivers;
+  for (auto &c : channels)
+    receivers.push_back(counting_receiver { c.fill, 0, 0, 0 });
+  MAC_MUX *mux = mac_mux_init();
+  add_channels(mux, channels);
+  MAC_DEMUX *demux = mac_demux_init(false);
+  for (auto &r : receivers)
+    mac_demux_add_channel(demux, r.lcid, &r, counting_received);
+
+  uint8_t timing_advance = 31;
+  for (int size : tb_sizes) {
+    vector<uint8_t> tb(size);
+    mac_mux_add_control_element(mux, MAC_LCID_DL_TIMING_ADVANCE, &timing_advance, 1);
+    int elements = mac_mux_transport_block(mux, 0, tb.data(), size);
+    for (auto &r : receivers)
+      r.errors = 0;
+    if (mac_demux_transport_block(demux, 0, tb.data(), size) != elements
+	|| receivers[0].errors + receivers[1].errors + receivers[2].errors) {
+      fprintf(stderr, "Transport block of %d bytes didn't survive demultiplexing\n", size);
+      exit(1);
+    }
+    b.run(str(format("demux/channels=3/tb=%d") % size), [&]() {
+	int n = mac_demux_transport_block(demux, 0, tb.data(), size);
+	bench_keep(n);
+      });
+  }
+
+  // A TTI worth of uplink from many UEs
+  static const int ue_counts[] = { 16, 128 };
+  for (int n_ues : ue_counts) {
+    vector<uint8_t> tbs(n_ues * 1500);
+    vector<MAC_DEMUX *> demuxes;
+    vector<mac_received_transport_block> blocks;
+    for (int u = 0; u < n_ues; ++u) {
+      mac_mux_transport_block(mux, 0, &tbs[u * 1500], 1500);
+      demuxes.push_back(mac_demux_init(true));
+      for (auto &r : receivers)
+	mac_demux_add_channel(demuxes.back(), r.lcid, &r, counting_received);
+      blocks.push_back(mac_received_transport_block { demuxes.back(), &tbs[u * 1500], 1500, 0 });
+    }
+    b.run(str(format("demux_tti/ues=%d/tb=1500") % n_ues), [&]() {
+	int malformed = mac_demux_transport_blocks(0, blocks.data(), blocks.size());
+	bench_keep(malformed);
+      });
+    for (MAC_DEMUX *d : demuxes)
+      mac_demux_free(d);
+  }
+  mac_demux_free(demux);
+  mac_mux_free(mux);
+}
+
+static void
+harq_fail(const char *what) {
+  fprintf(stderr, "HARQ: %s\n", what);
+  exit(1);
+}
+
+// Retransmissions with their timing and redundancy versions, and soft
+// combining with its feedback
+static void
+check_harq() {
+  MAC_HARQ_POOL *pool = mac_harq_pool_init(2, 64);
+  MAC_HARQ *harq = mac_harq_init(pool, 2, 3, 100);
+  mac_harq_stats stats;
+  mac_harq_tx tx;
+  uint8_t tb[100];
+  for (int i = 0; i < 100; ++i)
+    tb[i] = i;
+
+  // NACK, then the same block again after the round trip with the next RV
+  mac_harq_tx_new(harq, 100, 0, tb, sizeof(tb), &tx);
+  int ndi = tx.new_data_indicator;
+  if (tx.transmission != 1 || tx.redundancy_version != 0)
+    harq_fail("new transmission not the first with RV 0");
+  mac_harq_tx_feedback(harq, 100 + MAC_HARQ_FEEDBACK_DELAY, 0, 0);
+  if (mac_harq_tx_retransmission(harq, 100 + MAC_HARQ_RTT - 1, &tx))
+    harq_fail("retransmission before the round trip");
+  if (!mac_harq_tx_retransmission(harq, 100 + MAC_HARQ_RTT, &tx) || tx.process != 0 || tx.transmission != 2
+      || tx.redundancy_version != 2 || tx.new_data_indicator != ndi || tx.size != (int)sizeof(tb)
+      || memcmp(tx.data, tb, sizeof(tb)))
+    harq_fail("NACKed block not retransmitted as the second with RV 2");
+  // Feedback of the first transmission arriving now isn't for this one
+  mac_harq_tx_feedback(harq, 100 + MAC_HARQ_RTT + 1, 0, 1);
+  mac_harq_get_stats(harq, &stats);
+  if (stats.mistimed_feedback != 1 || stats.acks)
+    harq_fail("mistimed feedback taken");
+  // No feedback at all counts as a NACK, and the third NACK gives up
+  if (!mac_harq_tx_retransmission(harq, 100 + 2 * MAC_HARQ_RTT, &tx) || tx.transmission != 3 || tx.redundancy_version != 3)
+    harq_fail("block without feedback not retransmitted as the third with RV 3");
+  mac_harq_tx_feedback(harq, 100 + 2 * MAC_HARQ_RTT + MAC_HARQ_FEEDBACK_DELAY, 0, 0);
+  mac_harq_get_stats(harq, &stats);
+  if (mac_harq_tx_retransmission(harq, 100 + 3 * MAC_HARQ_RTT, &tx) || stats.missing_feedback != 1
+      || stats.failures != 1 || mac_harq_tx_idle_process(harq) != 0)
+    harq_fail("block not given up after max transmissions");
+  // An ACK frees the process with nothing to retransmit
+  mac_harq_tx_new(harq, 200, 1, tb, 10, &tx);
+  mac_harq_tx_feedback(harq, 200 + MAC_HARQ_FEEDBACK_DELAY, 1, 1);
+  if (mac_harq_tx_retransmission(harq, 200 + MAC_HARQ_RTT, &tx) || mac_harq_tx_idle_process(harq) != 0)
+    harq_fail("ACKed block retransmitted");
+
+  // A failed first copy is NACKed in its subframe and kept for combining
+  int8_t llrs[64];
+  for (int i = 0; i < 64; ++i)
+    llrs[i] = i * 5 - 100;
+  int16_t *soft_bits = mac_harq_rx_soft_buffer(harq, 300, 1, 1, 64);
+  if (!soft_bits)
+    harq_fail("no soft buffer for new data");
+  mac_harq_soft_combine(soft_bits, llrs, 64);
+  mac_harq_rx_result(harq, 300, 1, 0);
+  int process = -1;
+  if (mac_harq_rx_feedback(harq, 300 + MAC_HARQ_FEEDBACK_DELAY - 1, &process) != -1
+      || mac_harq_rx_feedback(harq, 300 + MAC_HARQ_FEEDBACK_DELAY, &process) != 0 || process != 1)
+    harq_fail("NACK not sent in its subframe");
+  // The retransmission adds to the same soft bits
+  if (mac_harq_rx_soft_buffer(harq, 308, 1, 1, 64) != soft_bits)
+    harq_fail("retransmission not combined into the same soft buffer");
+  mac_harq_soft_combine(soft_bits, llrs, 64);
+  for (int i = 0; i < 64; ++i)
+    if (soft_bits[i] != 2 * llrs[i])
+      harq_fail("soft bits not combined");
+  mac_harq_rx_result(harq, 308, 1, 1);
+  // The ACK is dropped when its subframe is missed, a duplicate is ACKed again
+  if (mac_harq_rx_feedback(harq, 308 + MAC_HARQ_FEEDBACK_DELAY + 1, &process) != -1)
+    harq_fail("ACK sent late");
+  if (mac_harq_rx_soft_buffer(harq, 316, 1, 1, 64) || errno != EALREADY
+      || mac_harq_rx_feedback(harq, 316 + MAC_HARQ_FEEDBACK_DELAY, &process) != 1)
+    harq_fail("duplicate not ACKed again");
+  // New data starts from cleared soft bits
+  soft_bits = mac_harq_rx_soft_buffer(harq, 324, 1, 0, 64);
+  for (int i = 0; soft_bits && i < 64; ++i)
+    if (soft_bits[i])
+      soft_bits = NULL;
+  mac_harq_get_stats(harq, &stats);
+  if (!soft_bits || stats.rx_new != 2 || stats.rx_retransmissions != 1 || stats.rx_duplicates != 1
+      || stats.rx_ok != 1 || stats.rx_feedback_missed != 1)
+    harq_fail("new data not in a cleared soft buffer");
+  // Combining saturates
+  int16_t high[16];
+  int8_t up[16];
+  for (int i = 0; i < 16; ++i)
+    high[i] = INT16_MAX - 1, up[i] = 100;
+  mac_harq_soft_combine(high, up, 16);
+  if (high[0] != INT16_MAX || high[15] != INT16_MAX)
+    harq_fail("soft combining wrapped around");
+  mac_harq_free(harq);
+  mac_harq_pool_free(pool);
+}
+
+static void
+bench_harq(bench &b) {
+  check_harq();
+  MAC_HARQ_POOL *pool = mac_harq_pool_init(8, 3 * 6148);
+  MAC_HARQ *harq = mac_harq_init(pool, 8, 4, 9422);
+  vector<uint8_t> tb(1500, 0x55);
+  mac_harq_tx tx;
+  unsigned time_in_ms = 0;
+  // One NACK and retransmission for every block
+  b.run("harq/tx_new_nack_retransmit_ack/tb=1500", [&]() {
+      mac_harq_tx_new(harq, time_in_ms, mac_harq_tx_idle_process(harq), tb.data(), tb.size(), &tx);
+      mac_harq_tx_feedback(harq, time_in_ms + MAC_HARQ_FEEDBACK_DELAY, tx.process, 0);
+      time_in_ms += MAC_HARQ_RTT;
+      mac_harq_tx_retransmission(harq, time_in_ms, &tx);
+      mac_harq_tx_feedback(harq, time_in_ms + MAC_HARQ_FEEDBACK_DELAY, tx.process, 1);
+      bench_keep(tx);
+    });
+  // Soft bits of one largest code block, rate 1/3
+  vector<int8_t> llrs(3 * 6148);
+  for (size_t i = 0; i < llrs.size(); ++i)
+    llrs[i] = (int8_t)(i * 37);
+  int ndi = 0;
+  b.run("harq/rx_combine/soft_bits=18444", [&]() {
+      int16_t *soft_bits = mac_harq_rx_soft_buffer(harq, time_in_ms, 0, ndi, llrs.size());
+      mac_harq_soft_combine(soft_bits, llrs.data(), llrs.size());
+      mac_harq_rx_result(harq, time_in_ms, 0, 0);
+      ndi ^= 1;
+      bench_keep(soft_bits);
+    });
+  mac_harq_free(harq);
+  mac_harq_pool_free(pool);
+}
+
+// Backlogged bearer, or one draining by its grants when simulating
+struct simulated_bearer {
+  unsigned queued;
+};
+
+static void
+simulated_buffer_status(void *arg, struct rlc_buffer_status *status) {
+  status->status_bytes = status->retransmission_bytes = 0;
+  status->new_data_bytes = ((simulated_bearer *)arg)->queued;
+}
+
+struct simulated_cell {
+  MAC_SCHEDULER *scheduler;
+  vector<simulated_bearer> bearers; // Three per UE
+  vector<mac_grant> grants;
+  int n_ues;
+
+  simulated_cell(int policy, int n_ues, unsigned queued) : n_ues(n_ues) {
+    scheduler = mac_scheduler_init(policy);
+    bearers.resize(n_ues * 3, simulated_bearer { queued });
+    grants.resize(16);
+    for (int u = 0; u < n_ues; ++u) {
+      int ue = mac_scheduler_add_ue(scheduler, NULL);
+      // SRB1, SRB2 and a best effort DRB with 8 kB/s prioritised
+      mac_scheduler_add_bearer(scheduler, ue, 1, 1, MAC_PBR_INFINITY, 0, &bearers[u * 3], simulated_buffer_status);
+      mac_scheduler_add_bearer(scheduler, ue, 2, 3, MAC_PBR_INFINITY, 0, &bearers[u * 3 + 1], simulated_buffer_status);
+      mac_scheduler_add_bearer(scheduler, ue, 3, 9, 8, 100, &bearers[u * 3 + 2], simulated_buffer_status);
+    }
+  }
+  ~simulated_cell() { mac_scheduler_free(scheduler); }
+};
+
+static void
+bench_scheduler(bench &b) {
+  static const int ue_counts[] = { 4, 32, 256 };
+  static const char *policies[] = { "round_robin", "proportional_fair" };
+  for (int policy = 0; policy < 2; ++policy) {
+    for (int n_ues : ue_counts) {
+      simulated_cell cell(policy, n_ues, 100000);
+      unsigned time_in_ms = 0;
+      b.run(str(format("schedule/%s/ues=%d/bearers=%d") % policies[policy] % n_ues % (n_ues * 3)), [&]() {
+	  int n = mac_scheduler_run(cell.scheduler, ++time_in_ms, 1500, cell.grants.data(), cell.grants.size());
+	  bench_keep(n);
+	});
+    }
+  }
+}
+
+// A narrow cell shared by UEs with channel qualities 1:2:...:n_ues and
+// bursty DRB traffic. Reports what fraction of the capacity was used and
+// Jain's fairness index of the UE throughputs.
+static void
+simulate_scheduler(bench &b) {
+  if (!b.enabled("simulate"))
+    return;
+  static const char *policies[] = { "round_robin", "proportional_fair" };
+  printf("%-56s %12s %12s %12s\n", "simulation", "utilization", "fairness", "min/max");
+  for (int policy = 0; policy < 2; ++policy) {
+    const int n_ues = 8, capacity = 200, ttis = 100000;
+    simulated_cell cell(policy, n_ues, 0);
+    vector<double> received(n_ues);
+    for (int u = 0; u < n_ues; ++u)
+      mac_scheduler_set_ue_rate(cell.scheduler, u, capacity * (u + 1) / n_ues);
+    uint64_t used = 0;
+    srand(1);
+    for (unsigned time_in_ms = 1; time_in_ms <= ttis; ++time_in_ms) {
+      for (int u = 0; u < n_ues; ++u) {
+	// Bursts averaging more than the cell can carry
+	if (rand() % 20 == 0) {
+	  cell.bearers[u * 3 + 2].queued += 1000;
+	  mac_scheduler_wake(cell.scheduler, u, 3);
+	}
+      }
+      int n = mac_scheduler_run(cell.scheduler, time_in_ms, capacity, cell.grants.data(), cell.grants.size());
+      for (int g = 0; g < n; ++g) {
+	simulated_bearer &drb = cell.bearers[cell.grants[g].ue * 3 + 2];
+	unsigned payload = std::min(drb.queued, (unsigned)std::max(cell.grants[g].size - 3, 0));
+	drb.queued -= payload;
+	received[cell.grants[g].ue] += payload;
+	used += cell.grants[g].size;
+      }
+    }
+    double sum = 0, squares = 0;
+    for (double r : received) {
+      sum += r;
+      squares += r * r;
+    }
+    auto extremes = std::minmax_element(received.begin(), received.end());
+    printf("%-56s %12.3f %12.3f %12.3f\n", str(format("simulate/%s/ues=%d") % policies[policy] % n_ues).c_str(),
+	   used / ((double)capacity * ttis), sum * sum / (n_ues * squares), *extremes.first / *extremes.second);
+  }
+}
+
+int
+main(int argc, char **argv) {
+  bench b(argc, argv);
+  bench_transport_block(b);
+  bench_tti(b);
+  bench_demux(b);
+  bench_scheduler(b);
+  bench_harq(b);
+  bench_rlc(b);
+  simulate_scheduler(b);
+  return 0;
+}
@@ -0,0 +1,247 @@
+/*
+   Implement the transport block demultiplexing part of 3GPP LTE MAC
+
+   The subheader chain is parsed in place into views of the transport
+   block, checked as a whole, and only then dispatched.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#include "mac.h"
+
+// Size of each control element, -1 for reserved LCIDs, -2 for variable
+// size ones which have a length field like MAC SDUs
+static const int8_t mac_dl_control_element_sizes[32] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  0, // Long DRX Command
+  1, // Activation/Deactivation
+  6, // UE Contention Resolution Identity
+  1, // Timing Advance Command
+  0, // DRX Command
+  0, // Padding
+};
+static const int8_t mac_ul_control_element_sizes[32] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -2, // Extended Power Headroom Report
+  1, // Power Headroom Report
+  2, // C-RNTI
+  1, // Truncated BSR
+  1, // Short BSR
+  3, // Long BSR
+  0, // Padding
+};
+
+struct mac_receiver {
+  void *arg;
+  mac_pdu_received_fn received;
+};
+
+struct mac_demux {
+  bool uplink;
+  const int8_t *control_element_sizes;
+  mac_receiver channels[MAC_LCID_MAX_LOGICAL_CHANNEL + 1];
+  void *control_element_arg;
+  mac_control_element_received_fn control_element_received;
+  mac_ue_reports reports;
+};
+
+MAC_DEMUX *
+mac_demux_init(int uplink) {
+  MAC_DEMUX *demux = new MAC_DEMUX();
+  demux->uplink = uplink;
+  demux->control_element_sizes = uplink ? mac_ul_control_element_sizes : mac_dl_control_element_sizes;
+  return demux;
+}
+
+void
+mac_demux_free(MAC_DEMUX *demux) {
+  delete demux;
+}
+
+int
+mac_demux_add_channel(MAC_DEMUX *demux, int lcid, void *arg, mac_pdu_received_fn received) {
+  if (lcid < 0 || lcid > MAC_LCID_MAX_LOGICAL_CHANNEL) {
+    errno = EINVAL;
+    return -1;
+  }
+  demux->channels[lcid] = mac_receiver { arg, received };
+  return 0;
+}
+
+int
+mac_demux_remove_channel(MAC_DEMUX *demux, int lcid) {
+  return mac_demux_add_channel(demux, lcid, NULL, NULL);
+}
+
+void
+mac_demux_set_control_element_callback(MAC_DEMUX *demux, void *arg, mac_control_element_received_fn received) {
+  demux->control_element_arg = arg;
+  demux->control_element_received = received;
+}
+
+void
+mac_demux_get_reports(MAC_DEMUX *demux, struct mac_ue_reports *reports) {
+  *reports = demux->reports;
+}
+
+/******
+ ** Buffer Size levels
+ **
+ ** Table 6.1.3.1-1 of 36.321: index i means at most this many bytes.
+ ** The last index means more than 150000 bytes.
+ **/
+static const uint32_t mac_bsr_levels[64] = {
+  0, 10, 12, 14, 17, 19, 22, 26, 31, 36, 42, 49, 57, 67, 78, 91,
+  107, 125, 146, 171, 200, 234, 274, 321, 376, 440, 515, 603, 706, 826, 967, 1132,
+  1326, 1552, 1817, 2127, 2490, 2915, 3413, 3995, 4677, 5476, 6411, 7505, 8787, 10287, 12043, 14099,
+  16507, 19325, 22624, 26487, 31009, 36304, 42502, 49759, 58255, 68201, 79846, 93479, 109439, 128125, 150000, 150001,
+};
+
+int
+mac_bsr_index(uint32_t bytes) {
+  return std::lower_bound(mac_bsr_levels, mac_bsr_levels + 63, bytes) - mac_bsr_levels;
+}
+
+uint32_t
+mac_bsr_buffer_size(int index) {
+  return mac_bsr_levels[index & 63];
+}
+
+static void
+mac_record_report(MAC_DEMUX *demux, unsigned time_in_ms, int lcid, const uint8_t *data) {
+  mac_ue_reports &r = demux->reports;
+  switch (lcid) {
+  case MAC_LCID_UL_SHORT_BSR:
+    // Only the group reported has anything
+    std::fill(r.buffer_size, r.buffer_size + MAC_LOGICAL_CHANNEL_GROUPS, 0);
+    // Fall through
+  case MAC_LCID_UL_TRUNCATED_BSR:
+    r.buffer_size[data[0] >> 6] = mac_bsr_buffer_size(data[0]);
+    break;
+  case MAC_LCID_UL_LONG_BSR:
+    r.buffer_size[0] = mac_bsr_buffer_size(data[0] >> 2);
+    r.buffer_size[1] = mac_bsr_buffer_size((data[0] << 4) | (data[1] >> 4));
+    r.buffer_size[2] = mac_bsr_buffer_size((data[1] << 2) | (data[2] >> 6));
+    r.buffer_size[3] = mac_bsr_buffer_size(data[2]);
+    break;
+  case MAC_LCID_UL_PHR:
+    r.power_headroom_db = (data[0] & 0x3f) - 23;
+    r.phr_time_in_ms = time_in_ms;
+    ++r.phrs_received;
+    return;
+  default:
+    return;
+  }
+  r.bsr_time_in_ms = time_in_ms;
+  ++r.bsrs_received;
+}
+
+/******
+ ** Subheader chain parsing
+ **
+ ** R R E LCID [F L]. An element without a length field, that is the
+ ** last MAC SDU or padding after the last subheader, takes the rest of
+ ** the transport block.
+ **/
+struct mac_view {
+  uint8_t lcid;
+  const uint8_t *data;
+  int size;
+};
+
+// Returns number of views, -1 if the block is malformed
+static int
+mac_parse(const MAC_DEMUX *demux, const uint8_t *tb, int size, mac_view *views) {
+  int n = 0, offset = 0, payload_size = 0;
+  int rest = -1; // View that takes the rest of the block
+  bool more = true;
+  while (more) {
+    // Room for one padding subheader per SDU or control element, plus two in front
+    if (offset >= size || n == MAC_MAX_SUBHEADERS * 2 + 2)
+      return -1;
+    uint8_t subheader = tb[offset++];
+    more = subheader & 0x20;
+    int lcid = subheader & 0x1f;
+    int length = demux->control_element_sizes[lcid];
+    if (length == -1)
+      return -1;
+    if (lcid <= MAC_LCID_MAX_LOGICAL_CHANNEL || length == -2 || (lcid == MAC_LCID_PADDING && !more)) {
+      if (!more) {
+	rest = n;
+	length = 0;
+      } else if (lcid != MAC_LCID_PADDING) {
+	if (offset >= size)
+	  return -1;
+	length = tb[offset++];
+	if (length & 0x80) {
+	  if (offset >= size)
+	    return -1;
+	  length = ((length & 0x7f) << 8) | tb[offset++];
+	}
+      }
+    }
+    views[n++] = mac_view { (uint8_t)lcid, NULL, length };
+    payload_size += length;
+  }
+  if (offset + payload_size > size || (rest == -1 && offset + payload_size != size))
+    return -1;
+  if (rest != -1)
+    views[rest].size = size - offset - payload_size;
+  for (int i = 0; i < n; ++i) {
+    views[i].data = tb + offset;
+    offset += views[i].size;
+  }
+  return n;
+}
+
+static int
+mac_dispatch(MAC_DEMUX *demux, unsigned time_in_ms, const mac_view *views, int n) {
+  int elements = 0;
+  for (int i = 0; i < n; ++i) {
+    const mac_view &v = views[i];
+    if (v.lcid <= MAC_LCID_MAX_LOGICAL_CHANNEL) {
+      const mac_receiver &channel = demux->channels[v.lcid];
+      if (channel.received)
+	channel.received(channel.arg, time_in_ms, v.data, v.size);
+      ++elements;
+    } else if (v.lcid != MAC_LCID_PADDING) {
+      if (demux->uplink)
+	mac_record_report(demux, time_in_ms, v.lcid, v.data);
+      if (demux->control_element_received)
+	demux->control_element_received(demux->control_element_arg, time_in_ms, v.lcid, v.data, v.size);
+      ++elements;
+    }
+  }
+  return elements;
+}
+
+int
+mac_demux_transport_block(MAC_DEMUX *demux, unsigned time_in_ms, const void *transport_block, int size) {
+  mac_view views[MAC_MAX_SUBHEADERS * 2 + 2];
+  int n = mac_parse(demux, (const uint8_t *)transport_block, size, views);
+  if (n < 0) {
+    errno = EBADMSG;
+    return -1;
+  }
+  return mac_dispatch(demux, time_in_ms, views, n);
+}
+
+int
+mac_demux_transport_blocks(unsigned time_in_ms, struct mac_received_transport_block *blocks, int n_blocks) {
+  int malformed = 0;
+  for (int i = 0; i < n_blocks; ++i) {
+    // The next header is likely not in cache yet: the decoder wrote it
+    // long before the receivers touched this block
+    if (i + 1 < n_blocks)
+      __builtin_prefetch(blocks[i + 1].data);
+    mac_received_transport_block &b = blocks[i];
+    b.result = mac_demux_transport_block(b.demux, time_in_ms, b.data, b.size);
+    if (b.result < 0)
+      ++malformed;
+  }
+  return malformed;
+}
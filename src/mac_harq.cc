@@ -0,0 +1,342 @@
+/*
+   Implement HARQ of 3GPP LTE MAC
+
+   Timing is FDD: feedback MAC_HARQ_FEEDBACK_DELAY subframes after a
+   transmission, retransmission no earlier than MAC_HARQ_RTT after it.
+   Which process to use when is up to the caller, so both synchronous
+   (uplink) and asynchronous (downlink) HARQ work on top of this.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "mac.h"
+
+using std::vector;
+
+static const int mac_harq_redundancy_versions[4] = { 0, 2, 3, 1 };
+
+static inline bool
+mac_time_reached(unsigned now, unsigned then) {
+  return (int32_t)(now - then) >= 0;
+}
+
+/******
+ ** Soft buffer pool
+ **
+ ** All soft buffers are allocated up front in one block. Free buffers
+ ** are kept on a stack of indices.
+ **/
+struct mac_harq_pool {
+  int soft_bits_per_buffer;
+  vector<int16_t> soft_bits;
+  vector<int> free_buffers;
+
+  int16_t *buffer(int i) { return &soft_bits[(size_t)i * soft_bits_per_buffer]; }
+  int take() {
+    if (free_buffers.empty())
+      return -1;
+    int i = free_buffers.back();
+    free_buffers.pop_back();
+    return i;
+  }
+  void give_back(int i) { free_buffers.push_back(i); }
+};
+
+MAC_HARQ_POOL *
+mac_harq_pool_init(int n_buffers, int soft_bits_per_buffer) {
+  MAC_HARQ_POOL *pool = new MAC_HARQ_POOL();
+  pool->soft_bits_per_buffer = soft_bits_per_buffer;
+  pool->soft_bits.resize((size_t)n_buffers * soft_bits_per_buffer);
+  for (int i = n_buffers - 1; i >= 0; --i)
+    pool->free_buffers.push_back(i);
+  return pool;
+}
+
+void
+mac_harq_pool_free(MAC_HARQ_POOL *pool) {
+  delete pool;
+}
+
+/******
+ ** HARQ entity
+ **/
+struct mac_harq_process {
+  // Transmitter
+  bool tx_busy;
+  uint8_t tx_new_data_indicator;
+  int tx_transmissions;
+  unsigned tx_time_in_ms;
+  int tx_feedback;      // -1 none yet, 0 NACK, 1 ACK
+  int tx_size;
+  // Receiver
+  int rx_buffer;        // Index in pool, -1 for none
+  int rx_new_data_indicator; // -1 before anything was received
+  int rx_transmissions;
+  bool rx_done;         // Decoded, further copies are duplicates
+  int rx_feedback;      // -1 none pending
+  unsigned rx_feedback_time_in_ms;
+};
+
+struct mac_harq {
+  MAC_HARQ_POOL *pool;
+  int n_processes;
+  int max_transmissions;
+  int max_tb_size;
+  vector<uint8_t> transport_blocks; // max_tb_size for each process
+  mac_harq_process processes[MAC_HARQ_MAX_PROCESSES];
+  mac_harq_stats stats;
+};
+
+MAC_HARQ *
+mac_harq_init(MAC_HARQ_POOL *pool, int n_processes, int max_transmissions, int max_tb_size) {
+  if (n_processes < 1 || n_processes > MAC_HARQ_MAX_PROCESSES || max_transmissions < 1 || max_tb_size < 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  MAC_HARQ *harq = new MAC_HARQ();
+  harq->pool = pool;
+  harq->n_processes = n_processes;
+  harq->max_transmissions = max_transmissions;
+  harq->max_tb_size = max_tb_size;
+  harq->transport_blocks.resize((size_t)n_processes * max_tb_size);
+  for (mac_harq_process &p : harq->processes) {
+    p.rx_buffer = -1;
+    p.rx_new_data_indicator = -1;
+    p.rx_feedback = -1;
+  }
+  return harq;
+}
+
+static void
+mac_harq_release_soft_buffer(MAC_HARQ *harq, mac_harq_process &p) {
+  if (p.rx_buffer != -1) {
+    harq->pool->give_back(p.rx_buffer);
+    p.rx_buffer = -1;
+  }
+}
+
+void
+mac_harq_free(MAC_HARQ *harq) {
+  for (mac_harq_process &p : harq->processes)
+    mac_harq_release_soft_buffer(harq, p);
+  delete harq;
+}
+
+void
+mac_harq_get_stats(MAC_HARQ *harq, struct mac_harq_stats *stats) {
+  *stats = harq->stats;
+}
+
+/******
+ ** Transmitter
+ **/
+static void
+mac_harq_fill_tx(MAC_HARQ *harq, int process, struct mac_harq_tx *tx) {
+  const mac_harq_process &p = harq->processes[process];
+  tx->process = process;
+  tx->new_data_indicator = p.tx_new_data_indicator;
+  tx->redundancy_version = mac_harq_redundancy_versions[(p.tx_transmissions - 1) % 4];
+  tx->transmission = p.tx_transmissions;
+  tx->data = &harq->transport_blocks[(size_t)process * harq->max_tb_size];
+  tx->size = p.tx_size;
+}
+
+int
+mac_harq_tx_idle_process(MAC_HARQ *harq) {
+  for (int i = 0; i < harq->n_processes; ++i)
+    if (!harq->processes[i].tx_busy)
+      return i;
+  return -1;
+}
+
+int
+mac_harq_tx_new(MAC_HARQ *harq, unsigned time_in_ms, int process, const void *transport_block, int size, struct mac_harq_tx *tx) {
+  if (process < 0 || process >= harq->n_processes || size < 0 || size > harq->max_tb_size) {
+    errno = EINVAL;
+    return -1;
+  }
+  mac_harq_process &p = harq->processes[process];
+  if (p.tx_busy) {
+    errno = EBUSY;
+    return -1;
+  }
+  memcpy(&harq->transport_blocks[(size_t)process * harq->max_tb_size], transport_block, size);
+  p.tx_busy = true;
+  p.tx_new_data_indicator ^= 1;
+  p.tx_transmissions = 1;
+  p.tx_time_in_ms = time_in_ms;
+  p.tx_feedback = -1;
+  p.tx_size = size;
+  ++harq->stats.new_transmissions;
+  mac_harq_fill_tx(harq, process, tx);
+  return 0;
+}
+
+// A NACKed block is dropped once it has been sent max_transmissions times
+static void
+mac_harq_tx_nack(MAC_HARQ *harq, mac_harq_process &p) {
+  p.tx_feedback = 0;
+  if (p.tx_transmissions >= harq->max_transmissions) {
+    p.tx_busy = false;
+    ++harq->stats.failures;
+  }
+}
+
+void
+mac_harq_tx_feedback(MAC_HARQ *harq, unsigned time_in_ms, int process, int ack) {
+  if (process < 0 || process >= harq->n_processes)
+    return;
+  mac_harq_process &p = harq->processes[process];
+  if (!p.tx_busy || p.tx_feedback != -1)
+    return;
+  // Feedback of another subframe may be for an earlier transmission
+  if (time_in_ms != p.tx_time_in_ms + MAC_HARQ_FEEDBACK_DELAY) {
+    ++harq->stats.mistimed_feedback;
+    return;
+  }
+  if (ack) {
+    p.tx_busy = false;
+    p.tx_feedback = 1;
+    ++harq->stats.acks;
+  } else {
+    ++harq->stats.nacks;
+    mac_harq_tx_nack(harq, p);
+  }
+}
+
+int
+mac_harq_tx_retransmission(MAC_HARQ *harq, unsigned time_in_ms, struct mac_harq_tx *tx) {
+  int oldest = -1;
+  for (int i = 0; i < harq->n_processes; ++i) {
+    mac_harq_process &p = harq->processes[i];
+    if (!p.tx_busy || !mac_time_reached(time_in_ms, p.tx_time_in_ms + MAC_HARQ_RTT))
+      continue;
+    if (p.tx_feedback == -1) {
+      ++harq->stats.missing_feedback;
+      mac_harq_tx_nack(harq, p);
+      if (!p.tx_busy)
+	continue;
+    }
+    if (oldest == -1 || (int32_t)(p.tx_time_in_ms - harq->processes[oldest].tx_time_in_ms) < 0)
+      oldest = i;
+  }
+  if (oldest == -1)
+    return 0;
+  mac_harq_process &p = harq->processes[oldest];
+  ++p.tx_transmissions;
+  p.tx_time_in_ms = time_in_ms;
+  p.tx_feedback = -1;
+  ++harq->stats.retransmissions;
+  mac_harq_fill_tx(harq, oldest, tx);
+  return 1;
+}
+
+/******
+ ** Receiver
+ **/
+int16_t *
+mac_harq_rx_soft_buffer(MAC_HARQ *harq, unsigned time_in_ms, int process, int new_data_indicator, int n_soft_bits) {
+  if (process < 0 || process >= harq->n_processes) {
+    errno = EINVAL;
+    return NULL;
+  }
+  mac_harq_process &p = harq->processes[process];
+  bool new_data = p.rx_new_data_indicator != (new_data_indicator & 1);
+  if (new_data) {
+    p.rx_new_data_indicator = new_data_indicator & 1;
+    p.rx_transmissions = 0;
+    p.rx_done = false;
+    ++harq->stats.rx_new;
+  } else if (p.rx_done) {
+    ++harq->stats.rx_duplicates;
+    p.rx_feedback = 1;
+    p.rx_feedback_time_in_ms = time_in_ms + MAC_HARQ_FEEDBACK_DELAY;
+    errno = EALREADY;
+    return NULL;
+  } else {
+    ++harq->stats.rx_retransmissions;
+  }
+  ++p.rx_transmissions;
+
+  if (!harq->pool || n_soft_bits > harq->pool->soft_bits_per_buffer) {
+    mac_harq_release_soft_buffer(harq, p);
+  } else if (p.rx_buffer == -1 && p.rx_transmissions == 1) {
+    p.rx_buffer = harq->pool->take();
+  }
+  if (p.rx_buffer == -1) {
+    // Without the earlier soft bits there is nothing to combine with
+    ++harq->stats.rx_no_soft_buffer;
+    errno = ENOBUFS;
+    return NULL;
+  }
+  int16_t *soft_bits = harq->pool->buffer(p.rx_buffer);
+  if (new_data)
+    memset(soft_bits, 0, n_soft_bits * sizeof(*soft_bits));
+  return soft_bits;
+}
+
+void
+mac_harq_rx_result(MAC_HARQ *harq, unsigned time_in_ms, int process, int crc_ok) {
+  if (process < 0 || process >= harq->n_processes)
+    return;
+  mac_harq_process &p = harq->processes[process];
+  p.rx_feedback = crc_ok ? 1 : 0;
+  p.rx_feedback_time_in_ms = time_in_ms + MAC_HARQ_FEEDBACK_DELAY;
+  if (crc_ok) {
+    p.rx_done = true;
+    ++harq->stats.rx_ok;
+    mac_harq_release_soft_buffer(harq, p);
+  } else if (p.rx_transmissions >= harq->max_transmissions) {
+    ++harq->stats.rx_failed;
+    mac_harq_release_soft_buffer(harq, p);
+  }
+}
+
+int
+mac_harq_rx_feedback(MAC_HARQ *harq, unsigned time_in_ms, int *process) {
+  for (int i = 0; i < harq->n_processes; ++i) {
+    mac_harq_process &p = harq->processes[i];
+    if (p.rx_feedback == -1 || !mac_time_reached(time_in_ms, p.rx_feedback_time_in_ms))
+      continue;
+    // Sent late it would answer another transmission
+    if (p.rx_feedback_time_in_ms != time_in_ms) {
+      p.rx_feedback = -1;
+      ++harq->stats.rx_feedback_missed;
+      continue;
+    }
+    int ack = p.rx_feedback;
+    p.rx_feedback = -1;
+    if (process)
+      *process = i;
+    return ack;
+  }
+  return -1;
+}
+
+static inline int16_t
+mac_saturating_add(int16_t soft_bit, int8_t llr) {
+  return std::min(std::max(soft_bit + llr, INT16_MIN), INT16_MAX);
+}
+
+void
+mac_harq_soft_combine(int16_t *soft_bits, const int8_t *llrs, int n) {
+  int i = 0;
+#ifdef __SSE2__
+  // Sign extend 16 LLRs at a time and add with saturation
+  for (; i + 16 <= n; i += 16) {
+    __m128i l = _mm_loadu_si128((const __m128i *)(llrs + i));
+    __m128i sign = _mm_cmpgt_epi8(_mm_setzero_si128(), l);
+    __m128i *s = (__m128i *)(soft_bits + i);
+    _mm_storeu_si128(s, _mm_adds_epi16(_mm_loadu_si128(s), _mm_unpacklo_epi8(l, sign)));
+    _mm_storeu_si128(s + 1, _mm_adds_epi16(_mm_loadu_si128(s + 1), _mm_unpackhi_epi8(l, sign)));
+  }
+#endif
+  for (; i < n; ++i)
+    soft_bits[i] = mac_saturating_add(soft_bits[i], llrs[i]);
+}
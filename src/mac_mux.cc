@@ -0,0 +1,243 @@
+/*
+   Implement the transport block multiplexing part of 3GPP LTE MAC
+
+   A MAC PDU is all subheaders first, then control elements, then MAC
+   SDUs and finally padding. See HamLTE_MAC_description.md.
+*/
+/*
+  TODO: Variable size control elements (Extended PHR) are not supported
+ */
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+#include "mac.h"
+
+#define MAC_MAX_CONTROL_ELEMENTS 8
+#define MAC_MAX_CONTROL_ELEMENT_SIZE 8
+
+// Subheader sizes as counted by rlc_pdus_send_opportunity()
+static inline int
+mac_subheader_size(int sdu_size) {
+  return sdu_size < 128 ? 2 : 3;
+}
+
+/******
+ ** Subheader encoding
+ **
+ ** R R E LCID [F L], where E says another subheader follows, F says L
+ ** has 15 bits instead of 7. The last subheader of a MAC SDU has no L
+ ** as it's the rest of the transport block.
+ **/
+static inline uint8_t *
+mac_put_subheader(uint8_t *p, bool extension, int lcid) {
+  *p++ = (extension ? 0x20 : 0) | lcid;
+  return p;
+}
+
+static inline uint8_t *
+mac_put_sdu_subheader(uint8_t *p, bool extension, int lcid, int size) {
+  p = mac_put_subheader(p, extension, lcid);
+  if (size < 128) {
+    *p++ = size;
+  } else {
+    *p++ = 0x80 | (size >> 8);
+    *p++ = size;
+  }
+  return p;
+}
+
+struct mac_channel {
+  int lcid;
+  int priority;
+  void *arg;
+  mac_pdus_send_opportunity_fn send;
+};
+
+struct mac_control_element {
+  uint8_t lcid;
+  uint8_t size;
+  uint8_t data[MAC_MAX_CONTROL_ELEMENT_SIZE];
+};
+
+struct mac_mux {
+  // Sorted by priority, stable for equal priorities
+  mac_channel channels[MAC_LCID_MAX_LOGICAL_CHANNEL + 1];
+  int n_channels;
+  // Sent in the order they were queued
+  mac_control_element control_elements[MAC_MAX_CONTROL_ELEMENTS];
+  int n_control_elements;
+};
+
+MAC_MUX *
+mac_mux_init() {
+  return new MAC_MUX();
+}
+
+void
+mac_mux_free(MAC_MUX *mux) {
+  delete mux;
+}
+
+int
+mac_mux_remove_channel(MAC_MUX *mux, int lcid) {
+  mac_channel *end = mux->channels + mux->n_channels;
+  mac_channel *found = std::remove_if(mux->channels, end, [=](const mac_channel &c) { return c.lcid == lcid; });
+  if (found == end) {
+    errno = ENOENT;
+    return -1;
+  }
+  mux->n_channels = found - mux->channels;
+  return 0;
+}
+
+int
+mac_mux_add_channel(MAC_MUX *mux, int lcid, int priority, void *arg, mac_pdus_send_opportunity_fn send) {
+  if (lcid < 0 || lcid > MAC_LCID_MAX_LOGICAL_CHANNEL || !send) {
+    errno = EINVAL;
+    return -1;
+  }
+  mac_mux_remove_channel(mux, lcid);
+  mac_channel *end = mux->channels + mux->n_channels;
+  mac_channel *at = std::upper_bound(mux->channels, end, priority,
+				     [](int p, const mac_channel &c) { return p < c.priority; });
+  std::copy_backward(at, end, end + 1);
+  *at = mac_channel { lcid, priority, arg, send };
+  ++mux->n_channels;
+  return 0;
+}
+
+int
+mac_mux_add_control_element(MAC_MUX *mux, int lcid, const void *data, int size) {
+  if (lcid <= MAC_LCID_MAX_LOGICAL_CHANNEL || lcid >= MAC_LCID_PADDING
+      || size < 0 || size > MAC_MAX_CONTROL_ELEMENT_SIZE) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (mux->n_control_elements == MAC_MAX_CONTROL_ELEMENTS) {
+    errno = ENOBUFS;
+    return -1;
+  }
+  mac_control_element &ce = mux->control_elements[mux->n_control_elements++];
+  ce.lcid = lcid;
+  ce.size = size;
+  memcpy(ce.data, data, size);
+  return 0;
+}
+
+/******
+ ** Transport block filling
+ **
+ ** Each channel writes its PDUs straight into the transport block at the
+ ** point where they would start if every subheader so far were in front
+ ** of them. Once the real header size is known, every channel's PDUs are
+ ** moved to the right with one memmove, last channel first.
+ **
+ ** Padding of one or two bytes is done with padding subheaders at the
+ ** front, which also lets the last MAC SDU drop its length field. Any
+ ** more padding gets a padding subheader last and zeros at the end.
+ **/
+struct mac_sdu {
+  uint8_t lcid;
+  uint16_t size;
+};
+
+struct mac_written_region {
+  int offset;   // Where the channel wrote its PDUs
+  int size;     // Sum of the PDU sizes
+};
+
+int
+mac_mux_transport_block(MAC_MUX *mux, unsigned time_in_ms, void *transport_block, int size) {
+  uint8_t *tb = (uint8_t *)transport_block;
+  if (size <= 0)
+    return 0;
+
+  // Control elements that fit, in order
+  int n_ces = 0, ce_bytes = 0;
+  while (n_ces < mux->n_control_elements
+	 && n_ces + ce_bytes + 1 + mux->control_elements[n_ces].size <= size) {
+    ce_bytes += mux->control_elements[n_ces].size;
+    ++n_ces;
+  }
+  int used = n_ces + ce_bytes;
+
+  // Logical channels in priority order
+  mac_sdu sdus[MAC_MAX_SUBHEADERS];
+  int pdu_sizes[MAC_MAX_SUBHEADERS];
+  mac_written_region regions[MAC_LCID_MAX_LOGICAL_CHANNEL + 1];
+  int n_sdus = 0, n_regions = 0, sdu_subheader_bytes = 0, sdu_bytes = 0;
+  for (int c = 0; c < mux->n_channels && n_ces + n_sdus < MAC_MAX_SUBHEADERS; ++c) {
+    // Room for a subheader and at least a one byte PDU
+    if (size - used < 3)
+      break;
+    const mac_channel &channel = mux->channels[c];
+    int n = channel.send(channel.arg, time_in_ms, tb + used, size - used,
+			 pdu_sizes, MAC_MAX_SUBHEADERS - n_ces - n_sdus);
+    if (n <= 0)
+      continue;
+    mac_written_region &region = regions[n_regions++];
+    region.offset = used;
+    region.size = 0;
+    for (int i = 0; i < n; ++i) {
+      sdus[n_sdus++] = mac_sdu { (uint8_t)channel.lcid, (uint16_t)pdu_sizes[i] };
+      region.size += pdu_sizes[i];
+      sdu_subheader_bytes += mac_subheader_size(pdu_sizes[i]);
+    }
+    sdu_bytes += region.size;
+    used = n_ces + ce_bytes + sdu_subheader_bytes + sdu_bytes;
+    assert(used <= size);
+  }
+
+  // Decide where the padding goes
+  int padding = size - (n_ces + ce_bytes + sdu_subheader_bytes + sdu_bytes);
+  int last_saving = n_sdus ? mac_subheader_size(sdus[n_sdus - 1].size) - 1 : 0;
+  int front_padding = 0, end_padding = 0;
+  if (padding + last_saving <= 2) {
+    front_padding = padding + last_saving;
+  } else {
+    last_saving = 0;
+    end_padding = padding;
+  }
+  int header_size = front_padding + n_ces + sdu_subheader_bytes - last_saving + (end_padding ? 1 : 0);
+
+  // Move the PDUs into place, never to the left
+  int payload_end = header_size + ce_bytes + sdu_bytes;
+  for (int r = n_regions - 1; r >= 0; --r) {
+    payload_end -= regions[r].size;
+    assert(payload_end >= regions[r].offset);
+    memmove(tb + payload_end, tb + regions[r].offset, regions[r].size);
+  }
+
+  // Subheaders
+  uint8_t *p = tb;
+  int remaining = front_padding + n_ces + n_sdus + (end_padding ? 1 : 0);
+  for (int i = 0; i < front_padding; ++i)
+    p = mac_put_subheader(p, --remaining, MAC_LCID_PADDING);
+  for (int i = 0; i < n_ces; ++i)
+    p = mac_put_subheader(p, --remaining, mux->control_elements[i].lcid);
+  for (int i = 0; i < n_sdus; ++i) {
+    if (--remaining || end_padding)
+      p = mac_put_sdu_subheader(p, remaining, sdus[i].lcid, sdus[i].size);
+    else
+      p = mac_put_subheader(p, false, sdus[i].lcid);
+  }
+  if (end_padding)
+    p = mac_put_subheader(p, false, MAC_LCID_PADDING);
+  assert(p == tb + header_size);
+
+  // Control elements, then padding after the MAC SDUs
+  for (int i = 0; i < n_ces; ++i) {
+    memcpy(p, mux->control_elements[i].data, mux->control_elements[i].size);
+    p += mux->control_elements[i].size;
+  }
+  if (end_padding > 1)
+    memset(tb + size - (end_padding - 1), 0, end_padding - 1);
+
+  mux->n_control_elements -= n_ces;
+  std::copy(mux->control_elements + n_ces, mux->control_elements + n_ces + mux->n_control_elements,
+	    mux->control_elements);
+  return n_ces + n_sdus;
+}
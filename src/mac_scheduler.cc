@@ -0,0 +1,369 @@
+/*
+   Implement the per-TTI grant sizing of 3GPP LTE MAC
+
+   Logical channel prioritization follows 36.321 5.4.3.1, applied over
+   the whole cell: every bearer has a token bucket Bj filled at its
+   prioritisedBitRate up to bucketSizeDuration worth, and bearers with
+   tokens are served first in priority order. Whatever capacity is left
+   goes to UEs in round robin or proportional fair order.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "mac.h"
+
+using std::vector;
+using std::min;
+
+// Bytes counted for the MAC subheader of each bearer with data
+#define MAC_SCHEDULER_SUBHEADER_SIZE 3
+// Averaging window of the proportional fair throughput in TTIs
+#define MAC_PF_WINDOW 100.0
+
+struct mac_bearer {
+  bool configured;
+  bool active;        // In the active list
+  int priority;
+  int64_t pbr;        // Bytes per ms, or MAC_PBR_INFINITY
+  int64_t bucket_size;
+  int64_t bucket;     // Bj, may go negative
+  bool bucket_started; // Filled up to bucket_time_in_ms
+  unsigned bucket_time_in_ms;
+  void *arg;
+  mac_buffer_status_fn buffer_status;
+  int demand;         // Bytes wanted this TTI, with subheader
+};
+
+struct mac_scheduler_ue {
+  bool in_use;
+  void *arg;
+  int rate;
+  double average;     // Bytes per TTI
+  bool average_started; // Decayed up to average_time_in_ms
+  unsigned average_time_in_ms;
+  mac_bearer bearers[MAC_LCID_MAX_LOGICAL_CHANNEL + 1];
+  // State of the TTI being scheduled
+  uint64_t tti;
+  int demand;
+  int granted;
+  int grant;          // Index in grants, -1 for none yet
+  double key;
+};
+
+struct mac_active_bearer {
+  int ue;
+  int lcid;
+};
+
+struct mac_scheduler {
+  int policy;
+  vector<mac_scheduler_ue> ues;
+  vector<int> free_ues;
+  // Bearers that may have data. Scratch space for a TTI is kept around
+  // so a TTI allocates nothing.
+  vector<mac_active_bearer> active;
+  vector<int> tti_ues;
+  vector<int> ordered;
+  vector<mac_active_bearer> by_priority[MAC_PRIORITY_MAX + 1];
+  uint64_t tti;
+  int round_robin_next;
+};
+
+MAC_SCHEDULER *
+mac_scheduler_init(int policy) {
+  MAC_SCHEDULER *scheduler = new MAC_SCHEDULER();
+  scheduler->policy = policy;
+  return scheduler;
+}
+
+void
+mac_scheduler_free(MAC_SCHEDULER *scheduler) {
+  delete scheduler;
+}
+
+static mac_scheduler_ue *
+mac_scheduler_get_ue(MAC_SCHEDULER *scheduler, int ue) {
+  if (ue < 0 || ue >= (int)scheduler->ues.size() || !scheduler->ues[ue].in_use) {
+    errno = ENOENT;
+    return NULL;
+  }
+  return &scheduler->ues[ue];
+}
+
+int
+mac_scheduler_add_ue(MAC_SCHEDULER *scheduler, void *arg) {
+  int ue;
+  if (!scheduler->free_ues.empty()) {
+    ue = scheduler->free_ues.back();
+    scheduler->free_ues.pop_back();
+  } else {
+    ue = scheduler->ues.size();
+    scheduler->ues.emplace_back();
+  }
+  mac_scheduler_ue &u = scheduler->ues[ue];
+  // Bearers of a removed UE may still be in the active list
+  for (mac_bearer &b : u.bearers) {
+    bool active = b.active;
+    b = mac_bearer();
+    b.active = active;
+  }
+  u.in_use = true;
+  u.arg = arg;
+  u.rate = 0;
+  u.average = 0;
+  u.average_started = false;
+  u.tti = 0;
+  return ue;
+}
+
+int
+mac_scheduler_remove_ue(MAC_SCHEDULER *scheduler, int ue) {
+  mac_scheduler_ue *u = mac_scheduler_get_ue(scheduler, ue);
+  if (!u)
+    return -1;
+  u->in_use = false;
+  for (mac_bearer &b : u->bearers)
+    b.configured = false;
+  scheduler->free_ues.push_back(ue);
+  return 0;
+}
+
+int
+mac_scheduler_set_ue_rate(MAC_SCHEDULER *scheduler, int ue, int bytes_per_tti) {
+  mac_scheduler_ue *u = mac_scheduler_get_ue(scheduler, ue);
+  if (!u)
+    return -1;
+  u->rate = bytes_per_tti;
+  return 0;
+}
+
+int
+mac_scheduler_add_bearer(MAC_SCHEDULER *scheduler, int ue, int lcid, int priority,
+			 int prioritised_bit_rate, int bucket_size_duration,
+			 void *arg, mac_buffer_status_fn buffer_status) {
+  mac_scheduler_ue *u = mac_scheduler_get_ue(scheduler, ue);
+  if (!u)
+    return -1;
+  if (lcid < 0 || lcid > MAC_LCID_MAX_LOGICAL_CHANNEL || priority < 1 || priority > MAC_PRIORITY_MAX
+      || (prioritised_bit_rate < 0 && prioritised_bit_rate != MAC_PBR_INFINITY)
+      || bucket_size_duration < 0 || !buffer_status) {
+    errno = EINVAL;
+    return -1;
+  }
+  mac_bearer &b = u->bearers[lcid];
+  bool active = b.active;
+  b = mac_bearer();
+  b.active = active;
+  b.configured = true;
+  b.priority = priority;
+  // 1 kB/s is 1 byte per ms
+  b.pbr = prioritised_bit_rate;
+  b.bucket_size = (int64_t)prioritised_bit_rate * bucket_size_duration;
+  b.arg = arg;
+  b.buffer_status = buffer_status;
+  return mac_scheduler_wake(scheduler, ue, lcid);
+}
+
+int
+mac_scheduler_remove_bearer(MAC_SCHEDULER *scheduler, int ue, int lcid) {
+  mac_scheduler_ue *u = mac_scheduler_get_ue(scheduler, ue);
+  if (!u)
+    return -1;
+  if (lcid < 0 || lcid > MAC_LCID_MAX_LOGICAL_CHANNEL) {
+    errno = EINVAL;
+    return -1;
+  }
+  u->bearers[lcid].configured = false;
+  return 0;
+}
+
+int
+mac_scheduler_wake(MAC_SCHEDULER *scheduler, int ue, int lcid) {
+  mac_scheduler_ue *u = mac_scheduler_get_ue(scheduler, ue);
+  if (!u)
+    return -1;
+  if (lcid < 0 || lcid > MAC_LCID_MAX_LOGICAL_CHANNEL || !u->bearers[lcid].configured) {
+    errno = EINVAL;
+    return -1;
+  }
+  mac_bearer &b = u->bearers[lcid];
+  if (!b.active) {
+    b.active = true;
+    scheduler->active.push_back(mac_active_bearer { ue, lcid });
+  }
+  return 0;
+}
+
+/******
+ ** Token buckets
+ **
+ ** Filled lazily for the time since the bearer was last looked at, so
+ ** idle bearers cost nothing. A new bucket starts empty.
+ **/
+static void
+mac_fill_bucket(mac_bearer &b, unsigned time_in_ms) {
+  if (b.pbr == MAC_PBR_INFINITY)
+    return;
+  if (!b.bucket_started) {
+    b.bucket_started = true;
+    b.bucket_time_in_ms = time_in_ms;
+    return;
+  }
+  int64_t elapsed = (int32_t)(time_in_ms - b.bucket_time_in_ms);
+  b.bucket_time_in_ms = time_in_ms;
+  if (elapsed > 0 && b.bucket < b.bucket_size)
+    b.bucket = min(b.bucket + b.pbr * elapsed, b.bucket_size);
+}
+
+/******
+ ** Grants
+ **/
+struct mac_tti {
+  MAC_SCHEDULER *scheduler;
+  mac_grant *grants;
+  int n_grants, max_grants;
+  int remaining;
+};
+
+// How much more the UE can use this TTI
+static int
+mac_ue_room(const mac_scheduler_ue &u) {
+  int room = u.demand - u.granted;
+  if (u.rate)
+    room = min(room, u.rate - u.granted);
+  return room;
+}
+
+static bool
+mac_can_grant(const mac_tti &t, const mac_scheduler_ue &u) {
+  return u.grant != -1 || t.n_grants < t.max_grants;
+}
+
+static void
+mac_give(mac_tti &t, int ue, int bytes) {
+  mac_scheduler_ue &u = t.scheduler->ues[ue];
+  if (u.grant == -1) {
+    u.grant = t.n_grants++;
+    t.grants[u.grant] = mac_grant { ue, u.arg, 0 };
+  }
+  t.grants[u.grant].size += bytes;
+  u.granted += bytes;
+  t.remaining -= bytes;
+}
+
+// Collect the demand of active bearers, dropping the ones without data
+static void
+mac_collect_demand(MAC_SCHEDULER *s, unsigned time_in_ms) {
+  s->tti_ues.clear();
+  for (auto &list : s->by_priority)
+    list.clear();
+  size_t kept = 0;
+  for (size_t i = 0; i < s->active.size(); ++i) {
+    mac_active_bearer a = s->active[i];
+    mac_scheduler_ue &u = s->ues[a.ue];
+    mac_bearer &b = u.bearers[a.lcid];
+    struct rlc_buffer_status status = { 0, 0, 0 };
+    if (u.in_use && b.configured)
+      b.buffer_status(b.arg, &status);
+    unsigned bytes = status.status_bytes + status.retransmission_bytes + status.new_data_bytes;
+    if (!bytes) {
+      b.active = false;
+      continue;
+    }
+    s->active[kept++] = a;
+    mac_fill_bucket(b, time_in_ms);
+    b.demand = min(bytes, (unsigned)INT32_MAX / 2) + MAC_SCHEDULER_SUBHEADER_SIZE;
+    if (u.tti != s->tti) {
+      u.tti = s->tti;
+      u.demand = u.granted = 0;
+      u.grant = -1;
+      s->tti_ues.push_back(a.ue);
+    }
+    u.demand = min((int64_t)u.demand + b.demand, (int64_t)INT32_MAX / 2);
+    s->by_priority[b.priority].push_back(a);
+  }
+  s->active.resize(kept);
+}
+
+int
+mac_scheduler_run(MAC_SCHEDULER *scheduler, unsigned time_in_ms, int capacity,
+		  struct mac_grant *grants, int max_grants) {
+  MAC_SCHEDULER *s = scheduler;
+  ++s->tti;
+  mac_collect_demand(s, time_in_ms);
+  mac_tti t = { s, grants, 0, max_grants, capacity };
+
+  // Prioritised bit rates, highest priority first over all UEs. Within a
+  // priority the starting bearer rotates so nobody is always last.
+  for (auto &list : s->by_priority) {
+    for (size_t i = 0; i < list.size(); ++i) {
+      if (t.remaining <= 0)
+	break;
+      const mac_active_bearer &a = list[(i + s->tti) % list.size()];
+      mac_scheduler_ue &u = s->ues[a.ue];
+      mac_bearer &b = u.bearers[a.lcid];
+      if ((b.bucket <= 0 && b.pbr != MAC_PBR_INFINITY) || !mac_can_grant(t, u))
+	continue;
+      int64_t give = min((int64_t)min(b.demand, mac_ue_room(u)), (int64_t)t.remaining);
+      if (b.pbr != MAC_PBR_INFINITY)
+	give = min(give, b.bucket + MAC_SCHEDULER_SUBHEADER_SIZE);
+      if (give <= 0)
+	continue;
+      mac_give(t, a.ue, give);
+      b.bucket -= give;
+    }
+  }
+
+  // The rest in policy order
+  int n_ues = s->ues.size();
+  for (int ue : s->tti_ues) {
+    mac_scheduler_ue &u = s->ues[ue];
+    if (s->policy == MAC_SCHEDULER_PROPORTIONAL_FAIR) {
+      if (u.average_started)
+	u.average *= pow(1 - 1 / MAC_PF_WINDOW, (int32_t)(time_in_ms - u.average_time_in_ms));
+      u.average_started = true;
+      u.average_time_in_ms = time_in_ms;
+      double rate = u.rate ? u.rate : capacity;
+      u.key = -rate / (u.average + 1);
+    } else {
+      u.key = (ue - s->round_robin_next + n_ues) % n_ues;
+    }
+  }
+  // Only UEs with room get more: those with a grant already, and as many
+  // of the others as there are grants left, as each one served before
+  // the capacity runs out takes a grant. Only they need ordering.
+  vector<int> &ordered = s->ordered;
+  ordered.clear();
+  for (int ue : s->tti_ues)
+    if (mac_ue_room(s->ues[ue]) > 0 && s->ues[ue].grant != -1)
+      ordered.push_back(ue);
+  size_t held = ordered.size(), wanted = held + (t.max_grants - t.n_grants);
+  for (int ue : s->tti_ues)
+    if (mac_ue_room(s->ues[ue]) > 0 && s->ues[ue].grant == -1)
+      ordered.push_back(ue);
+  auto by_key = [s](int a, int b) { return s->ues[a].key < s->ues[b].key; };
+  if (ordered.size() > wanted) {
+    std::nth_element(ordered.begin() + held, ordered.begin() + wanted, ordered.end(), by_key);
+    ordered.resize(wanted);
+  }
+  std::sort(ordered.begin(), ordered.end(), by_key);
+  for (int ue : ordered) {
+    if (t.remaining <= 0)
+      break;
+    mac_scheduler_ue &u = s->ues[ue];
+    int give = min(mac_ue_room(u), t.remaining);
+    if (give <= 0 || !mac_can_grant(t, u))
+      continue;
+    mac_give(t, ue, give);
+    s->round_robin_next = (ue + 1) % n_ues;
+  }
+
+  for (int ue : s->tti_ues) {
+    mac_scheduler_ue &u = s->ues[ue];
+    u.average += u.granted / MAC_PF_WINDOW;
+  }
+  return t.n_grants;
+}
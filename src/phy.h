@@ -0,0 +1,410 @@
+// 3GPP LTE PHY: 4G physical layer interface
+//
+// FDD with one antenna port and normal cyclic prefix, as used by HamLTE.
+#ifndef PHY_H
+#define PHY_H
+
+#include "rlc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /******** Downlink control information *********/
+  // DCI formats 0, 1A and 1C of 36.212 5.3.3.1. Field widths depend on the
+  // bandwidth and are resolved at compile time for each of 6, 15, 25, 50,
+  // 75 and 100 resource blocks. A packed DCI is its payload followed by
+  // CRC16 scrambled with the RNTI, most significant bit first.
+
+#define PHY_DCI_FORMAT_0 0
+#define PHY_DCI_FORMAT_1A 1
+#define PHY_DCI_FORMAT_1C 2
+
+  // Bytes of any packed DCI
+#define PHY_DCI_MAX_SIZE 8
+
+  // RA-RNTIs are 1 .. PHY_RA_RNTI_MAX
+#define PHY_RA_RNTI_MAX 60
+#define PHY_P_RNTI 0xfffe
+#define PHY_SI_RNTI 0xffff
+
+  struct phy_dci {
+    int format;
+    int rnti;
+    int hopping;            // 0: frequency hopping flag, 1A: distributed VRB flag
+    int n_ul_hop;           // 0 with hopping: 1 bit below 50 RBs, else 2
+    int n_gap;              // 1A distributed and 1C from 50 RBs: 1 for N_gap,2
+    int riv;                // Resource indication value
+    int mcs;                // 0: MCS and RV, 1C: transport block size index
+    int harq_process;       // 1A
+    int new_data_indicator;
+    int redundancy_version; // 1A
+    int tpc;                // 1A with RA-RNTI, P-RNTI or SI-RNTI: N_1A_PRB in the LSB
+    int cyclic_shift;       // 0: DM RS cyclic shift
+    int csi_request;        // 0
+  };
+
+  // Payload bits without CRC. Formats 0 and 1A are padded to the same size.
+  // Returns -1 with errno EINVAL for unsupported bandwidths and formats.
+  DLL_PUBLIC int     phy_dci_size(int n_prb, int format);
+  // Writes PHY_DCI_MAX_SIZE bytes, zero padded. Returns the size in bits with
+  // CRC, or -1 with errno EINVAL if a field doesn't fit.
+  DLL_PUBLIC int     phy_dci_pack(int n_prb, const struct phy_dci *dci, void *out);
+  // Format is told by size_in_bits and the format 0/1A flag. The RNTI is
+  // what the CRC was scrambled with, so a corrupted DCI decodes with some
+  // other RNTI. Returns 0 or -1 with errno EINVAL for a size of no format.
+  DLL_PUBLIC int     phy_dci_unpack(int n_prb, const void *in, int size_in_bits, struct phy_dci *dci);
+  // All DCIs of a subframe, each PHY_DCI_MAX_SIZE bytes apart in out.
+  // Sizes in bits go to sizes_in_bits, -1 for DCIs that didn't pack.
+  // Returns the number packed.
+  DLL_PUBLIC int     phy_dci_pack_batch(int n_prb, const struct phy_dci *dcis, int n_dcis, void *out, int *sizes_in_bits);
+
+  /******** Scrambling *********/
+  // Gold sequence c(n) of 36.211 7.2, packed most significant bit first
+  // like the bits it scrambles. Generated 64 bits at a time, 256 with AVX2.
+
+  DLL_PUBLIC void    phy_gold_sequence(uint32_t c_init, void *out, int size_in_bits);
+  // XOR c(n) into packed bits without keeping the sequence
+  DLL_PUBLIC void    phy_gold_scramble(uint32_t c_init, void *bits, int size_in_bits);
+  // XOR a sequence into packed bits. Bits after size_in_bits are kept.
+  DLL_PUBLIC void    phy_scramble(void *bits, const void *sequence, int size_in_bits);
+  // Negate the soft bits whose sequence bit is 1
+  DLL_PUBLIC void    phy_descramble_llrs(int8_t *llrs, const void *sequence, int n);
+
+  // Sequences of a cell that only depend on the subframe, generated once.
+  // PHICH uses the start of the PCFICH sequence. The PBCH sequence spans
+  // four frames, frame sfn%4 being its quarter. CRS has the sequences of the
+  // four reference symbols of antenna port 0, already cut to the bandwidth,
+  // each 4 * n_prb bits.
+#define PHY_SCRAMBLING_PDCCH 0
+#define PHY_SCRAMBLING_PCFICH 1
+#define PHY_SCRAMBLING_PBCH 2
+#define PHY_SCRAMBLING_CRS 3
+#define PHY_SCRAMBLING_CHANNELS 4
+
+#define PHY_PBCH_SIZE_IN_BITS 1920
+
+  struct phy_scrambling;
+  typedef struct phy_scrambling PHY_SCRAMBLING;
+
+  // Returns NULL with errno EINVAL for a cell ID over 503 or n_prb not 6 .. 110
+  DLL_PUBLIC PHY_SCRAMBLING *phy_scrambling_init(int cell_id, int n_prb);
+  DLL_PUBLIC void    phy_scrambling_free(PHY_SCRAMBLING *scrambling);
+  // Valid until phy_scrambling_free(). size_in_bits may be NULL.
+  DLL_PUBLIC const uint8_t *phy_scrambling_get(PHY_SCRAMBLING *scrambling, int channel, int subframe, int *size_in_bits);
+
+  /******** CRC *********/
+  // CRCs of 36.212 5.1.1 over packed bits, most significant bit first:
+  // CRC24A for transport blocks, CRC24B for code blocks, CRC16 for DCI and
+  // BCH and CRC8. Whole bytes go through slice-by-8 tables, or 64 bytes at
+  // a time by carry-less multiplication on CPUs with PCLMULQDQ.
+
+#define PHY_CRC24A 0
+#define PHY_CRC24B 1
+#define PHY_CRC16 2
+#define PHY_CRC8 3
+
+  // Returns -1 with errno EINVAL for an unknown CRC
+  DLL_PUBLIC int     phy_crc_size(int crc);
+  DLL_PUBLIC int     phy_crc(int crc, const void *data, int size_in_bits);
+  // Writes the CRC after size_in_bits bits. Bits after it in the last byte
+  // are cleared. Returns the size in bits with CRC.
+  DLL_PUBLIC int     phy_crc_attach(int crc, void *data, int size_in_bits);
+  // size_in_bits includes the CRC. Returns 0 or -1 with errno EBADMSG.
+  DLL_PUBLIC int     phy_crc_check(int crc, const void *data, int size_in_bits);
+
+  /******** Transport block coding *********/
+  // DL-SCH and UL-SCH channel coding of 36.212 5.3.2 and 5.2.2 up to code
+  // block concatenation: CRC24A, code block segmentation with CRC24B,
+  // turbo coding and rate matching, for one layer. Everything that only
+  // depends on the sizes, from segmentation to the order in which coded
+  // bits are selected for each redundancy version, is worked out once by
+  // phy_tb_plan_init(), so plans are worth keeping for the sizes in use.
+  // A plan has buffers of its own and is used by one thread at a time.
+
+#define PHY_TURBO_MAX_K 6144
+
+  struct phy_tb_plan;
+  typedef struct phy_tb_plan PHY_TB_PLAN;
+
+  // Transport block size in bits, a multiple of 8. g coded bits, a multiple
+  // of the modulation order qm of 2, 4 or 6. n_ir is the soft buffer size
+  // N_IR of the transport block in bits, 0 for the full circular buffer of
+  // UL-SCH. Returns NULL with errno EINVAL.
+  DLL_PUBLIC PHY_TB_PLAN *phy_tb_plan_init(int tbs, int g, int qm, int n_ir);
+  DLL_PUBLIC void    phy_tb_plan_free(PHY_TB_PLAN *plan);
+  DLL_PUBLIC int     phy_tb_plan_code_blocks(PHY_TB_PLAN *plan);
+  // Writes the g coded bits of redundancy version rv of tb to out, ready
+  // for scrambling and modulation. Returns g or -1 with errno EINVAL.
+  DLL_PUBLIC int     phy_tb_encode(PHY_TB_PLAN *plan, const void *tb, int rv, void *out);
+
+  // Receiving. LLRs are log P(0) / P(1), positive for 0, and soft bits
+  // their sums over transmissions in the circular buffer order of the plan,
+  // phy_tb_plan_soft_bits() of them: a HARQ soft buffer.
+  DLL_PUBLIC int     phy_tb_plan_soft_bits(PHY_TB_PLAN *plan);
+  // Rate dematching: adds the g LLRs of redundancy version rv to soft_bits,
+  // saturating. Returns g or -1 with errno EINVAL.
+  DLL_PUBLIC int     phy_tb_combine(PHY_TB_PLAN *plan, const int8_t *llrs, int rv, int16_t *soft_bits);
+
+  // Worker threads decoding the code blocks of a transport block along with
+  // the thread calling phy_tb_decode(), one call at a time
+  struct phy_turbo_pool;
+  typedef struct phy_turbo_pool PHY_TURBO_POOL;
+
+  DLL_PUBLIC PHY_TURBO_POOL *phy_turbo_pool_init(int n_threads);
+  DLL_PUBLIC void    phy_turbo_pool_free(PHY_TURBO_POOL *pool);
+
+#define PHY_TURBO_MAX_ITERATIONS 16
+
+  // Max-log-MAP turbo decoding in 16-bit fixed point, stopping a code block
+  // early once its CRC passes. pool may be NULL. Writes tbs bits to tb and
+  // returns the most iterations any code block took, or -1 with errno
+  // EBADMSG if the CRC of the transport block or a code block didn't pass,
+  // tb then having the hard decisions.
+  DLL_PUBLIC int     phy_tb_decode(PHY_TB_PLAN *plan, const int16_t *soft_bits, int max_iterations,
+				   PHY_TURBO_POOL *pool, void *tb);
+
+  /******** Convolutional coding *********/
+  // Tail-biting convolutional code of 36.212 5.1.3.1 and its rate matching
+  // of 5.1.4.2, for BCH and DCI. Packed bits with CRC attached go in and
+  // come out, coded bits are in the order of transmission.
+
+#define PHY_CONV_MAX_SIZE 128
+
+  // Codes 6 .. PHY_CONV_MAX_SIZE bits to e bits. Returns e or -1 with errno
+  // EINVAL.
+  DLL_PUBLIC int     phy_conv_encode(const void *in, int size_in_bits, int e, void *out);
+  // Viterbi decoding of e LLRs, positive for 0, to (size_in_bits + 7) / 8
+  // bytes. Returns 0 or -1 with errno EINVAL.
+  DLL_PUBLIC int     phy_conv_decode(const int8_t *llrs, int e, int size_in_bits, void *out);
+  // n candidates of the same size, such as those of a PDCCH search space,
+  // decoded 16 at a time: e[i] LLRs of candidate i at llrs[i], decoded to
+  // out + i * ((size_in_bits + 7) / 8). Returns n or -1 with errno EINVAL.
+  DLL_PUBLIC int     phy_conv_decode_batch(const int8_t *const *llrs, const int *e, int n, int size_in_bits,
+					   void *out);
+
+  /******** Modulation *********/
+  // Modulation mapping of 36.211 7.1 for QPSK, 16QAM and 64QAM, modulation
+  // order qm of 2, 4 or 6, with unit average power. Soft demapping gives
+  // simplified max-log LLRs, positive for 0, scaled by PHY_LLR_SCALE and
+  // saturated to int8.
+
+  struct phy_complex {
+    float re, im;
+  };
+  typedef struct phy_complex phy_complex;
+
+  // int8 steps of an LLR of 1
+#define PHY_LLR_SCALE 4
+
+  // Maps packed bits to size_in_bits / qm symbols and returns their number,
+  // or -1 with errno EINVAL if size_in_bits is no multiple of qm.
+  DLL_PUBLIC int     phy_modulate(int qm, const void *bits, int size_in_bits, phy_complex *symbols);
+  // Demaps n equalized symbols to qm * n LLRs, returning their number. The
+  // noise variance of each symbol is in noise_variances, or noise_variance
+  // for all if it is NULL. Returns -1 with errno EINVAL.
+  DLL_PUBLIC int     phy_demodulate(int qm, const phy_complex *symbols, int n, const float *noise_variances,
+				    float noise_variance, int8_t *llrs);
+
+  /******** OFDM *********/
+  // OFDM symbols of 36.211 6.12 and SC-FDMA symbols of 5.6, normal cyclic
+  // prefix. The sample rate is 15 kHz times the FFT size, by default the
+  // usual one of the bandwidth from 128 for 6 RBs to 2048 for 100. Resource
+  // elements of a symbol are its 12 * n_prb subcarriers from the lowest
+  // frequency up. Both directions scale by 1 / sqrt(FFT size), so
+  // demodulation undoes modulation.
+
+#define PHY_SYMBOLS_PER_SLOT 7
+#define PHY_SYMBOLS_PER_SUBFRAME 14
+
+  // Unnormalized DFT of n = 2^a 3^b up to 4096 points, e^(-2 pi i k t / n)
+  // forward. Returns 0 or -1 with errno EINVAL for other sizes and in == out.
+  DLL_PUBLIC int     phy_fft(int n, int inverse, const phy_complex *in, phy_complex *out);
+
+  struct phy_ofdm;
+  typedef struct phy_ofdm PHY_OFDM;
+
+  // fft_size 0 for the usual one, or a multiple of 128 of only factors 2
+  // and 3 with room for the subcarriers, such as 384, 768 or 1536. uplink
+  // shifts subcarriers by half and has no DC gap. Returns NULL with errno
+  // EINVAL.
+  DLL_PUBLIC PHY_OFDM *phy_ofdm_init(int n_prb, int fft_size, int uplink);
+  DLL_PUBLIC void    phy_ofdm_free(PHY_OFDM *ofdm);
+  DLL_PUBLIC int     phy_ofdm_fft_size(PHY_OFDM *ofdm);
+  // Samples of symbols first_symbol .. first_symbol + n_symbols - 1 of a
+  // subframe, with cyclic prefixes. A subframe has 15 * FFT size.
+  DLL_PUBLIC int     phy_ofdm_samples(PHY_OFDM *ofdm, int first_symbol, int n_symbols);
+  // n_symbols symbols of resource elements from first_symbol on to samples.
+  // Returns the samples written or -1 with errno EINVAL.
+  DLL_PUBLIC int     phy_ofdm_modulate(PHY_OFDM *ofdm, const phy_complex *res, int first_symbol, int n_symbols,
+				       phy_complex *samples);
+  // Symbols starting at samples, with their cyclic prefixes, to resource
+  // elements. Returns the samples read or -1 with errno EINVAL.
+  DLL_PUBLIC int     phy_ofdm_demodulate(PHY_OFDM *ofdm, const phy_complex *samples, int first_symbol, int n_symbols,
+					 phy_complex *res);
+
+  /******** Resource element mapping *********/
+  // Where the downlink channels of 36.211 6.6 to 6.11 go in a subframe of
+  // resource elements, symbol after symbol as in phy_ofdm_modulate(), for
+  // normal PHICH duration. Tables of resource element indices for each
+  // channel are worked out once per cell configuration, and mapping
+  // scatters symbols through them, demapping gathers.
+
+#define PHY_RE_CRS 0            // Port 0, 2 * n_prb in each of symbols 0, 4, 7 and 11
+#define PHY_RE_PCFICH 1         // 16
+#define PHY_RE_PHICH 2          // 12 of each PHICH group
+#define PHY_RE_PDCCH 3          // 36 of each CCE, then REGs left over, before interleaving
+#define PHY_RE_PBCH 4           // 240 in subframe 0
+#define PHY_RE_PSS 5            // 62 in subframes 0 and 5
+#define PHY_RE_SSS 6
+#define PHY_RE_PDSCH 7          // All resource blocks
+#define PHY_RE_CHANNELS 8
+
+  // PHICH resources N_g
+#define PHY_PHICH_NG_1_6 0
+#define PHY_PHICH_NG_1_2 1
+#define PHY_PHICH_NG_1 2
+#define PHY_PHICH_NG_2 3
+
+  struct phy_re_map;
+  typedef struct phy_re_map PHY_RE_MAP;
+
+  // cfi of 1 .. 3 control symbols, one more below 11 RBs. n_ports of 1, 2
+  // or 4 cell-specific reference signals reserve their resource elements.
+  // Returns NULL with errno EINVAL.
+  DLL_PUBLIC PHY_RE_MAP *phy_re_map_init(int cell_id, int n_prb, int cfi, int phich_ng, int n_ports);
+  DLL_PUBLIC void    phy_re_map_free(PHY_RE_MAP *map);
+  DLL_PUBLIC int     phy_re_map_control_symbols(PHY_RE_MAP *map);
+  DLL_PUBLIC int     phy_re_map_cces(PHY_RE_MAP *map);
+  DLL_PUBLIC int     phy_re_map_phich_groups(PHY_RE_MAP *map);
+  // Resource elements of a channel in subframe 0 .. 9 in the order of its
+  // symbols, *n of them. Valid until phy_re_map_free(). Returns NULL with
+  // errno EINVAL.
+  DLL_PUBLIC const uint16_t *phy_re_map_indices(PHY_RE_MAP *map, int channel, int subframe, int *n);
+  // Symbols of a channel to their resource elements of a subframe and
+  // back. Returns the number of symbols or -1 with errno EINVAL.
+  DLL_PUBLIC int     phy_map_channel(PHY_RE_MAP *map, int channel, int subframe, const phy_complex *symbols,
+				     phy_complex *res);
+  DLL_PUBLIC int     phy_demap_channel(PHY_RE_MAP *map, int channel, int subframe, const phy_complex *res,
+				       phy_complex *symbols);
+  // PDSCH of resource blocks first_prb .. first_prb + n_prbs - 1 in both
+  // slots, as localized allocations have it. Return the number of symbols
+  // or -1 with errno EINVAL.
+  DLL_PUBLIC int     phy_pdsch_size(PHY_RE_MAP *map, int subframe, int first_prb, int n_prbs);
+  DLL_PUBLIC int     phy_map_pdsch(PHY_RE_MAP *map, int subframe, int first_prb, int n_prbs,
+				   const phy_complex *symbols, phy_complex *res);
+  DLL_PUBLIC int     phy_demap_pdsch(PHY_RE_MAP *map, int subframe, int first_prb, int n_prbs,
+				     const phy_complex *res, phy_complex *symbols);
+
+  /******** PDCCH blind decoding *********/
+  // Search spaces of 36.213 9.1.1 for DCI formats 0, 1A and 1C: the common
+  // one for SI-RNTI, P-RNTI, RA-RNTIs and monitored C-RNTIs, and the
+  // UE-specific ones of monitored C-RNTIs. Candidates shared by several
+  // search spaces are decoded once, those on CCEs without the power of a
+  // transmission not at all.
+
+  struct phy_pdcch_monitor;
+  typedef struct phy_pdcch_monitor PHY_PDCCH_MONITOR;
+
+  // Returns NULL with errno EINVAL for a cell ID over 503 or a bandwidth of
+  // no DCI sizes
+  DLL_PUBLIC PHY_PDCCH_MONITOR *phy_pdcch_monitor_init(int cell_id, int n_prb);
+  DLL_PUBLIC void    phy_pdcch_monitor_free(PHY_PDCCH_MONITOR *monitor);
+  // C-RNTIs to monitor instead of any before. Returns 0 or -1 with errno
+  // EINVAL.
+  DLL_PUBLIC int     phy_pdcch_monitor_rntis(PHY_PDCCH_MONITOR *monitor, const int *rntis, int n);
+  // Candidates the last phy_pdcch_decode() decoded
+  DLL_PUBLIC int     phy_pdcch_monitor_decoded(PHY_PDCCH_MONITOR *monitor);
+  // Blind decoding of n_cce CCEs of equalized PDCCH symbols in subframe 0
+  // .. 9, 36 each as phy_demap_channel() gives them, with noise variances
+  // as for phy_demodulate(). Up to max_dcis DCIs found go to dcis, and their
+  // first CCEs to first_cces unless it is NULL. Returns their number or -1
+  // with errno EINVAL.
+  DLL_PUBLIC int     phy_pdcch_decode(PHY_PDCCH_MONITOR *monitor, int subframe, const phy_complex *symbols, int n_cce,
+				      const float *noise_variances, float noise_variance, struct phy_dci *dcis,
+				      int *first_cces, int max_dcis);
+
+  /******** Synchronization *********/
+  // Cell search and tracking with PSS and SSS of 36.211 6.11 on a stream of
+  // downlink samples at 15 kHz times an FFT size, 128 being enough for any
+  // bandwidth. Searching correlates a half frame of lags with all three
+  // PSS, which costs more at larger FFT sizes; tracking only looks where
+  // PSS should be. Frequency offsets within half a subcarrier are found.
+
+  struct phy_sync;
+  typedef struct phy_sync PHY_SYNC;
+
+  struct phy_sync_state {
+    int cell_id;               // -1 while searching
+    int64_t frame_start;       // Stream sample starting a radio frame
+    double cfo;                // Frequency offset in subcarriers taken off the output
+    double timing;             // Delay of the frames after frame_start in samples, -0.5 .. 0.5
+    float quality;             // Normalized correlation of the last PSS, 0 .. 1
+  };
+
+  // PSS of N_ID(2) 0 .. 2 and SSS of a cell in subframe 0 or 5, 62 symbols
+  // each in the order of PHY_RE_PSS and PHY_RE_SSS. Return 62 or -1 with
+  // errno EINVAL.
+  DLL_PUBLIC int     phy_pss(int n_id2, phy_complex *symbols);
+  DLL_PUBLIC int     phy_sss(int cell_id, int subframe, phy_complex *symbols);
+
+  // Returns NULL with errno EINVAL for FFT sizes other than the multiples of
+  // 128 up to 2048 that phy_fft() does
+  DLL_PUBLIC PHY_SYNC *phy_sync_init(int fft_size);
+  DLL_PUBLIC void    phy_sync_free(PHY_SYNC *sync);
+  // The next n samples of the stream, out of which the frequency offset is
+  // taken to out. Returns 0 or -1 with errno EINVAL.
+  DLL_PUBLIC int     phy_sync_process(PHY_SYNC *sync, const phy_complex *samples, int n, phy_complex *out);
+  DLL_PUBLIC void    phy_sync_get(PHY_SYNC *sync, struct phy_sync_state *state);
+  // Takes the timing off n_symbols symbols of resource elements that
+  // phy_ofdm_demodulate() of n_prb RBs gave at the same FFT size, starting
+  // on a symbol boundary from frame_start
+  DLL_PUBLIC void    phy_sync_correct(PHY_SYNC *sync, int n_prb, phy_complex *res, int n_symbols);
+
+  /******** Channel estimation *********/
+  // Single antenna downlink channel from the CRS of port 0, 36.211 6.10.1.
+  // Least squares estimates on reference symbols are smoothed by a moving
+  // average over frequency_taps of them, 6 subcarriers apart, and
+  // interpolated to every subcarrier. Symbols in between either hold the
+  // last reference symbol or are linear between reference symbols,
+  // extrapolated from the last two until the next arrives. A subframe can
+  // be estimated and equalized symbol by symbol as it is received.
+
+#define PHY_ESTIMATOR_HOLD 0
+#define PHY_ESTIMATOR_LINEAR 1
+
+  // ZF keeps QAM amplitudes. MMSE shrinks symbols towards 0 where the
+  // channel fades, which only suits QPSK.
+#define PHY_EQUALIZE_ZF 0
+#define PHY_EQUALIZE_MMSE 1
+
+  struct phy_estimator;
+  typedef struct phy_estimator PHY_ESTIMATOR;
+
+  // Returns NULL with errno EINVAL for a cell ID over 503, n_prb not 6 ..
+  // 110, even frequency_taps or more than 2 * n_prb
+  DLL_PUBLIC PHY_ESTIMATOR *phy_estimator_init(int cell_id, int n_prb, int frequency_taps, int time_filter);
+  DLL_PUBLIC void    phy_estimator_free(PHY_ESTIMATOR *estimator);
+  // Channel of symbols 0 .. n_symbols - 1 of subframe 0 .. 9 from its
+  // resource elements as phy_ofdm_demodulate() gives them, carrying on
+  // from the last call if it had fewer symbols of the same subframe.
+  // Returns 0 or -1 with errno EINVAL.
+  DLL_PUBLIC int     phy_estimate_channel(PHY_ESTIMATOR *estimator, int subframe, const phy_complex *res,
+					  int n_symbols);
+  // 12 * n_prb subcarriers of symbol l, or NULL with errno EINVAL if it
+  // has not been estimated
+  DLL_PUBLIC const phy_complex *phy_estimator_channel(PHY_ESTIMATOR *estimator, int l);
+  // Of each resource element, over the reference symbols so far
+  DLL_PUBLIC float   phy_estimator_noise_variance(PHY_ESTIMATOR *estimator);
+  // Equalizes symbols first_symbol .. first_symbol + n_symbols - 1 of a
+  // subframe of resource elements to the same places of out, which may be
+  // res, and what is left of the noise on each to noise_variances unless
+  // it is NULL, ready for phy_demodulate(). Returns 0 or -1 with errno
+  // EINVAL for symbols not estimated.
+  DLL_PUBLIC int     phy_equalize(PHY_ESTIMATOR *estimator, int mode, const phy_complex *res, int first_symbol,
+				  int n_symbols, phy_complex *out, float *noise_variances);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
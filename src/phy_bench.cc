@@ -0,0 +1,1722 @@
+/*
+   Microbenchmarks for the PHY layer
+
+   Usage: phy_bench [-t seconds] [-o results.json] [name filter]
+*/
+#include "phy.h"
+#include "phy_turbo.hh"
+#include "bench.hh"
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <thread>
+#include <boost/format.hpp>
+
+using boost::str;
+using boost::format;
+using std::vector;
+
+static const int bandwidths[] = { 6, 15, 25, 50, 75, 100 };
+
+/******
+ ** Downlink control information
+ **/
+
+// Remainder of the whole packed DCI by the CRC16 polynomial, bit by bit.
+// Zero when the CRC descrambled with rnti is right.
+static unsigned
+dci_remainder(const uint8_t *packed, int size_in_bits, int rnti) {
+  unsigned crc = 0;
+  for (int i = 0; i < size_in_bits; ++i) {
+    unsigned bit = (packed[i / 8] >> (7 - i % 8)) & 1;
+    if (i >= size_in_bits - 16)
+      bit ^= (rnti >> (size_in_bits - 1 - i)) & 1;
+    crc = ((crc << 1) | bit) ^ (crc & 0x8000 ? 0x1021 : 0);
+  }
+  return crc & 0xffff;
+}
+
+static phy_dci
+random_dci(std::mt19937 &rng, int n_prb, int format, int rnti) {
+  phy_dci d = phy_dci();
+  d.format = format;
+  d.rnti = rnti;
+  auto bits = [&](int width) { return (int)(rng() & ((1u << width) - 1)); };
+  int riv_bits = 0;
+  while ((1 << riv_bits) < n_prb * (n_prb + 1) / 2)
+    ++riv_bits;
+  bool broadcast = rnti <= PHY_RA_RNTI_MAX || rnti >= PHY_P_RNTI;
+  switch (format) {
+  case PHY_DCI_FORMAT_0:
+    d.hopping = bits(1);
+    d.n_ul_hop = d.hopping ? bits(n_prb < 50 ? 1 : 2) : 0;
+    d.riv = bits(riv_bits - (d.hopping ? (n_prb < 50 ? 1 : 2) : 0));
+    d.mcs = bits(5);
+    d.new_data_indicator = bits(1);
+    d.tpc = bits(2);
+    d.cyclic_shift = bits(3);
+    d.csi_request = bits(1);
+    break;
+  case PHY_DCI_FORMAT_1A:
+    d.hopping = bits(1);
+    d.n_gap = d.hopping && n_prb >= 50 ? bits(1) : 0;
+    d.riv = bits(riv_bits - (d.hopping && n_prb >= 50 && !broadcast));
+    d.mcs = bits(5);
+    d.harq_process = bits(3);
+    d.new_data_indicator = broadcast ? 0 : bits(1);
+    d.redundancy_version = bits(2);
+    d.tpc = bits(2);
+    break;
+  case PHY_DCI_FORMAT_1C:
+    d.n_gap = n_prb >= 50 ? bits(1) : 0;
+    d.riv = bits(phy_dci_size(n_prb, format) - (n_prb >= 50) - 5);
+    d.mcs = bits(5);
+    break;
+  }
+  return d;
+}
+
+static void
+check_dci() {
+  // 36.212 sizes of formats 1A and 1C
+  static const int size_1a[] = { 21, 22, 25, 27, 27, 28 }, size_1c[] = { 8, 10, 12, 13, 14, 15 };
+  for (int i = 0; i < 6; ++i)
+    if (phy_dci_size(bandwidths[i], PHY_DCI_FORMAT_0) != size_1a[i]
+	|| phy_dci_size(bandwidths[i], PHY_DCI_FORMAT_1A) != size_1a[i]
+	|| phy_dci_size(bandwidths[i], PHY_DCI_FORMAT_1C) != size_1c[i]) {
+      fprintf(stderr, "DCI sizes wrong for %d RBs\n", bandwidths[i]);
+      exit(1);
+    }
+
+  std::mt19937 rng(1);
+  static const int rntis[] = { 1, PHY_RA_RNTI_MAX, 61, 0x1234, 0xfff3, PHY_P_RNTI, PHY_SI_RNTI };
+  uint8_t packed[PHY_DCI_MAX_SIZE];
+  for (int n_prb : bandwidths)
+    for (int format = PHY_DCI_FORMAT_0; format <= PHY_DCI_FORMAT_1C; ++format)
+      for (int rnti : rntis)
+	for (int k = 0; k < 100; ++k) {
+	  phy_dci d = random_dci(rng, n_prb, format, rnti), u;
+	  int size = phy_dci_pack(n_prb, &d, packed);
+	  if (size != phy_dci_size(n_prb, format) + 16 || dci_remainder(packed, size, rnti)
+	      || phy_dci_unpack(n_prb, packed, size, &u) || memcmp(&d, &u, sizeof(d))) {
+	    fprintf(stderr, "DCI format %d with %d RBs and RNTI %d didn't survive packing\n", format, n_prb, rnti);
+	    exit(1);
+	  }
+	  // Any single bit error shows up as another RNTI
+	  int bit = rng() % size;
+	  packed[bit / 8] ^= 0x80 >> (bit % 8);
+	  if (phy_dci_unpack(n_prb, packed, size, &u) || u.rnti == rnti) {
+	    fprintf(stderr, "DCI bit error not detected\n");
+	    exit(1);
+	  }
+	}
+
+  phy_dci d = random_dci(rng, 25, PHY_DCI_FORMAT_1A, 0x1234);
+  d.harq_process = 8;
+  if (phy_dci_pack(25, &d, packed) != -1 || errno != EINVAL) {
+    fprintf(stderr, "DCI with HARQ process 8 packed\n");
+    exit(1);
+  }
+}
+
+static void
+bench_dci(bench &b) {
+  check_dci();
+  std::mt19937 rng(2);
+  uint8_t packed[PHY_DCI_MAX_SIZE];
+  static const char *names[] = { "0", "1A", "1C" };
+  for (int n_prb : { 6, 25, 100 })
+    for (int f = PHY_DCI_FORMAT_0; f <= PHY_DCI_FORMAT_1C; ++f) {
+      phy_dci d = random_dci(rng, n_prb, f, f == PHY_DCI_FORMAT_1C ? PHY_SI_RNTI : 0x1234), u;
+      int size = phy_dci_pack(n_prb, &d, packed);
+      b.run(str(format("dci/pack/format=%s/n_prb=%d") % names[f] % n_prb), [&]() {
+	  bench_keep(phy_dci_pack(n_prb, &d, packed));
+	});
+      b.run(str(format("dci/unpack/format=%s/n_prb=%d") % names[f] % n_prb), [&]() {
+	  bench_keep(phy_dci_unpack(n_prb, packed, size, &u));
+	});
+    }
+
+  // A busy subframe: SI, uplink grants and downlink assignments
+  for (int n_prb : { 25, 100 }) {
+    vector<phy_dci> dcis;
+    dcis.push_back(random_dci(rng, n_prb, PHY_DCI_FORMAT_1C, PHY_SI_RNTI));
+    for (int ue = 0; ue < 8; ++ue) {
+      dcis.push_back(random_dci(rng, n_prb, PHY_DCI_FORMAT_0, 100 + ue));
+      dcis.push_back(random_dci(rng, n_prb, PHY_DCI_FORMAT_1A, 100 + ue));
+    }
+    vector<uint8_t> out(dcis.size() * PHY_DCI_MAX_SIZE);
+    vector<int> sizes(dcis.size());
+    b.run(str(format("dci/pack_batch/n_prb=%d/dcis=%d") % n_prb % dcis.size()), [&]() {
+	bench_keep(phy_dci_pack_batch(n_prb, dcis.data(), dcis.size(), out.data(), sizes.data()));
+      });
+  }
+}
+
+/******
+ ** Scrambling
+ **/
+
+// c(n) straight from 36.211 7.2
+static vector<uint8_t>
+gold_reference(uint32_t c_init, int size_in_bits) {
+  vector<uint8_t> x1(1600 + size_in_bits + 31), x2(x1.size()), c((size_in_bits + 7) / 8);
+  x1[0] = 1;
+  for (int n = 0; n < 31; ++n)
+    x2[n] = (c_init >> n) & 1;
+  for (size_t n = 0; n + 31 < x1.size(); ++n) {
+    x1[n + 31] = x1[n + 3] ^ x1[n];
+    x2[n + 31] = x2[n + 3] ^ x2[n + 2] ^ x2[n + 1] ^ x2[n];
+  }
+  for (int n = 0; n < size_in_bits; ++n)
+    c[n / 8] |= (x1[n + 1600] ^ x2[n + 1600]) << (7 - n % 8);
+  return c;
+}
+
+static void
+check_scrambling() {
+  std::mt19937 rng(3);
+  // Short ones are stepped a word at a time, long ones also with AVX2
+  for (int size : { 1, 12, 32, 63, 64, 65, 440, 1023, 1024, 1920, 6400, 8191, 57600 }) {
+    uint32_t c_init = rng() & 0x7fffffff;
+    vector<uint8_t> ref = gold_reference(c_init, size), c(ref.size());
+    phy_gold_sequence(c_init, c.data(), size);
+    if (size % 8)
+      c.back() &= 0xff00 >> size % 8;
+    if (c != ref) {
+      fprintf(stderr, "Gold sequence of %d bits for c_init %u wrong\n", size, c_init);
+      exit(1);
+    }
+
+    vector<uint8_t> bits(ref.size()), scrambled;
+    for (auto &byte : bits)
+      byte = rng();
+    scrambled = bits;
+    phy_gold_scramble(c_init, scrambled.data(), size);
+    for (int i = 0; i < size; ++i)
+      scrambled[i / 8] ^= ref[i / 8] & (0x80 >> i % 8);
+    if (scrambled != bits) {
+      fprintf(stderr, "Scrambling of %d bits wrong\n", size);
+      exit(1);
+    }
+
+    vector<int8_t> llrs(size), descrambled;
+    for (auto &llr : llrs)
+      llr = rng() % 255 - 127;
+    descrambled = llrs;
+    phy_descramble_llrs(descrambled.data(), ref.data(), size);
+    for (int i = 0; i < size; ++i)
+      if (descrambled[i] != (ref[i / 8] & (0x80 >> i % 8) ? -llrs[i] : llrs[i])) {
+	fprintf(stderr, "Descrambling of %d LLRs wrong\n", size);
+	exit(1);
+      }
+  }
+
+  for (int n_prb : { 6, 15, 25, 50, 75, 100, 110 }) {
+    int cell_id = rng() % 504, size;
+    PHY_SCRAMBLING *s = phy_scrambling_init(cell_id, n_prb);
+    for (int subframe = 0; subframe < 10; ++subframe) {
+      const uint8_t *pdcch = phy_scrambling_get(s, PHY_SCRAMBLING_PDCCH, subframe, &size);
+      const uint8_t *pcfich = phy_scrambling_get(s, PHY_SCRAMBLING_PCFICH, subframe, NULL);
+      const uint8_t *pbch = phy_scrambling_get(s, PHY_SCRAMBLING_PBCH, subframe, NULL);
+      const uint8_t *crs = phy_scrambling_get(s, PHY_SCRAMBLING_CRS, subframe, NULL);
+      bool ok = size >= 64 * n_prb
+	&& !memcmp(pdcch, gold_reference((subframe << 9) + cell_id, size).data(), size / 8)
+	&& !memcmp(pcfich, gold_reference(((subframe + 1) * (2 * cell_id + 1) << 9) + cell_id, 32).data(), 4)
+	&& !memcmp(pbch, gold_reference(cell_id, 1920).data(), 240);
+      for (int k = 0; k < 4; ++k) {
+	int slot = 2 * subframe + k / 2, l = k % 2 * 4;
+	vector<uint8_t> ref = gold_reference(1024 * (7 * (slot + 1) + l + 1) * (2 * cell_id + 1) + 2 * cell_id + 1, 440);
+	for (int m = 0; m < 4 * n_prb; ++m) {
+	  int i = 2 * (110 - n_prb) + m, j = k * ((4 * n_prb + 7) / 8) * 8 + m;
+	  ok &= !(ref[i / 8] >> (7 - i % 8) & 1) == !(crs[j / 8] >> (7 - j % 8) & 1);
+	}
+      }
+      if (!ok) {
+	fprintf(stderr, "Scrambling sequences of cell %d with %d RBs wrong in subframe %d\n", cell_id, n_prb, subframe);
+	exit(1);
+      }
+    }
+    phy_scrambling_free(s);
+  }
+  if (phy_scrambling_init(504, 25) || errno != EINVAL) {
+    fprintf(stderr, "Cell ID 504 accepted\n");
+    exit(1);
+  }
+}
+
+static void
+bench_scrambling(bench &b) {
+  check_scrambling();
+  // PCFICH, PBCH, PDCCH and PDSCH of 100 RBs
+  for (int size : { 32, 1920, 6400, 57600 }) {
+    vector<uint8_t> sequence((size + 7) / 8), bits(sequence.size());
+    vector<int8_t> llrs(size);
+    b.run(str(format("scrambling/sequence/bits=%d") % size), [&]() {
+	phy_gold_sequence(0x1234567, sequence.data(), size);
+	bench_keep(sequence[0]);
+      });
+    b.run(str(format("scrambling/gold_scramble/bits=%d") % size), [&]() {
+	phy_gold_scramble(0x1234567, bits.data(), size);
+	bench_keep(bits[0]);
+      });
+    b.run(str(format("scrambling/scramble/bits=%d") % size), [&]() {
+	phy_scramble(bits.data(), sequence.data(), size);
+	bench_keep(bits[0]);
+      });
+    b.run(str(format("scrambling/descramble_llrs/bits=%d") % size), [&]() {
+	phy_descramble_llrs(llrs.data(), sequence.data(), size);
+	bench_keep(llrs[0]);
+      });
+  }
+
+  PHY_SCRAMBLING *s = NULL;
+  b.run("scrambling/cache/init/n_prb=100", [&]() {
+      phy_scrambling_free(s);
+      s = phy_scrambling_init(1, 100);
+    });
+  // Per subframe lookups instead of generating the PDCCH and CRS sequences
+  unsigned subframe = 0;
+  b.run("scrambling/cache/get/n_prb=100", [&]() {
+      bench_keep(phy_scrambling_get(s, PHY_SCRAMBLING_PDCCH, subframe, NULL));
+      bench_keep(phy_scrambling_get(s, PHY_SCRAMBLING_CRS, subframe, NULL));
+      subframe = (subframe + 1) % 10;
+    });
+  phy_scrambling_free(s);
+}
+
+/******
+ ** CRC
+ **/
+
+static const struct { int crc; const char *name; unsigned generator; int size; } crcs[] = {
+  { PHY_CRC24A, "crc24a", 0x1864cfb, 24 },
+  { PHY_CRC24B, "crc24b", 0x1800063, 24 },
+  { PHY_CRC16, "crc16", 0x11021, 16 },
+  { PHY_CRC8, "crc8", 0x19b, 8 },
+};
+
+// Bit by bit division by the generator polynomial of 36.212 5.1.1
+static unsigned
+crc_reference(unsigned generator, int size, const uint8_t *data, int size_in_bits) {
+  unsigned r = 0;
+  for (int i = 0; i < size_in_bits + size; ++i) {
+    r = r << 1 | (i < size_in_bits ? (data[i / 8] >> (7 - i % 8)) & 1 : 0);
+    if (r >> size & 1)
+      r ^= generator;
+  }
+  return r;
+}
+
+static void
+check_crc() {
+  std::mt19937 rng(4);
+  vector<uint8_t> data(6200);
+  for (auto &byte : data)
+    byte = rng();
+  for (auto &c : crcs)
+    // Short ones only go through the tables
+    for (int size : { 0, 1, 7, 8, 21, 24, 63, 504, 511, 512, 1000, 2048, 6120, 6144 * 8 - 24, 6200 * 8 - 24 }) {
+      if (phy_crc_size(c.crc) != c.size
+	  || phy_crc(c.crc, data.data(), size) != (int)crc_reference(c.generator, c.size, data.data(), size)) {
+	fprintf(stderr, "%s of %d bits wrong\n", c.name, size);
+	exit(1);
+      }
+      vector<uint8_t> block(data.begin(), data.begin() + (size + c.size + 7) / 8);
+      if (phy_crc_attach(c.crc, block.data(), size) != size + c.size || phy_crc_check(c.crc, block.data(), size + c.size)
+	  || (size % 8 && memcmp(block.data(), data.data(), size / 8))) {
+	fprintf(stderr, "%s attached to %d bits doesn't check\n", c.name, size);
+	exit(1);
+      }
+      int bit = rng() % (size + c.size);
+      block[bit / 8] ^= 0x80 >> bit % 8;
+      if (phy_crc_check(c.crc, block.data(), size + c.size) != -1 || errno != EBADMSG) {
+	fprintf(stderr, "%s missed a bit error in %d bits\n", c.name, size);
+	exit(1);
+      }
+    }
+  if (phy_crc(4, data.data(), 8) != -1 || errno != EINVAL) {
+    fprintf(stderr, "Unknown CRC accepted\n");
+    exit(1);
+  }
+}
+
+static void
+bench_crc(bench &b) {
+  check_crc();
+  // DCI, BCH, a 100 byte transport block, the largest code block and the
+  // largest transport block of one layer
+  vector<uint8_t> data(75376 / 8 + 3);
+  for (auto &c : crcs)
+    for (int size : { 21, 24, 800, 6144 - 24, 75376 }) {
+      if (c.crc == PHY_CRC8 && size > 800)
+	continue;
+      b.run(str(format("crc/%s/bits=%d") % c.name % size), [&]() {
+	  bench_keep(phy_crc(c.crc, data.data(), size));
+	});
+    }
+  b.run("crc/crc24a/attach_check/bits=75376", [&]() {
+      phy_crc_attach(PHY_CRC24A, data.data(), 75376);
+      bench_keep(phy_crc_check(PHY_CRC24A, data.data(), 75376 + 24));
+    });
+}
+
+/******
+ ** Transport block coding
+ **/
+
+// Table 5.1.3-3 block sizes
+static vector<int>
+turbo_block_sizes() {
+  vector<int> sizes;
+  for (int k = 40; k <= 6144; k += k < 512 ? 8 : k < 1024 ? 16 : k < 2048 ? 32 : 64)
+    sizes.push_back(k);
+  return sizes;
+}
+
+// Bitwise CRC of bits, <NULL> (2) as 0
+static vector<uint8_t>
+bits_crc(const vector<uint8_t> &bits, unsigned generator, int size) {
+  unsigned r = 0;
+  for (size_t i = 0; i < bits.size() + size; ++i) {
+    r = r << 1 | (i < bits.size() ? bits[i] & 1 : 0);
+    if (r >> size & 1)
+      r ^= generator;
+  }
+  vector<uint8_t> crc(size);
+  for (int i = 0; i < size; ++i)
+    crc[i] = (r >> (size - 1 - i)) & 1;
+  return crc;
+}
+
+// 36.212 5.1.1 to 5.1.5 bit by bit as written, with <NULL> as 2
+static vector<uint8_t>
+tb_encode_reference(const uint8_t *tb, int tbs, int g, int qm, int n_ir, int rv) {
+  const uint8_t NUL = 2;
+  vector<uint8_t> b(tbs);
+  for (int i = 0; i < tbs; ++i)
+    b[i] = (tb[i / 8] >> (7 - i % 8)) & 1;
+  auto crc = bits_crc(b, 0x1864cfb, 24);
+  b.insert(b.end(), crc.begin(), crc.end());
+
+  // 5.1.2
+  int B = b.size(), L, C, B_;
+  if (B <= 6144)
+    L = 0, C = 1, B_ = B;
+  else
+    L = 24, C = (B + 6120 - 1) / 6120, B_ = B + C * L;
+  vector<int> ks = turbo_block_sizes();
+  int K_plus = *std::find_if(ks.begin(), ks.end(), [&](int k) { return C * k >= B_; });
+  int K_minus = 0, C_minus = 0;
+  if (C > 1) {
+    K_minus = *(std::find(ks.begin(), ks.end(), K_plus) - 1);
+    C_minus = (C * K_plus - B_) / (K_plus - K_minus);
+  }
+  int C_plus = C - C_minus, F = C_plus * K_plus + C_minus * K_minus - B_;
+  vector<vector<uint8_t>> cbs(C);
+  for (int k = 0; k < F; ++k)
+    cbs[0].push_back(NUL);
+  int s = 0;
+  for (int r = 0; r < C; ++r) {
+    int K = r < C_minus ? K_minus : K_plus;
+    while ((int)cbs[r].size() < K - L)
+      cbs[r].push_back(b[s++]);
+    if (C > 1) {
+      auto p = bits_crc(cbs[r], 0x1800063, 24);
+      cbs[r].insert(cbs[r].end(), p.begin(), p.end());
+    }
+  }
+
+  int G_ = g / qm, gamma = G_ % C;
+  vector<uint8_t> e;
+  for (int r = 0; r < C; ++r) {
+    // 5.1.3.2
+    auto &c = cbs[r];
+    int K = c.size(), D = K + 4;
+    const uint16_t *pi = phy_turbo_interleaver(K);
+    vector<uint8_t> d[3];
+    auto rsc = [&](const vector<uint8_t> &u, vector<uint8_t> &z, uint8_t x_tail[3], uint8_t z_tail[3]) {
+      int s1 = 0, s2 = 0, s3 = 0;
+      for (int i = 0; i < K + 3; ++i) {
+	int in = i < K ? u[i] & 1 : s2 ^ s3;
+	int a = in ^ s2 ^ s3, out = a ^ s1 ^ s3;
+	if (i < K)
+	  z.push_back(u[i] == NUL ? NUL : out);
+	else
+	  x_tail[i - K] = in, z_tail[i - K] = out;
+	s3 = s2, s2 = s1, s1 = a;
+      }
+    };
+    vector<uint8_t> c2(K), z, z2;
+    for (int i = 0; i < K; ++i)
+      c2[i] = c[pi[i]] & 1;
+    uint8_t x[3], zt[3], x2[3], z2t[3];
+    rsc(c, z, x, zt);
+    rsc(c2, z2, x2, z2t);
+    d[0] = c, d[1] = z, d[2] = z2;
+    for (int i = 0; i < K; ++i)
+      if (d[2][i] == NUL)
+	d[2][i] = 0;
+    d[0].insert(d[0].end(), { x[0], zt[1], x2[0], z2t[1] });
+    d[1].insert(d[1].end(), { zt[0], x[2], z2t[0], x2[2] });
+    d[2].insert(d[2].end(), { x[1], zt[2], x2[1], z2t[2] });
+
+    // 5.1.4.1
+    static const int P[32] = { 0, 16, 8, 24, 4, 20, 12, 28, 2, 18, 10, 26, 6, 22, 14, 30,
+			       1, 17, 9, 25, 5, 21, 13, 29, 3, 19, 11, 27, 7, 23, 15, 31 };
+    int R = (D + 31) / 32, K_pi = 32 * R, N_D = K_pi - D;
+    vector<uint8_t> v[3];
+    for (int i = 0; i < 3; ++i) {
+      vector<uint8_t> y(N_D, NUL);
+      y.insert(y.end(), d[i].begin(), d[i].end());
+      for (int k = 0; k < K_pi; ++k)
+	v[i].push_back(i < 2 ? y[P[k / R] + 32 * (k % R)] : y[(P[k / R] + 32 * (k % R) + 1) % K_pi]);
+    }
+    vector<uint8_t> w(v[0]);
+    for (int k = 0; k < K_pi; ++k)
+      w.push_back(v[1][k]), w.push_back(v[2][k]);
+    int K_w = 3 * K_pi, N_cb = n_ir ? std::min(n_ir / C, K_w) : K_w;
+    int E = r <= C - gamma - 1 ? qm * (G_ / C) : qm * ((G_ + C - 1) / C);
+    int k0 = R * (2 * ((N_cb + 8 * R - 1) / (8 * R)) * rv + 2);
+    for (int k = 0, j = 0; k < E; ++j)
+      if (w[(k0 + j) % N_cb] != NUL) {
+	e.push_back(w[(k0 + j) % N_cb]);
+	++k;
+      }
+  }
+  return e;
+}
+
+static void
+check_turbo() {
+  for (int k : turbo_block_sizes()) {
+    const uint16_t *pi = phy_turbo_interleaver(k);
+    vector<bool> seen(k);
+    for (int i = 0; pi && i < k; ++i)
+      seen[pi[i]] = true;
+    if (!pi || std::count(seen.begin(), seen.end(), true) != k) {
+      fprintf(stderr, "QPP interleaver of %d bits isn't a permutation\n", k);
+      exit(1);
+    }
+  }
+  // f1 and f2 of a few block sizes
+  static const int qpp[][3] = { { 40, 3, 10 }, { 1056, 17, 66 }, { 3200, 111, 240 }, { 6144, 263, 480 } };
+  for (auto &q : qpp)
+    if (phy_turbo_interleaver(q[0])[5] != (q[1] * 5 + q[2] * 25) % q[0]) {
+      fprintf(stderr, "QPP interleaver of %d bits wrong\n", q[0]);
+      exit(1);
+    }
+
+  std::mt19937 rng(5);
+  // Single code blocks with and without filler bits, K- and K+ blocks,
+  // uplink and limited soft buffers, and a 100 RB 64QAM subframe
+  static const int cases[][4] = {
+    { 16, 288, 2, 0 }, { 152, 600, 2, 0 }, { 1000, 2000, 4, 0 }, { 6120, 12000, 6, 0 }, { 6128, 10000, 2, 0 },
+    { 15264, 30000, 6, 25344 }, { 30576, 40000, 4, 0 }, { 75376, 86400, 6, 250368 }, { 75376, 86400, 6, 0 },
+  };
+  for (auto &t : cases) {
+    int tbs = t[0], g = t[1], qm = t[2], n_ir = t[3];
+    vector<uint8_t> tb(tbs / 8), out(g / 8 + 1);
+    for (auto &byte : tb)
+      byte = rng();
+    PHY_TB_PLAN *plan = phy_tb_plan_init(tbs, g, qm, n_ir);
+    for (int rv = 0; rv < 4; ++rv) {
+      auto ref = tb_encode_reference(tb.data(), tbs, g, qm, n_ir, rv);
+      bool ok = phy_tb_encode(plan, tb.data(), rv, out.data()) == g && (int)ref.size() == g;
+      for (int i = 0; ok && i < g; ++i)
+	ok = ((out[i / 8] >> (7 - i % 8)) & 1) == ref[i];
+      if (!ok) {
+	fprintf(stderr, "Transport block of %d bits coded to %d wrong for RV %d\n", tbs, g, rv);
+	exit(1);
+      }
+    }
+    phy_tb_plan_free(plan);
+  }
+  if (phy_tb_plan_init(100, 1000, 2, 0) || errno != EINVAL) {
+    fprintf(stderr, "Transport block of 100 bits accepted\n");
+    exit(1);
+  }
+}
+
+static void
+bench_turbo(bench &b) {
+  check_turbo();
+  std::mt19937 rng(6);
+  // 6 RBs QPSK, 25 RBs 16QAM and 100 RBs 64QAM of 12 data symbols
+  static const int cases[][3] = { { 600, 1440, 2 }, { 8760, 14400, 4 }, { 75376, 86400, 6 } };
+  for (auto &t : cases) {
+    int tbs = t[0], g = t[1], qm = t[2];
+    vector<uint8_t> tb(tbs / 8), out(g / 8);
+    for (auto &byte : tb)
+      byte = rng();
+    PHY_TB_PLAN *plan = phy_tb_plan_init(tbs, g, qm, 0);
+    b.run(str(format("turbo/plan_init/tbs=%d") % tbs), [&]() {
+	phy_tb_plan_free(phy_tb_plan_init(tbs, g, qm, 0));
+      });
+    int rv = 0;
+    b.run(str(format("turbo/encode/tbs=%d") % tbs), [&]() {
+	bench_keep(phy_tb_encode(plan, tb.data(), rv, out.data()));
+	rv = (rv + 1) % 4;
+      });
+    phy_tb_plan_free(plan);
+  }
+}
+
+// Coded bits over QPSK in AWGN of Es/N0 snr_db, as LLRs of scale 4 per
+// unit and without noise for an infinite SNR
+static vector<int8_t>
+awgn_llrs(std::mt19937 &rng, const vector<uint8_t> &coded, int g, double snr_db) {
+  double snr = pow(10, snr_db / 10);
+  std::normal_distribution<double> noise(0, sqrt(1 / snr));
+  vector<int8_t> llrs(g);
+  for (int i = 0; i < g; ++i) {
+    double x = (coded[i / 8] >> (7 - i % 8)) & 1 ? -1 : 1;
+    llrs[i] = std::isinf(snr) ? 64 * x : std::min(std::max(lrint(4 * 2 * (x + noise(rng)) * snr), -127l), 127l);
+  }
+  return llrs;
+}
+
+static void
+check_turbo_decode() {
+  std::mt19937 rng(7);
+  PHY_TURBO_POOL *pool = phy_turbo_pool_init(3);
+  // Single and multiple code blocks, noiseless and at an SNR where
+  // rate 1/3 decodes reliably
+  static const int cases[][4] = {
+    { 16, 288, 2, 0 }, { 1000, 3000, 2, 0 }, { 6120, 18432, 2, 0 }, { 15264, 30000, 6, 25344 }, { 75376, 86400, 6, 0 },
+  };
+  for (auto &t : cases) {
+    int tbs = t[0], g = t[1], qm = t[2], n_ir = t[3];
+    vector<uint8_t> tb(tbs / 8), coded(g / 8), decoded(tbs / 8);
+    for (auto &byte : tb)
+      byte = rng();
+    PHY_TB_PLAN *plan = phy_tb_plan_init(tbs, g, qm, n_ir);
+    phy_tb_encode(plan, tb.data(), 0, coded.data());
+    for (double snr_db : { (double)INFINITY, 8.0 }) {
+      for (PHY_TURBO_POOL *p : { (PHY_TURBO_POOL *)NULL, pool }) {
+	vector<int16_t> soft(phy_tb_plan_soft_bits(plan));
+	auto llrs = awgn_llrs(rng, coded, g, snr_db);
+	phy_tb_combine(plan, llrs.data(), 0, soft.data());
+	int iterations = phy_tb_decode(plan, soft.data(), 8, p, decoded.data());
+	if (iterations < 1 || decoded != tb || (std::isinf(snr_db) && iterations != 1)) {
+	  fprintf(stderr, "Transport block of %d bits coded to %d didn't decode at %.1f dB\n", tbs, g, snr_db);
+	  exit(1);
+	}
+      }
+    }
+    phy_tb_plan_free(plan);
+  }
+
+  // Fewer coded bits than data: only retransmissions make it decodable
+  int tbs = 6120, g = 3000;
+  vector<uint8_t> tb(tbs / 8), coded(g / 8), decoded(tbs / 8);
+  for (auto &byte : tb)
+    byte = rng();
+  PHY_TB_PLAN *plan = phy_tb_plan_init(tbs, g, 2, 0);
+  vector<int16_t> soft(phy_tb_plan_soft_bits(plan));
+  for (int rv : { 0, 2, 3, 1 }) {
+    phy_tb_encode(plan, tb.data(), rv, coded.data());
+    auto llrs = awgn_llrs(rng, coded, g, 3);
+    phy_tb_combine(plan, llrs.data(), rv, soft.data());
+    int iterations = phy_tb_decode(plan, soft.data(), 8, pool, decoded.data());
+    if (rv == 0 ? iterations != -1 || errno != EBADMSG : rv == 1 && (iterations < 1 || decoded != tb)) {
+      fprintf(stderr, "HARQ combining of RV %d wrong\n", rv);
+      exit(1);
+    }
+  }
+  phy_tb_plan_free(plan);
+  phy_turbo_pool_free(pool);
+}
+
+// Bit and block error rates of rate 1/3 over QPSK, the waterfall of turbo
+// decoding and where fixed point losses would show
+static void
+simulate_turbo(bench &b) {
+  if (!b.enabled("turbo/ber"))
+    return;
+  const int tbs = 6120, g = 18432, blocks = 100;
+  printf("%-56s %12s %12s %12s\n", "simulation", "BER", "BLER", "iterations");
+  std::mt19937 rng(8);
+  PHY_TB_PLAN *plan = phy_tb_plan_init(tbs, g, 2, 0);
+  vector<uint8_t> tb(tbs / 8), coded(g / 8), decoded(tbs / 8);
+  vector<int16_t> soft(phy_tb_plan_soft_bits(plan));
+  for (double snr_db = -2.5; snr_db <= -0.5; snr_db += 0.25) {
+    int errors = 0, failed = 0, iterations = 0;
+    for (int i = 0; i < blocks; ++i) {
+      for (auto &byte : tb)
+	byte = rng();
+      phy_tb_encode(plan, tb.data(), 0, coded.data());
+      auto llrs = awgn_llrs(rng, coded, g, snr_db);
+      std::fill(soft.begin(), soft.end(), 0);
+      phy_tb_combine(plan, llrs.data(), 0, soft.data());
+      int n = phy_tb_decode(plan, soft.data(), 8, NULL, decoded.data());
+      iterations += n < 0 ? 8 : n;
+      failed += n < 0;
+      for (int j = 0; j < tbs / 8; ++j)
+	errors += __builtin_popcount(tb[j] ^ decoded[j]);
+    }
+    printf("%-56s %12.2e %12.3f %12.2f\n", str(format("turbo/ber/tbs=%d/snr=%.2f") % tbs % snr_db).c_str(),
+	   (double)errors / tbs / blocks, (double)failed / blocks, (double)iterations / blocks);
+  }
+  phy_tb_plan_free(plan);
+}
+
+static void
+bench_turbo_decode(bench &b) {
+  check_turbo_decode();
+  simulate_turbo(b);
+  std::mt19937 rng(9);
+  int n_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  PHY_TURBO_POOL *pool = phy_turbo_pool_init(n_threads - 1);
+  // As in bench_turbo, 3 dB above where they start to decode
+  static const int cases[][4] = { { 600, 1440, 2, 3 }, { 8760, 14400, 4, 4 }, { 75376, 86400, 6, 8 } };
+  vector<std::pair<std::string, double>> rates;
+  for (auto &t : cases) {
+    int tbs = t[0], g = t[1], qm = t[2];
+    vector<uint8_t> tb(tbs / 8), coded(g / 8), decoded(tbs / 8);
+    for (auto &byte : tb)
+      byte = rng();
+    PHY_TB_PLAN *plan = phy_tb_plan_init(tbs, g, qm, 0);
+    phy_tb_encode(plan, tb.data(), 0, coded.data());
+    auto llrs = awgn_llrs(rng, coded, g, t[3]);
+    vector<int16_t> soft(phy_tb_plan_soft_bits(plan));
+    std::string name = str(format("turbo/combine/tbs=%d") % tbs);
+    b.run(name, [&]() {
+	bench_keep(phy_tb_combine(plan, llrs.data(), 0, soft.data()));
+      });
+    std::fill(soft.begin(), soft.end(), 0);
+    phy_tb_combine(plan, llrs.data(), 0, soft.data());
+    for (PHY_TURBO_POOL *p : { (PHY_TURBO_POOL *)NULL, pool }) {
+      name = str(format("turbo/decode/tbs=%d/threads=%d") % tbs % (p ? n_threads : 1));
+      if (!b.enabled(name) || (p && n_threads == 1))
+	continue;
+      b.run(name, [&]() {
+	  bench_keep(phy_tb_decode(plan, soft.data(), 8, p, decoded.data()));
+	});
+      rates.push_back({ name, tbs * 1e3 / b.results.back().ns_per_op });
+    }
+    phy_tb_plan_free(plan);
+  }
+  phy_turbo_pool_free(pool);
+  if (!rates.empty())
+    printf("%-56s %12s\n", "decoding", "Mbit/s");
+  for (auto &rate : rates)
+    printf("%-56s %12.1f\n", rate.first.c_str(), rate.second);
+}
+
+/******
+ ** Convolutional coding
+ **/
+
+// 36.212 5.1.3.1 and 5.1.4.2 bit by bit as written, with <NULL> as 2
+static vector<uint8_t>
+conv_encode_reference(const uint8_t *in, int K, int E) {
+  const uint8_t NUL = 2;
+  static const int g[3] = { 0133, 0171, 0165 };
+  vector<uint8_t> c(K);
+  for (int i = 0; i < K; ++i)
+    c[i] = (in[i / 8] >> (7 - i % 8)) & 1;
+  vector<uint8_t> d[3];
+  for (int k = 0; k < K; ++k)
+    for (int i = 0; i < 3; ++i) {
+      int sum = 0;
+      for (int j = 0; j <= 6; ++j)
+	sum += ((g[i] >> (6 - j)) & 1) * c[(k - j + K) % K];
+      d[i].push_back(sum % 2);
+    }
+  static const int P[32] = { 1, 17, 9, 25, 5, 21, 13, 29, 3, 19, 11, 27, 7, 23, 15, 31,
+			     0, 16, 8, 24, 4, 20, 12, 28, 2, 18, 10, 26, 6, 22, 14, 30 };
+  int R = (K + 31) / 32, N_D = 32 * R - K;
+  vector<uint8_t> w;
+  for (int i = 0; i < 3; ++i) {
+    vector<uint8_t> y(N_D, NUL);
+    y.insert(y.end(), d[i].begin(), d[i].end());
+    for (int col = 0; col < 32; ++col)
+      for (int row = 0; row < R; ++row)
+	w.push_back(y[row * 32 + P[col]]);
+  }
+  vector<uint8_t> e;
+  for (int j = 0; (int)e.size() < E; ++j)
+    if (w[j % w.size()] != NUL)
+      e.push_back(w[j % w.size()]);
+  return e;
+}
+
+// Coded bits as LLRs of BPSK in AWGN with the noise variance of an SNR
+static vector<int8_t>
+noisy_llrs(std::mt19937 &rng, const uint8_t *coded, int e, double snr_db) {
+  std::normal_distribution<double> noise(0, sqrt(pow(10, -snr_db / 10)));
+  vector<int8_t> llrs(e);
+  for (int i = 0; i < e; ++i) {
+    double y = ((coded[i / 8] >> (7 - i % 8)) & 1 ? -1 : 1) + noise(rng);
+    llrs[i] = std::min(std::max(lrint(16 * y), -127l), 127l);
+  }
+  return llrs;
+}
+
+static void
+check_conv() {
+  std::mt19937 rng(10);
+  // BCH, DCIs at each aggregation level, punctured and the largest
+  static const int cases[][2] = {
+    { 40, 1920 }, { 41, 72 }, { 43, 144 }, { 57, 288 }, { 31, 576 }, { 64, 120 }, { 128, 600 }, { 6, 72 },
+  };
+  for (auto &t : cases) {
+    int k = t[0], e = t[1];
+    vector<uint8_t> in(PHY_CONV_MAX_SIZE / 8), out(e / 8 + 1), decoded((k + 7) / 8);
+    for (int trial = 0; trial < 20; ++trial) {
+      for (auto &byte : in)
+	byte = rng();
+      if (k % 8)
+	in[k / 8] &= 0xff00 >> (k % 8);
+      auto ref = conv_encode_reference(in.data(), k, e);
+      bool ok = phy_conv_encode(in.data(), k, e, out.data()) == e;
+      for (int i = 0; ok && i < e; ++i)
+	ok = ((out[i / 8] >> (7 - i % 8)) & 1) == ref[i];
+      if (!ok) {
+	fprintf(stderr, "Convolutional coding of %d bits to %d wrong\n", k, e);
+	exit(1);
+      }
+      // Noiseless, and at 1 dB where rate 1/3 or lower gets through
+      auto llrs = noisy_llrs(rng, out.data(), e, e < 3 * k ? 30 : 1);
+      if (phy_conv_decode(llrs.data(), e, k, decoded.data()) || memcmp(decoded.data(), in.data(), decoded.size())) {
+	fprintf(stderr, "Convolutional code of %d bits coded to %d didn't decode\n", k, e);
+	exit(1);
+      }
+    }
+  }
+
+  // A batch over two rounds of lanes, with candidates of other data and
+  // sizes than their neighbours, decodes like each of them alone
+  const int k = 43, n = 21;
+  vector<vector<int8_t>> llrs(n);
+  vector<const int8_t *> pointers(n);
+  vector<int> e(n);
+  vector<uint8_t> batch(n * 6), single(6);
+  for (int i = 0; i < n; ++i) {
+    uint8_t in[6], coded[72];
+    for (auto &byte : in)
+      byte = rng();
+    e[i] = 72 << (i % 4);
+    phy_conv_encode(in, k, e[i], coded);
+    llrs[i] = noisy_llrs(rng, coded, e[i], -2);
+    pointers[i] = llrs[i].data();
+  }
+  phy_conv_decode_batch(pointers.data(), e.data(), n, k, batch.data());
+  for (int i = 0; i < n; ++i) {
+    phy_conv_decode(pointers[i], e[i], k, single.data());
+    if (memcmp(single.data(), &batch[6 * i], 6)) {
+      fprintf(stderr, "Candidate %d of a batch decoded differently\n", i);
+      exit(1);
+    }
+  }
+  if (phy_conv_encode(single.data(), PHY_CONV_MAX_SIZE + 1, 72, batch.data()) != -1 || errno != EINVAL) {
+    fprintf(stderr, "Convolutional coding of too many bits accepted\n");
+    exit(1);
+  }
+}
+
+static void
+bench_conv(bench &b) {
+  check_conv();
+  std::mt19937 rng(11);
+  // BCH, and DCIs of 20 MHz format 1A at aggregation level 1 as a UE would
+  // blind decode a search space
+  static const int cases[][2] = { { 40, 1920 }, { 43, 72 } };
+  for (auto &t : cases) {
+    int k = t[0], e = t[1];
+    vector<uint8_t> in(k / 8 + 1), coded(e / 8);
+    for (auto &byte : in)
+      byte = rng();
+    b.run(str(format("conv/encode/bits=%d/e=%d") % k % e), [&]() {
+	bench_keep(phy_conv_encode(in.data(), k, e, coded.data()));
+      });
+    auto llrs = noisy_llrs(rng, coded.data(), e, 0);
+    b.run(str(format("conv/decode/bits=%d/e=%d") % k % e), [&]() {
+	bench_keep(phy_conv_decode(llrs.data(), e, k, in.data()));
+      });
+  }
+  for (int n : { 16, 44 }) {
+    const int k = 43, e = 72;
+    vector<const int8_t *> llrs(n);
+    vector<int> es(n, e);
+    vector<int8_t> soft(e);
+    for (auto &llr : soft)
+      llr = rng();
+    std::fill(llrs.begin(), llrs.end(), soft.data());
+    vector<uint8_t> out(n * 6);
+    b.run(str(format("conv/decode_batch/bits=%d/candidates=%d") % k % n), [&]() {
+	bench_keep(phy_conv_decode_batch(llrs.data(), es.data(), n, k, out.data()));
+      });
+  }
+}
+
+/******
+ ** Modulation
+ **/
+
+// Symbol of bits b(0) .. b(qm - 1) by the formulas behind Tables 7.1.2-1
+// to 7.1.4-1, in units of the innermost amplitude
+static std::pair<int, int>
+qam_reference(int qm, const int *b) {
+  auto dimension = [&](int c) {
+    int sign = 1 - 2 * b[c];
+    if (qm == 2)
+      return sign;
+    if (qm == 4)
+      return sign * (2 - (1 - 2 * b[c + 2]));
+    return sign * (4 - (1 - 2 * b[c + 2]) * (2 - (1 - 2 * b[c + 4])));
+  };
+  return { dimension(0), dimension(1) };
+}
+
+static void
+check_modulation() {
+  std::mt19937 rng(12);
+  static const double d[] = { 0, 1 / sqrt(2), 1 / sqrt(10), 1 / sqrt(42) };
+  for (int qm : { 2, 4, 6 }) {
+    // All symbols, then odd counts of random ones for the leftovers
+    for (int n : { 1 << qm, 1, 7, 13, 1001 }) {
+      vector<uint8_t> bits((qm * n + 7) / 8);
+      vector<phy_complex> symbols(n);
+      for (int i = 0; i < qm * n; ++i) {
+	int bit = n == 1 << qm ? ((i / qm) >> (qm - 1 - i % qm)) & 1 : rng() & 1;
+	bits[i / 8] |= bit << (7 - i % 8);
+      }
+      double power = 0;
+      bool ok = phy_modulate(qm, bits.data(), qm * n, symbols.data()) == n;
+      for (int i = 0; ok && i < n; ++i) {
+	int b[6] = { 0 };
+	for (int j = 0; j < qm; ++j)
+	  b[j] = (bits[(qm * i + j) / 8] >> (7 - (qm * i + j) % 8)) & 1;
+	auto ref = qam_reference(qm, b);
+	ok = fabs(symbols[i].re - ref.first * d[qm / 2]) < 1e-6 && fabs(symbols[i].im - ref.second * d[qm / 2]) < 1e-6;
+	power += symbols[i].re * symbols[i].re + symbols[i].im * symbols[i].im;
+      }
+      if (!ok || (n == 1 << qm && fabs(power / n - 1) > 1e-5)) {
+	fprintf(stderr, "Modulation of %d symbols of order %d wrong\n", n, qm);
+	exit(1);
+      }
+
+      // Noisy symbols against max-log LLRs in double precision, with a
+      // noise variance per symbol or for all
+      std::normal_distribution<double> noise(0, 0.1);
+      vector<float> noise_variances(n);
+      for (auto &symbol : symbols) {
+	symbol.re += noise(rng);
+	symbol.im += noise(rng);
+      }
+      for (auto &v : noise_variances)
+	v = 0.01 + (rng() % 100) / 1000.0;
+      vector<int8_t> llrs(qm * n);
+      for (bool per_symbol : { false, true }) {
+	ok = phy_demodulate(qm, symbols.data(), n, per_symbol ? noise_variances.data() : NULL, 0.05, llrs.data()) == qm * n;
+	for (int i = 0; ok && i < qm * n; ++i) {
+	  double y = i % 2 ? symbols[i / qm].im : symbols[i / qm].re, dd = d[qm / 2];
+	  int level = (i % qm) / 2;
+	  double distance = level == 0 ? y : level == 1 ? (qm == 4 ? 2 : 4) * dd - fabs(y) : 2 * dd - fabs(fabs(y) - 4 * dd);
+	  double llr = 4 * dd * distance / (per_symbol ? noise_variances[i / qm] : 0.05) * PHY_LLR_SCALE;
+	  ok = fabs(std::min(std::max(llr, -127.0), 127.0) - llrs[i]) <= 1;
+	}
+	if (!ok) {
+	  fprintf(stderr, "Demodulation of %d symbols of order %d wrong\n", n, qm);
+	  exit(1);
+	}
+      }
+    }
+  }
+  phy_complex big = { 1e30f, -1e30f };
+  int8_t llrs[6];
+  if (phy_demodulate(6, &big, 1, NULL, 1e-30f, llrs) != 6 || llrs[0] != 127 || llrs[1] != -127) {
+    fprintf(stderr, "Demodulation doesn't saturate\n");
+    exit(1);
+  }
+}
+
+static void
+bench_modulation(bench &b) {
+  check_modulation();
+  std::mt19937 rng(13);
+  // 100 RBs of 12 data symbols
+  const int n = 14400;
+  vector<uint8_t> bits(6 * n / 8);
+  for (auto &byte : bits)
+    byte = rng();
+  vector<phy_complex> symbols(n);
+  vector<float> noise_variances(n, 0.1f);
+  vector<int8_t> llrs(6 * n);
+  for (int qm : { 2, 4, 6 }) {
+    b.run(str(format("modulation/modulate/qm=%d/symbols=%d") % qm % n), [&]() {
+	bench_keep(phy_modulate(qm, bits.data(), qm * n, symbols.data()));
+      });
+    b.run(str(format("modulation/demodulate/qm=%d/symbols=%d") % qm % n), [&]() {
+	bench_keep(phy_demodulate(qm, symbols.data(), n, NULL, 0.1f, llrs.data()));
+      });
+    b.run(str(format("modulation/demodulate_per_symbol/qm=%d/symbols=%d") % qm % n), [&]() {
+	bench_keep(phy_demodulate(qm, symbols.data(), n, noise_variances.data(), 0, llrs.data()));
+      });
+  }
+}
+
+/******
+ ** OFDM
+ **/
+
+static vector<phy_complex>
+random_symbols(std::mt19937 &rng, int n) {
+  std::normal_distribution<float> normal(0, 1);
+  vector<phy_complex> symbols(n);
+  for (auto &symbol : symbols)
+    symbol = { normal(rng), normal(rng) };
+  return symbols;
+}
+
+// Largest difference relative to the largest magnitude
+static double
+relative_error(const phy_complex *a, const std::complex<double> *b, int n) {
+  double error = 0, largest = 1e-30;
+  for (int i = 0; i < n; ++i) {
+    error = std::max(error, std::abs(std::complex<double>(a[i].re, a[i].im) - b[i]));
+    largest = std::max(largest, std::abs(b[i]));
+  }
+  return error / largest;
+}
+
+static void
+check_ofdm() {
+  std::mt19937 rng(14);
+  for (int n : { 1, 2, 3, 4, 6, 8, 9, 12, 16, 18, 27, 32, 48, 64, 128, 384, 1536 }) {
+    auto in = random_symbols(rng, n);
+    vector<phy_complex> out(n);
+    for (int inverse = 0; inverse < 2; ++inverse) {
+      vector<std::complex<double>> dft(n);
+      for (int k = 0; k < n; ++k)
+	for (int t = 0; t < n; ++t)
+	  dft[k] += std::complex<double>(in[t].re, in[t].im) * std::polar(1.0, (inverse ? 2 : -2) * M_PI * k * t / n);
+      if (phy_fft(n, inverse, in.data(), out.data()) || relative_error(out.data(), dft.data(), n) > 1e-5) {
+	fprintf(stderr, "FFT of %d points wrong\n", n);
+	exit(1);
+      }
+    }
+  }
+  vector<phy_complex> buffer(5);
+  if (phy_fft(5, 0, buffer.data(), buffer.data() + 0) != -1 || errno != EINVAL) {
+    fprintf(stderr, "FFT of 5 points accepted\n");
+    exit(1);
+  }
+  for (int n : { 0, -4 })
+    if (phy_fft(n, 0, buffer.data(), buffer.data()) != -1 || errno != EINVAL) {
+      fprintf(stderr, "FFT of %d points accepted\n", n);
+      exit(1);
+    }
+
+  static const int cases[][2] = { { 6, 0 }, { 15, 384 }, { 25, 0 }, { 25, 768 }, { 50, 0 }, { 75, 0 }, { 100, 0 } };
+  for (auto &c : cases)
+    for (int uplink = 0; uplink < 2; ++uplink) {
+      int n_prb = c[0], subcarriers = 12 * n_prb;
+      PHY_OFDM *ofdm = phy_ofdm_init(n_prb, c[1], uplink);
+      int n = phy_ofdm_fft_size(ofdm), samples = phy_ofdm_samples(ofdm, 0, PHY_SYMBOLS_PER_SUBFRAME);
+      auto res = random_symbols(rng, subcarriers * PHY_SYMBOLS_PER_SUBFRAME);
+      vector<phy_complex> time(samples), back(res.size());
+      bool ok = samples == 15 * n && phy_ofdm_modulate(ofdm, res.data(), 0, PHY_SYMBOLS_PER_SUBFRAME, time.data()) == samples;
+      ok = ok && phy_ofdm_demodulate(ofdm, time.data(), 0, PHY_SYMBOLS_PER_SUBFRAME, back.data()) == samples;
+      vector<std::complex<double>> expected(res.size());
+      for (size_t i = 0; i < res.size(); ++i)
+	expected[i] = std::complex<double>(res[i].re, res[i].im);
+      ok = ok && relative_error(back.data(), expected.data(), res.size()) < 1e-4;
+
+      // Symbol 1 of the slot, by the baseband signal formulas of 36.211
+      // 6.12 and 5.6 with Ts of the FFT size
+      int cp = 144 * n / 2048;
+      expected.assign(cp + n, 0);
+      for (int k = 0; k < subcarriers; ++k) {
+	double f = uplink ? k - subcarriers / 2 + 0.5 : k < subcarriers / 2 ? k - subcarriers / 2 : k - subcarriers / 2 + 1;
+	std::complex<double> a(res[subcarriers + k].re, res[subcarriers + k].im);
+	for (int t = 0; t < cp + n; ++t)
+	  expected[t] += a * std::polar(1 / sqrt(n), 2 * M_PI * f * (t - cp) / n);
+      }
+      int first = phy_ofdm_samples(ofdm, 0, 1);
+      ok = ok && relative_error(time.data() + first, expected.data(), cp + n) < 1e-4;
+      if (!ok) {
+	fprintf(stderr, "%s OFDM of %d RBs with FFT size %d wrong\n", uplink ? "Uplink" : "Downlink", n_prb, n);
+	exit(1);
+      }
+      phy_ofdm_free(ofdm);
+    }
+  if (phy_ofdm_init(100, 1024, 0) || errno != EINVAL) {
+    fprintf(stderr, "OFDM of 100 RBs with FFT size 1024 accepted\n");
+    exit(1);
+  }
+}
+
+static void
+bench_ofdm(bench &b) {
+  check_ofdm();
+  std::mt19937 rng(15);
+  for (int n : { 128, 256, 384, 512, 768, 1024, 1536, 2048 }) {
+    auto in = random_symbols(rng, n);
+    vector<phy_complex> out(n);
+    b.run(str(format("ofdm/fft/n=%d") % n), [&]() {
+	bench_keep(phy_fft(n, 0, in.data(), out.data()));
+      });
+  }
+  // A whole subframe at once, 1 ms of samples
+  for (int n_prb : { 6, 25, 100 })
+    for (int uplink = 0; uplink < 2; ++uplink) {
+      PHY_OFDM *ofdm = phy_ofdm_init(n_prb, 0, uplink);
+      auto res = random_symbols(rng, 12 * n_prb * PHY_SYMBOLS_PER_SUBFRAME);
+      vector<phy_complex> time(phy_ofdm_samples(ofdm, 0, PHY_SYMBOLS_PER_SUBFRAME));
+      const char *direction = uplink ? "uplink" : "downlink";
+      b.run(str(format("ofdm/modulate/%s/n_prb=%d/subframe") % direction % n_prb), [&]() {
+	  bench_keep(phy_ofdm_modulate(ofdm, res.data(), 0, PHY_SYMBOLS_PER_SUBFRAME, time.data()));
+	});
+      b.run(str(format("ofdm/demodulate/%s/n_prb=%d/subframe") % direction % n_prb), [&]() {
+	  bench_keep(phy_ofdm_demodulate(ofdm, time.data(), 0, PHY_SYMBOLS_PER_SUBFRAME, res.data()));
+	});
+      phy_ofdm_free(ofdm);
+    }
+}
+
+/******
+ ** Resource element mapping
+ **/
+
+static void
+check_re_map() {
+  for (int n_prb : bandwidths)
+    for (int cell_id : { 0, 7, 503 })
+      for (int n_ports : { 1, 2, 4 })
+	for (int cfi = 1; cfi <= 3; ++cfi)
+	  for (int ng = PHY_PHICH_NG_1_6; ng <= PHY_PHICH_NG_2; ++ng) {
+	    PHY_RE_MAP *map = phy_re_map_init(cell_id, n_prb, cfi, ng, n_ports);
+	    int n_sc = 12 * n_prb, control = cfi + (n_prb <= 10), center = n_sc / 2 - 36;
+	    int groups = (int)ceil((ng == 0 ? 1 / 6.0 : ng == 1 ? 0.5 : ng == 2 ? 1 : 2) * n_prb / 8);
+	    int regs = 0;
+	    for (int l = 0; l < control; ++l)
+	      regs += (l == 0 || (l == 1 && n_ports == 4) ? 2 : 3) * n_prb;
+	    int pdcch_regs = regs - 4 - 3 * groups;
+	    bool ok = map && phy_re_map_control_symbols(map) == control && phy_re_map_phich_groups(map) == groups;
+	    ok = ok && phy_re_map_cces(map) == pdcch_regs / 9;
+	    for (int subframe : { 0, 1, 5 }) {
+	      const int sizes[PHY_RE_CHANNELS] = { 8 * n_prb, 16, 12 * groups, 4 * pdcch_regs, subframe ? 0 : 240,
+		subframe % 5 ? 0 : 62, subframe % 5 ? 0 : 62, -1 };
+	      vector<int> owner(PHY_SYMBOLS_PER_SUBFRAME * n_sc, -1);
+	      for (int channel = 0; ok && channel < PHY_RE_CHANNELS; ++channel) {
+		int n;
+		const uint16_t *indices = phy_re_map_indices(map, channel, subframe, &n);
+		ok = sizes[channel] < 0 || n == sizes[channel];
+		for (int i = 0; ok && i < n; ++i) {
+		  ok = indices[i] < owner.size() && owner[indices[i]] < 0;
+		  owner[indices[i]] = channel;
+		}
+	      }
+	      // Everything else is reference signals or unused around PBCH and
+	      // synchronization signals
+	      int pdsch = 0;
+	      for (int l = 0; ok && l < PHY_SYMBOLS_PER_SUBFRAME; ++l)
+		for (int k = 0; ok && k < n_sc; ++k) {
+		  int slot_symbol = l % PHY_SYMBOLS_PER_SLOT, channel = owner[l * n_sc + k];
+		  bool rs01 = (slot_symbol == 0 || slot_symbol == 4) && k % 3 == cell_id % 3;
+		  bool rs23 = slot_symbol == 1 && k % 3 == cell_id % 3;
+		  bool rs = (rs01 && (n_ports > 1 || k % 6 == (cell_id + 3 * (slot_symbol == 4)) % 6)) || (rs23 && n_ports == 4);
+		  bool middle = k >= center && k < center + 72;
+		  bool sync = subframe % 5 == 0 && (l == 5 || l == 6) && middle;
+		  bool pbch = subframe == 0 && l >= 7 && l <= 10 && middle;
+		  if (l < control)
+		    ok = rs01 || (rs23 && n_ports == 4) ? channel < 0 || channel == PHY_RE_CRS
+		      : channel >= PHY_RE_PCFICH && channel <= PHY_RE_PDCCH;
+		  else if (rs || sync || pbch)
+		    ok = channel != PHY_RE_PDSCH;
+		  else
+		    ok = channel == PHY_RE_PDSCH;
+		  pdsch += channel == PHY_RE_PDSCH;
+		}
+	      ok = ok && phy_pdsch_size(map, subframe, 0, n_prb) == pdsch;
+
+	      // Allocations are the resource blocks of the whole band. Symbols
+	      // are numbered from 1 to tell them from unmapped elements.
+	      int first = n_prb / 3, n_prbs = n_prb / 2, size = phy_pdsch_size(map, subframe, first, n_prbs);
+	      vector<phy_complex> symbols(size), res(owner.size()), back(size), all(pdsch);
+	      for (int i = 0; i < size; ++i)
+		symbols[i] = { (float)i + 1, 0 };
+	      ok = ok && phy_map_pdsch(map, subframe, first, n_prbs, symbols.data(), res.data()) == size;
+	      ok = ok && phy_demap_pdsch(map, subframe, first, n_prbs, res.data(), back.data()) == size;
+	      ok = ok && !memcmp(back.data(), symbols.data(), size * sizeof(phy_complex));
+	      ok = ok && phy_demap_channel(map, PHY_RE_PDSCH, subframe, res.data(), all.data()) == pdsch;
+	      for (int i = 0; ok && i < (int)res.size(); ++i)
+		ok = (res[i].re != 0) == (owner[i] == PHY_RE_PDSCH && i % n_sc / 12 >= first && i % n_sc / 12 < first + n_prbs);
+	      ok = ok && phy_pdsch_size(map, subframe, 0, first) + size + phy_pdsch_size(map, subframe, first + n_prbs,
+											 n_prb - first - n_prbs) == pdsch;
+	    }
+	    // PCFICH from k = 6 (cell_id % 2 n_prb) on in quarters of the band
+	    int n;
+	    const uint16_t *pcfich = phy_re_map_indices(map, PHY_RE_PCFICH, 1, &n);
+	    for (int i = 0; ok && i < 4; ++i) {
+	      int k = (6 * (cell_id % (2 * n_prb)) + 6 * (i * n_prb / 2)) % n_sc;
+	      ok = pcfich[4 * i] >= k && pcfich[4 * i + 3] < k + 6;
+	    }
+	    if (!ok) {
+	      fprintf(stderr, "Resource element map of cell %d, %d RBs, CFI %d, N_g %d and %d ports wrong\n",
+		      cell_id, n_prb, cfi, ng, n_ports);
+	      exit(1);
+	    }
+	    phy_re_map_free(map);
+	  }
+  if (phy_re_map_init(0, 25, 4, 0, 1) || errno != EINVAL) {
+    fprintf(stderr, "CFI 4 accepted\n");
+    exit(1);
+  }
+}
+
+static void
+bench_re_map(bench &b) {
+  check_re_map();
+  std::mt19937 rng(17);
+  for (int n_prb : { 6, 25, 100 }) {
+    b.run(str(format("re_map/init/n_prb=%d") % n_prb), [&]() {
+	phy_re_map_free(phy_re_map_init(1, n_prb, 2, PHY_PHICH_NG_1, 1));
+      });
+    PHY_RE_MAP *map = phy_re_map_init(1, n_prb, 2, PHY_PHICH_NG_1, 1);
+    vector<phy_complex> res = random_symbols(rng, 12 * n_prb * PHY_SYMBOLS_PER_SUBFRAME), symbols(res.size());
+    for (int channel : { PHY_RE_PDCCH, PHY_RE_PDSCH }) {
+      const char *name = channel == PHY_RE_PDCCH ? "pdcch" : "pdsch";
+      b.run(str(format("re_map/map/%s/n_prb=%d") % name % n_prb), [&]() {
+	  bench_keep(phy_map_channel(map, channel, 1, symbols.data(), res.data()));
+	});
+      b.run(str(format("re_map/demap/%s/n_prb=%d") % name % n_prb), [&]() {
+	  bench_keep(phy_demap_channel(map, channel, 1, res.data(), symbols.data()));
+	});
+    }
+    b.run(str(format("re_map/demap/pdsch/n_prb=%d/allocation=%d") % n_prb % (n_prb / 4)), [&]() {
+	bench_keep(phy_demap_pdsch(map, 1, n_prb / 2, n_prb / 4, res.data(), symbols.data()));
+      });
+    phy_re_map_free(map);
+  }
+}
+
+/******
+ ** PDCCH blind decoding
+ **/
+
+// CCEs of the candidates of a search space, 36.213 9.1.1
+static vector<int>
+search_space(int rnti, int subframe, int n_cce, int level, bool common) {
+  uint32_t y = rnti;
+  for (int k = 0; k <= subframe; ++k)
+    y = 39827 * y % 65537;
+  if (common)
+    y = 0;
+  int positions = n_cce / level, candidates = common ? (level >= 4 ? 16 / level : 0) : (level <= 2 ? 6 : 2);
+  vector<int> cces;
+  for (int m = 0; m < candidates && positions; ++m)
+    cces.push_back(level * ((y + m) % positions));
+  return cces;
+}
+
+struct pdcch_transmission {
+  phy_dci dci;
+  int level, cce;
+};
+
+// Puts DCIs on free candidates of their search spaces, dropping those that
+// don't fit, and returns the symbols of all CCEs with noise added
+static vector<phy_complex>
+pdcch_symbols(std::mt19937 &rng, PHY_SCRAMBLING *scrambling, int n_prb, int subframe, int n_cce,
+	      vector<pdcch_transmission> &transmissions, double noise_variance) {
+  vector<uint8_t> bits(9 * n_cce);
+  vector<bool> used(n_cce);
+  vector<pdcch_transmission> placed;
+  for (auto t : transmissions) {
+    int rnti = t.dci.rnti;
+    bool common = rnti <= PHY_RA_RNTI_MAX || rnti >= PHY_P_RNTI;
+    for (int cce : search_space(rnti, subframe, n_cce, t.level, common)) {
+      bool free = true;
+      for (int i = cce; i < cce + t.level; ++i)
+	free = free && !used[i];
+      if (!free)
+	continue;
+      for (int i = cce; i < cce + t.level; ++i)
+	used[i] = true;
+      uint8_t packed[PHY_DCI_MAX_SIZE];
+      int size = phy_dci_pack(n_prb, &t.dci, packed);
+      phy_conv_encode(packed, size, 72 * t.level, &bits[9 * cce]);
+      t.cce = cce;
+      placed.push_back(t);
+      break;
+    }
+  }
+  transmissions = placed;
+  phy_scramble(bits.data(), phy_scrambling_get(scrambling, PHY_SCRAMBLING_PDCCH, subframe, NULL), 72 * n_cce);
+  vector<phy_complex> symbols(36 * n_cce);
+  phy_modulate(2, bits.data(), 72 * n_cce, symbols.data());
+  std::normal_distribution<float> noise(0, sqrt(noise_variance / 2));
+  for (int i = 0; i < 36 * n_cce; ++i) {
+    if (!used[i / 36])
+      symbols[i] = { 0, 0 };
+    if (noise_variance > 0)
+      symbols[i] = { symbols[i].re + noise(rng), symbols[i].im + noise(rng) };
+  }
+  return symbols;
+}
+
+// System information and DCIs for n_ues UEs from C-RNTI 100 on, at
+// aggregation levels 1, 2, 4 and 8 in turn
+static vector<pdcch_transmission>
+pdcch_transmissions(std::mt19937 &rng, int n_prb, int n_ues) {
+  vector<pdcch_transmission> t;
+  t.push_back({ random_dci(rng, n_prb, PHY_DCI_FORMAT_1A, PHY_SI_RNTI), 4, 0 });
+  t.push_back({ random_dci(rng, n_prb, PHY_DCI_FORMAT_1C, PHY_P_RNTI), 8, 0 });
+  for (int ue = 0; ue < n_ues; ++ue)
+    t.push_back({ random_dci(rng, n_prb, ue % 2 ? PHY_DCI_FORMAT_0 : PHY_DCI_FORMAT_1A, 100 + 37 * ue), 1 << ue % 4, 0 });
+  return t;
+}
+
+static void
+check_pdcch() {
+  std::mt19937 rng(18);
+  for (int n_prb : { 6, 25, 100 })
+    for (int subframe : { 0, 4, 9 })
+      for (double noise_variance : { 0.0, 0.1 }) {
+	int cell_id = 3 * n_prb + subframe;
+	PHY_RE_MAP *map = phy_re_map_init(cell_id, n_prb, 3, PHY_PHICH_NG_1, 1);
+	PHY_SCRAMBLING *scrambling = phy_scrambling_init(cell_id, n_prb);
+	PHY_PDCCH_MONITOR *monitor = phy_pdcch_monitor_init(cell_id, n_prb);
+	int n_cce = phy_re_map_cces(map), n_ues = n_cce / 4;
+	auto transmissions = pdcch_transmissions(rng, n_prb, n_ues);
+	// Y_0 of C-RNTI 3765 is 65536, past 16 bits
+	transmissions.insert(transmissions.begin() + 2, { random_dci(rng, n_prb, PHY_DCI_FORMAT_1A, 3765), 1, 0 });
+	auto symbols = pdcch_symbols(rng, scrambling, n_prb, subframe, n_cce, transmissions, noise_variance);
+	// All UEs and one that has nothing
+	vector<int> rntis;
+	for (int ue = 0; ue <= n_ues; ++ue)
+	  rntis.push_back(100 + 37 * ue);
+	rntis.push_back(3765);
+	phy_pdcch_monitor_rntis(monitor, rntis.data(), rntis.size());
+	vector<phy_dci> dcis(2 * transmissions.size() + 2);
+	vector<int> cces(dcis.size());
+	int found = phy_pdcch_decode(monitor, subframe, symbols.data(), n_cce, NULL, std::max(noise_variance, 0.01),
+				     dcis.data(), cces.data(), dcis.size());
+	bool ok = found == (int)transmissions.size();
+	for (auto &t : transmissions) {
+	  bool match = false;
+	  for (int i = 0; i < found; ++i)
+	    match = match || (cces[i] == t.cce && !memcmp(&dcis[i], &t.dci, sizeof(phy_dci)));
+	  ok = ok && match;
+	}
+	if (!ok) {
+	  fprintf(stderr, "PDCCH of %d RBs in subframe %d with noise variance %g: %d of %d DCIs found\n", n_prb,
+		  subframe, noise_variance, found, (int)transmissions.size());
+	  exit(1);
+	}
+	phy_pdcch_monitor_free(monitor);
+	phy_scrambling_free(scrambling);
+	phy_re_map_free(map);
+      }
+}
+
+static void
+bench_pdcch(bench &b) {
+  check_pdcch();
+  std::mt19937 rng(19);
+  const int n_prb = 100, subframe = 1;
+  PHY_RE_MAP *map = phy_re_map_init(1, n_prb, 3, PHY_PHICH_NG_1, 1);
+  PHY_SCRAMBLING *scrambling = phy_scrambling_init(1, n_prb);
+  PHY_PDCCH_MONITOR *monitor = phy_pdcch_monitor_init(1, n_prb);
+  int n_cce = phy_re_map_cces(map);
+  vector<std::pair<int, int>> decoded;
+  // A cell with 8 DCIs, monitored for some of its UEs or many
+  auto transmissions = pdcch_transmissions(rng, n_prb, 6);
+  auto symbols = pdcch_symbols(rng, scrambling, n_prb, subframe, n_cce, transmissions, 0.1);
+  for (int n_rntis : { 1, 6, 64 }) {
+    vector<int> rntis;
+    for (int ue = 0; ue < n_rntis; ++ue)
+      rntis.push_back(100 + 37 * ue);
+    phy_pdcch_monitor_rntis(monitor, rntis.data(), n_rntis);
+    phy_dci dcis[16];
+    b.run(str(format("pdcch/decode/n_prb=%d/rntis=%d") % n_prb % n_rntis), [&]() {
+	bench_keep(phy_pdcch_decode(monitor, subframe, symbols.data(), n_cce, NULL, 0.1, dcis, NULL, 16));
+      });
+    decoded.push_back({ n_rntis, phy_pdcch_monitor_decoded(monitor) });
+  }
+  if (b.enabled("pdcch/decode/")) {
+    printf("\n%-56s %12s %12s\n", "blind decodes of a subframe", "search", "decoded");
+    for (auto &d : decoded) {
+      int search = 0;
+      for (int level = 1; level <= 8; level *= 2) {
+	search += 2 * search_space(0, subframe, n_cce, level, true).size();
+	for (int ue = 0; ue < d.first; ++ue)
+	  search += search_space(100 + 37 * ue, subframe, n_cce, level, false).size();
+      }
+      printf("%-56s %12d %12d\n", str(format("pdcch/n_prb=%d/rntis=%d") % n_prb % d.first).c_str(), search, d.second);
+    }
+    printf("\n");
+  }
+  phy_pdcch_monitor_free(monitor);
+  phy_scrambling_free(scrambling);
+  phy_re_map_free(map);
+}
+
+/******
+ ** Synchronization
+ **/
+
+// A radio frame of a cell as resource elements and samples, PSS and SSS
+// alone in the middle of their symbols, with the subframes delayed by a
+// fraction of a sample
+static vector<phy_complex>
+sync_frame(std::mt19937 &rng, int cell_id, int n_prb, int fft_size, double delay, vector<phy_complex> &res) {
+  PHY_RE_MAP *map = phy_re_map_init(cell_id, n_prb, 1, PHY_PHICH_NG_1, 1);
+  PHY_OFDM *ofdm = phy_ofdm_init(n_prb, fft_size, 0);
+  const int subcarriers = 12 * n_prb, size = subcarriers * PHY_SYMBOLS_PER_SUBFRAME;
+  res = random_symbols(rng, 10 * size);
+  vector<phy_complex> samples(150 * fft_size), delayed(size);
+  for (int subframe = 0; subframe < 10; ++subframe) {
+    phy_complex *grid = res.data() + subframe * size;
+    if (subframe % 5 == 0) {
+      for (int l : { 5, 6 })
+	std::fill_n(grid + l * subcarriers + 6 * n_prb - 36, 72, phy_complex{ 0, 0 });
+      phy_complex pss[62], sss[62];
+      phy_pss(cell_id % 3, pss);
+      phy_sss(cell_id, subframe, sss);
+      phy_map_channel(map, PHY_RE_PSS, subframe, pss, grid);
+      phy_map_channel(map, PHY_RE_SSS, subframe, sss, grid);
+    }
+    for (int i = 0; i < size; ++i) {
+      int k = i % subcarriers, f = k - 6 * n_prb + (k >= 6 * n_prb);
+      auto y = std::complex<float>(grid[i].re, grid[i].im) * std::polar(1.0f, (float)(-2 * M_PI * f * delay / fft_size));
+      delayed[i] = { y.real(), y.imag() };
+    }
+    phy_ofdm_modulate(ofdm, delayed.data(), 0, PHY_SYMBOLS_PER_SUBFRAME, samples.data() + subframe * 15 * fft_size);
+  }
+  phy_ofdm_free(ofdm);
+  phy_re_map_free(map);
+  return samples;
+}
+
+static void
+check_sync() {
+  std::mt19937 rng(20);
+  // PSS against the Zadoff-Chu sequences of 36.211 6.11.1.1
+  static const int roots[3] = { 25, 29, 34 };
+  for (int id2 = 0; id2 < 3; ++id2) {
+    phy_complex pss[62];
+    vector<std::complex<double>> expected(62);
+    for (int n = 0; n < 62; ++n) {
+      int u = roots[id2], m = n < 31 ? n * (n + 1) : (n + 1) * (n + 2);
+      expected[n] = std::polar(1.0, -M_PI * u * m / 63);
+    }
+    if (phy_pss(id2, pss) != 62 || relative_error(pss, expected.data(), 62) > 1e-5) {
+      fprintf(stderr, "PSS %d wrong\n", id2);
+      exit(1);
+    }
+  }
+  // SSS against 36.211 6.11.2.1 term by term, for every cell
+  int x[3][31] = { { 0, 0, 0, 0, 1 }, { 0, 0, 0, 0, 1 }, { 0, 0, 0, 0, 1 } };
+  for (int i = 0; i + 5 < 31; ++i) {
+    x[0][i + 5] = (x[0][i + 2] + x[0][i]) % 2;
+    x[1][i + 5] = (x[1][i + 3] + x[1][i]) % 2;
+    x[2][i + 5] = (x[2][i + 4] + x[2][i + 2] + x[2][i + 1] + x[2][i]) % 2;
+  }
+  for (int cell_id = 0; cell_id < 504; ++cell_id) {
+    int id1 = cell_id / 3, id2 = cell_id % 3;
+    int q1 = id1 / 30, q = (id1 + q1 * (q1 + 1) / 2) / 30, m = id1 + q * (q + 1) / 2;
+    int m0 = m % 31, m1 = (m0 + m / 31 + 1) % 31;
+    auto s = [&](int n, int mi) { return 1 - 2 * x[0][(n + mi) % 31]; };
+    auto c = [&](int n, int shift) { return 1 - 2 * x[1][(n + id2 + shift) % 31]; };
+    auto z = [&](int n, int mi) { return 1 - 2 * x[2][(n + mi % 8) % 31]; };
+    for (int subframe : { 0, 5 }) {
+      phy_complex sss[62];
+      bool ok = phy_sss(cell_id, subframe, sss) == 62;
+      for (int n = 0; n < 31 && ok; ++n) {
+	int even = subframe ? s(n, m1) * c(n, 0) : s(n, m0) * c(n, 0);
+	int odd = subframe ? s(n, m0) * c(n, 3) * z(n, m1) : s(n, m1) * c(n, 3) * z(n, m0);
+	ok = sss[2 * n].re == even && sss[2 * n + 1].re == odd && sss[2 * n].im == 0 && sss[2 * n + 1].im == 0;
+      }
+      if (!ok) {
+	fprintf(stderr, "SSS of cell %d in subframe %d wrong\n", cell_id, subframe);
+	exit(1);
+      }
+    }
+  }
+
+  // After noise, or cut that many samples into the frame: just before the
+  // PSS of subframe 0, which has less than a slot before it
+  static const int cases[][4] = { { 6, 128, 0, -1 }, { 6, 128, 301, -1 }, { 15, 256, 107, -1 }, { 25, 384, 503, -1 },
+				  { 6, 128, 12, 400 } };
+  for (auto &c : cases) {
+    int n_prb = c[0], n = c[1], cell_id = c[2], subcarriers = 12 * n_prb, frame = 150 * n;
+    std::uniform_real_distribution<double> uniform(-0.4, 0.4);
+    double delay = uniform(rng), cfo = uniform(rng), noise_variance = 0.1;
+    int offset = c[3] < 0 ? std::uniform_int_distribution<int>(0, frame - 1)(rng) : -c[3];
+    vector<phy_complex> res;
+    auto samples = sync_frame(rng, cell_id, n_prb, n, delay, res);
+    // Noise before and 6 frames with frequency offset and noise
+    std::normal_distribution<float> noise(0, sqrt(noise_variance / 2));
+    vector<phy_complex> stream(std::max(offset, 0) + 6 * frame), out(stream.size());
+    for (size_t t = 0; t < stream.size(); ++t) {
+      std::complex<float> x = 0;
+      if ((int)t >= offset)
+	x = std::complex<float>(samples[(t - offset) % frame].re, samples[(t - offset) % frame].im);
+      x = x * (std::complex<float>)std::polar(1.0, 2 * M_PI * cfo * t / n) + std::complex<float>(noise(rng), noise(rng));
+      stream[t] = { x.real(), x.imag() };
+    }
+    PHY_SYNC *sync = phy_sync_init(n);
+    for (size_t t = 0; t < stream.size(); ) {
+      int size = std::min<int>(std::uniform_int_distribution<int>(1, 3000)(rng), stream.size() - t);
+      phy_sync_process(sync, stream.data() + t, size, out.data() + t);
+      t += size;
+    }
+    phy_sync_state state;
+    phy_sync_get(sync, &state);
+    bool ok = state.cell_id == cell_id && (state.frame_start - offset) % frame == 0 &&
+      fabs(state.timing - delay) < 0.1 && fabs(state.cfo - cfo) < 0.01;
+
+    // Resource elements of the last frame back within the noise, but for
+    // a phase of each symbol that channel estimation would take off
+    int64_t start = state.frame_start + (stream.size() - state.frame_start) / frame * frame - frame;
+    PHY_OFDM *ofdm = phy_ofdm_init(n_prb, n, 0);
+    vector<phy_complex> back(res.size());
+    for (int subframe = 0; subframe < 10 && ok; ++subframe) {
+      phy_complex *grid = back.data() + subframe * subcarriers * PHY_SYMBOLS_PER_SUBFRAME;
+      phy_ofdm_demodulate(ofdm, out.data() + start + subframe * 15 * n, 0, PHY_SYMBOLS_PER_SUBFRAME, grid);
+      phy_sync_correct(sync, n_prb, grid, PHY_SYMBOLS_PER_SUBFRAME);
+    }
+    for (size_t l = 0; l < res.size() / subcarriers && ok; ++l) {
+      std::complex<double> gain = 0;
+      double power = 0, error = 0;
+      for (int k = 0; k < subcarriers; ++k) {
+	auto &x = res[l * subcarriers + k], &y = back[l * subcarriers + k];
+	gain += std::complex<double>(y.re, y.im) * std::complex<double>(x.re, -x.im);
+	power += x.re * x.re + x.im * x.im;
+      }
+      gain /= power;
+      for (int k = 0; k < subcarriers; ++k) {
+	auto &x = res[l * subcarriers + k], &y = back[l * subcarriers + k];
+	error += std::norm(std::complex<double>(y.re, y.im) - gain * std::complex<double>(x.re, x.im));
+      }
+      ok = error / power < 0.15;
+    }
+    if (!ok) {
+      fprintf(stderr, "Sync to cell %d of %d RBs with FFT size %d: cell %d, frame start %lld, timing %g, cfo %g "
+	      "against %d, %g, %g\n", cell_id, n_prb, n, state.cell_id, (long long)state.frame_start, state.timing,
+	      state.cfo, offset, delay, cfo);
+      exit(1);
+    }
+    phy_ofdm_free(ofdm);
+    phy_sync_free(sync);
+  }
+
+  // Noise alone finds no cell
+  PHY_SYNC *sync = phy_sync_init(128);
+  auto noise = random_symbols(rng, 2 * 150 * 128);
+  vector<phy_complex> out(noise.size());
+  phy_sync_state state;
+  phy_sync_process(sync, noise.data(), noise.size(), out.data());
+  phy_sync_get(sync, &state);
+  if (state.cell_id != -1) {
+    fprintf(stderr, "Sync found cell %d in noise\n", state.cell_id);
+    exit(1);
+  }
+  phy_sync_free(sync);
+  if (phy_sync_init(640) || errno != EINVAL) {
+    fprintf(stderr, "Sync with FFT size 640 accepted\n");
+    exit(1);
+  }
+}
+
+static void
+bench_sync(bench &b) {
+  check_sync();
+  std::mt19937 rng(21);
+  // A subframe of samples at a time, searching noise or tracking a cell
+  for (int n : { 128, 256, 512 }) {
+    vector<phy_complex> res;
+    auto frame = sync_frame(rng, 1, n == 128 ? 6 : n == 256 ? 15 : 25, n, 0, res);
+    auto noise = random_symbols(rng, 15 * n);
+    vector<phy_complex> out(15 * n);
+    PHY_SYNC *sync = phy_sync_init(n);
+    b.run(str(format("sync/search/n=%d/subframe") % n), [&]() {
+	bench_keep(phy_sync_process(sync, noise.data(), 15 * n, out.data()));
+      });
+    phy_sync_free(sync);
+    sync = phy_sync_init(n);
+    int subframe = 0;
+    b.run(str(format("sync/track/n=%d/subframe") % n), [&]() {
+	bench_keep(phy_sync_process(sync, frame.data() + subframe * 15 * n, 15 * n, out.data()));
+	subframe = (subframe + 1) % 10;
+      });
+    phy_sync_free(sync);
+  }
+}
+
+/******
+ ** Channel estimation
+ **/
+
+// A subframe of QPSK with the CRS of port 0 through a channel linear in
+// time and close to linear in frequency, and noise. The channel goes to h.
+static vector<phy_complex>
+estimation_subframe(std::mt19937 &rng, PHY_RE_MAP *map, PHY_SCRAMBLING *scrambling, int n_prb, int subframe,
+		    double noise_variance, vector<phy_complex> &res, vector<std::complex<float>> &h) {
+  const int subcarriers = 12 * n_prb, stride = (4 * n_prb + 7) / 8;
+  std::uniform_int_distribution<int> bit(0, 1);
+  res.resize(subcarriers * PHY_SYMBOLS_PER_SUBFRAME);
+  for (auto &x : res)
+    x = { (1 - 2 * bit(rng)) * (float)M_SQRT1_2, (1 - 2 * bit(rng)) * (float)M_SQRT1_2 };
+  vector<phy_complex> crs(8 * n_prb);
+  const uint8_t *sequence = phy_scrambling_get(scrambling, PHY_SCRAMBLING_CRS, subframe, NULL);
+  for (int r = 0; r < 4; ++r)
+    phy_modulate(2, sequence + r * stride, 4 * n_prb, crs.data() + 2 * n_prb * r);
+  phy_map_channel(map, PHY_RE_CRS, subframe, crs.data(), res.data());
+
+  std::normal_distribution<float> normal(0, 1), noise(0, sqrt(noise_variance / 2));
+  std::complex<float> a[2], b[2];
+  for (int i = 0; i < 2; ++i) {
+    a[i] = std::complex<float>(normal(rng), normal(rng));
+    b[i] = 0.3f * std::complex<float>(normal(rng), normal(rng));
+  }
+  h.resize(res.size());
+  vector<phy_complex> y(res.size());
+  for (int l = 0; l < PHY_SYMBOLS_PER_SUBFRAME; ++l)
+    for (int k = 0; k < subcarriers; ++k) {
+      float t = l / 13.0f;
+      int i = l * subcarriers + k;
+      h[i] = a[0] + t * (a[1] - a[0]) + (b[0] + t * (b[1] - b[0])) * std::polar(1.0f, (float)(-2 * M_PI * 0.002 * k));
+      auto v = h[i] * std::complex<float>(res[i].re, res[i].im) + std::complex<float>(noise(rng), noise(rng));
+      y[i] = { v.real(), v.imag() };
+    }
+  return y;
+}
+
+static void
+check_estimation() {
+  std::mt19937 rng(22);
+  for (int n_prb : { 6, 15, 100 })
+    for (int taps : { 1, 5 })
+      for (int time_filter : { PHY_ESTIMATOR_HOLD, PHY_ESTIMATOR_LINEAR }) {
+	int cell_id = (7 * n_prb + taps) % 504, subframe = n_prb % 10, subcarriers = 12 * n_prb;
+	PHY_RE_MAP *map = phy_re_map_init(cell_id, n_prb, 1, PHY_PHICH_NG_1, 1);
+	PHY_SCRAMBLING *scrambling = phy_scrambling_init(cell_id, n_prb);
+	PHY_ESTIMATOR *estimator = phy_estimator_init(cell_id, n_prb, taps, time_filter);
+	vector<phy_complex> res, out(subcarriers * PHY_SYMBOLS_PER_SUBFRAME);
+	vector<float> noise_variances(out.size());
+	vector<std::complex<float>> h;
+	const double noise_variance = 0.01;
+	auto y = estimation_subframe(rng, map, scrambling, n_prb, subframe, noise_variance, res, h);
+
+	// Symbol by symbol ends up where the whole subframe does
+	bool ok = true;
+	for (int n = 1; n <= PHY_SYMBOLS_PER_SUBFRAME && ok; ++n)
+	  ok = !phy_estimate_channel(estimator, subframe, y.data(), n) &&
+	    !phy_equalize(estimator, PHY_EQUALIZE_ZF, y.data(), n - 1, 1, out.data(), noise_variances.data());
+	PHY_ESTIMATOR *whole = phy_estimator_init(cell_id, n_prb, taps, time_filter);
+	ok = ok && !phy_estimate_channel(whole, subframe, y.data(), PHY_SYMBOLS_PER_SUBFRAME);
+	for (int l = 0; l < PHY_SYMBOLS_PER_SUBFRAME && ok; ++l)
+	  ok = !memcmp(phy_estimator_channel(estimator, l), phy_estimator_channel(whole, l),
+		       subcarriers * sizeof(phy_complex));
+	phy_estimator_free(whole);
+
+	// The noise estimate, and the noise left on data close to what ZF
+	// says it is once the subframe is in. Holding misses the fading.
+	float estimate = phy_estimator_noise_variance(estimator);
+	ok = ok && estimate > 0.7 * noise_variance && estimate < 1.4 * noise_variance;
+	if (time_filter == PHY_ESTIMATOR_LINEAR) {
+	  phy_equalize(estimator, PHY_EQUALIZE_ZF, y.data(), 0, PHY_SYMBOLS_PER_SUBFRAME, out.data(),
+		       noise_variances.data());
+	  // Relative to what is reported for each, as fades dominate sums
+	  double error = 0;
+	  for (size_t i = 0; i < res.size(); ++i)
+	    error += std::norm(std::complex<float>(out[i].re - res[i].re, out[i].im - res[i].im)) / noise_variances[i];
+	  error /= res.size();
+	  ok = ok && error < 1.5 && error > 0.4;
+	}
+
+	// Without noise on a flat channel both equalize exactly
+	y = estimation_subframe(rng, map, scrambling, n_prb, subframe, 0, res, h);
+	for (size_t i = 0; i < y.size(); ++i) {
+	  auto v = (h[0] + 0.0f * h[i]) * std::complex<float>(res[i].re, res[i].im);
+	  y[i] = { v.real(), v.imag() };
+	}
+	ok = ok && !phy_estimate_channel(estimator, subframe, y.data(), PHY_SYMBOLS_PER_SUBFRAME) &&
+	  phy_estimator_noise_variance(estimator) < 1e-8;
+	for (int mode : { PHY_EQUALIZE_ZF, PHY_EQUALIZE_MMSE }) {
+	  ok = ok && !phy_equalize(estimator, mode, y.data(), 0, PHY_SYMBOLS_PER_SUBFRAME, out.data(), NULL);
+	  for (size_t i = 0; i < res.size() && ok; ++i)
+	    ok = fabsf(out[i].re - res[i].re) < 1e-4 && fabsf(out[i].im - res[i].im) < 1e-4;
+	}
+	if (!ok) {
+	  fprintf(stderr, "Channel estimation of %d RBs with %d taps and filter %d wrong, noise variance %g\n", n_prb,
+		  taps, time_filter, estimate);
+	  exit(1);
+	}
+	phy_estimator_free(estimator);
+	phy_scrambling_free(scrambling);
+	phy_re_map_free(map);
+      }
+  PHY_ESTIMATOR *estimator = phy_estimator_init(1, 25, 5, PHY_ESTIMATOR_LINEAR);
+  vector<phy_complex> res(12 * 25 * PHY_SYMBOLS_PER_SUBFRAME);
+  phy_estimate_channel(estimator, 0, res.data(), 4);
+  if (phy_estimator_init(1, 25, 4, PHY_ESTIMATOR_HOLD) || errno != EINVAL ||
+      phy_equalize(estimator, PHY_EQUALIZE_ZF, res.data(), 3, 2, res.data(), NULL) != -1 || errno != EINVAL) {
+    fprintf(stderr, "Channel estimation accepted even taps or symbols not estimated\n");
+    exit(1);
+  }
+  phy_estimator_free(estimator);
+}
+
+static void
+bench_estimation(bench &b) {
+  check_estimation();
+  std::mt19937 rng(23);
+  for (int n_prb : { 25, 100 }) {
+    const int subframe = 1;
+    PHY_RE_MAP *map = phy_re_map_init(1, n_prb, 1, PHY_PHICH_NG_1, 1);
+    PHY_SCRAMBLING *scrambling = phy_scrambling_init(1, n_prb);
+    PHY_ESTIMATOR *estimator = phy_estimator_init(1, n_prb, 5, PHY_ESTIMATOR_LINEAR);
+    vector<phy_complex> res;
+    vector<std::complex<float>> h;
+    auto y = estimation_subframe(rng, map, scrambling, n_prb, subframe, 0.01, res, h);
+    vector<phy_complex> out(y.size());
+    vector<float> noise_variances(y.size());
+    b.run(str(format("estimation/estimate/n_prb=%d/subframe") % n_prb), [&]() {
+	bench_keep(phy_estimate_channel(estimator, subframe, y.data(), PHY_SYMBOLS_PER_SUBFRAME));
+      });
+    phy_estimate_channel(estimator, subframe, y.data(), PHY_SYMBOLS_PER_SUBFRAME);
+    for (int mode : { PHY_EQUALIZE_ZF, PHY_EQUALIZE_MMSE })
+      b.run(str(format("estimation/equalize/%s/n_prb=%d/subframe") % (mode ? "mmse" : "zf") % n_prb), [&]() {
+	  bench_keep(phy_equalize(estimator, mode, y.data(), 0, PHY_SYMBOLS_PER_SUBFRAME, out.data(),
+				  noise_variances.data()));
+	});
+    // As received, estimating and equalizing each symbol when it comes
+    b.run(str(format("estimation/per_symbol/n_prb=%d/subframe") % n_prb), [&]() {
+	for (int l = 0; l < PHY_SYMBOLS_PER_SUBFRAME; ++l) {
+	  phy_estimate_channel(estimator, subframe, y.data(), l + 1);
+	  bench_keep(phy_equalize(estimator, PHY_EQUALIZE_ZF, y.data(), l, 1, out.data(), noise_variances.data()));
+	}
+      });
+    phy_estimator_free(estimator);
+    phy_scrambling_free(scrambling);
+    phy_re_map_free(map);
+  }
+}
+
+int
+main(int argc, char **argv) {
+  bench b(argc, argv);
+  bench_dci(b);
+  bench_scrambling(b);
+  bench_crc(b);
+  bench_turbo(b);
+  bench_turbo_decode(b);
+  bench_conv(b);
+  bench_modulation(b);
+  bench_ofdm(b);
+  bench_re_map(b);
+  bench_pdcch(b);
+  bench_sync(b);
+  bench_estimation(b);
+  return 0;
+}
@@ -0,0 +1,134 @@
+// Packed bits, most significant bit first, and bits one per byte as 0 or 1
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "cpu.hh"
+
+// n bits of in from bit first on to out. Reads the byte after the last one.
+static inline void
+phy_copy_bits(uint8_t *out, const uint8_t *in, int first, int n) {
+  int shift = first % 8;
+  in += first / 8;
+  for (int i = 0; i < (n + 7) / 8; ++i)
+    out[i] = shift ? in[i] << shift | in[i + 1] >> (8 - shift) : in[i];
+}
+
+// Eight bits of one byte each to a byte and back, by multiplication
+static inline uint8_t
+phy_pack8(uint64_t bits) {
+  return (bits * 0x8040201008040201ull) >> 56;
+}
+
+static inline uint8_t
+phy_pack8(const uint8_t *in) {
+  uint64_t bits;
+  memcpy(&bits, in, 8);
+  return phy_pack8(bits);
+}
+
+static inline void
+phy_unpack8(uint8_t *out, uint8_t byte) {
+  uint64_t bits = (byte * 0x0101010101010101ull) & 0x0102040810204080ull;
+  bits = ((bits + 0x7f7f7f7f7f7f7f7full) >> 7) & 0x0101010101010101ull;
+  memcpy(out, &bits, 8);
+}
+
+#ifdef CPU_X86
+__attribute__((target("avx2"))) static inline void
+phy_pack_bits_avx2(uint8_t *out, const uint8_t *in, int n) {
+  const __m256i reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+					   7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  for (int i = 0; i < n; i += 32) {
+    __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(in + i)), reverse);
+    uint32_t mask = _mm256_movemask_epi8(_mm256_slli_epi16(v, 7));
+    memcpy(out + i / 8, &mask, 4);
+  }
+}
+
+__attribute__((target("avx2"))) static inline void
+phy_unpack_bits_avx2(uint8_t *out, const uint8_t *in, int n) {
+  const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+					  2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+  const __m256i bit = _mm256_set1_epi64x(0x0102040810204080);
+  for (int i = 0; i < n; i += 32) {
+    uint32_t bytes;
+    memcpy(&bytes, in + i / 8, 4);
+    __m256i v = _mm256_and_si256(_mm256_shuffle_epi8(_mm256_set1_epi32(bytes), spread), bit);
+    _mm256_storeu_si256((__m256i *)(out + i), _mm256_and_si256(_mm256_cmpeq_epi8(v, bit), _mm256_set1_epi8(1)));
+  }
+}
+#endif
+
+// n bytes of 0 or 1 to (n + 7) / 8 bytes. Bits after n in the last byte are cleared.
+static inline void
+phy_pack_bits(uint8_t *out, const uint8_t *in, int n) {
+  int i = 0;
+#ifdef CPU_X86
+  if (n >= 64 && cpu_has(CPU_AVX2)) {
+    i = n & ~31;
+    phy_pack_bits_avx2(out, in, i);
+  }
+#endif
+  for (; i + 8 <= n; i += 8)
+    out[i / 8] = phy_pack8(in + i);
+  if (i < n) {
+    uint8_t last = 0;
+    for (int k = 0; i + k < n; ++k)
+      last |= in[i + k] << (7 - k);
+    out[i / 8] = last;
+  }
+}
+
+static inline void
+phy_unpack_bits(uint8_t *out, const uint8_t *in, int n) {
+  int i = 0;
+#ifdef CPU_X86
+  if (n >= 64 && cpu_has(CPU_AVX2)) {
+    i = n & ~31;
+    phy_unpack_bits_avx2(out, in, i);
+  }
+#endif
+  for (; i + 8 <= n; i += 8)
+    phy_unpack8(out + i, in[i / 8]);
+  for (; i < n; ++i)
+    out[i] = (in[i / 8] >> (7 - i % 8)) & 1;
+}
+
+// Bits of in from bit first on, the first one on top. The top 57 are
+// valid; reads the eight bytes from first / 8.
+static inline uint64_t
+phy_read_bits(const uint8_t *in, int first) {
+  uint64_t word;
+  memcpy(&word, in + first / 8, 8);
+  return __builtin_bswap64(word) << first % 8;
+}
+
+// Appends to packed bits. Each append stores eight bytes from the current
+// one, with the bits after the last one cleared, so out needs eight bytes
+// to spare.
+struct phy_bit_writer {
+  uint8_t *out;
+  uint64_t bits = 0;           // Pending bits of the current byte, on top
+  int n = 0;
+
+  explicit phy_bit_writer(uint8_t *out) : out(out) {}
+  // count up to 56 bits on top of word, the rest zero
+  void put(uint64_t word, int count) {
+    bits |= word >> n;
+    n += count;
+    uint64_t be = __builtin_bswap64(bits);
+    memcpy(out, &be, 8);
+    out += n / 8;
+    bits <<= n & ~7;
+    n %= 8;
+  }
+  // count bits of in from bit first on
+  void copy(const uint8_t *in, int first, int count) {
+    for (; count > 0; first += 56, count -= 56) {
+      int chunk = count < 56 ? count : 56;
+      put(phy_read_bits(in, first) & ~(~0ull >> chunk), chunk);
+    }
+  }
+};
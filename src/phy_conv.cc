@@ -0,0 +1,333 @@
+/*
+   Implement tail-biting convolutional coding of 3GPP LTE PHY, 36.212
+   5.1.3.1 and the rate matching of 5.1.4.2, for PBCH and PDCCH
+
+   Decoding sums repeated LLRs back into the three streams and runs a
+   Viterbi decoder over the code block with PHY_CONV_WRAP steps of it
+   before and after, so that it starts and ends in the right states without
+   knowing them. Candidates of the same size are decoded side by side, one
+   per 16-bit lane, so add-compare-select has no shuffles and a batch of 16
+   costs about what one would. A lone candidate has its 64 states across
+   the lanes instead.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "phy.h"
+#include "cpu.hh"
+#include "phy_bits.hh"
+
+#define PHY_CONV_STATES 64
+// Steps decoded on both sides of the code block
+#define PHY_CONV_WRAP 32
+#define PHY_CONV_STEPS (PHY_CONV_MAX_SIZE + 2 * PHY_CONV_WRAP)
+// Summed LLRs are scaled down to this so that path metrics fit 16 bits
+#define PHY_CONV_LLR_MAX 511
+// Candidates decoded at once
+#define PHY_CONV_LANES 16
+
+/******
+ ** Encoding
+ **/
+
+// G0 = 133, G1 = 171 and G2 = 165 octal with c(k - i) at bit i
+static const uint8_t phy_conv_generators[3] = { 0x6d, 0x4f, 0x57 };
+
+// The three output bits of each register of c(k) and the state, its 6
+// previous bits, as bits 0 .. 2
+struct phy_conv_table {
+  uint8_t out[2 * PHY_CONV_STATES];
+  constexpr phy_conv_table() : out() {
+    for (int r = 0; r < 2 * PHY_CONV_STATES; ++r)
+      for (int i = 0; i < 3; ++i)
+	out[r] |= __builtin_parity(r & phy_conv_generators[i]) << i;
+  }
+};
+static constexpr phy_conv_table phy_conv_lut;
+
+// Column permutation of the sub-block interleaver, Table 5.1.4-2
+static const uint8_t phy_conv_permutation[32] = {
+  1, 17, 9, 25, 5, 21, 13, 29, 3, 19, 11, 27, 7, 23, 15, 31,
+  0, 16, 8, 24, 4, 20, 12, 28, 2, 18, 10, 26, 6, 22, 14, 30
+};
+
+// Circular buffer of 3 * k bits without <NULL> bits, as indexes to the
+// streams d(s)_k at s * k + k
+static void
+phy_conv_order(int k, uint16_t *order) {
+  int rows = (k + 31) / 32, nulls = 32 * rows - k, n = 0;
+  for (int s = 0; s < 3; ++s)
+    for (int column = 0; column < 32; ++column)
+      for (int y = phy_conv_permutation[column]; y < 32 * rows; y += 32)
+	if (y >= nulls)
+	  order[n++] = s * k + y - nulls;
+}
+
+int
+phy_conv_encode(const void *in, int size_in_bits, int e, void *out) {
+  int k = size_in_bits;
+  if (k < 6 || k > PHY_CONV_MAX_SIZE || e < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  uint8_t c[PHY_CONV_MAX_SIZE], d[3 * PHY_CONV_MAX_SIZE], w[3 * PHY_CONV_MAX_SIZE], bits[8 * 64];
+  uint16_t order[3 * PHY_CONV_MAX_SIZE];
+  phy_unpack_bits(c, (const uint8_t *)in, k);
+  // Tail-biting: the register starts with the last 6 bits
+  int state = 0;
+  for (int i = k - 6; i < k; ++i)
+    state = (state << 1 | c[i]) & (PHY_CONV_STATES - 1);
+  for (int i = 0; i < k; ++i) {
+    int r = c[i] | state << 1, o = phy_conv_lut.out[r];
+    d[i] = o & 1;
+    d[k + i] = (o >> 1) & 1;
+    d[2 * k + i] = o >> 2;
+    state = r & (PHY_CONV_STATES - 1);
+  }
+  phy_conv_order(k, order);
+  for (int i = 0; i < 3 * k; ++i)
+    w[i] = d[order[i]];
+  // Bit selection, repeating the circular buffer, a chunk at a time
+  uint8_t *o = (uint8_t *)out;
+  for (int i = 0, j = 0; i < e; i += sizeof(bits)) {
+    int n = std::min(e - i, (int)sizeof(bits));
+    for (int m = 0; m < n; ) {
+      int run = std::min(n - m, 3 * k - j);
+      memcpy(bits + m, w + j, run);
+      m += run;
+      j = (j + run) % (3 * k);
+    }
+    phy_pack_bits(o + i / 8, bits, n);
+  }
+  return e;
+}
+
+/******
+ ** Viterbi decoding
+ **
+ ** State n holds c(k - 1) at bit 0. It is reached from n >> 1 and
+ ** n >> 1 | 32 with c(k) = n & 1, and as all generators tap both c(k) and
+ ** c(k - 6), the branch from n >> 1 | 32 and the one into n ^ 1 have the
+ ** opposite outputs. A butterfly j thus makes states 2j and 2j + 1 from j
+ ** and j + 32 with one branch metric.
+ **/
+
+// Soft bits of one candidate: sums of its LLRs in the three streams
+static void
+phy_conv_dematch(const int8_t *llrs, int e, int k, const uint16_t *order, int16_t *soft, int stride) {
+  int sums[3 * PHY_CONV_MAX_SIZE] = { 0 }, largest = 0;
+  for (int i = 0, j = 0; i < e; ++i) {
+    sums[order[j]] += llrs[i];
+    if (++j == 3 * k)
+      j = 0;
+  }
+  for (int i = 0; i < 3 * k; ++i)
+    largest = std::max(largest, std::abs(sums[i]));
+  int shift = 0;
+  while (largest >> shift > PHY_CONV_LLR_MAX)
+    ++shift;
+  for (int i = 0; i < 3 * k; ++i)
+    soft[i * stride] = sums[i] >> shift;
+}
+
+// Step t of the decoder is bit (t - PHY_CONV_WRAP) mod k
+static inline int
+phy_conv_bit(int t, int k) {
+  return (t + k * ((PHY_CONV_WRAP + k - 1) / k) - PHY_CONV_WRAP) % k;
+}
+
+// From the best state at the end back to the first step of the code block.
+// Whether state n of step t came from n >> 1 | 32 is decision(t, n).
+template<typename Decision> static void
+phy_conv_traceback(Decision decision, int k, int state, uint8_t *out) {
+  uint8_t bits[PHY_CONV_MAX_SIZE];
+  for (int t = k + 2 * PHY_CONV_WRAP - 1; t >= PHY_CONV_WRAP; --t) {
+    if (t < PHY_CONV_WRAP + k)
+      bits[t - PHY_CONV_WRAP] = state & 1;
+    state = state >> 1 | decision(t, state) << 5;
+  }
+  phy_pack_bits(out, bits, k);
+}
+
+// One candidate with soft bits at soft[i]
+static void
+phy_conv_viterbi(const int16_t *soft, int k, uint8_t *out) {
+  uint8_t decisions[PHY_CONV_STEPS * PHY_CONV_STATES];
+  int metrics[PHY_CONV_STATES] = { 0 }, next[PHY_CONV_STATES];
+  for (int t = 0; t < k + 2 * PHY_CONV_WRAP; ++t) {
+    int i = phy_conv_bit(t, k), l[3] = { soft[i], soft[k + i], soft[2 * k + i] };
+    for (int j = 0; j < PHY_CONV_STATES / 2; ++j) {
+      int o = phy_conv_lut.out[2 * j], m = 0;
+      for (int s = 0; s < 3; ++s)
+	m += (o >> s) & 1 ? -l[s] : l[s];
+      int a = metrics[j], c = metrics[j + 32];
+      next[2 * j] = std::max(a + m, c - m);
+      next[2 * j + 1] = std::max(a - m, c + m);
+      decisions[t * PHY_CONV_STATES + 2 * j] = c - m > a + m;
+      decisions[t * PHY_CONV_STATES + 2 * j + 1] = c + m > a - m;
+    }
+    std::copy(next, next + PHY_CONV_STATES, metrics);
+  }
+  int best = std::max_element(metrics, metrics + PHY_CONV_STATES) - metrics;
+  phy_conv_traceback([&](int t, int n) { return decisions[t * PHY_CONV_STATES + n]; }, k, best, out);
+}
+
+#ifdef CPU_X86
+// Signs of the LLRs of the three streams in the branch metric of each
+// butterfly
+struct phy_conv_sign_table {
+  int16_t sign[3][PHY_CONV_STATES / 2];
+  constexpr phy_conv_sign_table() : sign() {
+    for (int s = 0; s < 3; ++s)
+      for (int j = 0; j < PHY_CONV_STATES / 2; ++j)
+	sign[s][j] = (phy_conv_lut.out[2 * j] >> s) & 1 ? -1 : 1;
+  }
+};
+static constexpr phy_conv_sign_table phy_conv_signs;
+
+// PHY_CONV_LANES candidates with soft bits at soft[PHY_CONV_LANES * i + lane]
+__attribute__((target("avx2"))) static void
+phy_conv_viterbi_avx2(const int16_t *soft, int k, int lanes, uint8_t *out, int out_stride) {
+  // Butterflies of each step, with lanes 0 .. 7 of state 2j in bits 0 .. 7,
+  // of 2j + 1 in bits 8 .. 15, and lanes 8 .. 15 likewise from bit 16
+  uint32_t decisions[PHY_CONV_STEPS * PHY_CONV_STATES / 2];
+  __m256i buffers[2][PHY_CONV_STATES], *metrics = buffers[0], *next = buffers[1];
+  for (int n = 0; n < PHY_CONV_STATES; ++n)
+    metrics[n] = _mm256_setzero_si256();
+  for (int t = 0; t < k + 2 * PHY_CONV_WRAP; ++t) {
+    int i = phy_conv_bit(t, k);
+    __m256i l0 = _mm256_loadu_si256((const __m256i *)(soft + PHY_CONV_LANES * i));
+    __m256i l1 = _mm256_loadu_si256((const __m256i *)(soft + PHY_CONV_LANES * (k + i)));
+    __m256i l2 = _mm256_loadu_si256((const __m256i *)(soft + PHY_CONV_LANES * (2 * k + i)));
+    // Branch metrics of the 8 outputs, the last 4 negating the first
+    __m256i bm[8];
+    bm[0] = _mm256_add_epi16(_mm256_add_epi16(l0, l1), l2);
+    bm[1] = _mm256_add_epi16(_mm256_sub_epi16(l1, l0), l2);
+    bm[2] = _mm256_add_epi16(_mm256_sub_epi16(l0, l1), l2);
+    bm[3] = _mm256_sub_epi16(l2, _mm256_add_epi16(l0, l1));
+    for (int o = 0; o < 4; ++o)
+      bm[7 - o] = _mm256_sub_epi16(_mm256_setzero_si256(), bm[o]);
+    uint32_t *decision = decisions + t * PHY_CONV_STATES / 2;
+#pragma GCC unroll 32
+    for (int j = 0; j < PHY_CONV_STATES / 2; ++j) {
+      __m256i m = bm[phy_conv_lut.out[2 * j]], a = metrics[j], c = metrics[j + 32];
+      __m256i a0 = _mm256_adds_epi16(a, m), c0 = _mm256_subs_epi16(c, m);
+      __m256i a1 = _mm256_subs_epi16(a, m), c1 = _mm256_adds_epi16(c, m);
+      next[2 * j] = _mm256_max_epi16(a0, c0);
+      next[2 * j + 1] = _mm256_max_epi16(a1, c1);
+      decision[j] = _mm256_movemask_epi8(_mm256_packs_epi16(_mm256_cmpgt_epi16(c0, a0), _mm256_cmpgt_epi16(c1, a1)));
+    }
+    // Keep metrics near 0 by subtracting those of state 0 every few steps
+    if (t % 8 == 7) {
+      __m256i base = next[0];
+      for (int n = 0; n < PHY_CONV_STATES; ++n)
+	next[n] = _mm256_subs_epi16(next[n], base);
+    }
+    std::swap(metrics, next);
+  }
+  int16_t ends[PHY_CONV_STATES][PHY_CONV_LANES];
+  memcpy(ends, metrics, sizeof(ends));
+  for (int lane = 0; lane < lanes; ++lane) {
+    int best = 0;
+    for (int n = 1; n < PHY_CONV_STATES; ++n)
+      if (ends[n][lane] > ends[best][lane])
+	best = n;
+    int bit = lane % 8 + (lane / 8) * 16;
+    phy_conv_traceback([&](int t, int n) { return (decisions[t * PHY_CONV_STATES / 2 + n / 2] >> (bit + (n & 1) * 8)) & 1; },
+		       k, best, out + lane * out_stride);
+  }
+}
+
+// One candidate with soft bits at soft[i], its states across the lanes of
+// four registers. Butterflies 0 .. 15 make states 0 .. 31 from the first
+// and third register, 16 .. 31 the rest from the second and fourth.
+__attribute__((target("avx2"))) static void
+phy_conv_viterbi_states_avx2(const int16_t *soft, int k, uint8_t *out) {
+  // Butterflies of each step in two halves, with the bits of the 16
+  // butterflies of a half laid out as the lanes of phy_conv_viterbi_avx2
+  uint32_t decisions[PHY_CONV_STEPS][2];
+  __m256i signs[3][2], metrics[4], next[4];
+  for (int s = 0; s < 3; ++s)
+    for (int h = 0; h < 2; ++h)
+      signs[s][h] = _mm256_loadu_si256((const __m256i *)(phy_conv_signs.sign[s] + 16 * h));
+  for (int n = 0; n < 4; ++n)
+    metrics[n] = _mm256_setzero_si256();
+  for (int t = 0; t < k + 2 * PHY_CONV_WRAP; ++t) {
+    int i = phy_conv_bit(t, k);
+    __m256i l0 = _mm256_set1_epi16(soft[i]), l1 = _mm256_set1_epi16(soft[k + i]), l2 = _mm256_set1_epi16(soft[2 * k + i]);
+    for (int h = 0; h < 2; ++h) {
+      __m256i m = _mm256_add_epi16(_mm256_add_epi16(_mm256_sign_epi16(l0, signs[0][h]), _mm256_sign_epi16(l1, signs[1][h])),
+				   _mm256_sign_epi16(l2, signs[2][h]));
+      __m256i a = metrics[h], c = metrics[h + 2];
+      __m256i a0 = _mm256_adds_epi16(a, m), c0 = _mm256_subs_epi16(c, m);
+      __m256i a1 = _mm256_subs_epi16(a, m), c1 = _mm256_adds_epi16(c, m);
+      __m256i even = _mm256_max_epi16(a0, c0), odd = _mm256_max_epi16(a1, c1);
+      decisions[t][h] = _mm256_movemask_epi8(_mm256_packs_epi16(_mm256_cmpgt_epi16(c0, a0), _mm256_cmpgt_epi16(c1, a1)));
+      // States 2j and 2j + 1 next to each other again
+      __m256i lo = _mm256_unpacklo_epi16(even, odd), hi = _mm256_unpackhi_epi16(even, odd);
+      next[2 * h] = _mm256_permute2x128_si256(lo, hi, 0x20);
+      next[2 * h + 1] = _mm256_permute2x128_si256(lo, hi, 0x31);
+    }
+    if (t % 8 == 7) {
+      __m256i base = _mm256_broadcastw_epi16(_mm256_castsi256_si128(next[0]));
+      for (int n = 0; n < 4; ++n)
+	next[n] = _mm256_subs_epi16(next[n], base);
+    }
+    std::copy(next, next + 4, metrics);
+  }
+  int16_t ends[PHY_CONV_STATES];
+  memcpy(ends, metrics, sizeof(ends));
+  int best = std::max_element(ends, ends + PHY_CONV_STATES) - ends;
+  phy_conv_traceback([&](int t, int n) {
+      int j = n / 2 % 16;
+      return (decisions[t][n / 32] >> (j % 8 + (j / 8) * 16 + (n & 1) * 8)) & 1;
+    }, k, best, out);
+}
+#endif
+
+int
+phy_conv_decode_batch(const int8_t *const *llrs, const int *e, int n, int size_in_bits, void *out) {
+  int k = size_in_bits, out_stride = (k + 7) / 8;
+  if (k < 6 || k > PHY_CONV_MAX_SIZE || n < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  uint16_t order[3 * PHY_CONV_MAX_SIZE];
+  phy_conv_order(k, order);
+  uint8_t *o = (uint8_t *)out;
+#ifdef CPU_X86
+  if (cpu_has(CPU_AVX2)) {
+    int16_t soft[3 * PHY_CONV_MAX_SIZE * PHY_CONV_LANES];
+    for (int first = 0; first < n; first += PHY_CONV_LANES) {
+      int lanes = std::min(n - first, PHY_CONV_LANES);
+      // A lone candidate, as for phy_conv_decode(), is not worth clearing
+      // and running 16 lanes for
+      if (lanes == 1) {
+	phy_conv_dematch(llrs[first], e[first], k, order, soft, 1);
+	phy_conv_viterbi_states_avx2(soft, k, o + first * out_stride);
+	break;
+      }
+      if (lanes < PHY_CONV_LANES)
+	memset(soft, 0, sizeof(soft));
+      for (int lane = 0; lane < lanes; ++lane)
+	phy_conv_dematch(llrs[first + lane], e[first + lane], k, order, soft + lane, PHY_CONV_LANES);
+      phy_conv_viterbi_avx2(soft, k, lanes, o + first * out_stride, out_stride);
+    }
+    return n;
+  }
+#endif
+  int16_t soft[3 * PHY_CONV_MAX_SIZE];
+  for (int i = 0; i < n; ++i) {
+    phy_conv_dematch(llrs[i], e[i], k, order, soft, 1);
+    phy_conv_viterbi(soft, k, o + i * out_stride);
+  }
+  return n;
+}
+
+int
+phy_conv_decode(const int8_t *llrs, int e, int size_in_bits, void *out) {
+  return phy_conv_decode_batch(&llrs, &e, 1, size_in_bits, out) < 0 ? -1 : 0;
+}
@@ -0,0 +1,173 @@
+/*
+   Implement CRC attachment of 3GPP LTE PHY, 36.212 5.1.1
+
+   The register is kept left aligned in 32 bits for every CRC size, so one
+   slice-by-8 loop serves them all. With PCLMULQDQ whole 16-byte blocks are
+   first folded into a 128-bit remainder congruent to them modulo the
+   generator, and that remainder is run through the tables instead: a CRC
+   starting from zero only depends on the message modulo the generator.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+
+#include "phy.h"
+#include "cpu.hh"
+
+#define PHY_CRCS 4
+
+struct phy_crc_lut {
+  int size;
+  uint32_t poly;          // Generator without D^size, left aligned
+  uint32_t t[8][256];     // t[k][b]: byte b followed by k zero bytes
+  uint64_t fold[4];       // D^128, D^192, D^512 and D^576 modulo the generator
+
+  constexpr phy_crc_lut(int size, uint32_t generator) : size(size), poly(generator << (32 - size)), t(), fold() {
+    for (unsigned b = 0; b < 256; ++b) {
+      uint32_t crc = b << 24;
+      for (int k = 0; k < 8; ++k)
+	crc = (crc << 1) ^ (crc & 0x80000000 ? poly : 0);
+      t[0][b] = crc;
+    }
+    for (int k = 1; k < 8; ++k)
+      for (unsigned b = 0; b < 256; ++b)
+	t[k][b] = (t[k - 1][b] << 8) ^ t[0][t[k - 1][b] >> 24];
+    const int powers[4] = { 128, 192, 512, 576 };
+    for (int i = 0; i < 4; ++i) {
+      uint64_t r = 1;
+      for (int d = 0; d < powers[i]; ++d) {
+	r <<= 1;
+	if (r >> size & 1)
+	  r ^= (1ull << size) | generator;
+      }
+      fold[i] = r;
+    }
+  }
+};
+
+static constexpr phy_crc_lut phy_crc_luts[PHY_CRCS] = {
+  { 24, 0x864cfb }, // CRC24A
+  { 24, 0x800063 }, // CRC24B
+  { 16, 0x1021 },   // CRC16
+  { 8, 0x9b },      // CRC8
+};
+
+static inline uint32_t
+phy_load_be32(const uint8_t *p) {
+  uint32_t word;
+  memcpy(&word, p, 4);
+  return __builtin_bswap32(word);
+}
+
+static uint32_t
+phy_crc_bytes(const phy_crc_lut &c, uint32_t crc, const uint8_t *p, size_t n) {
+  for (; n >= 8; n -= 8, p += 8) {
+    uint32_t a = crc ^ phy_load_be32(p);
+    crc = c.t[7][a >> 24] ^ c.t[6][(a >> 16) & 0xff] ^ c.t[5][(a >> 8) & 0xff] ^ c.t[4][a & 0xff]
+      ^ c.t[3][p[4]] ^ c.t[2][p[5]] ^ c.t[1][p[6]] ^ c.t[0][p[7]];
+  }
+  for (; n; --n)
+    crc = (crc << 8) ^ c.t[0][(crc >> 24) ^ *p++];
+  return crc;
+}
+
+#ifdef CPU_X86
+__attribute__((target("pclmul,ssse3"))) static inline __m128i
+phy_crc_load(const uint8_t *p) {
+  const __m128i bswap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p), bswap);
+}
+
+// a times D^128 or D^512 modulo the generator, up to 64 + 24 bits
+__attribute__((target("pclmul,ssse3"))) static inline __m128i
+phy_crc_fold(__m128i a, __m128i k) {
+  return _mm_xor_si128(_mm_clmulepi64_si128(a, k, 0x11), _mm_clmulepi64_si128(a, k, 0x00));
+}
+
+// Register after blocks of 16 bytes
+__attribute__((target("pclmul,ssse3"))) static uint32_t
+phy_crc_clmul(const phy_crc_lut &c, const uint8_t *p, size_t blocks) {
+  const __m128i k128 = _mm_set_epi64x(c.fold[1], c.fold[0]), k512 = _mm_set_epi64x(c.fold[3], c.fold[2]);
+  __m128i acc = phy_crc_load(p);
+  size_t i = 1;
+  if (blocks >= 8) {
+    // Four independent chains 64 bytes apart, merged at the end
+    __m128i a1 = phy_crc_load(p + 16), a2 = phy_crc_load(p + 32), a3 = phy_crc_load(p + 48);
+    for (i = 4; i + 4 <= blocks; i += 4) {
+      acc = _mm_xor_si128(phy_crc_fold(acc, k512), phy_crc_load(p + 16 * i));
+      a1 = _mm_xor_si128(phy_crc_fold(a1, k512), phy_crc_load(p + 16 * i + 16));
+      a2 = _mm_xor_si128(phy_crc_fold(a2, k512), phy_crc_load(p + 16 * i + 32));
+      a3 = _mm_xor_si128(phy_crc_fold(a3, k512), phy_crc_load(p + 16 * i + 48));
+    }
+    acc = _mm_xor_si128(phy_crc_fold(acc, k128), a1);
+    acc = _mm_xor_si128(phy_crc_fold(acc, k128), a2);
+    acc = _mm_xor_si128(phy_crc_fold(acc, k128), a3);
+  }
+  for (; i < blocks; ++i)
+    acc = _mm_xor_si128(phy_crc_fold(acc, k128), phy_crc_load(p + 16 * i));
+  uint8_t remainder[16];
+  _mm_storeu_si128((__m128i *)remainder, phy_crc_load((const uint8_t *)&acc));
+  return phy_crc_bytes(c, 0, remainder, 16);
+}
+#endif
+
+int
+phy_crc_size(int crc) {
+  if (crc < 0 || crc >= PHY_CRCS) {
+    errno = EINVAL;
+    return -1;
+  }
+  return phy_crc_luts[crc].size;
+}
+
+int
+phy_crc(int crc, const void *data, int size_in_bits) {
+  if (crc < 0 || crc >= PHY_CRCS || size_in_bits < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  const phy_crc_lut &c = phy_crc_luts[crc];
+  const uint8_t *p = (const uint8_t *)data;
+  size_t bytes = size_in_bits / 8, done = 0;
+  uint32_t r = 0;
+#ifdef CPU_X86
+  if (bytes >= 64 && cpu_has(CPU_PCLMUL)) {
+    done = bytes & ~(size_t)15;
+    r = phy_crc_clmul(c, p, done / 16);
+  }
+#endif
+  r = phy_crc_bytes(c, r, p + done, bytes - done);
+  if (int rest = size_in_bits % 8) {
+    r ^= (uint32_t)(p[bytes] & (0xff00 >> rest)) << 24;
+    for (int k = 0; k < rest; ++k)
+      r = (r << 1) ^ (r & 0x80000000 ? c.poly : 0);
+  }
+  return r >> (32 - c.size);
+}
+
+int
+phy_crc_attach(int crc, void *data, int size_in_bits) {
+  int r = phy_crc(crc, data, size_in_bits);
+  if (r < 0)
+    return -1;
+  int size = phy_crc_luts[crc].size, shift = size_in_bits % 8;
+  uint8_t *p = (uint8_t *)data + size_in_bits / 8;
+  // The CRC left aligned after the shift bits already in the first byte
+  uint32_t bits = (uint32_t)r << (32 - size) >> shift;
+  p[0] = (p[0] & (0xff00 >> shift)) | bits >> 24;
+  for (int k = 1; k < (shift + size + 7) / 8; ++k)
+    p[k] = bits >> (24 - 8 * k);
+  return size_in_bits + size;
+}
+
+int
+phy_crc_check(int crc, const void *data, int size_in_bits) {
+  int r = phy_crc(crc, data, size_in_bits);
+  if (r < 0)
+    return -1;
+  if (r) {
+    errno = EBADMSG;
+    return -1;
+  }
+  return 0;
+}
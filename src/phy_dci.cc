@@ -0,0 +1,260 @@
+/*
+   Implement DCI formats 0, 1A and 1C of 3GPP LTE, 36.212 5.3.3.1
+
+   FDD, one antenna port, no carrier aggregation. Each format is one f<>
+   concatenation of its fields, so with the widths of a bandwidth known at
+   compile time packing is a few shifts. Payloads are at most 32 bits.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+
+#include "phy.h"
+#include "bitfield.hh"
+
+#define PHY_DCI_CRC_SIZE 16
+
+#define PHY_DCI_BANDWIDTHS(X) X(6) X(15) X(25) X(50) X(75) X(100)
+
+static constexpr unsigned
+phy_ceil_log2(unsigned n) {
+  unsigned width = 0;
+  while ((1u << width) < n)
+    ++width;
+  return width;
+}
+
+// Sizes that would make the UE unable to tell formats apart, 5.3.3.1.2
+static constexpr bool
+phy_dci_ambiguous_size(unsigned size) {
+  return size == 12 || size == 14 || size == 16 || size == 20 || size == 24 || size == 26
+    || size == 32 || size == 40 || size == 44 || size == 56;
+}
+
+// N_gap,1 of 36.211 Table 6.2.3.2-1
+static constexpr unsigned
+phy_n_gap1(unsigned n_prb) {
+  return n_prb <= 10 ? (n_prb + 1) / 2 : n_prb == 11 ? 4 : n_prb <= 19 ? 8 : n_prb <= 26 ? 12
+    : n_prb <= 44 ? 18 : n_prb <= 63 ? 27 : n_prb <= 79 ? 32 : 48;
+}
+
+static constexpr unsigned
+phy_min(unsigned a, unsigned b) { return a < b ? a : b; }
+
+template <unsigned N_PRB>
+struct phy_dci_layout {
+  static constexpr unsigned riv = phy_ceil_log2(N_PRB * (N_PRB + 1) / 2);
+  static constexpr unsigned ul_hop = N_PRB < 50 ? 1 : 2;
+  static constexpr unsigned gap = N_PRB >= 50;
+  static constexpr unsigned format_0 = 1 + 1 + riv + 5 + 1 + 2 + 3 + 1;
+  static constexpr unsigned format_1a = 1 + 1 + riv + 5 + 3 + 1 + 2 + 2;
+  static constexpr unsigned longer = format_0 > format_1a ? format_0 : format_1a;
+  static constexpr unsigned size_0_1a = longer + phy_dci_ambiguous_size(longer);
+  static constexpr unsigned padding_0 = size_0_1a - format_0;
+  static constexpr unsigned padding_1a = size_0_1a - format_1a;
+  // Format 1C allocates in steps of N_step over N_VRB,gap1
+  static constexpr unsigned step = N_PRB < 50 ? 2 : 4;
+  static constexpr unsigned vrb_steps = 2 * phy_min(phy_n_gap1(N_PRB), N_PRB - phy_n_gap1(N_PRB)) / step;
+  static constexpr unsigned riv_1c = phy_ceil_log2(vrb_steps * (vrb_steps + 1) / 2);
+  static constexpr unsigned size_1c = gap + riv_1c + 5;
+  static_assert(size_0_1a <= 32 && size_1c <= 32, "payload is held in an unsigned");
+};
+
+static bool
+phy_fits(int value, unsigned width) {
+  return value >= 0 && (unsigned)value < (1u << width);
+}
+
+// In format 1A these have no HARQ and carry N_gap and N_1A_PRB instead
+static bool
+phy_rnti_is_broadcast(int rnti) {
+  return rnti <= PHY_RA_RNTI_MAX || rnti == PHY_P_RNTI || rnti == PHY_SI_RNTI;
+}
+
+/******
+ ** CRC16 over the payload right aligned in 32 bits: leading zeros don't
+ ** change a CRC that starts from zero
+ **/
+static unsigned
+phy_dci_crc(unsigned payload) {
+  uint8_t bytes[4] = { uint8_t(payload >> 24), uint8_t(payload >> 16), uint8_t(payload >> 8), uint8_t(payload) };
+  return phy_crc(PHY_CRC16, bytes, 32);
+}
+
+/******
+ ** Packing
+ **/
+template <unsigned N_PRB>
+static int
+phy_dci_pack(const phy_dci &d, uint8_t *out) {
+  typedef phy_dci_layout<N_PRB> L;
+  if (d.rnti <= 0 || d.rnti > 0xffff)
+    return -1;
+  unsigned payload, size;
+  switch (d.format) {
+  case PHY_DCI_FORMAT_0: {
+    unsigned hop = d.hopping ? L::ul_hop : 0;
+    if (!phy_fits(d.hopping, 1) || !phy_fits(d.n_ul_hop, hop) || !phy_fits(d.riv, L::riv - hop)
+	|| !phy_fits(d.mcs, 5) || !phy_fits(d.new_data_indicator, 1) || !phy_fits(d.tpc, 2)
+	|| !phy_fits(d.cyclic_shift, 3) || !phy_fits(d.csi_request, 1))
+      return -1;
+    auto dci = f<1>(0) + f<1>(d.hopping) + f<L::riv>((d.n_ul_hop << (L::riv - hop)) | d.riv)
+      + f<5>(d.mcs) + f<1>(d.new_data_indicator) + f<2>(d.tpc) + f<3>(d.cyclic_shift)
+      + f<1>(d.csi_request) + f<L::padding_0>(0);
+    payload = dci.value;
+    size = dci.width;
+    break;
+  }
+  case PHY_DCI_FORMAT_1A: {
+    bool broadcast = phy_rnti_is_broadcast(d.rnti);
+    bool gap = L::gap && d.hopping;
+    // The gap goes in the MSB of the allocation, or for broadcast in place of NDI
+    unsigned gap_in_riv = gap && !broadcast;
+    unsigned ndi = broadcast ? (gap ? d.n_gap : 0) : d.new_data_indicator;
+    if (!phy_fits(d.hopping, 1) || !phy_fits(d.n_gap, gap) || !phy_fits(d.riv, L::riv - gap_in_riv)
+	|| !phy_fits(d.mcs, 5) || !phy_fits(d.harq_process, 3) || !phy_fits(d.new_data_indicator, 1)
+	|| !phy_fits(d.redundancy_version, 2) || !phy_fits(d.tpc, 2))
+      return -1;
+    auto dci = f<1>(1) + f<1>(d.hopping) + f<L::riv>((gap_in_riv ? d.n_gap << (L::riv - 1) : 0) | d.riv)
+      + f<5>(d.mcs) + f<3>(d.harq_process) + f<1>(ndi) + f<2>(d.redundancy_version)
+      + f<2>(d.tpc) + f<L::padding_1a>(0);
+    payload = dci.value;
+    size = dci.width;
+    break;
+  }
+  case PHY_DCI_FORMAT_1C: {
+    if (!phy_fits(d.n_gap, L::gap) || !phy_fits(d.riv, L::riv_1c) || !phy_fits(d.mcs, 5))
+      return -1;
+    auto dci = f<L::gap>(d.n_gap) + f<L::riv_1c>(d.riv) + f<5>(d.mcs);
+    payload = dci.value;
+    size = dci.width;
+    break;
+  }
+  default:
+    return -1;
+  }
+  // Payload and CRC left aligned in a word, stored most significant byte first
+  uint64_t word = (((uint64_t)payload << PHY_DCI_CRC_SIZE) | (phy_dci_crc(payload) ^ d.rnti))
+    << (64 - size - PHY_DCI_CRC_SIZE);
+  for (int i = 0; i < PHY_DCI_MAX_SIZE; ++i)
+    out[i] = word >> (56 - 8 * i);
+  return size + PHY_DCI_CRC_SIZE;
+}
+
+/******
+ ** Unpacking
+ **/
+template <unsigned N_PRB>
+static int
+phy_dci_unpack(const uint8_t *in, int size_in_bits, phy_dci &d) {
+  typedef phy_dci_layout<N_PRB> L;
+  unsigned size = size_in_bits - PHY_DCI_CRC_SIZE;
+  if (size_in_bits < PHY_DCI_CRC_SIZE || (size != L::size_0_1a && size != L::size_1c)) {
+    errno = EINVAL;
+    return -1;
+  }
+  bits b(const_cast<uint8_t *>(in));
+  unsigned payload = b / size;
+  d = phy_dci();
+  d.rnti = (b / PHY_DCI_CRC_SIZE) ^ phy_dci_crc(payload);
+  b.read_offset = 0;
+  if (size == L::size_1c) {
+    d.format = PHY_DCI_FORMAT_1C;
+    d.n_gap = b / L::gap;
+    d.riv = b / L::riv_1c;
+    d.mcs = b / 5;
+  } else if (!(b / 1)) {
+    d.format = PHY_DCI_FORMAT_0;
+    d.hopping = b / 1;
+    unsigned hop = d.hopping ? L::ul_hop : 0;
+    d.n_ul_hop = b / hop;
+    d.riv = b / (L::riv - hop);
+    d.mcs = b / 5;
+    d.new_data_indicator = b / 1;
+    d.tpc = b / 2;
+    d.cyclic_shift = b / 3;
+    d.csi_request = b / 1;
+  } else {
+    d.format = PHY_DCI_FORMAT_1A;
+    d.hopping = b / 1;
+    bool broadcast = phy_rnti_is_broadcast(d.rnti);
+    bool gap = L::gap && d.hopping;
+    if (gap && !broadcast)
+      d.n_gap = b / 1;
+    d.riv = b / (L::riv - (gap && !broadcast));
+    d.mcs = b / 5;
+    d.harq_process = b / 3;
+    unsigned ndi = b / 1;
+    if (!broadcast)
+      d.new_data_indicator = ndi;
+    else if (gap)
+      d.n_gap = ndi;
+    d.redundancy_version = b / 2;
+    d.tpc = b / 2;
+  }
+  return 0;
+}
+
+/******
+ ** Bandwidth dispatch
+ **/
+int
+phy_dci_size(int n_prb, int format) {
+#define PHY_DCI_SIZE(N)							\
+  case N:								\
+    if (format == PHY_DCI_FORMAT_0 || format == PHY_DCI_FORMAT_1A)	\
+      return phy_dci_layout<N>::size_0_1a;				\
+    if (format == PHY_DCI_FORMAT_1C)					\
+      return phy_dci_layout<N>::size_1c;				\
+    break;
+  switch (n_prb) {
+    PHY_DCI_BANDWIDTHS(PHY_DCI_SIZE)
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+int
+phy_dci_pack(int n_prb, const struct phy_dci *dci, void *out) {
+  int size = -1;
+#define PHY_DCI_PACK(N) case N: size = phy_dci_pack<N>(*dci, (uint8_t *)out); break;
+  switch (n_prb) {
+    PHY_DCI_BANDWIDTHS(PHY_DCI_PACK)
+  }
+  if (size < 0)
+    errno = EINVAL;
+  return size;
+}
+
+int
+phy_dci_unpack(int n_prb, const void *in, int size_in_bits, struct phy_dci *dci) {
+#define PHY_DCI_UNPACK(N) case N: return phy_dci_unpack<N>((const uint8_t *)in, size_in_bits, *dci);
+  switch (n_prb) {
+    PHY_DCI_BANDWIDTHS(PHY_DCI_UNPACK)
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+template <unsigned N_PRB>
+static int
+phy_dci_pack_batch(const phy_dci *dcis, int n_dcis, uint8_t *out, int *sizes_in_bits) {
+  int n = 0;
+  for (int i = 0; i < n_dcis; ++i) {
+    sizes_in_bits[i] = phy_dci_pack<N_PRB>(dcis[i], out + i * PHY_DCI_MAX_SIZE);
+    n += sizes_in_bits[i] >= 0;
+  }
+  return n;
+}
+
+int
+phy_dci_pack_batch(int n_prb, const struct phy_dci *dcis, int n_dcis, void *out, int *sizes_in_bits) {
+#define PHY_DCI_PACK_BATCH(N) case N: return phy_dci_pack_batch<N>(dcis, n_dcis, (uint8_t *)out, sizes_in_bits);
+  switch (n_prb) {
+    PHY_DCI_BANDWIDTHS(PHY_DCI_PACK_BATCH)
+  }
+  for (int i = 0; i < n_dcis; ++i)
+    sizes_in_bits[i] = -1;
+  errno = EINVAL;
+  return 0;
+}
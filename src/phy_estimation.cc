@@ -0,0 +1,276 @@
+/*
+   Implement downlink channel estimation from the cell-specific reference
+   signals of antenna port 0, 3GPP 36.211 6.10.1, and single antenna
+   equalization
+
+   Least squares estimates on the reference symbols of a symbol are
+   smoothed by a moving average over frequency_taps of them and
+   interpolated linearly to every subcarrier. Symbols in between have the
+   last reference symbol before them, or lie on the line through the
+   reference symbols either side, or through the last two until the next
+   one has arrived, so that a subframe can be equalized symbol by symbol
+   as it comes in. The noise variance comes from second differences of the
+   least squares estimates, which a channel close to linear over 12
+   subcarriers leaves alone.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "phy.h"
+
+using std::vector;
+
+#define PHY_REFERENCE_SYMBOLS 4
+
+// Symbols of the CRS of port 0, in the order of PHY_SCRAMBLING_CRS
+static const int phy_reference_symbols[PHY_REFERENCE_SYMBOLS] = { 0, 4, 7, 11 };
+
+struct phy_estimator {
+  int n_prb, taps, time_filter;
+  PHY_RE_MAP *map;
+  PHY_SCRAMBLING *scrambling;
+  // Of the subframe estimated so far
+  int subframe, symbols, references;
+  float noise[PHY_REFERENCE_SYMBOLS];
+  vector<phy_complex> reference[PHY_REFERENCE_SYMBOLS];
+  vector<phy_complex> channel;  // 14 symbols of 12 * n_prb
+  vector<phy_complex> ls, smoothed;
+};
+
+PHY_ESTIMATOR *
+phy_estimator_init(int cell_id, int n_prb, int frequency_taps, int time_filter) {
+  if (frequency_taps < 1 || frequency_taps % 2 == 0 || frequency_taps > 2 * n_prb ||
+      (time_filter != PHY_ESTIMATOR_HOLD && time_filter != PHY_ESTIMATOR_LINEAR)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  PHY_RE_MAP *map = phy_re_map_init(cell_id, n_prb, 1, PHY_PHICH_NG_1, 1);
+  PHY_SCRAMBLING *scrambling = map ? phy_scrambling_init(cell_id, n_prb) : NULL;
+  if (!scrambling) {
+    phy_re_map_free(map);
+    errno = EINVAL;
+    return NULL;
+  }
+  phy_estimator *e = new phy_estimator;
+  e->n_prb = n_prb;
+  e->taps = frequency_taps;
+  e->time_filter = time_filter;
+  e->map = map;
+  e->scrambling = scrambling;
+  e->subframe = -1;
+  e->symbols = e->references = 0;
+  for (auto &r : e->reference)
+    r.resize(12 * n_prb);
+  e->channel.resize(PHY_SYMBOLS_PER_SUBFRAME * 12 * n_prb);
+  e->ls.resize(2 * n_prb);
+  e->smoothed.resize(2 * n_prb);
+  return e;
+}
+
+void
+phy_estimator_free(PHY_ESTIMATOR *estimator) {
+  if (estimator) {
+    phy_scrambling_free(estimator->scrambling);
+    phy_re_map_free(estimator->map);
+  }
+  delete estimator;
+}
+
+/******
+ ** Estimation
+ **/
+
+// Reference symbol r of the subframe from its resource elements at
+// indices, 2 * n_prb of them 6 subcarriers apart
+static void
+phy_estimate_reference(phy_estimator *e, int r, const phy_complex *res, const uint16_t *indices,
+		       const uint8_t *sequence) {
+  const int n = 2 * e->n_prb, subcarriers = 12 * e->n_prb;
+  // Least squares, y / x = y conj(x) with |x| = 1
+  for (int m = 0; m < n; ++m) {
+    const phy_complex &y = res[indices[m]];
+    float re = sequence[2 * m / 8] >> (7 - 2 * m % 8) & 1 ? -M_SQRT1_2 : M_SQRT1_2;
+    float im = sequence[(2 * m + 1) / 8] >> (7 - (2 * m + 1) % 8) & 1 ? M_SQRT1_2 : -M_SQRT1_2;
+    e->ls[m] = { y.re * re - y.im * im, y.re * im + y.im * re };
+  }
+  float noise = 0;
+  for (int m = 1; m + 1 < n; ++m) {
+    float re = e->ls[m - 1].re - 2 * e->ls[m].re + e->ls[m + 1].re;
+    float im = e->ls[m - 1].im - 2 * e->ls[m].im + e->ls[m + 1].im;
+    noise += re * re + im * im;
+  }
+  e->noise[r] = noise / (6 * (n - 2));
+  // Moving average, over fewer at the edges
+  const int half = e->taps / 2;
+  phy_complex sum = { 0, 0 };
+  for (int m = 0; m < half; ++m)
+    sum = { sum.re + e->ls[m].re, sum.im + e->ls[m].im };
+  for (int m = 0; m < n; ++m) {
+    if (m + half < n)
+      sum = { sum.re + e->ls[m + half].re, sum.im + e->ls[m + half].im };
+    if (m - half - 1 >= 0)
+      sum = { sum.re - e->ls[m - half - 1].re, sum.im - e->ls[m - half - 1].im };
+    float scale = 1.0f / (std::min(m + half, n - 1) - std::max(m - half, 0) + 1);
+    e->smoothed[m] = { sum.re * scale, sum.im * scale };
+  }
+  // Linear between reference symbols, held beyond the first and last
+  phy_complex *h = e->reference[r].data();
+  const int first = indices[0] % subcarriers;
+  for (int k = 0; k < first; ++k)
+    h[k] = e->smoothed[0];
+  for (int m = 0; m + 1 < n; ++m) {
+    const phy_complex a = e->smoothed[m], b = e->smoothed[m + 1];
+    const phy_complex step = { (b.re - a.re) * (1.0f / 6), (b.im - a.im) * (1.0f / 6) };
+    for (int i = 0; i < 6; ++i)
+      h[first + 6 * m + i] = { a.re + step.re * i, a.im + step.im * i };
+  }
+  for (int k = first + 6 * (n - 1); k < subcarriers; ++k)
+    h[k] = e->smoothed[n - 1];
+}
+
+// Channel of symbol l as a + t (b - a)
+static void
+phy_estimate_between(phy_estimator *e, int l, const phy_complex *a, const phy_complex *b, float t) {
+  const int subcarriers = 12 * e->n_prb;
+  const float *x = &a->re, *y = &b->re;
+  float *h = &e->channel[l * subcarriers].re;
+  for (int i = 0; i < 2 * subcarriers; ++i)
+    h[i] = x[i] + t * (y[i] - x[i]);
+}
+
+int
+phy_estimate_channel(PHY_ESTIMATOR *e, int subframe, const phy_complex *res, int n_symbols) {
+  int n_crs;
+  const uint16_t *indices = phy_re_map_indices(e->map, PHY_RE_CRS, subframe, &n_crs);
+  if (!indices || n_symbols < 1 || n_symbols > PHY_SYMBOLS_PER_SUBFRAME) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (subframe != e->subframe || n_symbols <= e->symbols) {
+    e->subframe = subframe;
+    e->symbols = e->references = 0;
+  }
+  const uint8_t *sequence = phy_scrambling_get(e->scrambling, PHY_SCRAMBLING_CRS, subframe, NULL);
+  const int stride = (4 * e->n_prb + 7) / 8, n = 2 * e->n_prb, subcarriers = 12 * e->n_prb;
+  // Symbols whose channel the new reference symbols may change
+  int from = e->symbols;
+  for (int r = e->references; r < PHY_REFERENCE_SYMBOLS && phy_reference_symbols[r] < n_symbols; ++r) {
+    phy_estimate_reference(e, r, res, indices + r * n, sequence + r * stride);
+    if (r == e->references && r > 0)
+      from = std::min(from, phy_reference_symbols[r - 1]);
+    e->references = r + 1;
+  }
+  for (int l = from; l < n_symbols; ++l) {
+    int r = e->references - 1;
+    while (phy_reference_symbols[r] > l)
+      --r;
+    const int a = phy_reference_symbols[r];
+    if (e->time_filter == PHY_ESTIMATOR_HOLD || l == a) {
+      memcpy(&e->channel[l * subcarriers], e->reference[r].data(), subcarriers * sizeof(phy_complex));
+    } else if (r + 1 < e->references) {
+      const int b = phy_reference_symbols[r + 1];
+      phy_estimate_between(e, l, e->reference[r].data(), e->reference[r + 1].data(), (float)(l - a) / (b - a));
+    } else if (r > 0) {
+      const int b = phy_reference_symbols[r - 1];
+      phy_estimate_between(e, l, e->reference[r].data(), e->reference[r - 1].data(), (float)(l - a) / (b - a));
+    } else {
+      memcpy(&e->channel[l * subcarriers], e->reference[r].data(), subcarriers * sizeof(phy_complex));
+    }
+  }
+  e->symbols = n_symbols;
+  return 0;
+}
+
+const phy_complex *
+phy_estimator_channel(PHY_ESTIMATOR *e, int l) {
+  if (l < 0 || l >= e->symbols) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return &e->channel[l * 12 * e->n_prb];
+}
+
+float
+phy_estimator_noise_variance(PHY_ESTIMATOR *e) {
+  float noise = 0;
+  for (int r = 0; r < e->references; ++r)
+    noise += e->noise[r];
+  return e->references ? noise / e->references : 0;
+}
+
+/******
+ ** Equalization
+ **
+ ** With x^ = conj(h) y / (|h|^2 + c), c = 0 for ZF and the noise variance
+ ** for MMSE, what is left of the noise is
+ **   noise variance * (1 + estimation) / (|h|^2 + c)
+ ** estimation being the share of the noise the channel estimate kept.
+ **/
+
+// Resource elements left over from SIMD, or all of them without
+static void
+phy_equalize_re(phy_complex y, phy_complex h, float c, float noise, phy_complex *x, float *noise_variance) {
+  float inverse = 1 / (h.re * h.re + h.im * h.im + c);
+  *x = { (h.re * y.re + h.im * y.im) * inverse, (h.re * y.im - h.im * y.re) * inverse };
+  if (noise_variance)
+    *noise_variance = noise * inverse;
+}
+
+#ifdef __SSE2__
+// Two resource elements at a time. Returns how many were done.
+static int
+phy_equalize_sse2(const phy_complex *y, const phy_complex *h, int n, float c, float noise, phy_complex *x,
+		  float *noise_variances) {
+  const __m128 cs = _mm_set1_ps(c), noises = _mm_set1_ps(noise);
+  int i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128 yv = _mm_loadu_ps(&y[i].re), hv = _mm_loadu_ps(&h[i].re);
+    __m128 hh = _mm_mul_ps(hv, hv);
+    __m128 d = _mm_add_ps(_mm_add_ps(hh, _mm_shuffle_ps(hh, hh, _MM_SHUFFLE(2, 3, 0, 1))), cs);
+    // hr yr + hi yi in both lanes of each element, and hr yi - hi yr in the
+    // even ones, which the shuffles into z take
+    __m128 a = _mm_mul_ps(hv, yv), b = _mm_mul_ps(_mm_shuffle_ps(hv, hv, _MM_SHUFFLE(2, 3, 0, 1)), yv);
+    __m128 re = _mm_add_ps(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)));
+    __m128 im = _mm_sub_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1)), b);
+    __m128 z = _mm_shuffle_ps(re, im, _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm_shuffle_ps(z, z, _MM_SHUFFLE(3, 1, 2, 0));
+    __m128 inverse = _mm_div_ps(_mm_set1_ps(1), d);
+    _mm_storeu_ps(&x[i].re, _mm_mul_ps(z, inverse));
+    if (noise_variances) {
+      __m128 v = _mm_mul_ps(noises, inverse);
+      _mm_storel_pi((__m64 *)(noise_variances + i), _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 0, 2, 0)));
+    }
+  }
+  return i;
+}
+#endif
+
+int
+phy_equalize(PHY_ESTIMATOR *e, int mode, const phy_complex *res, int first_symbol, int n_symbols, phy_complex *out,
+	     float *noise_variances) {
+  if ((mode != PHY_EQUALIZE_ZF && mode != PHY_EQUALIZE_MMSE) || first_symbol < 0 || n_symbols < 0 ||
+      first_symbol + n_symbols > e->symbols) {
+    errno = EINVAL;
+    return -1;
+  }
+  const int subcarriers = 12 * e->n_prb, start = first_symbol * subcarriers, n = n_symbols * subcarriers;
+  const float noise_variance = phy_estimator_noise_variance(e);
+  const float noise = noise_variance * (1 + 1.0f / e->taps), c = mode == PHY_EQUALIZE_MMSE ? noise_variance : 1e-30f;
+  const phy_complex *y = res + start, *h = e->channel.data() + start;
+  phy_complex *x = out + start;
+  float *v = noise_variances ? noise_variances + start : NULL;
+  int i = 0;
+#ifdef __SSE2__
+  i = phy_equalize_sse2(y, h, n, c, noise, x, v);
+#endif
+  for (; i < n; ++i)
+    phy_equalize_re(y[i], h[i], c, noise, &x[i], v ? &v[i] : NULL);
+  return 0;
+}
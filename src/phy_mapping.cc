@@ -0,0 +1,323 @@
+/*
+   Implement resource element mapping of the 3GPP LTE PHY downlink, 36.211
+   6.2.4 and 6.6 to 6.11, for FDD, normal cyclic prefix and normal PHICH
+   duration
+
+   Where each channel goes only depends on the cell, bandwidth, CFI, PHICH
+   resources and antenna ports, and on whether the subframe is 0, 5 or
+   some other. phy_re_map_init() lays out the resource element groups,
+   PCFICH, PHICH and the interleaved and cyclically shifted PDCCH once for
+   all, and the rest of the grid for each of the three kinds of subframe.
+   Each channel then has a table of resource element indices in the order
+   of its symbols, and mapping is a gather or scatter through it.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <vector>
+#include <algorithm>
+
+#include "phy.h"
+
+using std::vector;
+
+#define PHY_RE_SUBFRAME_KINDS 3
+
+/******
+ ** Layout
+ **/
+
+// Column permutation of the sub-block interleaver, 36.212 Table 5.1.4-2
+static const uint8_t phy_pdcch_permutation[32] = {
+  1, 17, 9, 25, 5, 21, 13, 29, 3, 19, 11, 27, 7, 23, 15, 31,
+  0, 16, 8, 24, 4, 20, 12, 28, 2, 18, 10, 26, 6, 22, 14, 30
+};
+
+// Subframes 0 with PBCH and synchronization signals, 5 with only the
+// latter, and the rest
+static inline int
+phy_re_kind(int subframe) {
+  return subframe == 0 ? 0 : subframe == 5 ? 1 : 2;
+}
+
+// Subcarrier of the reference signals of antenna port p in each 6 of
+// symbol l of a subframe, or -1 if there are none, 6.10.1.2
+static int
+phy_crs_offset(int cell_id, int port, int l) {
+  int slot = l / PHY_SYMBOLS_PER_SLOT, symbol = l % PHY_SYMBOLS_PER_SLOT, v;
+  if (port < 2) {
+    if (symbol != 0 && symbol != PHY_SYMBOLS_PER_SLOT - 3)
+      return -1;
+    v = (symbol == 0) == (port == 0) ? 0 : 3;
+  } else {
+    if (symbol != 1)
+      return -1;
+    v = 3 * (port - 2) + 3 * (slot % 2);
+  }
+  return (v + cell_id % 6) % 6;
+}
+
+static inline bool
+phy_crs(int cell_id, int port, int l, int k) {
+  return k % 6 == phy_crs_offset(cell_id, port, l);
+}
+
+struct phy_re_map {
+  int n_prb, control_symbols, phich_groups, regs;
+  // Of each kind of subframe
+  vector<uint16_t> indices[PHY_RE_SUBFRAME_KINDS][PHY_RE_CHANNELS];
+  // PDSCH index of the first resource element of each resource block of
+  // each symbol, n_prb + 1 per symbol
+  vector<int> pdsch_start[PHY_RE_SUBFRAME_KINDS];
+};
+
+struct phy_reg {
+  int k, l;
+  uint16_t re[4];
+};
+
+// Resource element groups of the control region by k and then l, as PDCCH
+// goes to them. Symbols with reference signals have two groups of 6
+// subcarriers in a resource block, others three of 4, 6.2.4.
+static vector<phy_reg>
+phy_re_regs(int cell_id, int n_prb, int n_ports, int control_symbols) {
+  const int n_sc = 12 * n_prb;
+  // Control channels assume reference signals of ports 0 and 1 even when
+  // only port 0 has them
+  int assumed_ports = std::max(n_ports, 2);
+  vector<phy_reg> regs;
+  bool rs[4] = {};
+  for (int l = 0; l < control_symbols; ++l)
+    for (int port = 0; port < assumed_ports; ++port)
+      rs[l] = rs[l] || phy_crs_offset(cell_id, port, l) >= 0;
+  for (int k = 0; k < n_sc; k += 2)
+    for (int l = 0; l < control_symbols; ++l) {
+      int size = rs[l] ? 6 : 4;
+      if (k % size)
+	continue;
+      phy_reg reg = { k, l, {} };
+      int n = 0;
+      for (int i = k; i < k + size; ++i) {
+	bool used = false;
+	for (int port = 0; port < assumed_ports; ++port)
+	  used |= phy_crs(cell_id, port, l, i);
+	if (!used)
+	  reg.re[n++] = l * n_sc + i;
+      }
+      regs.push_back(reg);
+    }
+  return regs;
+}
+
+PHY_RE_MAP *
+phy_re_map_init(int cell_id, int n_prb, int cfi, int phich_ng, int n_ports) {
+  if (cell_id < 0 || cell_id > 503 || n_prb < 6 || n_prb > 110 || cfi < 1 || cfi > 3 ||
+      phich_ng < PHY_PHICH_NG_1_6 || phich_ng > PHY_PHICH_NG_2 || (n_ports != 1 && n_ports != 2 && n_ports != 4)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  const int n_sc = 12 * n_prb, n_re = PHY_SYMBOLS_PER_SUBFRAME * n_sc;
+  phy_re_map *m = new phy_re_map;
+  m->n_prb = n_prb;
+  m->control_symbols = cfi + (n_prb <= 10);
+  // N_g of 1/6, 1/2, 1 and 2 times n_prb / 8, rounded up
+  static const int ng_times_48[] = { 8, 24, 48, 96 };
+  m->phich_groups = (ng_times_48[phich_ng] * n_prb + 383) / 384;
+
+  // Control region, the same in every subframe
+  vector<phy_reg> regs = phy_re_regs(cell_id, n_prb, n_ports, m->control_symbols);
+  vector<phy_reg *> first;     // Groups of symbol 0 by frequency
+  for (auto &reg : regs)
+    if (reg.l == 0)
+      first.push_back(&reg);
+  vector<bool> taken(regs.size());
+  auto take = [&](phy_reg *reg, vector<uint16_t> &indices) {
+    taken[reg - regs.data()] = true;
+    indices.insert(indices.end(), reg->re, reg->re + 4);
+  };
+  vector<uint16_t> control[PHY_RE_CHANNELS];
+  // PCFICH, 6.7.4
+  int k_bar = 6 * (cell_id % (2 * n_prb));
+  for (int i = 0; i < 4; ++i)
+    take(first[(k_bar + 6 * (i * n_prb / 2)) % n_sc / 6], control[PHY_RE_PCFICH]);
+  // PHICH group m to the groups n_i of symbol 0 left by PCFICH, 6.9.3
+  vector<phy_reg *> free;
+  for (auto *reg : first)
+    if (!taken[reg - regs.data()])
+      free.push_back(reg);
+  int n0 = free.size();
+  for (int group = 0; group < m->phich_groups; ++group)
+    for (int i = 0; i < 3; ++i)
+      take(free[(cell_id + group + i * n0 / 3) % n0], control[PHY_RE_PHICH]);
+  // PDCCH quadruplets through the sub-block interleaver and shifted by the
+  // cell ID, 6.8.5, so that group i has quadruplet w((i + cell_id) % regs)
+  vector<phy_reg *> pdcch;
+  for (auto &reg : regs)
+    if (!taken[&reg - regs.data()])
+      pdcch.push_back(&reg);
+  int n_quad = pdcch.size(), rows = (n_quad + 31) / 32, dummies = 32 * rows - n_quad;
+  vector<int> w;
+  for (int column = 0; column < 32; ++column)
+    for (int y = phy_pdcch_permutation[column]; y < 32 * rows; y += 32)
+      if (y >= dummies)
+	w.push_back(y - dummies);
+  control[PHY_RE_PDCCH].resize(4 * n_quad);
+  for (int i = 0; i < n_quad; ++i)
+    std::copy(pdcch[i]->re, pdcch[i]->re + 4, &control[PHY_RE_PDCCH][4 * w[(i + cell_id) % n_quad]]);
+  m->regs = n_quad;
+
+  for (int kind = 0; kind < PHY_RE_SUBFRAME_KINDS; ++kind) {
+    vector<uint16_t> *t = m->indices[kind];
+    for (int channel : { PHY_RE_PCFICH, PHY_RE_PHICH, PHY_RE_PDCCH })
+      t[channel] = control[channel];
+    // Resource elements PDSCH can't have, beyond the control region
+    vector<bool> reserved(n_re);
+    for (int l = 0; l < PHY_SYMBOLS_PER_SUBFRAME; ++l)
+      for (int port = 0; port < n_ports; ++port) {
+	int offset = phy_crs_offset(cell_id, port, l);
+	for (int k = offset; offset >= 0 && k < n_sc; k += 6) {
+	  reserved[l * n_sc + k] = true;
+	  if (port == 0)
+	    t[PHY_RE_CRS].push_back(l * n_sc + k);
+	}
+      }
+    // The 72 subcarriers in the middle, 6.6.4 and 6.11
+    const int center = n_sc / 2 - 36;
+    if (kind < 2) {
+      for (int l = PHY_SYMBOLS_PER_SLOT - 2; l < PHY_SYMBOLS_PER_SLOT; ++l) {
+	for (int k = center; k < center + 72; ++k)
+	  reserved[l * n_sc + k] = true;
+	for (int n = 0; n < 62; ++n)
+	  t[l == PHY_SYMBOLS_PER_SLOT - 1 ? PHY_RE_PSS : PHY_RE_SSS].push_back(l * n_sc + center + 5 + n);
+      }
+    }
+    // PBCH in the first 4 symbols of slot 1 around reference signals of
+    // any 4 antenna ports
+    if (kind == 0)
+      for (int l = PHY_SYMBOLS_PER_SLOT; l < PHY_SYMBOLS_PER_SLOT + 4; ++l)
+	for (int k = center; k < center + 72; ++k) {
+	  bool rs = false;
+	  for (int port = 0; port < 4; ++port)
+	    rs |= phy_crs(cell_id, port, l, k);
+	  if (!rs)
+	    t[PHY_RE_PBCH].push_back(l * n_sc + k);
+	  reserved[l * n_sc + k] = true;
+	}
+    // PDSCH by k and then l, 6.3.5
+    vector<int> &start = m->pdsch_start[kind];
+    for (int l = 0; l < PHY_SYMBOLS_PER_SUBFRAME; ++l)
+      for (int k = 0; k <= n_sc; ++k) {
+	if (k % 12 == 0)
+	  start.push_back(t[PHY_RE_PDSCH].size());
+	if (k < n_sc && l >= m->control_symbols && !reserved[l * n_sc + k])
+	  t[PHY_RE_PDSCH].push_back(l * n_sc + k);
+      }
+  }
+  return m;
+}
+
+void
+phy_re_map_free(PHY_RE_MAP *map) {
+  delete map;
+}
+
+int
+phy_re_map_control_symbols(PHY_RE_MAP *map) {
+  return map->control_symbols;
+}
+
+int
+phy_re_map_cces(PHY_RE_MAP *map) {
+  return map->regs / 9;
+}
+
+int
+phy_re_map_phich_groups(PHY_RE_MAP *map) {
+  return map->phich_groups;
+}
+
+const uint16_t *
+phy_re_map_indices(PHY_RE_MAP *map, int channel, int subframe, int *n) {
+  if (channel < 0 || channel >= PHY_RE_CHANNELS || subframe < 0 || subframe > 9) {
+    errno = EINVAL;
+    return NULL;
+  }
+  const vector<uint16_t> &t = map->indices[phy_re_kind(subframe)][channel];
+  *n = t.size();
+  return t.data();
+}
+
+/******
+ ** Mapping
+ **/
+
+static inline void
+phy_re_scatter(const uint16_t *indices, int n, const phy_complex *symbols, phy_complex *res) {
+  for (int i = 0; i < n; ++i)
+    res[indices[i]] = symbols[i];
+}
+
+static inline void
+phy_re_gather(const uint16_t *indices, int n, const phy_complex *res, phy_complex *symbols) {
+  for (int i = 0; i < n; ++i)
+    symbols[i] = res[indices[i]];
+}
+
+int
+phy_map_channel(PHY_RE_MAP *map, int channel, int subframe, const phy_complex *symbols, phy_complex *res) {
+  int n;
+  const uint16_t *indices = phy_re_map_indices(map, channel, subframe, &n);
+  if (!indices)
+    return -1;
+  phy_re_scatter(indices, n, symbols, res);
+  return n;
+}
+
+int
+phy_demap_channel(PHY_RE_MAP *map, int channel, int subframe, const phy_complex *res, phy_complex *symbols) {
+  int n;
+  const uint16_t *indices = phy_re_map_indices(map, channel, subframe, &n);
+  if (!indices)
+    return -1;
+  phy_re_gather(indices, n, res, symbols);
+  return n;
+}
+
+// Resource blocks of a symbol are consecutive in the PDSCH table, so an
+// allocation is a run of it in each symbol
+template<bool scatter> static int
+phy_re_pdsch(PHY_RE_MAP *map, int subframe, int first_prb, int n_prbs, const phy_complex *in, phy_complex *out) {
+  if (subframe < 0 || subframe > 9 || first_prb < 0 || n_prbs < 0 || first_prb + n_prbs > map->n_prb) {
+    errno = EINVAL;
+    return -1;
+  }
+  int kind = phy_re_kind(subframe), n = 0;
+  const uint16_t *indices = map->indices[kind][PHY_RE_PDSCH].data();
+  const int *start = map->pdsch_start[kind].data();
+  for (int l = map->control_symbols; l < PHY_SYMBOLS_PER_SUBFRAME; ++l) {
+    const int *s = start + l * (map->n_prb + 1);
+    int begin = s[first_prb], size = s[first_prb + n_prbs] - begin;
+    if (in && scatter)
+      phy_re_scatter(indices + begin, size, in + n, out);
+    else if (in)
+      phy_re_gather(indices + begin, size, in, out + n);
+    n += size;
+  }
+  return n;
+}
+
+int
+phy_pdsch_size(PHY_RE_MAP *map, int subframe, int first_prb, int n_prbs) {
+  return phy_re_pdsch<false>(map, subframe, first_prb, n_prbs, NULL, NULL);
+}
+
+int
+phy_map_pdsch(PHY_RE_MAP *map, int subframe, int first_prb, int n_prbs, const phy_complex *symbols,
+	      phy_complex *res) {
+  return phy_re_pdsch<true>(map, subframe, first_prb, n_prbs, symbols, res);
+}
+
+int
+phy_demap_pdsch(PHY_RE_MAP *map, int subframe, int first_prb, int n_prbs, const phy_complex *res,
+		phy_complex *symbols) {
+  return phy_re_pdsch<false>(map, subframe, first_prb, n_prbs, res, symbols);
+}
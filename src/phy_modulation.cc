@@ -0,0 +1,208 @@
+/*
+   Implement modulation mapping of 3GPP LTE PHY, 36.211 7.1, and soft
+   demapping back to LLRs
+
+   Mapping looks up whole bytes: four QPSK or two 16QAM symbols, or 6 bits
+   of 64QAM. Demapping uses the simplified max-log LLRs of Tosato and
+   Bisaglia: I and Q are independent, and each bit of a level is a linear
+   function of the distance to the boundary between its values, so four
+   symbols go through SSE2 at a time without comparisons.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "phy.h"
+
+/******
+ ** Mapping
+ **/
+
+// Distance d from 0 of the innermost points, by modulation order / 2
+static const float phy_qam_d[4] = { 0, 0.70710678f, 0.31622777f, 0.15430335f };
+
+// Amplitude of I from bits b(0), b(2), b(4) or Q from b(1), b(3), b(5) of
+// Tables 7.1.2-1 to 7.1.4-1: the sign, then 0 for the inner half
+static constexpr float
+phy_qam_amplitude(int levels, int bits, float d) {
+  // bits has the first bit of the dimension as its most significant
+  int magnitude = 1;
+  if (levels == 2)
+    magnitude = 2 - (1 - 2 * (bits & 1));
+  else if (levels == 3)
+    magnitude = 4 - (1 - 2 * ((bits >> 1) & 1)) * (2 - (1 - 2 * (bits & 1)));
+  return (bits >> (levels - 1) ? -1 : 1) * magnitude * d;
+}
+
+struct phy_modulation_tables {
+  phy_complex qpsk[256][4];    // A byte
+  phy_complex qam16[256][2];
+  phy_complex qam64[64];       // 6 bits
+  constexpr phy_modulation_tables() : qpsk(), qam16(), qam64() {
+    const float d2 = 0.70710678f, d4 = 0.31622777f, d6 = 0.15430335f;
+    for (int byte = 0; byte < 256; ++byte)
+      for (int s = 0; s < 4; ++s) {
+	int b = byte >> (6 - 2 * s);
+	qpsk[byte][s] = { phy_qam_amplitude(1, (b >> 1) & 1, d2), phy_qam_amplitude(1, b & 1, d2) };
+      }
+    for (int byte = 0; byte < 256; ++byte)
+      for (int s = 0; s < 2; ++s) {
+	int b = byte >> (4 - 4 * s);
+	qam16[byte][s] = { phy_qam_amplitude(2, (b >> 2 & 2) | (b >> 1 & 1), d4),
+			   phy_qam_amplitude(2, (b >> 1 & 2) | (b & 1), d4) };
+      }
+    for (int b = 0; b < 64; ++b)
+      qam64[b] = { phy_qam_amplitude(3, (b >> 3 & 4) | (b >> 2 & 2) | (b >> 1 & 1), d6),
+		   phy_qam_amplitude(3, (b >> 2 & 4) | (b >> 1 & 2) | (b & 1), d6) };
+  }
+};
+static constexpr phy_modulation_tables phy_modulation_lut;
+
+int
+phy_modulate(int qm, const void *bits, int size_in_bits, phy_complex *symbols) {
+  if ((qm != 2 && qm != 4 && qm != 6) || size_in_bits < 0 || size_in_bits % qm) {
+    errno = EINVAL;
+    return -1;
+  }
+  const uint8_t *b = (const uint8_t *)bits;
+  const phy_modulation_tables &t = phy_modulation_lut;
+  int n = size_in_bits / qm, i = 0;
+  if (qm == 2) {
+    for (; i + 4 <= n; i += 4)
+      memcpy(symbols + i, t.qpsk[b[i / 4]], sizeof(t.qpsk[0]));
+    for (; i < n; ++i)
+      symbols[i] = t.qpsk[b[i / 4]][i % 4];
+  } else if (qm == 4) {
+    for (; i + 2 <= n; i += 2)
+      memcpy(symbols + i, t.qam16[b[i / 2]], sizeof(t.qam16[0]));
+    if (i < n)
+      symbols[i] = t.qam16[b[i / 2]][0];
+  } else {
+    // 4 symbols from 3 bytes
+    for (; i + 4 <= n; i += 4, b += 3) {
+      uint32_t word = b[0] << 16 | b[1] << 8 | b[2];
+      for (int s = 0; s < 4; ++s)
+	symbols[i + s] = t.qam64[(word >> (18 - 6 * s)) & 63];
+    }
+    for (int s = 0; i < n; ++i, ++s) {
+      int first = 6 * s, byte = first / 8, shift = first % 8;
+      int word = b[byte] << 8 | (shift > 2 ? b[byte + 1] : 0);
+      symbols[i] = t.qam64[(word >> (10 - shift)) & 63];
+    }
+  }
+  return n;
+}
+
+/******
+ ** Demapping
+ **
+ ** For I or Q y and level l, with points at odd multiples of d:
+ **   l = 0: y                      the sign
+ **   l = 1: 2^(qm/2 - 1) d - |y|   the inner half, 2d for 16QAM, 4d for 64QAM
+ **   l = 2: 2d - ||y| - 4d|        64QAM
+ ** times 4d / noise variance, in units of 1 / PHY_LLR_SCALE.
+ **/
+
+static inline int8_t
+phy_llr_saturate(float llr) {
+  return lrintf(std::min(std::max(llr, -127.0f), 127.0f));
+}
+
+// Symbols left over from SIMD, or all of them without
+static void
+phy_demodulate_symbol(int qm, phy_complex symbol, float scale, int8_t *llrs) {
+  float d = phy_qam_d[qm / 2], y[2] = { symbol.re, symbol.im };
+  for (int c = 0; c < 2; ++c) {
+    llrs[c] = phy_llr_saturate(scale * y[c]);
+    if (qm >= 4)
+      llrs[2 + c] = phy_llr_saturate(scale * ((qm == 4 ? 2 : 4) * d - fabsf(y[c])));
+    if (qm == 6)
+      llrs[4 + c] = phy_llr_saturate(scale * (2 * d - fabsf(fabsf(y[c]) - 4 * d)));
+  }
+}
+
+#ifdef __SSE2__
+// Four symbols at a time as I0 Q0 I1 Q1 and I2 Q2 I3 Q3. Returns how many
+// were done.
+template<int qm> static int
+phy_demodulate_sse2(const phy_complex *symbols, int n, const float *noise_variances, float noise_variance,
+		    int8_t *llrs) {
+  const float d = phy_qam_d[qm / 2], gain = 4 * d * PHY_LLR_SCALE;
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 inner = _mm_set1_ps((qm == 4 ? 2 : 4) * d), d2 = _mm_set1_ps(2 * d), d4 = _mm_set1_ps(4 * d);
+  const __m128 low = _mm_set1_ps(-127), high = _mm_set1_ps(127);
+  const __m128 scale = _mm_set1_ps(gain / noise_variance);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i levels[3][2];
+#pragma GCC unroll 2
+    for (int h = 0; h < 2; ++h) {
+      __m128 y = _mm_loadu_ps(&symbols[i + 2 * h].re), s = scale, v[3];
+      if (noise_variances) {
+	__m128 nv = _mm_castpd_ps(_mm_load_sd((const double *)(noise_variances + i + 2 * h)));
+	s = _mm_div_ps(_mm_set1_ps(gain), _mm_unpacklo_ps(nv, nv));
+      }
+      __m128 magnitude = _mm_and_ps(y, abs_mask);
+      v[0] = y;
+      v[1] = _mm_sub_ps(inner, magnitude);
+      v[2] = _mm_sub_ps(d2, _mm_and_ps(_mm_sub_ps(magnitude, d4), abs_mask));
+      // Saturated before conversion, which would overflow to negative
+#pragma GCC unroll 3
+      for (int level = 0; level < qm / 2; ++level)
+	levels[level][h] = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(v[level], s), low), high));
+    }
+    // 32-bit I and Q pairs of each level, symbol by symbol
+    __m128i l[3];
+    for (int level = 0; level < qm / 2; ++level)
+      l[level] = _mm_packs_epi32(levels[level][0], levels[level][1]);
+    int8_t *out = llrs + qm * i;
+    if (qm == 2) {
+      _mm_storel_epi64((__m128i *)out, _mm_packs_epi16(l[0], l[0]));
+    } else if (qm == 4) {
+      __m128i lo = _mm_unpacklo_epi32(l[0], l[1]), hi = _mm_unpackhi_epi32(l[0], l[1]);
+      _mm_storeu_si128((__m128i *)out, _mm_packs_epi16(lo, hi));
+    } else {
+      // Pairs of levels 0 and 1 of each symbol, with those of level 2
+      // shuffled in after them
+      __m128 a = _mm_castsi128_ps(_mm_unpacklo_epi32(l[0], l[1])), b = _mm_castsi128_ps(_mm_unpackhi_epi32(l[0], l[1]));
+      __m128 c = _mm_castsi128_ps(l[2]);
+      __m128 x0 = _mm_shuffle_ps(a, _mm_shuffle_ps(c, a, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+      __m128 x1 = _mm_shuffle_ps(_mm_shuffle_ps(a, c, _MM_SHUFFLE(1, 1, 3, 3)), b, _MM_SHUFFLE(1, 0, 2, 0));
+      __m128 t = _mm_shuffle_ps(c, b, _MM_SHUFFLE(3, 2, 3, 2));
+      __m128 x2 = _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 3, 2, 0));
+      _mm_storeu_si128((__m128i *)out, _mm_packs_epi16(_mm_castps_si128(x0), _mm_castps_si128(x1)));
+      __m128i last = _mm_castps_si128(x2);
+      _mm_storel_epi64((__m128i *)(out + 16), _mm_packs_epi16(last, last));
+    }
+  }
+  return i;
+}
+#endif
+
+int
+phy_demodulate(int qm, const phy_complex *symbols, int n, const float *noise_variances, float noise_variance,
+	       int8_t *llrs) {
+  if ((qm != 2 && qm != 4 && qm != 6) || n < 0 || (!noise_variances && !(noise_variance > 0))) {
+    errno = EINVAL;
+    return -1;
+  }
+  const float gain = 4 * phy_qam_d[qm / 2] * PHY_LLR_SCALE;
+  int i = 0;
+#ifdef __SSE2__
+  if (qm == 2)
+    i = phy_demodulate_sse2<2>(symbols, n, noise_variances, noise_variance, llrs);
+  else if (qm == 4)
+    i = phy_demodulate_sse2<4>(symbols, n, noise_variances, noise_variance, llrs);
+  else
+    i = phy_demodulate_sse2<6>(symbols, n, noise_variances, noise_variance, llrs);
+#endif
+  for (; i < n; ++i)
+    phy_demodulate_symbol(qm, symbols[i], gain / (noise_variances ? noise_variances[i] : noise_variance),
+			  llrs + qm * i);
+  return qm * n;
+}
@@ -0,0 +1,389 @@
+/*
+   Implement OFDM modulation of 3GPP LTE PHY, 36.211 6.12 and the SC-FDMA
+   baseband signal of 5.6, with normal cyclic prefix
+
+   The FFT is a Stockham autosort FFT of radix 4, 2 and 3 stages, so any
+   size of 2^a 3^b goes without bit reversal. Plans of twiddle factors are
+   built once per size and direction and shared by everything using that
+   size. Butterflies go through SSE2 two at a time. The sample rate
+   follows the FFT size, 15 kHz times its size, so that the same bandwidth
+   may be sampled faster or slower than usual.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "phy.h"
+
+using std::vector;
+
+#define PHY_FFT_MAX_SIZE 4096
+
+/******
+ ** FFT
+ **/
+
+struct phy_fft_stage {
+  int radix, m, s;             // Length of the stage n = radix * m, stride s
+  size_t twiddles;             // w^(p k) for 0 < k < radix, p < m, p fastest
+};
+
+struct phy_fft_plan {
+  int n;
+  bool inverse;
+  vector<phy_fft_stage> stages;
+  vector<phy_complex> twiddles;
+};
+
+static inline phy_complex
+operator+(phy_complex a, phy_complex b) {
+  return { a.re + b.re, a.im + b.im };
+}
+
+static inline phy_complex
+operator-(phy_complex a, phy_complex b) {
+  return { a.re - b.re, a.im - b.im };
+}
+
+static inline phy_complex
+operator*(phy_complex a, phy_complex b) {
+  return { a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re };
+}
+
+static inline phy_complex
+operator*(float a, phy_complex b) {
+  return { a * b.re, a * b.im };
+}
+
+// Multiplied by -i forward, i inverse
+template<bool inverse> static inline phy_complex
+phy_rotate(phy_complex a) {
+  return inverse ? phy_complex{ -a.im, a.re } : phy_complex{ a.im, -a.re };
+}
+
+#ifdef __SSE2__
+// Two complex numbers side by side
+struct phy_complex2 {
+  __m128 v;
+};
+
+static inline phy_complex2
+operator+(phy_complex2 a, phy_complex2 b) {
+  return { _mm_add_ps(a.v, b.v) };
+}
+
+static inline phy_complex2
+operator-(phy_complex2 a, phy_complex2 b) {
+  return { _mm_sub_ps(a.v, b.v) };
+}
+
+static inline phy_complex2
+operator*(phy_complex2 a, phy_complex2 b) {
+  const __m128 negate_re = _mm_castsi128_ps(_mm_setr_epi32(INT32_MIN, 0, INT32_MIN, 0));
+  __m128 re = _mm_shuffle_ps(b.v, b.v, _MM_SHUFFLE(2, 2, 0, 0)), im = _mm_shuffle_ps(b.v, b.v, _MM_SHUFFLE(3, 3, 1, 1));
+  __m128 swapped = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 3, 0, 1));
+  return { _mm_add_ps(_mm_mul_ps(a.v, re), _mm_xor_ps(_mm_mul_ps(swapped, im), negate_re)) };
+}
+
+static inline phy_complex2
+operator*(float a, phy_complex2 b) {
+  return { _mm_mul_ps(_mm_set1_ps(a), b.v) };
+}
+
+template<bool inverse> static inline phy_complex2
+phy_rotate(phy_complex2 a) {
+  const __m128 negate = _mm_castsi128_ps(inverse ? _mm_setr_epi32(INT32_MIN, 0, INT32_MIN, 0)
+					 : _mm_setr_epi32(0, INT32_MIN, 0, INT32_MIN));
+  return { _mm_xor_ps(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 3, 0, 1)), negate) };
+}
+#endif
+
+static phy_fft_plan *
+phy_fft_build(int n, bool inverse) {
+  phy_fft_plan *plan = new phy_fft_plan;
+  plan->n = n;
+  plan->inverse = inverse;
+  int s = 1;
+  for (int length = n; length > 1; ) {
+    int radix = length % 4 == 0 ? 4 : length % 2 == 0 ? 2 : 3;
+    phy_fft_stage stage = { radix, length / radix, s, plan->twiddles.size() };
+    for (int k = 1; k < radix; ++k)
+      for (int p = 0; p < stage.m; ++p) {
+	double angle = (inverse ? 2 : -2) * M_PI * p * k / length;
+	plan->twiddles.push_back({ (float)cos(angle), (float)sin(angle) });
+      }
+    plan->stages.push_back(stage);
+    length = stage.m;
+    s *= radix;
+  }
+  return plan;
+}
+
+// NULL for sizes with other factors than 2 and 3
+static const phy_fft_plan *
+phy_fft_plan_get(int n, bool inverse) {
+  if (n < 1 || n > PHY_FFT_MAX_SIZE)
+    return NULL;
+  int rest = n;
+  while (rest % 2 == 0)
+    rest /= 2;
+  while (rest % 3 == 0)
+    rest /= 3;
+  if (rest != 1)
+    return NULL;
+  static std::mutex mutex;
+  static std::map<int, std::unique_ptr<phy_fft_plan>> plans;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &plan = plans[inverse ? -n : n];
+  if (!plan)
+    plan.reset(phy_fft_build(n, inverse));
+  return plan.get();
+}
+
+// Outputs k of a stage from inputs k, with twiddle factors w^(p k)
+template<bool inverse, int radix, typename T> static inline void
+phy_butterfly(const T *a, const T *w, T *out) {
+  if (radix == 4) {
+    T t0 = a[0] + a[2], t1 = a[0] - a[2], t2 = a[1] + a[3], t3 = phy_rotate<inverse>(a[1] - a[3]);
+    out[0] = t0 + t2;
+    out[1] = (t1 + t3) * w[0];
+    out[2] = (t0 - t2) * w[1];
+    out[3] = (t1 - t3) * w[2];
+  } else if (radix == 2) {
+    out[0] = a[0] + a[1];
+    out[1] = (a[0] - a[1]) * w[0];
+  } else {
+    T t = a[1] + a[2], u = a[0] - 0.5f * t, v = 0.86602540f * phy_rotate<inverse>(a[1] - a[2]);
+    out[0] = a[0] + t;
+    out[1] = (u + v) * w[0];
+    out[2] = (u - v) * w[1];
+  }
+}
+
+// y(q + s (radix p + k)) from x(q + s (p + k m)). With SSE2, two q at a
+// time, or two p when the stride is 1 as in the first stage.
+template<bool inverse, int radix> static void
+phy_fft_stage_run(const phy_fft_stage &stage, const phy_complex *twiddles, const phy_complex *x, phy_complex *y) {
+  const int m = stage.m, s = stage.s;
+  const phy_complex *w = twiddles + stage.twiddles;
+  phy_complex a[radix], wp[radix - 1], out[radix];
+  int p = 0;
+#ifdef __SSE2__
+  phy_complex2 a2[radix], w2[radix - 1], out2[radix];
+  if (s == 1) {
+    for (; p + 2 <= m; p += 2) {
+      for (int k = 0; k < radix; ++k)
+	a2[k].v = _mm_loadu_ps(&x[p + k * m].re);
+      for (int k = 0; k < radix - 1; ++k)
+	w2[k].v = _mm_loadu_ps(&w[k * m + p].re);
+      phy_butterfly<inverse, radix>(a2, w2, out2);
+      for (int k = 0; k < radix; ++k) {
+	_mm_storel_pi((__m64 *)(y + radix * p + k), out2[k].v);
+	_mm_storeh_pi((__m64 *)(y + radix * (p + 1) + k), out2[k].v);
+      }
+    }
+  }
+#endif
+  for (; p < m; ++p) {
+    for (int k = 0; k < radix - 1; ++k)
+      wp[k] = w[k * m + p];
+    int q = 0;
+#ifdef __SSE2__
+    for (int k = 0; k < radix - 1; ++k)
+      w2[k].v = _mm_setr_ps(wp[k].re, wp[k].im, wp[k].re, wp[k].im);
+    for (; q + 2 <= s; q += 2) {
+      for (int k = 0; k < radix; ++k)
+	a2[k].v = _mm_loadu_ps(&x[q + s * (p + k * m)].re);
+      phy_butterfly<inverse, radix>(a2, w2, out2);
+      for (int k = 0; k < radix; ++k)
+	_mm_storeu_ps(&y[q + s * (radix * p + k)].re, out2[k].v);
+    }
+#endif
+    for (; q < s; ++q) {
+      for (int k = 0; k < radix; ++k)
+	a[k] = x[q + s * (p + k * m)];
+      phy_butterfly<inverse, radix>(a, wp, out);
+      for (int k = 0; k < radix; ++k)
+	y[q + s * (radix * p + k)] = out[k];
+    }
+  }
+}
+
+template<bool inverse> static void
+phy_fft_stage_dispatch(const phy_fft_stage &stage, const phy_complex *twiddles, const phy_complex *x, phy_complex *y) {
+  if (stage.radix == 4)
+    phy_fft_stage_run<inverse, 4>(stage, twiddles, x, y);
+  else if (stage.radix == 2)
+    phy_fft_stage_run<inverse, 2>(stage, twiddles, x, y);
+  else
+    phy_fft_stage_run<inverse, 3>(stage, twiddles, x, y);
+}
+
+// Stages alternate between out and work so that the last one ends in out
+static void
+phy_fft_run(const phy_fft_plan &plan, const phy_complex *in, phy_complex *out, phy_complex *work) {
+  if (plan.stages.empty()) {
+    memcpy(out, in, plan.n * sizeof(*out));
+    return;
+  }
+  const phy_complex *x = in;
+  phy_complex *y = plan.stages.size() % 2 ? out : work;
+  for (auto &stage : plan.stages) {
+    if (plan.inverse)
+      phy_fft_stage_dispatch<true>(stage, plan.twiddles.data(), x, y);
+    else
+      phy_fft_stage_dispatch<false>(stage, plan.twiddles.data(), x, y);
+    x = y;
+    y = y == out ? work : out;
+  }
+}
+
+int
+phy_fft(int n, int inverse, const phy_complex *in, phy_complex *out) {
+  const phy_fft_plan *plan = phy_fft_plan_get(n, inverse);
+  if (!plan || in == out) {
+    errno = EINVAL;
+    return -1;
+  }
+  static thread_local vector<phy_complex> work;
+  work.resize(n);
+  phy_fft_run(*plan, in, out, work.data());
+  return 0;
+}
+
+/******
+ ** OFDM symbols
+ **/
+
+struct phy_ofdm {
+  int n_prb, n, uplink;
+  int cp[2];                   // First symbol of a slot and the others
+  const phy_fft_plan *ifft, *fft;
+  // FFT bin of each subcarrier
+  vector<int> bins;
+  // Uplink: e^(i pi t / n) from t = -cp[0] on, for the half subcarrier
+  vector<phy_complex> shift;
+  vector<phy_complex> frequency, time, work;
+};
+
+PHY_OFDM *
+phy_ofdm_init(int n_prb, int fft_size, int uplink) {
+  static const int sizes[][2] = { { 6, 128 }, { 15, 256 }, { 25, 512 }, { 50, 1024 }, { 75, 1536 }, { 100, 2048 } };
+  if (!fft_size)
+    for (auto &size : sizes)
+      if (n_prb <= size[0] && !fft_size)
+	fft_size = size[1];
+  // Any 2^a 3^b, with room for the guard band, and cyclic prefixes of
+  // whole samples
+  if (n_prb < 6 || n_prb > 110 || 12 * n_prb >= fft_size || fft_size % 128 || !phy_fft_plan_get(fft_size, false)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  phy_ofdm *o = new phy_ofdm;
+  o->n_prb = n_prb;
+  o->n = fft_size;
+  o->uplink = uplink;
+  o->cp[0] = 160 * fft_size / 2048;
+  o->cp[1] = 144 * fft_size / 2048;
+  o->ifft = phy_fft_plan_get(fft_size, true);
+  o->fft = phy_fft_plan_get(fft_size, false);
+  int half = 6 * n_prb;
+  for (int k = 0; k < 12 * n_prb; ++k) {
+    // Downlink leaves the DC subcarrier empty
+    int f = k - half + (!uplink && k >= half);
+    o->bins.push_back((f + fft_size) % fft_size);
+  }
+  if (uplink)
+    for (int t = -o->cp[0]; t < fft_size; ++t)
+      o->shift.push_back({ (float)cos(M_PI * t / fft_size), (float)sin(M_PI * t / fft_size) });
+  o->frequency.resize(fft_size);
+  o->time.resize(fft_size);
+  o->work.resize(fft_size);
+  return o;
+}
+
+void
+phy_ofdm_free(PHY_OFDM *ofdm) {
+  delete ofdm;
+}
+
+int
+phy_ofdm_fft_size(PHY_OFDM *ofdm) {
+  return ofdm->n;
+}
+
+int
+phy_ofdm_samples(PHY_OFDM *o, int first_symbol, int n_symbols) {
+  int samples = 0;
+  for (int l = first_symbol; l < first_symbol + n_symbols; ++l)
+    samples += o->n + o->cp[l % PHY_SYMBOLS_PER_SLOT != 0];
+  return samples;
+}
+
+int
+phy_ofdm_modulate(PHY_OFDM *o, const phy_complex *res, int first_symbol, int n_symbols, phy_complex *samples) {
+  if (first_symbol < 0 || n_symbols < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  const int n = o->n, subcarriers = 12 * o->n_prb;
+  const float scale = 1 / sqrtf(n);
+  phy_complex *out = samples;
+  for (int l = first_symbol; l < first_symbol + n_symbols; ++l, res += subcarriers) {
+    std::fill(o->frequency.begin(), o->frequency.end(), phy_complex{ 0, 0 });
+    for (int k = 0; k < subcarriers; ++k)
+      o->frequency[o->bins[k]] = scale * res[k];
+    phy_fft_run(*o->ifft, o->frequency.data(), o->time.data(), o->work.data());
+    const phy_complex *t = o->time.data();
+    int cp = o->cp[l % PHY_SYMBOLS_PER_SLOT != 0];
+    if (o->uplink) {
+      // The half subcarrier makes the symbol continue with the opposite
+      // sign, so the prefix is rotated along with the rest
+      const phy_complex *shift = o->shift.data() + o->cp[0];
+      for (int i = -cp; i < 0; ++i)
+	*out++ = t[n + i] * shift[i];
+      for (int i = 0; i < n; ++i)
+	*out++ = t[i] * shift[i];
+    } else {
+      memcpy(out, t + n - cp, cp * sizeof(*out));
+      memcpy(out + cp, t, n * sizeof(*out));
+      out += cp + n;
+    }
+  }
+  return out - samples;
+}
+
+int
+phy_ofdm_demodulate(PHY_OFDM *o, const phy_complex *samples, int first_symbol, int n_symbols, phy_complex *res) {
+  if (first_symbol < 0 || n_symbols < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  const int n = o->n, subcarriers = 12 * o->n_prb;
+  const float scale = 1 / sqrtf(n);
+  const phy_complex *in = samples;
+  for (int l = first_symbol; l < first_symbol + n_symbols; ++l, res += subcarriers) {
+    in += o->cp[l % PHY_SYMBOLS_PER_SLOT != 0];
+    const phy_complex *t = in;
+    if (o->uplink) {
+      const phy_complex *shift = o->shift.data() + o->cp[0];
+      for (int i = 0; i < n; ++i)
+	o->time[i] = in[i] * phy_complex{ shift[i].re, -shift[i].im };
+      t = o->time.data();
+    }
+    phy_fft_run(*o->fft, t, o->frequency.data(), o->work.data());
+    for (int k = 0; k < subcarriers; ++k)
+      res[k] = scale * o->frequency[o->bins[k]];
+    in += n;
+  }
+  return in - samples;
+}
@@ -0,0 +1,248 @@
+/*
+   Implement PDCCH blind decoding of 3GPP LTE PHY, 36.213 9.1.1, for DCI
+   formats 0, 1A and 1C
+
+   The common search space and the UE-specific ones of every monitored
+   C-RNTI are pooled into one list of candidates, each position, size and
+   aggregation level once however many search spaces share it. Candidates
+   on CCEs that carry little more than noise are dropped, and the rest of
+   each DCI size go through the Viterbi decoder together, 16 at a time.
+   The RNTI comes out of the CRC, so a candidate is only accepted after
+   decoding, if that RNTI may use it.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "phy.h"
+
+using std::vector;
+
+#define PHY_CCE_BITS 72
+#define PHY_CCE_SYMBOLS 36
+#define PHY_PDCCH_LEVELS 4
+
+// Mean power a CCE must have over the noise to be decoded, against 1 for
+// CCEs in use. Unused CCEs are not transmitted.
+#define PHY_PDCCH_MIN_POWER 0.25f
+
+// Candidates of aggregation levels 1, 2, 4 and 8, Table 9.1.1-1
+static const int phy_ue_candidates[PHY_PDCCH_LEVELS] = { 6, 6, 2, 2 };
+static const int phy_common_candidates[PHY_PDCCH_LEVELS] = { 0, 0, 4, 2 };
+
+struct phy_pdcch_candidate {
+  int cce, level;              // First CCE and aggregation level 1 .. 8
+  bool common;
+};
+
+struct phy_pdcch_monitor {
+  int n_prb;
+  PHY_SCRAMBLING *scrambling;
+  int sizes[2];                // Formats 0 and 1A, 1C, with CRC
+  // Sorted, with Y_k of each subframe
+  vector<int> rntis;
+  vector<uint32_t> y;
+  int decoded;
+  // Of each call
+  vector<int8_t> llrs;
+  vector<float> excess;
+  vector<uint8_t> seen;
+  vector<phy_pdcch_candidate> candidates[2];
+  vector<const int8_t *> candidate_llrs;
+  vector<int> e;
+  vector<uint8_t> decoded_bits;
+};
+
+static inline bool
+phy_rnti_is_common(int rnti) {
+  return (rnti >= 1 && rnti <= PHY_RA_RNTI_MAX) || rnti == PHY_P_RNTI || rnti == PHY_SI_RNTI;
+}
+
+// Y_k of subframe k = 0 .. 9 from Y_-1 = rnti, 9.1.1
+static void
+phy_search_space_y(int rnti, uint32_t *y) {
+  uint32_t value = rnti;
+  for (int k = 0; k < 10; ++k)
+    y[k] = value = 39827 * value % 65537;
+}
+
+// Whether the search space starting at y has a candidate at cce
+static bool
+phy_search_space_has(int y, int candidates, int n_cce, int level, int cce) {
+  int positions = n_cce / level;
+  for (int m = 0; m < candidates; ++m)
+    if (level * ((y + m) % positions) == cce)
+      return true;
+  return false;
+}
+
+PHY_PDCCH_MONITOR *
+phy_pdcch_monitor_init(int cell_id, int n_prb) {
+  int size_0_1a = phy_dci_size(n_prb, PHY_DCI_FORMAT_0), size_1c = phy_dci_size(n_prb, PHY_DCI_FORMAT_1C);
+  PHY_SCRAMBLING *scrambling = size_0_1a > 0 ? phy_scrambling_init(cell_id, n_prb) : NULL;
+  if (!scrambling) {
+    errno = EINVAL;
+    return NULL;
+  }
+  phy_pdcch_monitor *m = new phy_pdcch_monitor;
+  m->n_prb = n_prb;
+  m->scrambling = scrambling;
+  m->sizes[0] = size_0_1a + 16;
+  m->sizes[1] = size_1c + 16;
+  m->decoded = 0;
+  return m;
+}
+
+void
+phy_pdcch_monitor_free(PHY_PDCCH_MONITOR *monitor) {
+  if (monitor)
+    phy_scrambling_free(monitor->scrambling);
+  delete monitor;
+}
+
+int
+phy_pdcch_monitor_rntis(PHY_PDCCH_MONITOR *m, const int *rntis, int n) {
+  for (int i = 0; i < n; ++i)
+    if (rntis[i] < 1 || rntis[i] > 0xfff3) {
+      errno = EINVAL;
+      return -1;
+    }
+  m->rntis.assign(rntis, rntis + n);
+  std::sort(m->rntis.begin(), m->rntis.end());
+  m->rntis.erase(std::unique(m->rntis.begin(), m->rntis.end()), m->rntis.end());
+  m->y.resize(10 * m->rntis.size());
+  for (size_t i = 0; i < m->rntis.size(); ++i)
+    phy_search_space_y(m->rntis[i], &m->y[10 * i]);
+  return 0;
+}
+
+int
+phy_pdcch_monitor_decoded(PHY_PDCCH_MONITOR *monitor) {
+  return monitor->decoded;
+}
+
+/******
+ ** Blind decoding
+ **/
+
+// Adds the candidates of a search space that aren't there yet and have
+// the power of a transmission
+static void
+phy_pdcch_add(phy_pdcch_monitor *m, int n_cce, int y, const int *candidates, bool common, int n_sizes) {
+  for (int li = PHY_PDCCH_LEVELS - 1; li >= 0; --li) {
+    int level = 1 << li, positions = n_cce / level;
+    for (int c = 0; c < candidates[li] && positions; ++c) {
+      int cce = level * ((y + c) % positions);
+      uint8_t &seen = m->seen[li * n_cce + cce];
+      // Bit 1 once the power is known, 2 with enough of it, 3 + s when
+      // listed for size s
+      if (!(seen & 2)) {
+	float excess = 0;
+	for (int i = cce; i < cce + level; ++i)
+	  excess += m->excess[i];
+	seen |= 2 | (excess >= PHY_PDCCH_MIN_POWER * level ? 4 : 0);
+      }
+      if (!(seen & 4))
+	continue;
+      for (int s = 0; s < n_sizes; ++s) {
+	// A common candidate of the size of formats 0 and 1A may also be
+	// in a UE-specific search space
+	auto &list = m->candidates[s];
+	if (!(seen & 1 << (3 + s))) {
+	  seen |= 1 << (3 + s);
+	  list.push_back({ cce, level, common });
+	} else if (common) {
+	  for (auto &candidate : list)
+	    if (candidate.cce == cce && candidate.level == level)
+	      candidate.common = true;
+	}
+      }
+    }
+  }
+}
+
+// Whether the RNTI of a decoded DCI may use the candidate
+static bool
+phy_pdcch_accept(phy_pdcch_monitor *m, int subframe, int n_cce, const phy_pdcch_candidate &c, const phy_dci &dci) {
+  auto it = std::lower_bound(m->rntis.begin(), m->rntis.end(), dci.rnti);
+  bool monitored = it != m->rntis.end() && *it == dci.rnti;
+  if (c.common && (phy_rnti_is_common(dci.rnti) || (monitored && dci.format != PHY_DCI_FORMAT_1C)))
+    return true;
+  if (!monitored || dci.format == PHY_DCI_FORMAT_1C)
+    return false;
+  int li = __builtin_ctz(c.level);
+  return phy_search_space_has(m->y[10 * (it - m->rntis.begin()) + subframe], phy_ue_candidates[li], n_cce, c.level,
+			      c.cce);
+}
+
+int
+phy_pdcch_decode(PHY_PDCCH_MONITOR *m, int subframe, const phy_complex *symbols, int n_cce,
+		 const float *noise_variances, float noise_variance, struct phy_dci *dcis, int *first_cces,
+		 int max_dcis) {
+  int sequence_bits;
+  const uint8_t *sequence = phy_scrambling_get(m->scrambling, PHY_SCRAMBLING_PDCCH, subframe, &sequence_bits);
+  if (!sequence || n_cce < 0 || PHY_CCE_BITS * n_cce > sequence_bits || max_dcis < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  m->llrs.resize(PHY_CCE_BITS * n_cce);
+  if (phy_demodulate(2, symbols, PHY_CCE_SYMBOLS * n_cce, noise_variances, noise_variance, m->llrs.data()) < 0)
+    return -1;
+  phy_descramble_llrs(m->llrs.data(), sequence, PHY_CCE_BITS * n_cce);
+  // Power of each CCE over its noise
+  m->excess.resize(n_cce);
+  for (int cce = 0; cce < n_cce; ++cce) {
+    float power = 0, noise = 0;
+    for (int i = PHY_CCE_SYMBOLS * cce; i < PHY_CCE_SYMBOLS * (cce + 1); ++i) {
+      power += symbols[i].re * symbols[i].re + symbols[i].im * symbols[i].im;
+      noise += noise_variances ? noise_variances[i] : noise_variance;
+    }
+    m->excess[cce] = (power - noise) / PHY_CCE_SYMBOLS;
+  }
+
+  // Largest aggregation levels first, so that of a DCI found at several
+  // levels from the same CCE on the largest is kept
+  m->seen.assign(PHY_PDCCH_LEVELS * n_cce, 0);
+  for (auto &list : m->candidates)
+    list.clear();
+  phy_pdcch_add(m, n_cce, 0, phy_common_candidates, true, 2);
+  for (size_t i = 0; i < m->rntis.size(); ++i)
+    phy_pdcch_add(m, n_cce, m->y[10 * i + subframe], phy_ue_candidates, false, 1);
+  m->decoded = m->candidates[0].size() + m->candidates[1].size();
+
+  int found = 0;
+  for (int s = 0; s < 2; ++s) {
+    auto &list = m->candidates[s];
+    std::sort(list.begin(), list.end(), [](const phy_pdcch_candidate &a, const phy_pdcch_candidate &b) {
+	return a.level != b.level ? a.level > b.level : a.cce < b.cce;
+      });
+    int n = list.size(), size = m->sizes[s], stride = (size + 7) / 8;
+    m->candidate_llrs.resize(n);
+    m->e.resize(n);
+    for (int i = 0; i < n; ++i) {
+      m->candidate_llrs[i] = m->llrs.data() + PHY_CCE_BITS * list[i].cce;
+      m->e[i] = PHY_CCE_BITS * list[i].level;
+    }
+    m->decoded_bits.resize(n * stride);
+    if (n && phy_conv_decode_batch(m->candidate_llrs.data(), m->e.data(), n, size, m->decoded_bits.data()) < 0)
+      return -1;
+    for (int i = 0; i < n && found < max_dcis; ++i) {
+      phy_dci dci;
+      if (phy_dci_unpack(m->n_prb, m->decoded_bits.data() + i * stride, size, &dci) ||
+	  !phy_pdcch_accept(m, subframe, n_cce, list[i], dci))
+	continue;
+      // The same DCI again from CCEs of one already found
+      bool again = false;
+      for (int j = 0; j < found && !again; ++j)
+	again = !memcmp(&dcis[j], &dci, sizeof(dci));
+      if (again)
+	continue;
+      if (first_cces)
+	first_cces[found] = list[i].cce;
+      dcis[found++] = dci;
+    }
+  }
+  return found;
+}
@@ -0,0 +1,295 @@
+/*
+   Implement scrambling of 3GPP LTE PHY, 36.211 7.2
+
+   The two m-sequences of the Gold sequence are stepped 64 bits at a time
+   with their characteristic polynomials raised to the 4th power, so that
+   each new word only depends on the two before it. With AVX2 the 16th
+   power gives four words from the eight before them. The state at
+   N_c = 1600 is looked up by the bytes of c_init instead of clocked there.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "phy.h"
+#include "cpu.hh"
+#include "phy_bits.hh"
+
+using std::vector;
+
+#define PHY_GOLD_NC 1600
+// Words of x1 and x2 kept between steps
+#define PHY_GOLD_HISTORY 8
+#define PHY_GOLD_CHUNK 64
+
+/******
+ ** Gold sequence
+ **/
+
+// x1 and x2 from x(PHY_GOLD_NC) on, one bit at a time
+static constexpr void
+phy_gold_clock(uint32_t x, bool second, uint64_t *words) {
+  for (int n = 0; n < PHY_GOLD_NC + 128; ++n) {
+    if (n >= PHY_GOLD_NC && (x & 1))
+      words[(n - PHY_GOLD_NC) / 64] |= 1ull << (63 - (n - PHY_GOLD_NC) % 64);
+    uint32_t next = second ? x ^ x >> 1 ^ x >> 2 ^ x >> 3 : x ^ x >> 3;
+    x = x >> 1 | (next & 1) << 30;
+  }
+}
+
+// First two words of x1, and of x2 for each byte of c_init
+struct phy_gold_start {
+  uint64_t x1[2];
+  uint64_t x2[4][256][2];
+  constexpr phy_gold_start() : x1(), x2() {
+    phy_gold_clock(1, false, x1);
+    uint64_t basis[31][2] = {};
+    for (int bit = 0; bit < 31; ++bit)
+      phy_gold_clock(1u << bit, true, basis[bit]);
+    for (int byte = 0; byte < 4; ++byte)
+      for (int value = 0; value < 256; ++value)
+	for (int bit = 0; bit < 8 && 8 * byte + bit < 31; ++bit)
+	  if (value & (1 << bit))
+	    for (int k = 0; k < 2; ++k)
+	      x2[byte][value][k] ^= basis[8 * byte + bit][k];
+  }
+};
+static constexpr phy_gold_start phy_gold_start_lut;
+
+struct phy_gold {
+  uint64_t x1[PHY_GOLD_HISTORY], x2[PHY_GOLD_HISTORY];
+  int pending; // Words of c in the history not yet output
+};
+
+static inline uint64_t
+phy_gold_extract(uint64_t a, uint64_t b, int shift) {
+  return a << shift | b >> (64 - shift);
+}
+
+// Word j of x1 and x2 from words j - 2 and j - 1. Returns word j of c.
+static inline uint64_t
+phy_gold_step(uint64_t *x1, uint64_t *x2, int j) {
+  uint64_t a = x1[j - 2], b = x1[j - 1];
+  x1[j] = phy_gold_extract(a, b, 16) ^ phy_gold_extract(a, b, 4);
+  a = x2[j - 2], b = x2[j - 1];
+  x2[j] = phy_gold_extract(a, b, 16) ^ phy_gold_extract(a, b, 12)
+    ^ phy_gold_extract(a, b, 8) ^ phy_gold_extract(a, b, 4);
+  return x1[j] ^ x2[j];
+}
+
+static inline void
+phy_store_word(uint8_t *out, uint64_t word) {
+  word = __builtin_bswap64(word);
+  memcpy(out, &word, 8);
+}
+
+static void
+phy_gold_init(phy_gold &g, uint32_t c_init) {
+  c_init &= 0x7fffffff;
+  for (int k = 0; k < 2; ++k) {
+    g.x1[k] = phy_gold_start_lut.x1[k];
+    g.x2[k] = 0;
+    for (int byte = 0; byte < 4; ++byte)
+      g.x2[k] ^= phy_gold_start_lut.x2[byte][(c_init >> 8 * byte) & 0xff][k];
+  }
+  for (int j = 2; j < PHY_GOLD_HISTORY; ++j)
+    phy_gold_step(g.x1, g.x2, j);
+  g.pending = PHY_GOLD_HISTORY;
+}
+
+#ifdef CPU_X86
+// n words, a multiple of 4, after the PHY_GOLD_HISTORY words before x1 and x2
+__attribute__((target("avx2"))) static void
+phy_gold_steps_avx2(uint64_t *x1, uint64_t *x2, uint8_t *out, int n) {
+  const __m256i bswap = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+					 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  __m256i a0 = _mm256_loadu_si256((const __m256i *)(x1 - 8)), a1 = _mm256_loadu_si256((const __m256i *)(x1 - 4));
+  __m256i b0 = _mm256_loadu_si256((const __m256i *)(x2 - 8)), b1 = _mm256_loadu_si256((const __m256i *)(x2 - 4));
+  for (int j = 0; j < n; j += 4) {
+    // Words j - 8 .. j - 5 and j - 7 .. j - 4
+    __m256i a = a0, b = _mm256_permute4x64_epi64(_mm256_blend_epi32(a0, a1, 0x03), 0x39);
+    __m256i next1 = _mm256_xor_si256(b, _mm256_or_si256(_mm256_slli_epi64(a, 16), _mm256_srli_epi64(b, 48)));
+    a = b0, b = _mm256_permute4x64_epi64(_mm256_blend_epi32(b0, b1, 0x03), 0x39);
+    __m256i next2 = _mm256_xor_si256(b, _mm256_or_si256(_mm256_slli_epi64(a, 48), _mm256_srli_epi64(b, 16)));
+    next2 = _mm256_xor_si256(next2, _mm256_or_si256(_mm256_slli_epi64(a, 32), _mm256_srli_epi64(b, 32)));
+    next2 = _mm256_xor_si256(next2, _mm256_or_si256(_mm256_slli_epi64(a, 16), _mm256_srli_epi64(b, 48)));
+    _mm256_storeu_si256((__m256i *)(out + 8 * j), _mm256_shuffle_epi8(_mm256_xor_si256(next1, next2), bswap));
+    a0 = a1, a1 = next1, b0 = b1, b1 = next2;
+  }
+  _mm256_storeu_si256((__m256i *)(x1 + n - 8), a0);
+  _mm256_storeu_si256((__m256i *)(x1 + n - 4), a1);
+  _mm256_storeu_si256((__m256i *)(x2 + n - 8), b0);
+  _mm256_storeu_si256((__m256i *)(x2 + n - 4), b1);
+}
+#endif
+
+// Next n words of c, most significant byte first
+static void
+phy_gold_next(phy_gold &g, uint8_t *out, int n) {
+  for (; g.pending && n; --g.pending, --n, out += 8)
+    phy_store_word(out, g.x1[PHY_GOLD_HISTORY - g.pending] ^ g.x2[PHY_GOLD_HISTORY - g.pending]);
+  while (n) {
+    int chunk = std::min(n, PHY_GOLD_CHUNK), j = 0;
+    uint64_t x1[PHY_GOLD_HISTORY + PHY_GOLD_CHUNK], x2[PHY_GOLD_HISTORY + PHY_GOLD_CHUNK];
+    memcpy(x1, g.x1, sizeof(g.x1));
+    memcpy(x2, g.x2, sizeof(g.x2));
+#ifdef CPU_X86
+    if (chunk >= 16 && cpu_has(CPU_AVX2)) {
+      j = chunk & ~3;
+      phy_gold_steps_avx2(x1 + PHY_GOLD_HISTORY, x2 + PHY_GOLD_HISTORY, out, j);
+    }
+#endif
+    for (; j < chunk; ++j)
+      phy_store_word(out + 8 * j, phy_gold_step(x1, x2, PHY_GOLD_HISTORY + j));
+    memcpy(g.x1, x1 + chunk, sizeof(g.x1));
+    memcpy(g.x2, x2 + chunk, sizeof(g.x2));
+    out += 8 * chunk;
+    n -= chunk;
+  }
+}
+
+void
+phy_gold_sequence(uint32_t c_init, void *out, int size_in_bits) {
+  phy_gold g;
+  phy_gold_init(g, c_init);
+  uint8_t *o = (uint8_t *)out;
+  int words = size_in_bits / 64, rest = (size_in_bits % 64 + 7) / 8;
+  phy_gold_next(g, o, words);
+  if (rest) {
+    uint8_t last[8];
+    phy_gold_next(g, last, 1);
+    memcpy(o + 8 * words, last, rest);
+  }
+}
+
+void
+phy_gold_scramble(uint32_t c_init, void *bits, int size_in_bits) {
+  phy_gold g;
+  phy_gold_init(g, c_init);
+  uint8_t sequence[8 * PHY_GOLD_CHUNK], *b = (uint8_t *)bits;
+  for (int done = 0; done < size_in_bits; done += 64 * PHY_GOLD_CHUNK) {
+    int size = std::min(size_in_bits - done, 64 * PHY_GOLD_CHUNK);
+    phy_gold_next(g, sequence, (size + 63) / 64);
+    phy_scramble(b + done / 8, sequence, size);
+  }
+}
+
+/******
+ ** Scrambling
+ **/
+
+void
+phy_scramble(void *bits, const void *sequence, int size_in_bits) {
+  uint8_t *b = (uint8_t *)bits;
+  const uint8_t *s = (const uint8_t *)sequence;
+  int bytes = size_in_bits / 8, i = 0;
+#ifdef __SSE2__
+  for (; i + 16 <= bytes; i += 16)
+    _mm_storeu_si128((__m128i *)(b + i), _mm_xor_si128(_mm_loadu_si128((const __m128i *)(b + i)),
+						       _mm_loadu_si128((const __m128i *)(s + i))));
+#endif
+  for (; i < bytes; ++i)
+    b[i] ^= s[i];
+  if (size_in_bits % 8)
+    b[bytes] ^= s[bytes] & (0xff00 >> size_in_bits % 8);
+}
+
+void
+phy_descramble_llrs(int8_t *llrs, const void *sequence, int n) {
+  const uint8_t *s = (const uint8_t *)sequence;
+  int i = 0;
+#ifdef __SSE2__
+  // Spread two sequence bytes over 16 LLRs, one bit each
+  const __m128i bit = _mm_set1_epi64x(0x0102040810204080);
+  for (; i + 16 <= n; i += 16) {
+    __m128i m = _mm_set_epi64x(s[i / 8 + 1] * 0x0101010101010101ull, s[i / 8] * 0x0101010101010101ull);
+    m = _mm_cmpeq_epi8(_mm_and_si128(m, bit), bit);
+    __m128i l = _mm_loadu_si128((const __m128i *)(llrs + i));
+    _mm_storeu_si128((__m128i *)(llrs + i), _mm_sub_epi8(_mm_xor_si128(l, m), m));
+  }
+#endif
+  for (; i < n; ++i)
+    if (s[i / 8] & (0x80 >> i % 8))
+      llrs[i] = -llrs[i];
+}
+
+/******
+ ** Sequences of a cell
+ **/
+
+struct phy_scrambling {
+  int cell_id, n_prb;
+  int size_in_bits[PHY_SCRAMBLING_CHANNELS];
+  size_t offset[PHY_SCRAMBLING_CHANNELS][10];
+  vector<uint8_t> sequences;
+};
+
+PHY_SCRAMBLING *
+phy_scrambling_init(int cell_id, int n_prb) {
+  if (cell_id < 0 || cell_id > 503 || n_prb < 6 || n_prb > 110) {
+    errno = EINVAL;
+    return NULL;
+  }
+  phy_scrambling *s = new phy_scrambling;
+  s->cell_id = cell_id;
+  s->n_prb = n_prb;
+  // PDCCH of at most 3 symbols, 4 below 11 RBs, with one antenna port
+  s->size_in_bits[PHY_SCRAMBLING_PDCCH] = (n_prb <= 10 ? 88 : 64) * n_prb;
+  s->size_in_bits[PHY_SCRAMBLING_PCFICH] = 32;
+  s->size_in_bits[PHY_SCRAMBLING_PBCH] = PHY_PBCH_SIZE_IN_BITS;
+  s->size_in_bits[PHY_SCRAMBLING_CRS] = 4 * n_prb;
+  int crs_stride = (4 * n_prb + 7) / 8;
+
+  size_t size = 0;
+  for (int channel = 0; channel < PHY_SCRAMBLING_CHANNELS; ++channel)
+    for (int subframe = 0; subframe < 10; ++subframe) {
+      s->offset[channel][subframe] = size;
+      if (channel == PHY_SCRAMBLING_PBCH && subframe)
+	s->offset[channel][subframe] = s->offset[channel][0];
+      else
+	size += channel == PHY_SCRAMBLING_CRS ? 4 * crs_stride : (s->size_in_bits[channel] + 7) / 8;
+    }
+  s->sequences.resize(size);
+
+  uint8_t *base = s->sequences.data();
+  phy_gold_sequence(cell_id, base + s->offset[PHY_SCRAMBLING_PBCH][0], PHY_PBCH_SIZE_IN_BITS);
+  for (uint32_t subframe = 0; subframe < 10; ++subframe) {
+    phy_gold_sequence((subframe << 9) + cell_id, base + s->offset[PHY_SCRAMBLING_PDCCH][subframe],
+		      s->size_in_bits[PHY_SCRAMBLING_PDCCH]);
+    phy_gold_sequence(((subframe + 1) * (2 * cell_id + 1) << 9) + cell_id,
+		      base + s->offset[PHY_SCRAMBLING_PCFICH][subframe], 32);
+    // Symbols 0 and 4 of both slots. Sequences are for 110 RBs and the
+    // middle 2 * n_prb of their pairs of bits is used. One byte more is
+    // generated for phy_copy_bits() to read.
+    static const int symbols[4][2] = { { 0, 0 }, { 0, 4 }, { 1, 0 }, { 1, 4 } };
+    for (int k = 0; k < 4; ++k) {
+      uint32_t slot = 2 * subframe + symbols[k][0], l = symbols[k][1];
+      uint8_t full[448 / 8];
+      phy_gold_sequence((7 * (slot + 1) + l + 1) * (2 * cell_id + 1) << 10 | (2 * cell_id + 1), full, 448);
+      phy_copy_bits(base + s->offset[PHY_SCRAMBLING_CRS][subframe] + k * crs_stride, full,
+		    2 * (110 - n_prb), 4 * n_prb);
+    }
+  }
+  return s;
+}
+
+void
+phy_scrambling_free(PHY_SCRAMBLING *scrambling) {
+  delete scrambling;
+}
+
+const uint8_t *
+phy_scrambling_get(PHY_SCRAMBLING *s, int channel, int subframe, int *size_in_bits) {
+  if (channel < 0 || channel >= PHY_SCRAMBLING_CHANNELS || subframe < 0 || subframe >= 10) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if (size_in_bits)
+    *size_in_bits = s->size_in_bits[channel];
+  return s->sequences.data() + s->offset[channel][subframe];
+}
@@ -0,0 +1,440 @@
+/*
+   Implement cell search and synchronization to the 3GPP LTE PHY downlink
+   with the primary and secondary synchronization signals of 36.211 6.11,
+   as in Sync_model.md
+
+   Samples stream through phy_sync_process(), which takes the carrier
+   frequency offset off them. Until a cell is found, every lag of a half
+   frame is correlated with the three PSS by overlap-save FFTs. The best
+   peak is confirmed by SSS, equalized with the channel seen on PSS and
+   compared with all 336 sequences of that PSS, which also tells whether
+   it was subframe 0 or 5. From then on PSS is only correlated within a
+   few samples of where it should be. Fractional timing comes from the
+   phase slope of PSS across its subcarriers, to be corrected in the
+   frequency domain, and the frequency offset within half a subcarrier
+   from the cyclic prefixes of the slot before, each through a first
+   order loop.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <algorithm>
+
+#include "phy.h"
+
+using std::vector;
+
+#define PHY_SYNC_LENGTH 62
+// Normalized correlation of a PSS peak and of an SSS
+#define PHY_PSS_THRESHOLD 0.1f
+#define PHY_SSS_THRESHOLD 0.5f
+// Samples either side of the expected PSS when tracking
+#define PHY_SYNC_WINDOW 2
+// Half frames without PSS before searching again
+#define PHY_SYNC_MISSES 8
+// Gains of the timing and frequency loops
+#define PHY_SYNC_TIMING_GAIN 0.5
+#define PHY_SYNC_CFO_GAIN 0.5
+
+typedef std::complex<float> cfloat;
+
+/******
+ ** Sequences
+ **/
+
+// x~(i) of s~, c~ and z~ in 6.11.2.1 as +-1
+struct phy_sss_tables {
+  int8_t s[31], c[31], z[31];
+  constexpr phy_sss_tables() : s(), c(), z() {
+    int xs[31] = { 0, 0, 0, 0, 1 }, xc[31] = { 0, 0, 0, 0, 1 }, xz[31] = { 0, 0, 0, 0, 1 };
+    for (int i = 0; i + 5 < 31; ++i) {
+      xs[i + 5] = (xs[i + 2] + xs[i]) % 2;
+      xc[i + 5] = (xc[i + 3] + xc[i]) % 2;
+      xz[i + 5] = (xz[i + 4] + xz[i + 2] + xz[i + 1] + xz[i]) % 2;
+    }
+    for (int i = 0; i < 31; ++i) {
+      s[i] = 1 - 2 * xs[i];
+      c[i] = 1 - 2 * xc[i];
+      z[i] = 1 - 2 * xz[i];
+    }
+  }
+};
+static constexpr phy_sss_tables phy_sss_lut;
+
+int
+phy_pss(int n_id2, phy_complex *symbols) {
+  static const int roots[3] = { 25, 29, 34 };
+  if (n_id2 < 0 || n_id2 > 2) {
+    errno = EINVAL;
+    return -1;
+  }
+  for (int n = 0; n < PHY_SYNC_LENGTH; ++n) {
+    int m = n < 31 ? n * (n + 1) : (n + 1) * (n + 2);
+    double angle = -M_PI * (roots[n_id2] * m % 126) / 63;
+    symbols[n] = { (float)cos(angle), (float)sin(angle) };
+  }
+  return PHY_SYNC_LENGTH;
+}
+
+// d(n) of 6.11.2.1 as +-1
+static void
+phy_sss_sequence(int n_id1, int n_id2, int subframe, int8_t *d) {
+  const phy_sss_tables &t = phy_sss_lut;
+  int q1 = n_id1 / 30, q = (n_id1 + q1 * (q1 + 1) / 2) / 30, m1 = n_id1 + q * (q + 1) / 2;
+  int m0 = m1 % 31;
+  m1 = (m0 + m1 / 31 + 1) % 31;
+  if (subframe)
+    std::swap(m0, m1);
+  for (int n = 0; n < 31; ++n) {
+    d[2 * n] = t.s[(n + m0) % 31] * t.c[(n + n_id2) % 31];
+    d[2 * n + 1] = t.s[(n + m1) % 31] * t.c[(n + n_id2 + 3) % 31] * t.z[(n + m0 % 8) % 31];
+  }
+}
+
+int
+phy_sss(int cell_id, int subframe, phy_complex *symbols) {
+  if (cell_id < 0 || cell_id > 503 || (subframe != 0 && subframe != 5)) {
+    errno = EINVAL;
+    return -1;
+  }
+  int8_t d[PHY_SYNC_LENGTH];
+  phy_sss_sequence(cell_id / 3, cell_id % 3, subframe, d);
+  for (int n = 0; n < PHY_SYNC_LENGTH; ++n)
+    symbols[n] = { (float)d[n], 0 };
+  return PHY_SYNC_LENGTH;
+}
+
+/******
+ ** Search and tracking
+ **/
+
+struct phy_sync {
+  int n, cp[2];
+  int subframe, half_frame;    // Samples
+  int pss_offset;              // From the start of a subframe to PSS after its cyclic prefix
+  int block, step;             // Of the overlap-save correlation
+  phy_complex pss[3][PHY_SYNC_LENGTH];
+  vector<int> bins;            // FFT bin of each PSS and SSS subcarrier
+  vector<phy_complex> replica[3], spectrum[3];
+  float replica_energy;
+
+  phy_sync_state state;
+  // Samples from stream index position on, frequency corrected
+  int64_t position;
+  vector<phy_complex> history;
+  double phase;                // Of the correction at the next sample, in cycles
+  // Searching: lags from search_start up to searched correlated
+  int64_t search_start, searched, best_at;
+  float best;
+  int best_id2;
+  // Tracking: PSS of n_id2 expected after cyclic prefix at next_pss
+  int n_id2, pss_subframe, misses;
+  int64_t next_pss;
+  vector<phy_complex> a, b, c, rotation;
+  vector<float> energies;      // Of the n samples from each lag of a block
+};
+
+static inline cfloat
+phy_c(phy_complex x) {
+  return cfloat(x.re, x.im);
+}
+
+PHY_SYNC *
+phy_sync_init(int fft_size) {
+  vector<phy_complex> probe(fft_size > 0 ? 2 * fft_size : 0);
+  if (fft_size < 128 || fft_size > 2048 || fft_size % 128 || phy_fft(fft_size, 0, probe.data(), probe.data() + fft_size) < 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  phy_sync *s = new phy_sync;
+  int n = s->n = fft_size;
+  s->cp[0] = 160 * n / 2048;
+  s->cp[1] = 144 * n / 2048;
+  s->subframe = 2 * (s->cp[0] + 6 * s->cp[1] + PHY_SYMBOLS_PER_SLOT * n);
+  s->half_frame = 5 * s->subframe;
+  s->pss_offset = s->cp[0] + n + 5 * (s->cp[1] + n) + s->cp[1];
+  s->block = n <= 1024 ? 4 * n : 2 * n;
+  s->step = s->block - n;
+  // Subcarriers -31 .. -1 and 1 .. 31 around DC
+  for (int k = 0; k < PHY_SYNC_LENGTH; ++k)
+    s->bins.push_back((k - 31 + (k >= 31) + n) % n);
+  vector<phy_complex> frequency(s->block), padded(s->block);
+  for (int id2 = 0; id2 < 3; ++id2) {
+    phy_pss(id2, s->pss[id2]);
+    frequency.assign(n, { 0, 0 });
+    for (int k = 0; k < PHY_SYNC_LENGTH; ++k)
+      frequency[s->bins[k]] = s->pss[id2][k];
+    s->replica[id2].resize(n);
+    phy_fft(n, 1, frequency.data(), s->replica[id2].data());
+    std::copy(s->replica[id2].begin(), s->replica[id2].end(), padded.begin());
+    std::fill(padded.begin() + n, padded.end(), phy_complex{ 0, 0 });
+    s->spectrum[id2].resize(s->block);
+    phy_fft(s->block, 0, padded.data(), s->spectrum[id2].data());
+    // Conjugated and with the 1 / block of the inverse FFT
+    for (auto &x : s->spectrum[id2])
+      x = { x.re / s->block, -x.im / s->block };
+  }
+  s->replica_energy = 0;
+  for (auto &x : s->replica[0])
+    s->replica_energy += x.re * x.re + x.im * x.im;
+
+  s->state = { -1, 0, 0, 0, 0 };
+  s->position = 0;
+  s->phase = 0;
+  s->search_start = s->searched = s->best_at = 0;
+  s->best = 0;
+  s->best_id2 = 0;
+  s->n_id2 = s->pss_subframe = s->misses = 0;
+  s->next_pss = 0;
+  s->a.resize(s->block);
+  s->b.resize(s->block);
+  s->c.resize(s->block);
+  s->energies.resize(s->step);
+  return s;
+}
+
+void
+phy_sync_free(PHY_SYNC *sync) {
+  delete sync;
+}
+
+void
+phy_sync_get(PHY_SYNC *sync, struct phy_sync_state *state) {
+  *state = sync->state;
+}
+
+static inline const phy_complex *
+phy_sync_at(phy_sync *s, int64_t t) {
+  return s->history.data() + (t - s->position);
+}
+
+// Channel on the PSS subcarriers with useful part at t, and the delay of
+// the symbol after t in samples from the phase slope across them. Phases
+// 32 subcarriers apart tell it within n / 64 samples, which is plenty
+// after the correlation peak, with far less noise than neighbours would.
+static double
+phy_pss_channel(phy_sync *s, int64_t t, int id2, cfloat *h) {
+  phy_fft(s->n, 0, phy_sync_at(s, t), s->a.data());
+  cfloat slope = 0;
+  for (int k = 0; k < PHY_SYNC_LENGTH; ++k) {
+    h[k] = phy_c(s->a[s->bins[k]]) * std::conj(phy_c(s->pss[id2][k]));
+    if (k >= 31)
+      slope += h[k] * std::conj(h[k - 31]);
+  }
+  return -std::arg(slope) * s->n / (2 * M_PI * 32);
+}
+
+// Frequency offset in subcarriers from the cyclic prefixes of the slot
+// before PSS at t, leaving out the first quarter of each to intersymbol
+// interference
+static double
+phy_sync_cfo(phy_sync *s, int64_t t) {
+  cfloat r = 0;
+  int64_t useful = t;
+  for (int l = PHY_SYMBOLS_PER_SLOT - 1; l >= 0; --l) {
+    int cp = s->cp[l != 0];
+    const phy_complex *x = phy_sync_at(s, useful - cp);
+    for (int i = cp / 4; i < cp; ++i)
+      r += std::conj(phy_c(x[i])) * phy_c(x[i + s->n]);
+    useful -= cp + s->n;
+  }
+  return std::arg(r) / (2 * M_PI);
+}
+
+// Normalized correlation with PSS of id2 at t
+static float
+phy_pss_metric(phy_sync *s, int64_t t, int id2) {
+  const phy_complex *x = phy_sync_at(s, t), *r = s->replica[id2].data();
+  cfloat c = 0;
+  float energy = 0;
+  for (int i = 0; i < s->n; ++i) {
+    c += phy_c(x[i]) * std::conj(phy_c(r[i]));
+    energy += x[i].re * x[i].re + x[i].im * x[i].im;
+  }
+  return std::norm(c) / (s->replica_energy * energy + 1e-30f);
+}
+
+// Takes the cell of PSS at t if SSS before it agrees
+static bool
+phy_sync_acquire(phy_sync *s, int64_t t, int id2, float metric) {
+  cfloat h[PHY_SYNC_LENGTH], z[PHY_SYNC_LENGTH];
+  double delay = phy_pss_channel(s, t, id2, h);
+  phy_fft(s->n, 0, phy_sync_at(s, t - s->n - s->cp[1]), s->a.data());
+  float energy = 0;
+  for (int k = 0; k < PHY_SYNC_LENGTH; ++k) {
+    z[k] = phy_c(s->a[s->bins[k]]) * std::conj(h[k]);
+    energy += std::norm(z[k]);
+  }
+  // Magnitudes, as frequency offset turns the phase between the symbols
+  float best = 0;
+  int best_id1 = 0, best_subframe = 0;
+  for (int id1 = 0; id1 < 168; ++id1)
+    for (int subframe : { 0, 5 }) {
+      int8_t d[PHY_SYNC_LENGTH];
+      phy_sss_sequence(id1, id2, subframe, d);
+      cfloat c = 0;
+      for (int k = 0; k < PHY_SYNC_LENGTH; ++k)
+	c += z[k] * (float)d[k];
+      if (std::norm(c) > best) {
+	best = std::norm(c);
+	best_id1 = id1;
+	best_subframe = subframe;
+      }
+    }
+  if (best < PHY_SSS_THRESHOLD * PHY_SSS_THRESHOLD * PHY_SYNC_LENGTH * energy)
+    return false;
+  int shift = lround(delay);
+  s->n_id2 = id2;
+  s->misses = 0;
+  s->next_pss = t + shift;
+  s->state.cell_id = 3 * best_id1 + id2;
+  s->state.timing = delay - shift;
+  s->state.cfo += phy_sync_cfo(s, t);
+  s->state.quality = metric;
+  s->state.frame_start = s->next_pss - s->pss_offset - (best_subframe ? 5 * s->subframe : 0);
+  s->next_pss += s->half_frame;
+  s->pss_subframe = 5 - best_subframe;
+  return true;
+}
+
+// Correlates one block of lags. Returns false without enough samples.
+static bool
+phy_sync_search(phy_sync *s) {
+  const int n = s->n;
+  if (s->searched + s->block > s->position + (int64_t)s->history.size())
+    return false;
+  const phy_complex *x = phy_sync_at(s, s->searched);
+  phy_fft(s->block, 0, x, s->a.data());
+  // Energy of the n samples from each lag
+  float energy = 0;
+  for (int i = 0; i < n; ++i)
+    energy += x[i].re * x[i].re + x[i].im * x[i].im;
+  for (int lag = 0; lag < s->step; ++lag) {
+    s->energies[lag] = std::max(energy, 1e-30f);
+    energy += x[lag + n].re * x[lag + n].re + x[lag + n].im * x[lag + n].im
+      - x[lag].re * x[lag].re - x[lag].im * x[lag].im;
+  }
+  // Acquisition reads back the slot before PSS, so a PSS with less of the
+  // stream before it is left for the next half frame
+  int first = (int)std::max<int64_t>(0, s->position + s->subframe / 2 - s->searched);
+  for (int id2 = 0; id2 < 3; ++id2) {
+    for (int i = 0; i < s->block; ++i)
+      s->b[i] = { s->a[i].re * s->spectrum[id2][i].re - s->a[i].im * s->spectrum[id2][i].im,
+		  s->a[i].re * s->spectrum[id2][i].im + s->a[i].im * s->spectrum[id2][i].re };
+    phy_fft(s->block, 1, s->b.data(), s->c.data());
+    for (int lag = first; lag < s->step; ++lag) {
+      float metric = (s->c[lag].re * s->c[lag].re + s->c[lag].im * s->c[lag].im)
+	/ (s->replica_energy * s->energies[lag]);
+      if (metric > s->best) {
+	s->best = metric;
+	s->best_at = s->searched + lag;
+	s->best_id2 = id2;
+      }
+    }
+  }
+  s->searched += s->step;
+  // A half frame of lags has a PSS
+  if (s->searched - s->search_start >= s->half_frame + n) {
+    if (!(s->best >= PHY_PSS_THRESHOLD && phy_sync_acquire(s, s->best_at, s->best_id2, s->best))) {
+      s->search_start = s->searched;
+      s->best = 0;
+    }
+  }
+  return true;
+}
+
+// Follows PSS expected at next_pss. Returns false without enough samples.
+static bool
+phy_sync_track(phy_sync *s) {
+  if (s->next_pss + s->n + PHY_SYNC_WINDOW > s->position + (int64_t)s->history.size())
+    return false;
+  float best = -1;
+  int offset = 0;
+  for (int d = -PHY_SYNC_WINDOW; d <= PHY_SYNC_WINDOW; ++d) {
+    float metric = phy_pss_metric(s, s->next_pss + d, s->n_id2);
+    if (metric > best) {
+      best = metric;
+      offset = d;
+    }
+  }
+  s->state.quality = best;
+  if (best < PHY_PSS_THRESHOLD) {
+    if (++s->misses >= PHY_SYNC_MISSES) {
+      s->state.cell_id = -1;
+      s->search_start = s->searched = s->next_pss;
+      s->best = 0;
+      return true;
+    }
+  } else {
+    s->misses = 0;
+    cfloat h[PHY_SYNC_LENGTH];
+    double error = offset + phy_pss_channel(s, s->next_pss + offset, s->n_id2, h) - s->state.timing;
+    s->state.timing += PHY_SYNC_TIMING_GAIN * error;
+    int shift = lround(s->state.timing);
+    s->next_pss += shift;
+    s->state.timing -= shift;
+    s->state.cfo += PHY_SYNC_CFO_GAIN * phy_sync_cfo(s, s->next_pss);
+  }
+  s->state.frame_start = s->next_pss - s->pss_offset - (s->pss_subframe ? 5 * s->subframe : 0);
+  s->next_pss += s->half_frame;
+  s->pss_subframe = 5 - s->pss_subframe;
+  return true;
+}
+
+int
+phy_sync_process(PHY_SYNC *s, const phy_complex *samples, int n, phy_complex *out) {
+  if (n < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  // Chunks short enough for the loops to see their own corrections
+  const int chunk = s->half_frame / 4;
+  for (int done = 0; done < n; ) {
+    int size = std::min(n - done, chunk);
+    // The correction is recomputed exactly every 1024 samples
+    for (int i = done; i < done + size; i += 1024) {
+      int m = std::min(done + size - i, 1024);
+      cfloat w = std::polar(1.0f, (float)(-2 * M_PI * s->phase));
+      cfloat rotation = std::polar(1.0f, (float)(-2 * M_PI * s->state.cfo / s->n));
+      for (int j = i; j < i + m; ++j) {
+	cfloat y = phy_c(samples[j]) * w;
+	out[j] = { y.real(), y.imag() };
+	w *= rotation;
+      }
+      s->phase += m * s->state.cfo / s->n;
+      s->phase -= floor(s->phase);
+    }
+    s->history.insert(s->history.end(), out + done, out + done + size);
+    done += size;
+    while (s->state.cell_id < 0 ? phy_sync_search(s) : phy_sync_track(s))
+      ;
+    // Enough for a half frame of search and the subframe before its PSS
+    size_t keep = s->half_frame + s->subframe + 2 * s->block;
+    if (s->history.size() > 2 * keep) {
+      size_t drop = s->history.size() - keep;
+      s->history.erase(s->history.begin(), s->history.begin() + drop);
+      s->position += drop;
+    }
+  }
+  return 0;
+}
+
+void
+phy_sync_correct(PHY_SYNC *s, int n_prb, phy_complex *res, int n_symbols) {
+  // e^(2 pi i f timing / n) on subcarrier f from DC
+  const int subcarriers = 12 * n_prb;
+  s->rotation.resize(subcarriers);
+  for (int k = 0; k < subcarriers; ++k) {
+    int f = k - 6 * n_prb + (k >= 6 * n_prb);
+    double angle = 2 * M_PI * f * s->state.timing / s->n;
+    s->rotation[k] = { (float)cos(angle), (float)sin(angle) };
+  }
+  for (int l = 0; l < n_symbols; ++l)
+    for (int k = 0; k < subcarriers; ++k) {
+      cfloat y = phy_c(res[l * subcarriers + k]) * phy_c(s->rotation[k]);
+      res[l * subcarriers + k] = { y.real(), y.imag() };
+    }
+}
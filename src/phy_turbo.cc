@@ -0,0 +1,459 @@
+/*
+   Implement DL-SCH and UL-SCH transport block coding of 3GPP LTE PHY,
+   36.212 5.1.1 to 5.1.5
+
+   Code blocks stay packed all the way. The constituent encoders go eight
+   bits at a time through a table, and the sub-block interleavers read the
+   columns of their 32 bit rows by transposing them. Only the QPP
+   interleaver gathers single bits, eight at a time with AVX2. The plan
+   keeps the circular buffer as runs between <NULL> bits, so bit selection
+   and pruning is copying runs.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "phy.h"
+#include "phy_bits.hh"
+#include "phy_turbo.hh"
+
+using std::vector;
+
+#define PHY_TURBO_BLOCK_SIZES 188
+
+/******
+ ** QPP interleavers
+ **/
+
+// K, f1 and f2 of Table 5.1.3-3
+static const uint16_t phy_qpp_parameters[PHY_TURBO_BLOCK_SIZES][3] = {
+  { 40, 3, 10 }, { 48, 7, 12 }, { 56, 19, 42 }, { 64, 7, 16 }, { 72, 7, 18 }, { 80, 11, 20 },
+  { 88, 5, 22 }, { 96, 11, 24 }, { 104, 7, 26 }, { 112, 41, 84 }, { 120, 103, 90 }, { 128, 15, 32 },
+  { 136, 9, 34 }, { 144, 17, 108 }, { 152, 9, 38 }, { 160, 21, 120 }, { 168, 101, 84 }, { 176, 21, 44 },
+  { 184, 57, 46 }, { 192, 23, 48 }, { 200, 13, 50 }, { 208, 27, 52 }, { 216, 11, 36 }, { 224, 27, 56 },
+  { 232, 85, 58 }, { 240, 29, 60 }, { 248, 33, 62 }, { 256, 15, 32 }, { 264, 17, 198 }, { 272, 33, 68 },
+  { 280, 103, 210 }, { 288, 19, 36 }, { 296, 19, 74 }, { 304, 37, 76 }, { 312, 19, 78 }, { 320, 21, 120 },
+  { 328, 21, 82 }, { 336, 115, 84 }, { 344, 193, 86 }, { 352, 21, 44 }, { 360, 133, 90 }, { 368, 81, 46 },
+  { 376, 45, 94 }, { 384, 23, 48 }, { 392, 243, 98 }, { 400, 151, 40 }, { 408, 155, 102 }, { 416, 25, 52 },
+  { 424, 51, 106 }, { 432, 47, 72 }, { 440, 91, 110 }, { 448, 29, 168 }, { 456, 29, 114 }, { 464, 247, 58 },
+  { 472, 29, 118 }, { 480, 89, 180 }, { 488, 91, 122 }, { 496, 157, 62 }, { 504, 55, 84 }, { 512, 31, 64 },
+  { 528, 17, 66 }, { 544, 35, 68 }, { 560, 227, 420 }, { 576, 65, 96 }, { 592, 19, 74 }, { 608, 37, 76 },
+  { 624, 41, 234 }, { 640, 39, 80 }, { 656, 185, 82 }, { 672, 43, 252 }, { 688, 21, 86 }, { 704, 155, 44 },
+  { 720, 79, 120 }, { 736, 139, 92 }, { 752, 23, 94 }, { 768, 217, 48 }, { 784, 25, 98 }, { 800, 17, 80 },
+  { 816, 127, 102 }, { 832, 25, 52 }, { 848, 239, 106 }, { 864, 17, 48 }, { 880, 137, 110 }, { 896, 215, 112 },
+  { 912, 29, 114 }, { 928, 15, 58 }, { 944, 147, 118 }, { 960, 29, 60 }, { 976, 59, 122 }, { 992, 65, 124 },
+  { 1008, 55, 84 }, { 1024, 31, 64 }, { 1056, 17, 66 }, { 1088, 171, 204 }, { 1120, 67, 140 }, { 1152, 35, 72 },
+  { 1184, 19, 74 }, { 1216, 39, 76 }, { 1248, 19, 78 }, { 1280, 199, 240 }, { 1312, 21, 82 }, { 1344, 211, 252 },
+  { 1376, 21, 86 }, { 1408, 43, 88 }, { 1440, 149, 60 }, { 1472, 45, 92 }, { 1504, 49, 846 }, { 1536, 71, 48 },
+  { 1568, 13, 28 }, { 1600, 17, 80 }, { 1632, 25, 102 }, { 1664, 183, 104 }, { 1696, 55, 954 }, { 1728, 127, 96 },
+  { 1760, 27, 110 }, { 1792, 29, 112 }, { 1824, 29, 114 }, { 1856, 57, 116 }, { 1888, 45, 354 }, { 1920, 31, 120 },
+  { 1952, 59, 610 }, { 1984, 185, 124 }, { 2016, 113, 420 }, { 2048, 31, 64 }, { 2112, 17, 66 }, { 2176, 171, 136 },
+  { 2240, 209, 420 }, { 2304, 253, 216 }, { 2368, 367, 444 }, { 2432, 265, 456 }, { 2496, 181, 468 }, { 2560, 39, 80 },
+  { 2624, 27, 164 }, { 2688, 127, 504 }, { 2752, 143, 172 }, { 2816, 43, 88 }, { 2880, 29, 300 }, { 2944, 45, 92 },
+  { 3008, 157, 188 }, { 3072, 47, 96 }, { 3136, 13, 28 }, { 3200, 111, 240 }, { 3264, 443, 204 }, { 3328, 51, 104 },
+  { 3392, 51, 212 }, { 3456, 451, 192 }, { 3520, 257, 220 }, { 3584, 57, 336 }, { 3648, 313, 228 }, { 3712, 271, 232 },
+  { 3776, 179, 236 }, { 3840, 331, 120 }, { 3904, 363, 244 }, { 3968, 375, 248 }, { 4032, 127, 168 }, { 4096, 31, 64 },
+  { 4160, 33, 130 }, { 4224, 43, 264 }, { 4288, 33, 134 }, { 4352, 477, 408 }, { 4416, 35, 138 }, { 4480, 233, 280 },
+  { 4544, 357, 142 }, { 4608, 337, 480 }, { 4672, 37, 146 }, { 4736, 71, 444 }, { 4800, 71, 120 }, { 4864, 37, 152 },
+  { 4928, 39, 462 }, { 4992, 127, 234 }, { 5056, 39, 158 }, { 5120, 39, 80 }, { 5184, 31, 96 }, { 5248, 113, 902 },
+  { 5312, 41, 166 }, { 5376, 251, 336 }, { 5440, 43, 170 }, { 5504, 21, 86 }, { 5568, 43, 174 }, { 5632, 45, 176 },
+  { 5696, 45, 178 }, { 5760, 161, 120 }, { 5824, 89, 182 }, { 5888, 323, 184 }, { 5952, 47, 186 }, { 6016, 23, 94 },
+  { 6080, 47, 190 }, { 6144, 263, 480 },
+};
+
+// Index in Table 5.1.3-3 or -1
+static int
+phy_turbo_block_index(int k) {
+  if (k >= 40 && k <= 512 && k % 8 == 0)
+    return (k - 40) / 8;
+  if (k > 512 && k <= 1024 && k % 16 == 0)
+    return 59 + (k - 512) / 16;
+  if (k > 1024 && k <= 2048 && k % 32 == 0)
+    return 91 + (k - 1024) / 32;
+  if (k > 2048 && k <= PHY_TURBO_MAX_K && k % 64 == 0)
+    return 123 + (k - 2048) / 64;
+  return -1;
+}
+
+struct phy_qpp_tables {
+  vector<uint16_t> pi;
+  size_t offset[PHY_TURBO_BLOCK_SIZES];
+  phy_qpp_tables() {
+    for (int i = 0; i < PHY_TURBO_BLOCK_SIZES; ++i) {
+      uint64_t k = phy_qpp_parameters[i][0], f1 = phy_qpp_parameters[i][1], f2 = phy_qpp_parameters[i][2];
+      offset[i] = pi.size();
+      for (uint64_t j = 0; j < k; ++j)
+	pi.push_back((f1 * j + f2 * j % k * j) % k);
+    }
+  }
+};
+
+const uint16_t *
+phy_turbo_interleaver(int k) {
+  static const phy_qpp_tables tables;
+  int i = phy_turbo_block_index(k);
+  return i < 0 ? NULL : tables.pi.data() + tables.offset[i];
+}
+
+/******
+ ** Turbo encoder
+ **/
+
+// One constituent encoder of 36.212 5.1.3.2.1 over eight bits, most
+// significant first, from each state: parity bits and the next state.
+// States are the shift register contents, the newest bit highest.
+struct phy_rsc_table {
+  uint16_t t[8][256];
+  constexpr phy_rsc_table() : t() {
+    for (unsigned state = 0; state < 8; ++state)
+      for (unsigned byte = 0; byte < 256; ++byte) {
+	unsigned s = state, parity = 0;
+	for (int i = 7; i >= 0; --i) {
+	  unsigned a = ((byte >> i) ^ (s >> 1) ^ s) & 1;
+	  parity = parity << 1 | ((a ^ (s >> 2) ^ s) & 1);
+	  s = a << 2 | s >> 1;
+	}
+	t[state][byte] = s << 8 | parity;
+      }
+  }
+};
+static constexpr phy_rsc_table phy_rsc_lut;
+
+// Trellis termination: x and z of the three tail bits
+static void
+phy_rsc_tail(unsigned state, uint8_t x[3], uint8_t z[3]) {
+  for (int i = 0; i < 3; ++i) {
+    x[i] = ((state >> 1) ^ state) & 1;
+    z[i] = ((state >> 2) ^ state) & 1;
+    state >>= 1;
+  }
+}
+
+// The QPP interleaver on c of k bits, one per byte, to packed bits. Each
+// gather reads the three bytes after a bit.
+#ifdef CPU_X86
+__attribute__((target("avx2"))) static void
+phy_turbo_interleave_avx2(uint8_t *out, const uint8_t *c, const uint16_t *pi, int k) {
+  // The first bit in the last lane, for the top of the mask
+  const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+  for (int i = 0; i < k; i += 8) {
+    __m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(pi + i)));
+    __m256i bits = _mm256_i32gather_epi32((const int *)c, _mm256_permutevar8x32_epi32(index, reverse), 1);
+    out[i / 8] = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_slli_epi32(bits, 31)));
+  }
+}
+#endif
+
+static void
+phy_turbo_interleave(uint8_t *out, const uint8_t *c, const uint16_t *pi, int k) {
+#ifdef CPU_X86
+  if (cpu_has(CPU_AVX2)) {
+    phy_turbo_interleave_avx2(out, c, pi, k);
+    return;
+  }
+#endif
+  for (int i = 0; i < k; i += 8) {
+    uint64_t eight = 0;
+    for (int j = 0; j < 8; ++j)
+      eight |= (uint64_t)c[pi[i + j]] << 8 * j;
+    out[i / 8] = phy_pack8(eight);
+  }
+}
+
+// Packed c of k bits to the packed streams d(0), d(1) and d(2) at d,
+// k / 8 + 1 bytes apart, with the tail bits in the last four bits of each.
+// work is k + k / 8 bytes.
+static void
+phy_turbo_encode(const uint8_t *c, int k, uint8_t *d, uint8_t *work) {
+  const int bytes = k / 8 + 1;
+  uint8_t *d0 = d, *d1 = d + bytes, *d2 = d + 2 * bytes;
+  uint8_t *unpacked = work, *interleaved = work + k;
+  phy_unpack_bits(unpacked, c, k);
+  phy_turbo_interleave(interleaved, unpacked, phy_turbo_interleaver(k), k);
+  memcpy(d0, c, k / 8);
+  // Both constituent encoders in step, as each only waits for its own state
+  unsigned s = 0, s2 = 0;
+  for (int i = 0; i < k / 8; ++i) {
+    unsigned r = phy_rsc_lut.t[s][c[i]], r2 = phy_rsc_lut.t[s2][interleaved[i]];
+    d1[i] = r, s = r >> 8;
+    d2[i] = r2, s2 = r2 >> 8;
+  }
+  uint8_t x[3], z[3], x2[3], z2[3];
+  phy_rsc_tail(s, x, z);
+  phy_rsc_tail(s2, x2, z2);
+  d0[k / 8] = x[0] << 7 | z[1] << 6 | x2[0] << 5 | z2[1] << 4;
+  d1[k / 8] = z[0] << 7 | x[2] << 6 | z2[0] << 5 | x2[2] << 4;
+  d2[k / 8] = x[1] << 7 | z[2] << 6 | x2[1] << 5 | z2[2] << 4;
+}
+
+/******
+ ** Rate matching
+ **/
+
+#define PHY_TURBO_MAX_ROWS ((PHY_TURBO_MAX_K + PHY_TURBO_TAIL + 31) / 32)
+#define PHY_TURBO_MAX_WORDS ((PHY_TURBO_MAX_ROWS + 31) / 32)
+
+// Column permutation of the sub-block interleaver, Table 5.1.4-1
+static const uint8_t phy_subblock_permutation[32] = {
+  0, 16, 8, 24, 4, 20, 12, 28, 2, 18, 10, 26, 6, 22, 14, 30,
+  1, 17, 9, 25, 5, 21, 13, 29, 3, 19, 11, 27, 7, 23, 15, 31
+};
+
+// Where w_k of 5.1.4.1.2 is in w of the plan. Each column of the sub-block
+// interleavers takes whole 32 bit words there: the 32 of v(0), then those
+// of v(1) and v(2) interlaced, twice as long.
+static int
+phy_turbo_w_position(int w, int rows) {
+  const int k_pi = 32 * rows, column = 32 * ((rows + 31) / 32), column2 = 32 * ((2 * rows + 31) / 32);
+  if (w < k_pi)
+    return w / rows * column + w % rows;
+  int v = (w - k_pi) / 2;
+  return 32 * column + v / rows * column2 + 2 * (v % rows) + (w - k_pi) % 2;
+}
+
+// 32 rows of 32 bits to 32 columns, the first column and row on top
+static void
+phy_transpose32(uint32_t a[32]) {
+  uint32_t m = 0x0000ffff;
+  for (int j = 16; j; j >>= 1, m ^= m << j)
+    for (int k = 0; k < 32; k = (k + j + 1) & ~j) {
+      uint32_t t = (a[k] ^ (a[k + j] >> j)) & m;
+      a[k] ^= t;
+      a[k + j] ^= t << j;
+    }
+}
+
+#ifdef CPU_X86
+// The same by moving masks of byte tops: row bytes are regrouped so that
+// each register has one byte of every row, last row first
+__attribute__((target("avx2"))) static void
+phy_transpose32_avx2(uint32_t a[32]) {
+  const __m256i regroup = _mm256_setr_epi8(15, 11, 7, 3, 14, 10, 6, 2, 13, 9, 5, 1, 12, 8, 4, 0,
+					   15, 11, 7, 3, 14, 10, 6, 2, 13, 9, 5, 1, 12, 8, 4, 0);
+  const __m256i lanes = _mm256_setr_epi32(4, 0, 5, 1, 6, 2, 7, 3);
+  __m256i q[4];
+  for (int i = 0; i < 4; ++i)
+    q[i] = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(a + 8 * i)), regroup),
+				       lanes);
+  __m256i lo32 = _mm256_unpacklo_epi64(q[3], q[2]), hi32 = _mm256_unpackhi_epi64(q[3], q[2]);
+  __m256i lo10 = _mm256_unpacklo_epi64(q[1], q[0]), hi10 = _mm256_unpackhi_epi64(q[1], q[0]);
+  __m256i bytes[4] = {
+    _mm256_permute2x128_si256(lo32, lo10, 0x20), _mm256_permute2x128_si256(hi32, hi10, 0x20),
+    _mm256_permute2x128_si256(lo32, lo10, 0x31), _mm256_permute2x128_si256(hi32, hi10, 0x31)
+  };
+  for (int j = 0; j < 4; ++j)
+    for (int b = 0; b < 8; ++b) {
+      a[8 * j + b] = _mm256_movemask_epi8(bytes[j]);
+      bytes[j] = _mm256_add_epi8(bytes[j], bytes[j]);
+    }
+}
+#endif
+
+// Columns of the n rows at y, 32 at a time, to w in the order of Table
+// 5.1.4-1, each in whole words. Rows after n are zeros.
+static void
+phy_subblock_columns(uint32_t *y, int n, uint8_t *w) {
+  const int words = (n + 31) / 32;
+  for (int b = 0; b < words; ++b) {
+    uint32_t *columns = y + 32 * b;
+#ifdef CPU_X86
+    if (cpu_has(CPU_AVX2))
+      phy_transpose32_avx2(columns);
+    else
+#endif
+      phy_transpose32(columns);
+    for (int i = 0; i < 32; ++i) {
+      uint32_t word = __builtin_bswap32(columns[phy_subblock_permutation[i]]);
+      memcpy(w + 4 * (i * words + b), &word, 4);
+    }
+  }
+}
+
+// Streams d of phy_turbo_encode() to w of the plan, <NULL> bits as zeros.
+// Rows of y(1) and y(2) take turns, so that their columns come out
+// interlaced.
+static void
+phy_turbo_collect(const uint8_t *d, int k, uint8_t *w) {
+  const int stream = k + PHY_TURBO_TAIL, rows = (stream + 31) / 32, dummies = 32 * rows - stream;
+  const int bytes = k / 8 + 1;
+  uint32_t y0[32 * PHY_TURBO_MAX_WORDS] = {}, y12[64 * PHY_TURBO_MAX_WORDS] = {};
+  for (int s = 0; s < 3; ++s) {
+    // Rows start with the <NULL> bits, then d(s) from the first row on
+    const uint8_t *ds = d + s * bytes;
+    uint32_t *y = s ? y12 + s - 1 : y0;
+    int step = s ? 2 : 1;
+    y[0] = phy_read_bits(ds, 0) >> 32 >> dummies;
+    for (int r = 1; r < rows; ++r)
+      y[step * r] = phy_read_bits(ds, 32 * r - dummies) >> 32;
+  }
+  // v(2) is one bit further along y(2), around the end
+  uint32_t first = y12[1] >> 31;
+  for (int r = 1; r < 2 * rows; r += 2)
+    y12[r] = y12[r] << 1 | (r + 2 < 2 * rows ? y12[r + 2] >> 31 : first);
+  phy_subblock_columns(y0, rows, w);
+  phy_subblock_columns(y12, 2 * rows, w + 128 * ((rows + 31) / 32));
+}
+
+/******
+ ** Plans
+ **/
+
+// 5.1.4.1.1 and 5.1.4.1.2 for code blocks of size k with fillers
+static phy_turbo_selection
+phy_turbo_select(int k, int fillers, int n_cb_limit) {
+  phy_turbo_selection s;
+  s.k = k;
+  s.fillers = fillers;
+  const int stream = k + PHY_TURBO_TAIL, rows = (stream + 31) / 32, k_pi = 32 * rows, dummies = k_pi - stream;
+  s.n_cb = n_cb_limit ? std::min(n_cb_limit, 3 * k_pi) : 3 * k_pi;
+  int k0[4];
+  for (int rv = 0; rv < 4; ++rv) {
+    k0[rv] = rows * (2 * ((s.n_cb + 8 * rows - 1) / (8 * rows)) * rv + 2) % s.n_cb;
+    s.start[rv] = -1;
+  }
+  for (int w = 0; w < s.n_cb; ++w) {
+    for (int rv = 0; rv < 4; ++rv)
+      if (w == k0[rv])
+	s.start[rv] = s.order.size();
+    // v(0) first, then v(1) and v(2) interlaced
+    int v = w < k_pi ? w : (w - k_pi) / 2, d = w < k_pi ? 0 : 1 + (w - k_pi) % 2;
+    int y = phy_subblock_permutation[v / rows] + 32 * (v % rows);
+    if (d == 2)
+      y = (y + 1) % k_pi;
+    int i = y - dummies;
+    if (i >= 0 && (d == 2 || i >= fillers)) {
+      s.order.push_back(d * stream + i);
+      int position = phy_turbo_w_position(w, rows);
+      if (!s.runs.empty() && s.runs.back().first + s.runs.back().second == position)
+	++s.runs.back().second;
+      else
+	s.runs.emplace_back(position, 1);
+    }
+  }
+  // k0 on a <NULL> bit starts from the next bit
+  for (int rv = 0; rv < 4; ++rv)
+    s.start[rv] %= s.order.size();
+  return s;
+}
+
+PHY_TB_PLAN *
+phy_tb_plan_init(int tbs, int g, int qm, int n_ir) {
+  if (tbs <= 0 || tbs % 8 || g <= 0 || (qm != 2 && qm != 4 && qm != 6) || g % qm || n_ir < 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  phy_tb_plan *p = new phy_tb_plan;
+  p->tbs = tbs;
+  p->g = g;
+  p->qm = qm;
+  p->n_ir = n_ir;
+
+  // Code block segmentation, 5.1.2. All sizes stay multiples of 8.
+  int b = tbs + PHY_TURBO_CRC_SIZE, c = 1, b_ = b;
+  p->crc_size = 0;
+  if (b > PHY_TURBO_MAX_K) {
+    p->crc_size = PHY_TURBO_CRC_SIZE;
+    c = (b + PHY_TURBO_MAX_K - PHY_TURBO_CRC_SIZE - 1) / (PHY_TURBO_MAX_K - PHY_TURBO_CRC_SIZE);
+    b_ = b + c * PHY_TURBO_CRC_SIZE;
+  }
+  int i_plus = 0;
+  while (c * phy_qpp_parameters[i_plus][0] < b_)
+    ++i_plus;
+  int k_plus = phy_qpp_parameters[i_plus][0], k_minus = 0, c_minus = 0;
+  if (c > 1) {
+    k_minus = phy_qpp_parameters[i_plus - 1][0];
+    c_minus = (c * k_plus - b_) / (k_plus - k_minus);
+  }
+  int fillers = (c - c_minus) * k_plus + c_minus * k_minus - b_;
+
+  // Rate matching output sizes, 5.1.4.1.2. Code blocks share selections
+  // by size, apart from the first one with filler bits.
+  int g_ = g / qm, gamma = g_ % c, first = 0, e_offset = 0, soft_offset = 0;
+  p->selections.reserve(3);
+  for (int r = 0; r < c; ++r) {
+    phy_tb_code_block block;
+    block.k = r < c_minus ? k_minus : k_plus;
+    block.fillers = r ? 0 : fillers;
+    block.first = first;
+    block.e = qm * (g_ / c + (r >= c - gamma));
+    block.e_offset = e_offset;
+    block.soft_offset = soft_offset;
+    block.selection = NULL;
+    for (auto &s : p->selections)
+      if (s.k == block.k && s.fillers == block.fillers)
+	block.selection = &s;
+    if (!block.selection) {
+      p->selections.push_back(phy_turbo_select(block.k, block.fillers, n_ir / c));
+      block.selection = &p->selections.back();
+    }
+    first += block.k - block.fillers - p->crc_size;
+    e_offset += block.e;
+    soft_offset += block.selection->order.size();
+    p->blocks.push_back(block);
+  }
+  p->soft_bits = soft_offset;
+
+  p->tb.resize(tbs / 8 + PHY_TURBO_CRC_SIZE / 8);
+  p->c.resize(k_plus / 8);
+  // Room for reading and writing eight bytes at a time after each
+  int rows = (k_plus + PHY_TURBO_TAIL + 31) / 32;
+  p->work.resize(k_plus + k_plus / 8);
+  p->d.resize(3 * (k_plus / 8 + 1) + 8);
+  p->w.resize(128 * ((rows + 31) / 32 + (2 * rows + 31) / 32) + 8);
+  p->e.resize(g / 8 + 16);
+  p->iterations.resize(c);
+  return p;
+}
+
+void
+phy_tb_plan_free(PHY_TB_PLAN *plan) {
+  delete plan;
+}
+
+int
+phy_tb_plan_code_blocks(PHY_TB_PLAN *plan) {
+  return plan->blocks.size();
+}
+
+/******
+ ** Encoding
+ **/
+
+int
+phy_tb_encode(PHY_TB_PLAN *p, const void *tb, int rv, void *out) {
+  if (rv < 0 || rv > 3) {
+    errno = EINVAL;
+    return -1;
+  }
+  uint8_t *a = p->tb.data(), *c = p->c.data(), *work = p->work.data(), *d = p->d.data();
+  uint8_t *w = p->w.data();
+  memcpy(a, tb, p->tbs / 8);
+  phy_crc_attach(PHY_CRC24A, a, p->tbs);
+
+  phy_bit_writer e(p->e.data());
+  for (auto &block : p->blocks) {
+    // Filler bits are zeros to the encoder and the CRC, <NULL> after it
+    int size = block.k - block.fillers - p->crc_size;
+    memset(c, 0, block.fillers / 8);
+    memcpy(c + block.fillers / 8, a + block.first / 8, size / 8);
+    if (p->crc_size)
+      phy_crc_attach(PHY_CRC24B, c, block.k - p->crc_size);
+    phy_turbo_encode(c, block.k, d, work);
+    phy_turbo_collect(d, block.k, w);
+
+    // Bit selection: the runs from k0 on, around the circular buffer
+    const phy_turbo_selection &s = *block.selection;
+    int run = 0, j = s.start[rv], runs = s.runs.size();
+    while (j >= s.runs[run].second)
+      j -= s.runs[run++].second;
+    for (int left = block.e; left; run = (run + 1) % runs, j = 0) {
+      int n = std::min(left, s.runs[run].second - j);
+      e.copy(w, s.runs[run].first + j, n);
+      left -= n;
+    }
+  }
+  memcpy(out, p->e.data(), (p->g + 7) / 8);
+  return p->g;
+}
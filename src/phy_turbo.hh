@@ -0,0 +1,67 @@
+// Turbo coding internals shared by the encoder and decoder of phy.h
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+#include "phy.h"
+
+// Bits after the K of each stream of the encoder: tails of both encoders
+#define PHY_TURBO_TAIL 4
+#define PHY_TURBO_CRC_SIZE 24
+
+// QPP interleaver Π(i) of 36.212 5.1.3.2.3 for a code block size of
+// Table 5.1.3-3, NULL for other sizes. All 188 are built on first use.
+const uint16_t *phy_turbo_interleaver(int k);
+
+// The circular buffer of one kind of code block, with the <NULL> bits left
+// out: code blocks of size K- and K+, and the first one if it has filler
+// bits. Entries are bits of the three encoder streams one after another,
+// d(s)_k at s * (K + PHY_TURBO_TAIL) + k.
+struct phy_turbo_selection {
+  int k, fillers;
+  int n_cb;                    // Circular buffer size with <NULL> bits
+  std::vector<uint16_t> order;
+  // The same bits as runs of w_k of 5.1.4.1.2 between <NULL> bits: first
+  // and count
+  std::vector<std::pair<int, int>> runs;
+  int start[4];                // Where in order k0 of each redundancy version is
+};
+
+struct phy_tb_code_block {
+  int k, fillers;
+  int first;                   // First bit in the transport block with CRC24A
+  int e, e_offset;             // Coded bits and where they start
+  int soft_offset;             // Its selection order in the soft buffer
+  const phy_turbo_selection *selection;
+};
+
+// Buffers of one thread decoding code blocks, sized for the largest
+struct phy_turbo_decoder {
+  std::vector<int16_t> d;      // LLRs of the d streams
+  std::vector<int16_t> llrs;   // Systematic interleaved, a priori, extrinsic
+  std::vector<int16_t> alpha;  // Forward state metrics of every step
+  std::vector<uint8_t> bits;   // Hard decisions
+  void reserve(int k);
+};
+
+// Decodes a code block into the transport block buffer of the plan.
+// Returns the iterations used, or -1 if its CRC didn't pass, leaving the
+// hard decisions of the last iteration.
+int phy_turbo_decode_block(phy_turbo_decoder &decoder, struct phy_tb_plan &plan, int block,
+			   const int16_t *soft_bits, int max_iterations);
+
+struct phy_tb_plan {
+  int tbs, g, qm, n_ir;
+  int crc_size;                // CRC24B of each code block, 0 for a single one
+  std::vector<phy_turbo_selection> selections;
+  std::vector<phy_tb_code_block> blocks;
+  int soft_bits;
+  // Transport block with CRC24A, a code block, room for the encoder, then
+  // packed d streams, w_k with <NULL> bits as zeros and coded bits
+  std::vector<uint8_t> tb, c, work, d, w, e;
+  // Decoding in the calling thread, and the iterations of each code block
+  phy_turbo_decoder decoder;
+  std::vector<int> iterations;
+};
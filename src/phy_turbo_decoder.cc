@@ -0,0 +1,453 @@
+/*
+   Implement turbo decoding of DL-SCH and UL-SCH transport blocks of
+   3GPP LTE PHY, the receiving side of phy_turbo.cc
+
+   Max-log-MAP with 16-bit saturating metrics of all 8 states side by
+   side. With AVX2 each constituent decoder runs over the two halves of the
+   code block at once, one half per 128-bit lane. A half starts from the
+   state metrics its neighbour ended with in the previous iteration, and
+   from equal metrics in the first. Extrinsic information is scaled by 3/4
+   to make up for the max-log approximation.
+
+   Code blocks are independent, so a pool of worker threads takes them one
+   at a time alongside the calling thread.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "phy.h"
+#include "cpu.hh"
+#include "phy_bits.hh"
+#include "phy_turbo.hh"
+
+using std::vector;
+
+// Channel LLRs and extrinsic information are kept within these so that
+// state metrics, normalized every step, stay well inside 16 bits
+#define PHY_TURBO_LLR_MAX 511
+#define PHY_TURBO_EXTRINSIC_MAX 1023
+#define PHY_TURBO_METRIC_MIN -8192
+
+static inline int16_t
+phy_clamp16(int value, int limit) {
+  return std::min(std::max(value, -limit), limit);
+}
+
+/******
+ ** Trellis
+ **/
+
+// Branches of the constituent encoder of phy_turbo.cc into and out of each
+// state, as byte shuffles of 16-bit metrics and signs of the systematic and
+// parity LLRs, +1 for a 0 bit. Both 128-bit lanes are the same.
+struct phy_trellis {
+  uint8_t from[2][32];       // Forward: predecessor with s3 = 0 or 1
+  int16_t from_u[2][16], from_z[2][16];
+  uint8_t to[2][32];         // Backward: successor for u = 0 or 1
+  int16_t to_z[2][16];
+  int8_t tail_next[8], tail_u[8], tail_z[8];
+  constexpr phy_trellis() : from(), from_u(), from_z(), to(), to_z(), tail_next(), tail_u(), tail_z() {
+    for (int lane = 0; lane < 16; ++lane) {
+      int s = lane % 8, s1 = s >> 2, s2 = (s >> 1) & 1, s3 = s & 1;
+      for (int b = 0; b < 2; ++b) {
+	// Into s, whose newest bit is a, from ((s & 3) << 1) | b
+	int a = s1, p = ((s & 3) << 1) | b, u = a ^ ((p >> 1) & 1) ^ b, z = a ^ (p >> 2) ^ b;
+	from[b][2 * lane] = 2 * p;
+	from[b][2 * lane + 1] = 2 * p + 1;
+	from_u[b][lane] = u ? -1 : 1;
+	from_z[b][lane] = z ? -1 : 1;
+	// Out of s with input b
+	a = b ^ s2 ^ s3;
+	int next = a << 2 | s >> 1;
+	to[b][2 * lane] = 2 * next;
+	to[b][2 * lane + 1] = 2 * next + 1;
+	to_z[b][lane] = (a ^ s1 ^ s3) ? -1 : 1;
+      }
+      // Trellis termination feeds back so that a is 0
+      tail_next[s] = s >> 1;
+      tail_u[s] = (s2 ^ s3) ? -1 : 1;
+      tail_z[s] = (s1 ^ s3) ? -1 : 1;
+    }
+  }
+};
+static constexpr phy_trellis phy_trellis_lut;
+
+// Backward metrics at K from the three tail bits: x and z of each
+static void
+phy_turbo_tail(const int16_t tail[6], int16_t beta[8]) {
+  int b[8] = { 0 };
+  for (int s = 1; s < 8; ++s)
+    b[s] = PHY_TURBO_METRIC_MIN;
+  for (int t = 2; t >= 0; --t) {
+    int next[8];
+    for (int s = 0; s < 8; ++s)
+      next[s] = b[phy_trellis_lut.tail_next[s]] + phy_trellis_lut.tail_u[s] * tail[2 * t]
+	+ phy_trellis_lut.tail_z[s] * tail[2 * t + 1];
+    for (int s = 0; s < 8; ++s)
+      b[s] = std::max(next[s] - next[0], PHY_TURBO_METRIC_MIN);
+  }
+  for (int s = 0; s < 8; ++s)
+    beta[s] = b[s];
+}
+
+/******
+ ** Constituent decoders
+ **
+ ** lu is the systematic plus a priori LLR of each step and par the parity
+ ** LLR. Extrinsic LLRs go to le. beta_end is from phy_turbo_tail().
+ **/
+
+static void
+phy_turbo_map(const int16_t *lu, const int16_t *par, const int16_t beta_end[8], int k, int16_t *le,
+	      int16_t *alpha) {
+  const phy_trellis &t = phy_trellis_lut;
+  int a[8] = { 0 };
+  for (int s = 1; s < 8; ++s)
+    a[s] = PHY_TURBO_METRIC_MIN;
+  for (int j = 0; j < k; ++j) {
+    int next[8];
+    for (int s = 0; s < 8; ++s) {
+      alpha[8 * j + s] = a[s];
+      int m0 = a[t.from[0][2 * s] / 2] + t.from_u[0][s] * lu[j] + t.from_z[0][s] * par[j];
+      int m1 = a[t.from[1][2 * s] / 2] + t.from_u[1][s] * lu[j] + t.from_z[1][s] * par[j];
+      next[s] = std::max(m0, m1);
+    }
+    for (int s = 0; s < 8; ++s)
+      a[s] = std::max(next[s] - next[0], PHY_TURBO_METRIC_MIN);
+  }
+  int b[8];
+  std::copy(beta_end, beta_end + 8, b);
+  for (int j = k - 1; j >= 0; --j) {
+    int max0 = INT32_MIN, max1 = INT32_MIN, next[8];
+    for (int s = 0; s < 8; ++s) {
+      int p0 = b[t.to[0][2 * s] / 2] + t.to_z[0][s] * par[j], p1 = b[t.to[1][2 * s] / 2] + t.to_z[1][s] * par[j];
+      max0 = std::max(max0, alpha[8 * j + s] + p0);
+      max1 = std::max(max1, alpha[8 * j + s] + p1);
+      next[s] = std::max(p0 + lu[j], p1 - lu[j]);
+    }
+    le[j] = phy_clamp16((max0 - max1) * 3 >> 3, PHY_TURBO_EXTRINSIC_MAX);
+    for (int s = 0; s < 8; ++s)
+      b[s] = std::max(next[s] - next[0], PHY_TURBO_METRIC_MIN);
+  }
+}
+
+#ifdef CPU_X86
+// Both halves at once. Saved metrics of the other half are read at the
+// start and written at the end: alpha_boundary is where the first half
+// ends, beta_boundary where the second half starts. pairs is 2 * k.
+__attribute__((target("avx2"))) static void
+phy_turbo_map_avx2(const int16_t *lu, const int16_t *par, const int16_t beta_end[8], int k, int16_t *le,
+		   int16_t *alpha, int16_t alpha_boundary[8], int16_t beta_boundary[8], int16_t *pairs) {
+  const phy_trellis &t = phy_trellis_lut;
+  const int h = k / 2;
+  // Step j of both halves next to each other
+  int16_t *lu_pairs = pairs, *par_pairs = pairs + k;
+  for (int j = 0; j < h; ++j) {
+    lu_pairs[2 * j] = lu[j], lu_pairs[2 * j + 1] = lu[h + j];
+    par_pairs[2 * j] = par[j], par_pairs[2 * j + 1] = par[h + j];
+  }
+  const __m256i pick = _mm256_setr_epi8(0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1,
+					2, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 3);
+  const __m256i first = _mm256_set1_epi16(0x0100);
+  const __m256i from0 = _mm256_loadu_si256((const __m256i *)t.from[0]), from1 = _mm256_loadu_si256((const __m256i *)t.from[1]);
+  const __m256i from_u0 = _mm256_loadu_si256((const __m256i *)t.from_u[0]), from_u1 = _mm256_loadu_si256((const __m256i *)t.from_u[1]);
+  const __m256i from_z0 = _mm256_loadu_si256((const __m256i *)t.from_z[0]), from_z1 = _mm256_loadu_si256((const __m256i *)t.from_z[1]);
+  const __m256i to0 = _mm256_loadu_si256((const __m256i *)t.to[0]), to1 = _mm256_loadu_si256((const __m256i *)t.to[1]);
+  const __m256i to_z0 = _mm256_loadu_si256((const __m256i *)t.to_z[0]), to_z1 = _mm256_loadu_si256((const __m256i *)t.to_z[1]);
+  int32_t value;
+
+  int16_t start[16] = { 0 };
+  for (int s = 1; s < 8; ++s)
+    start[s] = PHY_TURBO_METRIC_MIN;
+  memcpy(start + 8, alpha_boundary, 16);
+  __m256i a = _mm256_loadu_si256((const __m256i *)start);
+  for (int j = 0; j < h; ++j) {
+    _mm256_storeu_si256((__m256i *)(alpha + 16 * j), a);
+    memcpy(&value, lu_pairs + 2 * j, 4);
+    __m256i u = _mm256_shuffle_epi8(_mm256_set1_epi32(value), pick);
+    memcpy(&value, par_pairs + 2 * j, 4);
+    __m256i p = _mm256_shuffle_epi8(_mm256_set1_epi32(value), pick);
+    __m256i m0 = _mm256_adds_epi16(_mm256_shuffle_epi8(a, from0),
+				   _mm256_adds_epi16(_mm256_sign_epi16(u, from_u0), _mm256_sign_epi16(p, from_z0)));
+    __m256i m1 = _mm256_adds_epi16(_mm256_shuffle_epi8(a, from1),
+				   _mm256_adds_epi16(_mm256_sign_epi16(u, from_u1), _mm256_sign_epi16(p, from_z1)));
+    a = _mm256_max_epi16(m0, m1);
+    a = _mm256_subs_epi16(a, _mm256_shuffle_epi8(a, first));
+  }
+  _mm_storeu_si128((__m128i *)alpha_boundary, _mm256_castsi256_si128(a));
+
+  memcpy(start, beta_boundary, 16);
+  memcpy(start + 8, beta_end, 16);
+  __m256i b = _mm256_loadu_si256((const __m256i *)start);
+  for (int j = h - 1; j >= 0; --j) {
+    memcpy(&value, lu_pairs + 2 * j, 4);
+    __m256i u = _mm256_shuffle_epi8(_mm256_set1_epi32(value), pick);
+    memcpy(&value, par_pairs + 2 * j, 4);
+    __m256i p = _mm256_shuffle_epi8(_mm256_set1_epi32(value), pick);
+    __m256i p0 = _mm256_adds_epi16(_mm256_shuffle_epi8(b, to0), _mm256_sign_epi16(p, to_z0));
+    __m256i p1 = _mm256_adds_epi16(_mm256_shuffle_epi8(b, to1), _mm256_sign_epi16(p, to_z1));
+    __m256i al = _mm256_loadu_si256((const __m256i *)(alpha + 16 * j));
+    __m256i t0 = _mm256_adds_epi16(al, p0), t1 = _mm256_adds_epi16(al, p1);
+    // Largest of each lane's 8 states into its first element
+    t0 = _mm256_max_epi16(t0, _mm256_srli_si256(t0, 8));
+    t1 = _mm256_max_epi16(t1, _mm256_srli_si256(t1, 8));
+    t0 = _mm256_max_epi16(t0, _mm256_srli_si256(t0, 4));
+    t1 = _mm256_max_epi16(t1, _mm256_srli_si256(t1, 4));
+    t0 = _mm256_max_epi16(t0, _mm256_srli_si256(t0, 2));
+    t1 = _mm256_max_epi16(t1, _mm256_srli_si256(t1, 2));
+    __m256i d = _mm256_subs_epi16(t0, t1);
+    le[j] = phy_clamp16((int16_t)_mm256_extract_epi16(d, 0) * 3 >> 3, PHY_TURBO_EXTRINSIC_MAX);
+    le[h + j] = phy_clamp16((int16_t)_mm256_extract_epi16(d, 8) * 3 >> 3, PHY_TURBO_EXTRINSIC_MAX);
+    b = _mm256_max_epi16(_mm256_adds_epi16(p0, u), _mm256_subs_epi16(p1, u));
+    b = _mm256_subs_epi16(b, _mm256_shuffle_epi8(b, first));
+  }
+  _mm_storeu_si128((__m128i *)beta_boundary, _mm256_extracti128_si256(b, 1));
+}
+#endif
+
+/******
+ ** Code blocks
+ **/
+
+void
+phy_turbo_decoder::reserve(int k) {
+  d.resize(3 * (k + PHY_TURBO_TAIL));
+  llrs.resize(8 * k);
+  alpha.resize(8 * k + 16);
+  bits.resize(k);
+}
+
+int
+phy_turbo_decode_block(phy_turbo_decoder &dec, phy_tb_plan &p, int r, const int16_t *soft_bits, int max_iterations) {
+  const phy_tb_code_block &block = p.blocks[r];
+  const phy_turbo_selection &s = *block.selection;
+  const int k = block.k, stream = k + PHY_TURBO_TAIL;
+  const uint16_t *pi = phy_turbo_interleaver(k);
+  dec.reserve(k);
+
+  // Rate dematching: <NULL> bits stay 0, filler bits are known zeros
+  int16_t *d = dec.d.data(), *sys = d, *par1 = d + stream, *par2 = d + 2 * stream;
+  std::fill(dec.d.begin(), dec.d.end(), 0);
+  const int16_t *soft = soft_bits + block.soft_offset;
+  for (size_t i = 0; i < s.order.size(); ++i)
+    d[s.order[i]] = phy_clamp16(soft[i], PHY_TURBO_LLR_MAX);
+  for (int i = 0; i < block.fillers; ++i)
+    sys[i] = PHY_TURBO_LLR_MAX;
+
+  int16_t *sys2 = dec.llrs.data(), *la = sys2 + k, *la2 = la + k, *le = la2 + k, *le2 = le + k;
+  int16_t *lu = le2 + k, *pairs = lu + k;
+  for (int i = 0; i < k; ++i)
+    sys2[i] = sys[pi[i]];
+  std::fill(la, la + k, 0);
+  // x and z of the tail bits of each encoder, 5.1.3.2.2
+  const int16_t tail1[6] = { sys[k], par1[k], par2[k], sys[k + 1], par1[k + 1], par2[k + 1] };
+  const int16_t tail2[6] = { sys[k + 2], par1[k + 2], par2[k + 2], sys[k + 3], par1[k + 3], par2[k + 3] };
+  int16_t beta_end1[8], beta_end2[8], boundaries[4][8] = { { 0 } };
+  phy_turbo_tail(tail1, beta_end1);
+  phy_turbo_tail(tail2, beta_end2);
+
+  uint8_t *bits = dec.bits.data(), *c = (uint8_t *)pairs;
+  int crc = p.crc_size ? PHY_CRC24B : PHY_CRC24A;
+#ifdef CPU_X86
+  bool avx2 = cpu_has(CPU_AVX2);
+#endif
+  for (int iteration = 1; iteration <= max_iterations; ++iteration) {
+    for (int i = 0; i < k; ++i)
+      lu[i] = phy_clamp16(sys[i] + la[i], 2 * PHY_TURBO_EXTRINSIC_MAX);
+#ifdef CPU_X86
+    if (avx2)
+      phy_turbo_map_avx2(lu, par1, beta_end1, k, le, dec.alpha.data(), boundaries[0], boundaries[1], pairs);
+    else
+#endif
+      phy_turbo_map(lu, par1, beta_end1, k, le, dec.alpha.data());
+    for (int i = 0; i < k; ++i) {
+      la2[i] = le[pi[i]];
+      lu[i] = phy_clamp16(sys2[i] + la2[i], 2 * PHY_TURBO_EXTRINSIC_MAX);
+    }
+#ifdef CPU_X86
+    if (avx2)
+      phy_turbo_map_avx2(lu, par2, beta_end2, k, le2, dec.alpha.data(), boundaries[2], boundaries[3], pairs);
+    else
+#endif
+      phy_turbo_map(lu, par2, beta_end2, k, le2, dec.alpha.data());
+    for (int i = 0; i < k; ++i)
+      la[pi[i]] = le2[i];
+
+    for (int i = 0; i < k; ++i)
+      bits[i] = sys[i] + la[i] + le[i] < 0;
+    phy_pack_bits(c, bits, k);
+    bool passed = !phy_crc(crc, c, k);
+    if (passed || iteration == max_iterations) {
+      int size = k - block.fillers - p.crc_size;
+      memcpy(p.tb.data() + block.first / 8, c + block.fillers / 8, size / 8);
+      if (passed)
+	return iteration;
+    }
+  }
+  return -1;
+}
+
+/******
+ ** Transport blocks
+ **/
+
+int
+phy_tb_plan_soft_bits(PHY_TB_PLAN *plan) {
+  return plan->soft_bits;
+}
+
+static void
+phy_soft_combine(int16_t *soft_bits, const int8_t *llrs, int n) {
+  int i = 0;
+#ifdef __SSE2__
+  for (; i + 16 <= n; i += 16) {
+    __m128i l = _mm_loadu_si128((const __m128i *)(llrs + i));
+    __m128i sign = _mm_cmpgt_epi8(_mm_setzero_si128(), l);
+    __m128i *s = (__m128i *)(soft_bits + i);
+    _mm_storeu_si128(s, _mm_adds_epi16(_mm_loadu_si128(s), _mm_unpacklo_epi8(l, sign)));
+    _mm_storeu_si128(s + 1, _mm_adds_epi16(_mm_loadu_si128(s + 1), _mm_unpackhi_epi8(l, sign)));
+  }
+#endif
+  for (; i < n; ++i)
+    soft_bits[i] = std::min(std::max(soft_bits[i] + llrs[i], INT16_MIN), INT16_MAX);
+}
+
+int
+phy_tb_combine(PHY_TB_PLAN *p, const int8_t *llrs, int rv, int16_t *soft_bits) {
+  if (rv < 0 || rv > 3) {
+    errno = EINVAL;
+    return -1;
+  }
+  // Coded bits are consecutive in the circular buffer order
+  for (auto &block : p->blocks) {
+    const phy_turbo_selection &s = *block.selection;
+    int n = s.order.size(), j = s.start[rv];
+    const int8_t *l = llrs + block.e_offset;
+    for (int left = block.e; left; ) {
+      int run = std::min(left, n - j);
+      phy_soft_combine(soft_bits + block.soft_offset + j, l, run);
+      l += run;
+      left -= run;
+      j = 0;
+    }
+  }
+  return p->g;
+}
+
+struct phy_turbo_pool {
+  vector<std::thread> threads;
+  vector<phy_turbo_decoder> decoders;
+  std::mutex mutex;
+  std::condition_variable start, finished;
+  uint64_t generation = 0;
+  bool stopping = false;
+  int busy = 0;
+  // The transport block being decoded
+  phy_tb_plan *plan = NULL;
+  const int16_t *soft_bits = NULL;
+  int max_iterations = 0;
+  std::atomic<int> next_block;
+};
+
+// Takes code blocks until there are none left
+static void
+phy_turbo_take_blocks(phy_turbo_pool *pool, phy_turbo_decoder &decoder) {
+  phy_tb_plan &p = *pool->plan;
+  for (int r; (r = pool->next_block++) < (int)p.blocks.size(); )
+    p.iterations[r] = phy_turbo_decode_block(decoder, p, r, pool->soft_bits, pool->max_iterations);
+}
+
+static void
+phy_turbo_worker(phy_turbo_pool *pool, int i) {
+  uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(pool->mutex);
+      pool->start.wait(lock, [&]() { return pool->stopping || pool->generation != seen; });
+      if (pool->stopping)
+	return;
+      seen = pool->generation;
+    }
+    phy_turbo_take_blocks(pool, pool->decoders[i]);
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    if (!--pool->busy)
+      pool->finished.notify_one();
+  }
+}
+
+PHY_TURBO_POOL *
+phy_turbo_pool_init(int n_threads) {
+  if (n_threads < 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  phy_turbo_pool *pool = new phy_turbo_pool;
+  pool->decoders.resize(n_threads);
+  for (int i = 0; i < n_threads; ++i)
+    pool->threads.emplace_back(phy_turbo_worker, pool, i);
+  return pool;
+}
+
+void
+phy_turbo_pool_free(PHY_TURBO_POOL *pool) {
+  if (!pool)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->stopping = true;
+  }
+  pool->start.notify_all();
+  for (auto &thread : pool->threads)
+    thread.join();
+  delete pool;
+}
+
+int
+phy_tb_decode(PHY_TB_PLAN *p, const int16_t *soft_bits, int max_iterations, PHY_TURBO_POOL *pool, void *tb) {
+  if (max_iterations < 1 || max_iterations > PHY_TURBO_MAX_ITERATIONS) {
+    errno = EINVAL;
+    return -1;
+  }
+  int c = p->blocks.size();
+  if (pool && !pool->threads.empty() && c > 1) {
+    {
+      std::lock_guard<std::mutex> lock(pool->mutex);
+      pool->plan = p;
+      pool->soft_bits = soft_bits;
+      pool->max_iterations = max_iterations;
+      pool->next_block = 0;
+      pool->busy = pool->threads.size();
+      ++pool->generation;
+    }
+    pool->start.notify_all();
+    phy_turbo_take_blocks(pool, p->decoder);
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    pool->finished.wait(lock, [&]() { return !pool->busy; });
+  } else {
+    for (int r = 0; r < c; ++r)
+      p->iterations[r] = phy_turbo_decode_block(p->decoder, *p, r, soft_bits, max_iterations);
+  }
+
+  memcpy(tb, p->tb.data(), p->tbs / 8);
+  int iterations = 0;
+  for (int r = 0; r < c; ++r) {
+    if (p->iterations[r] < 0) {
+      errno = EBADMSG;
+      return -1;
+    }
+    iterations = std::max(iterations, p->iterations[r]);
+  }
+  if (c > 1 && phy_crc_check(PHY_CRC24A, p->tb.data(), p->tbs + PHY_TURBO_CRC_SIZE))
+    return -1;
+  return iterations;
+}
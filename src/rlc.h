@@ -1,8 +1,11 @@
 // 3GPP LTE RLC: 4G Radio Link Control protocol interface
+#ifndef RLC_H
+#define RLC_H
 
 
 #if !defined(CFFI_PARSE)
 #include <stddef.h> // For size_t
+#include <stdint.h> // For uint64_t
 #if defined _WIN32 || defined __CYGWIN__
   #ifdef BUILDING_DLL
     #ifdef __GNUC__
@@ -51,6 +54,12 @@ extern "C" {
   DLL_PUBLIC int     rlc_set_parameters(RLC *state, const char *envz, size_t envz_len);
   /* Returns -1 if doesn't want to or can't send a packet */
   DLL_PUBLIC int     rlc_pdu_send_opportunity(RLC *state, unsigned time_in_ms, void *buffer, int size);
+  // Fills a whole MAC grant of size bytes with up to max_pdus PDUs:
+  // STATUS first, then retransmissions, then new data. Each PDU is counted
+  // with a MAC subheader of 2 bytes if it is under 128 bytes, 3 otherwise.
+  // PDUs are written back to back into buffer and their sizes into pdu_sizes.
+  // Returns the number of PDUs, 0 if there is nothing to send.
+  DLL_PUBLIC int     rlc_pdus_send_opportunity(RLC *state, unsigned time_in_ms, void *buffer, int size, int *pdu_sizes, int max_pdus);
   DLL_PUBLIC void    rlc_pdu_received(RLC *state, unsigned time_in_ms, const void *buffer, int size);
   // rlc_timer_tick: Use this to do slow work. Call radio_link_failure
   // callback for example or shuffle buffers
@@ -73,6 +82,70 @@ extern "C" {
 			       rlc_sdu_delivered_fn sdu_delivered,
 			       rlc_radio_link_failure_fn rlf);
 
+  /******** Buffer status *********/
+
+  // Bytes waiting for a send opportunity, as RLC PDUs with headers.
+  // new_data_bytes only covers the unsent rest of a segmented SDU: SDUs
+  // still queued in the upper layer are not known to RLC.
+  struct rlc_buffer_status {
+    unsigned status_bytes;
+    unsigned retransmission_bytes;
+    unsigned new_data_bytes;
+  };
+  DLL_PUBLIC void    rlc_get_buffer_status(RLC *state, struct rlc_buffer_status *status);
+
+  /******** Statistics *********/
+
+#define RLC_STATS_LATENCY_BUCKETS 16
+
+  // Counters since rlc_init() or the last rlc_reset(), which zeroes them.
+  // Safe to call from another thread while the protocol is running; each
+  // field is read atomically, but the fields are not a consistent snapshot
+  // with each other.
+  struct rlc_stats {
+    uint64_t pdus_sent, bytes_sent;
+    uint64_t pdus_retransmitted, bytes_retransmitted, pdus_resegmented;
+    uint64_t status_pdus_sent, status_pdus_received;
+    uint64_t polls_sent;
+    // Send opportunities that found the transmit window full
+    uint64_t window_stalls;
+    uint64_t pdus_received, bytes_received;
+    uint64_t sdus_received, sdus_delivered;
+    uint64_t t_reordering_expiries, t_poll_retransmit_expiries;
+    // PDUs between the window edges after the latest send/receive
+    uint64_t tx_window_occupancy, rx_window_occupancy;
+    // Time from first transmission to acknowledgement of delivered SDUs.
+    // Bucket 0 counts below 1 ms, bucket i below 2^i ms, the last the rest.
+    uint64_t sdu_latency_histogram[RLC_STATS_LATENCY_BUCKETS];
+  };
+  DLL_PUBLIC void    rlc_get_stats(RLC *state, struct rlc_stats *stats);
+
+  /******** Protocol trace *********/
+
+#define RLC_TRACE_PDU_TX 1
+#define RLC_TRACE_PDU_RX 2
+#define RLC_TRACE_TIMER_EXPIRED 3
+
+  // Every instance records its latest "rlc/trace" events in a ring.
+  // PDU events hold the start of the PDU and timer events the timer name.
+  struct rlc_trace_event {
+    uint32_t time_in_ms;
+    uint8_t  type;
+    uint8_t  reserved;
+    uint16_t length; // Full length of PDU, may be more than fits in data
+    uint8_t  data[56];
+  };
+  // The trace functions may be called from another thread while the protocol
+  // is running, by one reader at a time. They return the events recorded since
+  // the previous call; older events may have been overwritten. Returns -1 and
+  // sets errno if max_events is negative.
+  DLL_PUBLIC int     rlc_trace_read(RLC *state, struct rlc_trace_event *events, int max_events);
+  // Writes PDU events in Wireshark's rlc-lte UDP framing. ueid and lcid are
+  // shown in the framing, is_ue marks transmitted PDUs as uplink.
+  // Returns number of PDUs written or -1 and sets errno.
+  DLL_PUBLIC int     rlc_trace_write_pcap(RLC *state, const char *filename, int ueid, int lcid, int is_ue);
+
 #ifdef __cplusplus
 }
 #endif			 
+#endif
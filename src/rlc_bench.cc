@@ -0,0 +1,244 @@
+/*
+   Microbenchmarks for the RLC AM hot paths in rlc_mux.cc
+
+   Usage: rlc_bench [-t seconds] [-o results.json] [name filter]
+*/
+// Benchmarks reach the static functions directly
+#include "rlc_mux.cc"
+#include "bench.hh"
+
+#include <boost/format.hpp>
+
+using boost::str;
+using boost::format;
+
+static const size_t occupancies[] = { 16, 128, 511 };
+static const size_t grants[] = { 16, 128, 1500 };
+
+static vector<packet>
+make_sdus(size_t count, size_t size) {
+  vector<packet> sdus;
+  for (size_t i = 0; i < count; ++i) {
+    packet sdu(size);
+    for (size_t j = 0; j < size; ++j)
+      sdu[j] = (uint8_t)(i + j);
+    sdus.push_back(sdu);
+  }
+  return sdus;
+}
+
+static rlc_am_tx_pdu_contents
+make_pdu(rlc_am_sn sn, size_t sdu_count, size_t sdu_size) {
+  rlc_am_tx_pdu_contents pdu;
+  pdu.sn = sn;
+  pdu.sdus = make_sdus(sdu_count, sdu_size);
+  pdu.max_size = pdu.total_size();
+  return pdu;
+}
+
+static void
+set_default_parameters(rlc_am_state &state) {
+  state.tx.am_window_size = state.rx.am_window_size = RLC_AM_WINDOW_SIZE;
+  state.tx.am_max_retx_threshold = 4;
+  state.tx.max_pdu_without_poll = 8;
+  state.tx.max_bytes_without_poll = 1024;
+}
+
+// Receiver with `occupancy` PDUs in the reordering window. Every eighth PDU
+// is missing and every 32nd is only partially received.
+static void
+make_rx_window(rlc_am_state &state, size_t occupancy) {
+  set_default_parameters(state);
+  auto &rx = state.rx;
+  rx.lowest_sequence_number = 1;
+  rx.highest_seen_plus_1 = rx.lowest_sequence_number + occupancy;
+  for (rlc_am_sn sn = rx.lowest_sequence_number; sn != rx.highest_seen_plus_1; ++sn) {
+    packet pdu = make_pdu(sn, 2, 50).encode();
+    if (sn.value % 32 == 5) {
+      auto segment = make_pdu(sn, 2, 50).resegment(40, std::make_pair(0, -1)).encode();
+      rx.resegmentation_queue[sn].add(segment);
+    } else if (sn.value % 8 != 1) {
+      rx.reordering_queue[sn] = pdu;
+    }
+  }
+}
+
+// Transmitter with `occupancy` unacknowledged PDUs of 100 bytes in flight
+static void
+make_tx_window(rlc_am_state &state, size_t occupancy) {
+  set_default_parameters(state);
+  auto &tx = state.tx;
+  tx.lowest_unacknowledged_sequence_number = 1;
+  tx.next_sequence_number = tx.lowest_unacknowledged_sequence_number + occupancy;
+  for (rlc_am_sn sn = tx.VT_A(); sn != tx.VT_S(); ++sn) {
+    tx.in_flight[sn].pdu = make_pdu(sn, 2, 50);
+  }
+}
+
+static void
+bench_bits(bench &b) {
+  uint8_t buf[64];
+  b.run("bits/encode_am_header", [&]() {
+      memset(buf, 0, 8);
+      bits header(buf);
+      header += f<1>(1) + f<1>(0) + f<1>(1) + f<2>(2) + f<1>(1);
+      header.push_bits(RLC_AM_SEQUENCE_NUMBER_FIELD_SIZE, 777);
+      header += f<1>(0) + f<11>(1234);
+      bits_pad_to_octet(header);
+      bench_keep(buf);
+    });
+  b.run("bits/decode_am_header", [&]() {
+      bits header(buf);
+      unsigned v = header/6;
+      v += header/RLC_AM_SEQUENCE_NUMBER_FIELD_SIZE;
+      v += header/1;
+      v += header/RLC_AM_LENGTH_FIELD_SIZE;
+      bench_keep(v);
+    });
+  b.run("bits/encode_32_length_fields", [&]() {
+      memset(buf, 0, sizeof(buf));
+      bits header(buf);
+      for (unsigned i = 0; i < 32; ++i)
+	header += f<1>(1) + f<RLC_AM_LENGTH_FIELD_SIZE>(i * 61);
+      bench_keep(buf);
+    });
+  b.run("bits/decode_32_length_fields", [&]() {
+      bits header(buf);
+      unsigned v = 0;
+      for (unsigned i = 0; i < 32; ++i)
+	v += header/(1 + RLC_AM_LENGTH_FIELD_SIZE);
+      bench_keep(v);
+    });
+}
+
+static void
+bench_codec(bench &b) {
+  static const size_t shapes[][2] = { { 1, 100 }, { 4, 40 }, { 16, 80 }, { 1, 1400 } };
+  for (auto &shape : shapes) {
+    auto name = str(format("sdus=%d/sdu_size=%d") % shape[0] % shape[1]);
+    auto pdu = make_pdu(100, shape[0], shape[1]);
+    packet encoded = pdu.encode();
+    b.run("encode/" + name, [&]() {
+	packet p = pdu.encode();
+	bench_keep(p);
+      });
+    b.run("decode/" + name, [&]() {
+	rlc_am_tx_pdu_contents d;
+	d.decode(encoded);
+	bench_keep(d);
+      });
+  }
+}
+
+static void
+bench_resegment(bench &b) {
+  auto pdu = make_pdu(100, 4, 350);
+  for (size_t grant : grants) {
+    b.run(str(format("resegment/sdus=4/sdu_size=350/grant=%d") % grant), [&]() {
+	auto segment = pdu.resegment(grant, std::make_pair(0, -1));
+	bench_keep(segment);
+      });
+    b.run(str(format("resegment/sdus=4/sdu_size=350/offset=500/grant=%d") % grant), [&]() {
+	auto segment = pdu.resegment(grant, std::make_pair(500, 900));
+	bench_keep(segment);
+      });
+  }
+}
+
+static void
+bench_status(bench &b) {
+  for (size_t occupancy : occupancies) {
+    rlc_am_state state;
+    make_rx_window(state, occupancy);
+    for (size_t grant : grants) {
+      b.run(str(format("make_status_pdu/window=%d/grant=%d") % occupancy % grant), [&]() {
+	  packet p = rlc_am_make_status_pdu(state.rx, grant);
+	  bench_keep(p);
+	});
+    }
+  }
+  for (size_t occupancy : occupancies) {
+    rlc_am_state peer;
+    make_rx_window(peer, occupancy);
+    packet status = rlc_am_make_status_pdu(peer.rx, 1500);
+
+    rlc_am_state prototype, state;
+    make_tx_window(prototype, occupancy);
+    b.run(str(format("handle_status/window=%d") % occupancy),
+	  [&]() { state = prototype; state.link(); },
+	  [&]() { rlc_am_handle_status(state.tx, status); });
+  }
+}
+
+static void
+bench_transmit(bench &b) {
+  auto pull_sdu = [](size_t max_size) { return packet(min(max_size, (size_t)300), 0x55); };
+  for (size_t grant : grants) {
+    rlc_am_state state;
+    set_default_parameters(state);
+    state.link();
+    b.run(str(format("mux_transmit/sdu_size=300/grant=%d") % grant),
+	  [&]() {
+	    // Keep the window from filling up
+	    state.tx.in_flight.clear();
+	    state.tx.lowest_unacknowledged_sequence_number = state.tx.next_sequence_number;
+	  },
+	  [&]() {
+	    packet p = rlc_am_mux_transmit(state.tx, grant, pull_sdu);
+	    bench_keep(p);
+	  });
+  }
+  for (size_t occupancy : occupancies) {
+    rlc_am_state prototype, state;
+    make_tx_window(prototype, occupancy);
+    // Only the last PDU in the window awaits retransmission
+    prototype.tx.request_retx(prototype.tx.in_flight.rbegin()->first);
+    for (size_t grant : grants) {
+      b.run(str(format("mux_retransmit/window=%d/grant=%d") % occupancy % grant),
+	    [&]() { state = prototype; state.link(); },
+	    [&]() {
+	      packet p = rlc_am_mux_retransmit(state.tx, grant);
+	      bench_keep(p);
+	    });
+    }
+  }
+}
+
+// A grant after a fade: STATUS owed, retransmissions queued, new data waiting
+static void
+bench_grant(bench &b) {
+  auto pull_sdu = [](size_t max_size) { return packet(min(max_size, (size_t)300), 0x55); };
+  rlc_am_state prototype, state;
+  make_rx_window(prototype, 128);
+  make_tx_window(prototype, 64);
+  prototype.tx.status_requested = true;
+  for (rlc_am_sn sn = prototype.tx.VT_A(); sn != prototype.tx.VT_S(); sn += 8)
+    prototype.tx.request_retx(sn);
+  for (size_t grant : grants) {
+    b.run(str(format("make_packet/after_fade/grant=%d") % grant),
+	  [&]() { state = prototype; state.link(); },
+	  [&]() {
+	    packet p = rlc_am_make_packet(state.tx, grant, pull_sdu);
+	    bench_keep(p);
+	  });
+    b.run(str(format("make_packets/after_fade/grant=%d") % grant),
+	  [&]() { state = prototype; state.link(); },
+	  [&]() {
+	    vector<packet> pdus;
+	    rlc_am_make_packets(state.tx, grant, 64, pull_sdu, pdus);
+	    bench_keep(pdus);
+	  });
+  }
+}
+
+int
+main(int argc, char **argv) {
+  bench b(argc, argv);
+  bench_bits(b);
+  bench_codec(b);
+  bench_resegment(b);
+  bench_status(b);
+  bench_transmit(b);
+  bench_grant(b);
+  return 0;
+}
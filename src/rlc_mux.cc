@@ -23,6 +23,7 @@
 #include <unordered_map>
 #include <iostream>
 #include <fstream>
+#include <atomic>
 #include <boost/foreach.hpp>
 #include <boost/range/adaptor/sliced.hpp>
 #include <boost/range/algorithm/copy.hpp>
@@ -38,6 +39,7 @@
 /* My C++ helpers */
 #include "math.hh"
 #include "bitfield.hh"
+#include "trace.hh"
 
 
 using boost::adaptors::sliced;
@@ -68,6 +70,19 @@ typedef vector<uint8_t> packet;
 const packet empty_packet;
 typedef sequence_number<RLC_AM_SEQUENCE_NUMBER_FIELD_SIZE> rlc_am_sn;
 
+/* Statistics counter written only by the protocol thread and read by
+ * anyone through rlc_get_stats(). Relaxed load+store instead of
+ * fetch_add keeps locked instructions off the TTI path. */
+struct counter {
+  std::atomic<uint64_t> value;
+  counter() : value(0) {}
+  counter(const counter &rhs) : value(rhs.get()) {}
+  counter &operator=(const counter &rhs) { set(rhs.get()); return *this; }
+  void operator+=(uint64_t n) { set(get() + n); }
+  void operator++() { *this += 1; }
+  void set(uint64_t n) { value.store(n, std::memory_order_relaxed); }
+  uint64_t get() const { return value.load(std::memory_order_relaxed); }
+};
 
 struct timer {
   const char *name;
@@ -94,7 +109,8 @@ struct timer {
       cerr << "Timer(" << (name?:"") << "=" << timeout_in_ms << "ms) reset" << endl;
     }
   }
-  void update(unsigned time_in_ms_) {
+  // Returns true when the timer expires
+  bool update(unsigned time_in_ms_) {
     time_in_ms = time_in_ms_;
     if(m_running && (time_in_ms - started_at_time_in_ms >= (int)timeout_in_ms)) {
       if (rlc_debug & 2) {
@@ -103,12 +119,23 @@ struct timer {
       }
       m_ringing = true;
       m_running = false;
+      ++expiries;
+      return true;
     }
+    return false;
   }
   bool running() const { return m_running; }
   bool ringing() const { return m_ringing; }
 
   void set_timeout(unsigned timeout_in_ms) { this->timeout_in_ms = timeout_in_ms; }
+  // Back to as constructed, keeping the name and timeout
+  void clear() {
+    timer fresh(name);
+    fresh.timeout_in_ms = timeout_in_ms;
+    *this = fresh;
+  }
+  unsigned timeout() const { return timeout_in_ms; }
+  counter expiries;
 protected:
   sequence_number<31> time_in_ms;
   bool m_running;
@@ -157,6 +184,28 @@ struct rlc_am_nack {
 
 struct rlc_am_rx_state;
 
+struct rlc_am_stats {
+  counter pdus_sent, bytes_sent;
+  counter pdus_retransmitted, bytes_retransmitted, pdus_resegmented;
+  counter status_pdus_sent, status_pdus_received;
+  counter polls_sent;
+  counter window_stalls;
+  counter pdus_received, bytes_received;
+  counter sdus_received, sdus_delivered;
+  counter tx_window_occupancy, rx_window_occupancy;
+  counter sdu_latency_histogram[RLC_STATS_LATENCY_BUCKETS];
+
+  // Bucket 0 counts latencies below 1 ms, bucket i below 2^i ms
+  void add_sdu_latency(unsigned latency_in_ms) {
+    unsigned bucket = 0;
+    while (latency_in_ms && bucket < RLC_STATS_LATENCY_BUCKETS - 1) {
+      latency_in_ms >>= 1;
+      ++bucket;
+    }
+    ++sdu_latency_histogram[bucket];
+  }
+};
+
 struct rlc_am_tx_pdu_contents {
   rlc_am_sn sn;
   bool poll;
@@ -175,6 +224,8 @@ struct rlc_am_tx_pdu_contents {
   void finalize(std::pair<size_t, packet> &initial_state);
   packet encode() const;
   size_t payload_size() const { return boost::accumulate(sdus, (size_t)0, [](auto i, auto &v) { return i + v.size(); }); }
+  size_t segment_size(std::pair<size_t, size_t> range) const;
+  size_t segment_header_size(std::pair<size_t, size_t> range) const;
   size_t header_size(size_t with_extra_packet_count=0) const {
     size_t pieces = sdus.size() + with_extra_packet_count;
     if(pieces == 0)
@@ -201,10 +252,70 @@ struct rlc_am_tx_pdu_state {
   rlc_am_tx_pdu_contents pdu;
   size_t retx_count;
   bool delivered;
-  bool retx_requested;
-  std::list<std::pair<size_t, size_t> > retx_ranges;
-  rlc_am_tx_pdu_state() : retx_count(0), delivered(false), retx_requested(false) {}
-  void request_retx() { if (!delivered) retx_requested = true; }
+  unsigned first_sent_in_ms;
+  rlc_am_tx_pdu_state() : retx_count(0), delivered(false), first_sent_in_ms(0) {}
+};
+
+/* A pending retransmission of a whole PDU or a byte range of its payload */
+struct rlc_am_retx {
+  rlc_am_sn sn;
+  std::pair<size_t, size_t> range;
+  size_t header_bytes, payload_bytes; // Of the PDU that would retransmit it all
+  bool is_whole_pdu() const { return range == whole_pdu(); }
+  static std::pair<size_t, size_t> whole_pdu() { return std::pair<size_t, size_t>(0, -1); }
+  bool operator<(const rlc_am_retx &rhs) const {
+    if (sn != rhs.sn)
+      return sn < rhs.sn;
+    return range.first < rhs.range.first;
+  }
+};
+
+/**************************************************************
+ **
+ ** rlc_am_retx_queue
+ **
+ **  Retransmissions in sequence number order with the total
+ **  number of bytes they will take for buffer status reports.
+ **/
+struct rlc_am_retx_queue {
+  rlc_am_retx_queue() : total_bytes(0) {}
+  bool empty() const { return entries.empty(); }
+  size_t bytes() const { return total_bytes; }
+  const rlc_am_retx &front() const { return *entries.begin(); }
+  void pop_front() {
+    total_bytes -= front().header_bytes + front().payload_bytes;
+    entries.erase(entries.begin());
+  }
+  void add(const rlc_am_retx &retx) {
+    auto inserted = entries.insert(retx);
+    if (inserted.second)
+      total_bytes += retx.header_bytes + retx.payload_bytes;
+  }
+  // Remove all retransmissions of a PDU
+  void erase(rlc_am_sn sn) {
+    rlc_am_retx first;
+    first.sn = sn;
+    first.range.first = 0;
+    auto p = entries.lower_bound(first);
+    while (p != entries.end() && p->sn == sn) {
+      total_bytes -= p->header_bytes + p->payload_bytes;
+      p = entries.erase(p);
+    }
+  }
+  void clear() {
+    entries.clear();
+    total_bytes = 0;
+  }
+  bool contains(rlc_am_sn sn) const {
+    rlc_am_retx first;
+    first.sn = sn;
+    first.range.first = 0;
+    auto p = entries.lower_bound(first);
+    return p != entries.end() && p->sn == sn;
+  }
+protected:
+  std::set<rlc_am_retx> entries;
+  size_t total_bytes;
 };
 
 struct rlc_am_tx_state {
@@ -234,6 +345,7 @@ struct rlc_am_tx_state {
 
   /* Retransmission */
   std::map<rlc_am_sn, rlc_am_tx_pdu_state> in_flight;
+  rlc_am_retx_queue retx_queue;
 
   /* Delivery indication required and then done! */
   std::queue<packet> delivered_sdus;
@@ -254,15 +366,11 @@ struct rlc_am_tx_state {
       && !have_data_to_send();
   }
   bool have_data_to_send() const {
-    return
-      (sdu_in_progress.first != 0) ||
-      boost::accumulate(in_flight | map_values, false,
-			[this](bool fail, const auto &s) {
-			  return fail || s.retx_requested;
-			});
+    return (sdu_in_progress.first != 0) || need_retransmission();
     //TODO: Really need this for performance      || sdu_peek_buffer();
   }
   void poll_sent(rlc_am_sn sn) {
+    ++stats->polls_sent;
     pdu_without_poll = 0;
     bytes_without_poll = 0;
     last_poll_sn = sn;
@@ -273,14 +381,41 @@ struct rlc_am_tx_state {
 
   /* Boilerplate */
 
-  bool need_retransmission() const {
-    return boost::accumulate(in_flight | map_values, false,
-			     [this](bool need, const auto &s) {
-			       return need || s.retx_requested;
-			     });
+  bool need_retransmission() const { return !retx_queue.empty(); }
+  // Queue a retransmission unless the PDU was delivered already
+  void request_retx(rlc_am_sn sn, std::pair<size_t, size_t> range = rlc_am_retx::whole_pdu()) {
+    auto &s = in_flight[sn];
+    if (s.delivered || range.first >= s.pdu.payload_size())
+      return;
+    rlc_am_retx retx;
+    retx.sn = sn;
+    retx.range = range;
+    if (retx.is_whole_pdu()) {
+      retx.header_bytes = s.pdu.header_size();
+      retx.payload_bytes = s.pdu.payload_size();
+    } else {
+      retx.header_bytes = s.pdu.segment_header_size(range);
+      retx.payload_bytes = min(s.pdu.payload_size(), range.second) - range.first;
+    }
+    retx_queue.add(retx);
   }
   rlc_am_tx_state() : status_requested(false) {}
+  // Protocol state back to zero in place, keeping parameters
+  void clear() {
+    time_in_ms = 0;
+    status_requested = false;
+    status_requested_sn = last_poll_sn = next_sequence_number = lowest_unacknowledged_sequence_number = 0;
+    bytes_without_poll = pdu_without_poll = 0;
+    t_PollRetransmit.clear();
+    sdu_in_progress.first = 0;
+    sdu_in_progress.second.clear();
+    in_flight.clear();
+    retx_queue.clear();
+    while (!delivered_sdus.empty())
+      delivered_sdus.pop();
+  }
   rlc_am_rx_state *rx_state;
+  rlc_am_stats *stats;
 
   /* Support same notation as 3GPP LTE RLC specification */
   rlc_am_sn VT_A() { return lowest_unacknowledged_sequence_number; }
@@ -304,7 +439,9 @@ struct rlc_am_rx_state {
 
   /* Status feedback */
   rlc_am_tx_state *tx_state;
+  rlc_am_stats *stats;
   timer t_StatusProhibit = "t-StatusProhibit";    // Configurable
+  size_t status_size; // Bits of a STATUS PDU with all NACKs, 0 until worked out
 
   /* Fragmentation state */
   packet partial_packet;
@@ -313,7 +450,19 @@ struct rlc_am_rx_state {
   std::queue<packet> sdus;
 
 
-  rlc_am_rx_state() {}
+  rlc_am_rx_state() : status_size(0) {}
+  // Protocol state back to zero in place, keeping parameters
+  void clear() {
+    lowest_sequence_number = highest_seen_plus_1 = timer_reordering_trigger_plus_1 = 0;
+    status_size = 0;
+    reordering_queue.clear();
+    t_Reordering.clear();
+    resegmentation_queue.clear();
+    t_StatusProhibit.clear();
+    partial_packet.clear();
+    while (!sdus.empty())
+      sdus.pop();
+  }
   // This function calculates VR(R) <= SN  < VR(MR)
   bool in_receive_window(rlc_am_sn sn) const { return sn - lowest_sequence_number >= 0; }
 
@@ -329,15 +478,31 @@ struct rlc_am_rx_state {
 struct rlc_am_state {
   rlc_am_tx_state tx;
   rlc_am_rx_state rx;
+  rlc_am_stats stats;
   rlc_am_state() {
+    link();
+    //TODO: Set parameters
+  }
+  // Point the halves at each other. Needed again after copying.
+  void link() {
     tx.rx_state = &rx;
     rx.tx_state = &tx;
-    //TODO: Set parameters
+    tx.stats = rx.stats = &stats;
   }
-  void set_time(unsigned time_in_ms) {
-    rx.t_Reordering.update(time_in_ms);
-    rx.t_StatusProhibit.update(time_in_ms);
-    tx.t_PollRetransmit.update(time_in_ms);
+  void update_window_stats() {
+    stats.tx_window_occupancy.set(tx.VT_S() - tx.VT_A());
+    stats.rx_window_occupancy.set(rx.VR_H() - rx.VR_R());
+  }
+  static const int n_timers = 3;
+  // Fills in the timers which expired and returns their number
+  int set_time(unsigned time_in_ms, const timer *expired[n_timers]) {
+    tx.time_in_ms = time_in_ms;
+    int n = 0;
+    for (timer *t : { &rx.t_Reordering, &rx.t_StatusProhibit, &tx.t_PollRetransmit }) {
+      if (t->update(time_in_ms))
+	expired[n++] = t;
+    }
+    return n;
   }
 };
 
@@ -398,12 +563,14 @@ rlc_am_tx_pdu_contents
 rlc_am_tx_pdu_contents::resegment(size_t max_size, std::pair<size_t, size_t> range) const {
   rlc_am_tx_pdu_contents pdu;
   pdu.segment_offset = range.first; // Set segment_offset the first thing
+  // Don't carry bytes past the end of the range
+  max_size = min(max_size, segment_size(range));
   pdu.max_size = max_size;
   if(!pdu.room_for_more())
     return pdu;
 
   range.second = min(payload_size(), range.second);
-  const size_t segment_size = range.second - range.first;
+  const size_t range_size = range.second - range.first;
   size_t skip = range.first;
   bool initialized = false;
   // Skip to beginning of range
@@ -432,7 +599,7 @@ rlc_am_tx_pdu_contents::resegment(size_t max_size, std::pair<size_t, size_t> ran
     } else {
       pdu.add_sdu(sdu);
     }
-    if (pdu.payload_size() >= segment_size) {
+    if (pdu.payload_size() >= range_size) {
       break;
     }
   }
@@ -442,6 +609,30 @@ rlc_am_tx_pdu_contents::resegment(size_t max_size, std::pair<size_t, size_t> ran
   return pdu;
 }
 
+// Header of a resegmented PDU carrying the whole range in one piece
+size_t
+rlc_am_tx_pdu_contents::segment_header_size(std::pair<size_t, size_t> range) const {
+  range.second = min(payload_size(), range.second);
+  if (range.first >= range.second)
+    return 0;
+  size_t pieces = 0, ofs = 0;
+  BOOST_FOREACH(const auto &sdu, sdus) {
+    if (ofs + sdu.size() > range.first && ofs < range.second)
+      ++pieces;
+    ofs += sdu.size();
+  }
+  return bits_to_bytes(RLC_AM_RESEG_HEADER_SIZE + RLC_AM_HEADER_CONTINUE_SIZE*(pieces-1));
+}
+
+// Size of a resegmented PDU carrying the whole range in one piece
+size_t
+rlc_am_tx_pdu_contents::segment_size(std::pair<size_t, size_t> range) const {
+  range.second = min(payload_size(), range.second);
+  if (range.first >= range.second)
+    return 0;
+  return segment_header_size(range) + range.second - range.first;
+}
+
 void
 rlc_am_tx_pdu_contents::add_sdu(packet sdu) {
   sdus.push_back(sdu);
@@ -628,6 +819,7 @@ static bool
 rlc_am_handle_status(rlc_am_tx_state &tx, packet &pdu_status) {
   vector<rlc_am_nack> nacks;
   rlc_am_sn ack_sn = rlc_am_parse_status(pdu_status, nacks);
+  ++tx.stats->status_pdus_received;
 
   std::set<rlc_am_sn> all_nacks;
   BOOST_FOREACH(auto nack, nacks) { all_nacks.insert(nack.sn); }
@@ -643,7 +835,7 @@ rlc_am_handle_status(rlc_am_tx_state &tx, packet &pdu_status) {
   // Now we got the NACKs and ACKs sorted out, update delivery status
   std::set<rlc_am_sn> just_delivered;
   BOOST_FOREACH(auto &sn, acks) {
-    tx.in_flight[sn].retx_requested = false;
+    tx.retx_queue.erase(sn);
     tx.in_flight[sn].delivered = true;
     just_delivered.insert(sn);
   }
@@ -655,27 +847,35 @@ rlc_am_handle_status(rlc_am_tx_state &tx, packet &pdu_status) {
     if (!has_key(tx.in_flight, sn)) break;
     if (!tx.in_flight[sn].delivered)  break;
     auto &pdu = tx.in_flight[sn].pdu;
+    size_t delivered_before = tx.delivered_sdus.size();
     if (pdu.f0 && !(pdu.f1 && pdu.sdus.size() == 1)) {
       tx.delivered_sdus.push(pdu.first_partial_sdu);
     }
     for(int i = pdu.f0; i < (int)pdu.sdus.size() - pdu.f1; ++i) {
       tx.delivered_sdus.push(pdu.sdus[i]);
     }
+    // Latency is counted from the first transmission of the PDU
+    // which completed the SDU
+    unsigned latency = tx.time_in_ms - tx.in_flight[sn].first_sent_in_ms;
+    for(size_t i = delivered_before; i < tx.delivered_sdus.size(); ++i) {
+      tx.stats->add_sdu_latency(latency);
+    }
+    tx.stats->sdus_delivered += tx.delivered_sdus.size() - delivered_before;
     tx.in_flight.erase(sn);
   }
   // Update lower edge of tx window
   tx.lowest_unacknowledged_sequence_number = sn;
-  //Add retransmit requests
+  //Add retransmit requests, replacing the ones from earlier status
   BOOST_FOREACH(rlc_am_sn sn, all_nacks) {
-    if (has_key(tx.in_flight, sn)) {
-      tx.in_flight[sn].request_retx();
-      tx.in_flight[sn].retx_ranges.clear();
-    }
+    tx.retx_queue.erase(sn);
   }
-  // Add retransmit byte ranges requested
   BOOST_FOREACH(rlc_am_nack nack, nacks) {
-    if (nack.reseg && has_key(tx.in_flight, nack.sn))
-      tx.in_flight[nack.sn].retx_ranges.push_back(nack.segment);
+    if (!has_key(tx.in_flight, nack.sn))
+      continue;
+    if (nack.reseg)
+      tx.request_retx(nack.sn, nack.segment);
+    else
+      tx.request_retx(nack.sn);
   }
   // Print debugging output
   if (rlc_debug) {
@@ -719,6 +919,8 @@ rlc_am_rx_new_packet(rlc_am_rx_state &rx, packet &pdu) {
     rlc_am_handle_status(*rx.tx_state, pdu);
     return;
   }
+  ++rx.stats->pdus_received;
+  rx.stats->bytes_received += pdu.size();
   auto sn = rlc_am_get_sn(pdu);
   bool poll = rlc_am_get_poll(pdu);
   if (poll) {
@@ -730,6 +932,7 @@ rlc_am_rx_new_packet(rlc_am_rx_state &rx, packet &pdu) {
     // Ignore packet. We might already have it or it's past the window.
     return;
   }
+  rx.status_size = 0;
   if (rlc_am_is_reseg(pdu)) {
     if (has_key(rx.reordering_queue, sn)) {
       // We already have all segments
@@ -803,9 +1006,9 @@ am_status_begin(bits &header, rlc_am_sn ack_sequence_number, bool ext) {
  **  We can report either a ACK, NACK for a sequence number
  **  or do a partial ACK/NACK for segmentation
  **/
-static packet
-rlc_am_make_status_pdu(rlc_am_rx_state &rx, size_t requested_bytes) {
-  std::vector<rlc_am_nack> nacks;
+// Collect as many NACKs as fit. Returns the STATUS PDU size in bits.
+static size_t
+rlc_am_status_contents(rlc_am_rx_state &rx, size_t requested_bytes, std::vector<rlc_am_nack> &nacks, rlc_am_sn &ack_point) {
   size_t total_size = RLC_AM_STATUS_BEGIN_SIZE;
   assert(requested_bytes >= bits_to_bytes(total_size));
 
@@ -843,8 +1046,28 @@ rlc_am_make_status_pdu(rlc_am_rx_state &rx, size_t requested_bytes) {
     if(!has_key(rx.reordering_queue, sn))
       break;
   }
-  rlc_am_sn ack_point = sn;
+  ack_point = sn;
   assert(!(ack_point < rx.lowest_sequence_number));
+  return total_size;
+}
+
+// Size in bits of a STATUS PDU with all NACKs, kept until the receive state
+// changes
+static size_t
+rlc_am_status_size(rlc_am_rx_state &rx) {
+  if (!rx.status_size) {
+    std::vector<rlc_am_nack> nacks;
+    rlc_am_sn ack_point;
+    rx.status_size = rlc_am_status_contents(rx, INT_MAX, nacks, ack_point);
+  }
+  return rx.status_size;
+}
+
+static packet
+rlc_am_make_status_pdu(rlc_am_rx_state &rx, size_t requested_bytes) {
+  std::vector<rlc_am_nack> nacks;
+  rlc_am_sn ack_point;
+  size_t total_size = rlc_am_status_contents(rx, requested_bytes, nacks, ack_point);
   rx.tx_state->status_requested = false;
 
   // Now encode the status packet
@@ -864,9 +1087,11 @@ rlc_am_make_status_pdu(rlc_am_rx_state &rx, size_t requested_bytes) {
   }
   //TODO:am_status_continue_nack_segment(header, nack, start, end);
   bits_pad_to_octet(header);
-  BOOST_FOREACH(uint8_t byte, pdu) {
-    if (byte == 0xff) {
-      cerr << "byte == 0xff" << endl;
+  if (rlc_debug) {
+    BOOST_FOREACH(uint8_t byte, pdu) {
+      if (byte == 0xff) {
+	cerr << "byte == 0xff" << endl;
+      }
     }
   }
   return pdu;
@@ -874,49 +1099,42 @@ rlc_am_make_status_pdu(rlc_am_rx_state &rx, size_t requested_bytes) {
 
 static packet
 rlc_am_mux_retransmit(rlc_am_tx_state &state, size_t requested_bytes) {
-  // Start
-  BOOST_FOREACH(auto &pdupair, state.in_flight) {
-    auto &pdu = pdupair.second;
-    if (pdu.retx_requested) {
-      if (pdu.retx_ranges.empty()) {
-	if (pdu.pdu.total_size() <= requested_bytes) {
-	  // Simple case: retransmit as-is
-	  pdu.retx_requested = false;
-	  //TODO: Add POLL flag?
-	  if (state.want_poll()) {
-	    pdu.pdu.poll = true;
-	    state.poll_sent(pdu.pdu.sn);
-	  }
-	  return pdu.pdu.encode();
-	}
-	// Resegmentation case
-	pdu.retx_ranges.push_back(std::pair<size_t, size_t>(0, -1));
-	//FALLTHROUGH
-      }
-      auto range = pdu.retx_ranges.front();
-      pdu.retx_ranges.pop_front();
-
-      //TODO: Add POLL flag?
-      auto rpdu = pdu.pdu.resegment(requested_bytes, range);
-      if (rpdu.total_size() == 0) {
-	// requested_bytes is too small for a segmented PDU
-	return empty_packet;
-      }
-      if (rpdu.payload_size() < (range.second - range.first)) {
-	pdu.retx_ranges.push_front(std::make_pair(range.first + rpdu.payload_size(), range.second));
-      }
-      if (pdu.retx_ranges.empty()) {
-	pdu.retx_requested = false;
-      }
-      if (state.want_poll()) {
-	rpdu.poll = true;
-	state.poll_sent(rpdu.sn);
-      }
-      return rpdu.encode();
+  if (state.retx_queue.empty())
+    return empty_packet;
+  const rlc_am_retx retx = state.retx_queue.front();
+  auto &pdu = state.in_flight[retx.sn];
+  if (retx.is_whole_pdu() && pdu.pdu.total_size() <= requested_bytes) {
+    // Simple case: retransmit as-is
+    state.retx_queue.pop_front();
+    //TODO: Add POLL flag?
+    if (state.want_poll()) {
+      pdu.pdu.poll = true;
+      state.poll_sent(pdu.pdu.sn);
     }
+    ++state.stats->pdus_retransmitted;
+    state.stats->bytes_retransmitted += pdu.pdu.total_size();
+    return pdu.pdu.encode();
   }
-  //NOTREACHED
-  return empty_packet;
+  // Resegmentation case
+  //TODO: Add POLL flag?
+  auto rpdu = pdu.pdu.resegment(requested_bytes, retx.range);
+  if (rpdu.total_size() == 0) {
+    // requested_bytes is too small for a segmented PDU
+    return empty_packet;
+  }
+  state.retx_queue.pop_front();
+  size_t range_end = min(retx.range.second, pdu.pdu.payload_size());
+  if (retx.range.first + rpdu.payload_size() < range_end) {
+    state.request_retx(retx.sn, std::make_pair(retx.range.first + rpdu.payload_size(), retx.range.second));
+  }
+  if (state.want_poll()) {
+    rpdu.poll = true;
+    state.poll_sent(rpdu.sn);
+  }
+  ++state.stats->pdus_retransmitted;
+  ++state.stats->pdus_resegmented;
+  state.stats->bytes_retransmitted += rpdu.total_size();
+  return rpdu.encode();
 }
 
 static packet
@@ -942,8 +1160,60 @@ rlc_am_mux_transmit(rlc_am_tx_state &state, size_t requested_bytes, std::functio
   }
 
   state.in_flight[pdu.sn].pdu = pdu;
+  state.in_flight[pdu.sn].first_sent_in_ms = state.time_in_ms;
+  ++state.stats->pdus_sent;
+  state.stats->bytes_sent += pdu.total_size();
   return pdu.encode();
 }
+/**************************************************************
+ **
+ ** rlc_am_make_poll
+ **
+ **  The window is stuck and t-PollRetransmit expired. Any PDU
+ **  can carry the POLL, so send the newest one that fits the
+ **  grant as-is. If none does, send the smallest segment we can:
+ **  the last byte of the newest PDU. Only the POLL matters here,
+ **  the STATUS reply will tell what really needs retransmitting.
+ **/
+static packet
+rlc_am_make_poll(rlc_am_tx_state &state, size_t requested_bytes) {
+  rlc_am_tx_pdu_contents *newest = NULL;
+  BOOST_REVERSE_FOREACH(auto &s, state.in_flight | map_values) {
+    if (s.delivered)
+      continue;
+    if (!newest)
+      newest = &s.pdu;
+    if (s.pdu.total_size() <= requested_bytes) {
+      s.pdu.poll = true;
+      state.poll_sent(s.pdu.sn);
+      ++state.stats->pdus_retransmitted;
+      state.stats->bytes_retransmitted += s.pdu.total_size();
+      return s.pdu.encode();
+    }
+  }
+  if (!newest)
+    return empty_packet;
+  size_t header = bits_to_bytes(RLC_AM_RESEG_HEADER_SIZE);
+  if (requested_bytes <= header)
+    return empty_packet;
+  size_t end = newest->payload_size();
+  auto rpdu = newest->resegment(requested_bytes, std::make_pair(end - 1, end));
+  if (rpdu.total_size() == 0)
+    return empty_packet;
+  rpdu.poll = true;
+  state.poll_sent(rpdu.sn);
+  ++state.stats->pdus_retransmitted;
+  ++state.stats->pdus_resegmented;
+  state.stats->bytes_retransmitted += rpdu.total_size();
+  return rpdu.encode();
+}
+
+static bool
+rlc_am_want_status(const rlc_am_tx_state &state) {
+  const auto &rx = *state.rx_state;
+  return !rx.t_StatusProhibit.running() && (state.status_requested || rx.t_Reordering.ringing());
+}
+
 /**************************************************************
  **
  ** rlc_am_make_packet
@@ -958,14 +1228,13 @@ rlc_am_make_packet(rlc_am_tx_state &state, size_t requested_bytes, std::function
   
   // Priority 1: STATUS REPORTS
   auto &rx = *state.rx_state;
-  if (!rx.t_StatusProhibit.running()) {
-    if (state.status_requested || rx.t_Reordering.ringing()) {
-      rx.t_StatusProhibit.start();
-      if (rx.t_Reordering.ringing())
-	rx.t_Reordering.start();
-      state.status_requested = false;
-      return rlc_am_make_status_pdu(rx, requested_bytes);
-    }
+  if (rlc_am_want_status(state)) {
+    rx.t_StatusProhibit.start();
+    if (rx.t_Reordering.ringing())
+      rx.t_Reordering.start();
+    state.status_requested = false;
+    ++state.stats->status_pdus_sent;
+    return rlc_am_make_status_pdu(rx, requested_bytes);
   }
   // Priority 2: RETRANSMISSIONS
   if (state.need_retransmission()) {
@@ -977,15 +1246,10 @@ rlc_am_make_packet(rlc_am_tx_state &state, size_t requested_bytes, std::function
     return rlc_am_mux_transmit(state, requested_bytes, pull_sdu);
   } else {
     // Window is full... Either wait for ACK or retransmit a packet with POLL
+    ++state.stats->window_stalls;
     if (state.t_PollRetransmit.ringing()) {
-      //TODO: FIND A PACKET FOR POLL
-      BOOST_REVERSE_FOREACH(auto &pdu, state.in_flight | map_values) {
-	//TODO: Probably should find a packet which doesn't require resegmentation
-	if(!pdu.delivered) {
-	  pdu.retx_requested = true;
-	  return rlc_am_mux_retransmit(state, requested_bytes);
-	}
-      }
+      if (!state.in_flight.empty())
+	return rlc_am_make_poll(state, requested_bytes);
       assert(state.lowest_unacknowledged_sequence_number == state.next_sequence_number);
     }
   }
@@ -993,6 +1257,38 @@ rlc_am_make_packet(rlc_am_tx_state &state, size_t requested_bytes, std::function
   return empty_packet;
 }
 
+// MAC subheader for a MAC SDU of this size: 7 or 15 bit length field
+static size_t
+mac_subheader_size(size_t sdu_size) {
+  return (sdu_size < 128) ? 2 : 3;
+}
+
+/**************************************************************
+ **
+ ** rlc_am_make_packets
+ **
+ **  Fill a whole MAC grant, with room left for a MAC subheader
+ **  in front of each PDU. The PDUs come in the same priority
+ **  order as from repeated rlc_am_make_packet() calls.
+ **/
+static size_t
+rlc_am_make_packets(rlc_am_tx_state &state, size_t grant_bytes, size_t max_pdus, std::function<packet(size_t)> pull_sdu, vector<packet> &pdus) {
+  size_t used = 0;
+  while (pdus.size() < max_pdus) {
+    size_t left = grant_bytes - used;
+    if (left < 2 + bits_to_bytes(RLC_AM_STATUS_BEGIN_SIZE))
+      break;
+    // Ask for a PDU which still fits with a short subheader if possible
+    size_t requested_bytes = (left - 2 < 128) ? left - 2 : left - 3;
+    packet pdu = rlc_am_make_packet(state, requested_bytes, pull_sdu);
+    if (pdu.empty())
+      break;
+    used += mac_subheader_size(pdu.size()) + pdu.size();
+    pdus.push_back(pdu);
+  }
+  return used;
+}
+
 /**************************************************************
  **
  ** RLC AM decoding
@@ -1055,22 +1351,50 @@ struct rlc_state {
   rlc_sdu_delivered_fn sdu_delivered;
   rlc_radio_link_failure_fn rlf;
   rlc_am_state state;
+  trace_ring<rlc_trace_event> trace;
+  size_t trace_size;
 };
 
+static void
+rlc_trace(RLC *rlc, uint8_t type, unsigned time_in_ms, const void *data, size_t size) {
+  if (!rlc->trace.enabled())
+    return;
+  auto &event = rlc->trace.next();
+  event.time_in_ms = time_in_ms;
+  event.type = type;
+  event.length = size;
+  memcpy(event.data, data, min(size, sizeof(event.data)));
+  rlc->trace.commit();
+}
+
+static void
+rlc_set_time(RLC *rlc, unsigned time_in_ms) {
+  const timer *expired[rlc_am_state::n_timers];
+  int n = rlc->state.set_time(time_in_ms, expired);
+  for (int i = 0; i < n; ++i)
+    rlc_trace(rlc, RLC_TRACE_TIMER_EXPIRED, time_in_ms, expired[i]->name, strlen(expired[i]->name) + 1);
+}
+
 RLC *rlc_init() {
   return new RLC();
 }
 
+// Fresh protocol state with the parameters of the old one, as zeroed
+// as rlc_init() leaves it. Containers are cleared in place so that a
+// pooled instance costs no allocations to reuse.
 void
-rlc_reset(RLC *state) {
+rlc_reset(RLC *rlc) {
+  rlc->state.tx.clear();
+  rlc->state.rx.clear();
+  rlc->state.stats = rlc_am_stats();
 }
 
 void
 rlc_free(RLC *rlc) {
-  free(rlc);
+  delete rlc;
 }
 static const char *default_parameters = ""
-"rlc/mode=AM rlc/debug=0 maxRetxThreshold=4 pollPDU=8 pollByte=1024 t-Reordering=35"
+"rlc/mode=AM rlc/debug=0 rlc/trace=1024 maxRetxThreshold=4 pollPDU=8 pollByte=1024 t-Reordering=35"
 " t-StatusProhibit=5 t-PollRetransmit=5";
 
 #define ENVZ_INT(name) atoi(envz_get(envz, envz_len, name))
@@ -1093,13 +1417,19 @@ rlc_set_parameters(RLC *rlc, const char *envz_more, size_t envz_more_len) {
 
   rlc->state.rx.t_Reordering.set_timeout(ENVZ_INT("t-Reordering"));
   rlc_debug = ENVZ_INT("rlc/debug");
+  // Resizing would confuse a concurrent trace reader, so only when changed
+  size_t trace_size = ENVZ_INT("rlc/trace");
+  if (trace_size != rlc->trace_size) {
+    rlc->trace.resize(trace_size);
+    rlc->trace_size = trace_size;
+  }
+  free(envz);
   return 0;
 }
 
-int
-rlc_pdu_send_opportunity(RLC *rlc, unsigned time_in_ms, void *buffer, int size) {
-  rlc->state.set_time(time_in_ms);
-  auto pull = [=](size_t max_size) {
+static std::function<packet(size_t)>
+rlc_sdu_puller(RLC *rlc, unsigned time_in_ms) {
+  return [=](size_t max_size) {
     packet sdu(max_size);
     int size = -1;
     if (rlc->sdu_send) {
@@ -1108,8 +1438,30 @@ rlc_pdu_send_opportunity(RLC *rlc, unsigned time_in_ms, void *buffer, int size)
     sdu.resize((size==-1)?0:size);
     return sdu;
   };
-  packet pkt = rlc_am_make_packet(rlc->state.tx, size, pull);
+}
+
+int
+rlc_pdus_send_opportunity(RLC *rlc, unsigned time_in_ms, void *buffer, int size, int *pdu_sizes, int max_pdus) {
+  rlc_set_time(rlc, time_in_ms);
+  vector<packet> pdus;
+  rlc_am_make_packets(rlc->state.tx, max(size, 0), max(max_pdus, 0), rlc_sdu_puller(rlc, time_in_ms), pdus);
+  rlc->state.update_window_stats();
+  uint8_t *p = (uint8_t *)buffer;
+  for (size_t i = 0; i < pdus.size(); ++i) {
+    rlc_trace(rlc, RLC_TRACE_PDU_TX, time_in_ms, pdus[i].data(), pdus[i].size());
+    p = boost::copy(pdus[i], p);
+    pdu_sizes[i] = pdus[i].size();
+  }
+  return pdus.size();
+}
+
+int
+rlc_pdu_send_opportunity(RLC *rlc, unsigned time_in_ms, void *buffer, int size) {
+  rlc_set_time(rlc, time_in_ms);
+  packet pkt = rlc_am_make_packet(rlc->state.tx, size, rlc_sdu_puller(rlc, time_in_ms));
+  rlc->state.update_window_stats();
   if (pkt.size()) {
+    rlc_trace(rlc, RLC_TRACE_PDU_TX, time_in_ms, pkt.data(), pkt.size());
     boost::copy(pkt, (uint8_t *)buffer);
     return pkt.size();
   }
@@ -1119,10 +1471,12 @@ rlc_pdu_send_opportunity(RLC *rlc, unsigned time_in_ms, void *buffer, int size)
 
 void
 rlc_pdu_received(RLC *rlc, unsigned time_in_ms, const void *buffer, int size) {
-  rlc->state.set_time(time_in_ms);
+  rlc_set_time(rlc, time_in_ms);
+  rlc_trace(rlc, RLC_TRACE_PDU_RX, time_in_ms, buffer, size);
   uint8_t *buf = (uint8_t *)buffer;
   packet pdu(buf, buf + size);
   rlc_am_rx_new_packet(rlc->state.rx, pdu);
+  rlc->state.update_window_stats();
 
   {
     // Deliver any new SDUs
@@ -1132,6 +1486,7 @@ rlc_pdu_received(RLC *rlc, unsigned time_in_ms, const void *buffer, int size) {
       if (rlc->sdu_recv) {
         rlc->sdu_recv(rlc->arg, time_in_ms, sdu.data(), sdu.size());
       }
+      ++rlc->state.stats.sdus_received;
       sdus.pop();
     }
   }
@@ -1159,5 +1514,103 @@ rlc_am_set_callbacks(RLC *rlc, void *arg, rlc_sdu_send_opportunity_fn sdu_send,
 
 void
 rlc_timer_tick(RLC *rlc, unsigned time_in_ms) {
-  rlc->state.set_time(time_in_ms);
+  rlc_set_time(rlc, time_in_ms);
+}
+
+void
+rlc_get_stats(RLC *rlc, struct rlc_stats *out) {
+  const auto &stats = rlc->state.stats;
+  out->pdus_sent = stats.pdus_sent.get();
+  out->bytes_sent = stats.bytes_sent.get();
+  out->pdus_retransmitted = stats.pdus_retransmitted.get();
+  out->bytes_retransmitted = stats.bytes_retransmitted.get();
+  out->pdus_resegmented = stats.pdus_resegmented.get();
+  out->status_pdus_sent = stats.status_pdus_sent.get();
+  out->status_pdus_received = stats.status_pdus_received.get();
+  out->polls_sent = stats.polls_sent.get();
+  out->window_stalls = stats.window_stalls.get();
+  out->pdus_received = stats.pdus_received.get();
+  out->bytes_received = stats.bytes_received.get();
+  out->sdus_received = stats.sdus_received.get();
+  out->sdus_delivered = stats.sdus_delivered.get();
+  out->t_reordering_expiries = rlc->state.rx.t_Reordering.expiries.get();
+  out->t_poll_retransmit_expiries = rlc->state.tx.t_PollRetransmit.expiries.get();
+  out->tx_window_occupancy = stats.tx_window_occupancy.get();
+  out->rx_window_occupancy = stats.rx_window_occupancy.get();
+  for (int i = 0; i < RLC_STATS_LATENCY_BUCKETS; ++i)
+    out->sdu_latency_histogram[i] = stats.sdu_latency_histogram[i].get();
+}
+
+int
+rlc_trace_read(RLC *rlc, struct rlc_trace_event *events, int max_events) {
+  if (max_events < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  return rlc->trace.drain(events, max_events);
+}
+
+/* Wireshark rlc-lte framing from packet-rlc-lte.h */
+#define RLC_LTE_START_STRING "rlc-lte"
+#define RLC_LTE_AM_MODE 4
+#define RLC_LTE_PAYLOAD_TAG 0x01
+#define RLC_LTE_DIRECTION_TAG 0x03
+#define RLC_LTE_UEID_TAG 0x05
+#define RLC_LTE_CHANNEL_TYPE_TAG 0x06
+#define RLC_LTE_CHANNEL_ID_TAG 0x07
+#define RLC_LTE_CHANNEL_TYPE_SRB 4
+#define RLC_LTE_CHANNEL_TYPE_DRB 5
+
+int
+rlc_trace_write_pcap(RLC *rlc, const char *filename, int ueid, int lcid, int is_ue) {
+  FILE *f = fopen(filename, "wb");
+  if (!f)
+    return -1;
+  bool ok = pcap_write_header(f);
+  int written = 0;
+  rlc_trace_event events[64];
+  int n;
+  while (ok && (n = rlc_trace_read(rlc, events, 64)) > 0) {
+    BOOST_FOREACH(const auto &event, events | sliced(0, n)) {
+      if (event.type != RLC_TRACE_PDU_TX && event.type != RLC_TRACE_PDU_RX)
+	continue;
+      bool uplink = (event.type == RLC_TRACE_PDU_TX) == !!is_ue;
+      uint8_t channel_type = (lcid <= 2) ? RLC_LTE_CHANNEL_TYPE_SRB : RLC_LTE_CHANNEL_TYPE_DRB;
+      packet framed(RLC_LTE_START_STRING, RLC_LTE_START_STRING + strlen(RLC_LTE_START_STRING));
+      const uint8_t tags[] = {
+	RLC_LTE_AM_MODE,
+	RLC_LTE_DIRECTION_TAG, !uplink,
+	RLC_LTE_UEID_TAG, (uint8_t)(ueid >> 8), (uint8_t)ueid,
+	RLC_LTE_CHANNEL_TYPE_TAG, 0, channel_type,
+	RLC_LTE_CHANNEL_ID_TAG, (uint8_t)(lcid >> 8), (uint8_t)lcid,
+	RLC_LTE_PAYLOAD_TAG
+      };
+      framed.insert(framed.end(), tags, tags + sizeof(tags));
+      size_t captured = min((size_t)event.length, sizeof(event.data));
+      framed.insert(framed.end(), event.data, event.data + captured);
+      ok = pcap_write_udp(f, event.time_in_ms, framed.data(), framed.size(),
+			  framed.size() - captured + event.length);
+      if (!ok)
+	break;
+      ++written;
+    }
+  }
+  if (fclose(f) != 0 || !ok)
+    return -1;
+  return written;
+}
+
+void
+rlc_get_buffer_status(RLC *rlc, struct rlc_buffer_status *status) {
+  auto &tx = rlc->state.tx;
+  status->status_bytes = 0;
+  if (rlc_am_want_status(tx))
+    status->status_bytes = bits_to_bytes(rlc_am_status_size(rlc->state.rx));
+  status->retransmission_bytes = tx.retx_queue.bytes();
+  status->new_data_bytes = 0;
+  if (tx.sdu_in_progress.first) {
+    // Rest of the SDU with a header for one piece
+    status->new_data_bytes = tx.sdu_in_progress.second.size() - tx.sdu_in_progress.first
+      + bits_to_bytes(RLC_AM_HEADER_SIZE);
+  }
 }
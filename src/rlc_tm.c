@@ -35,6 +35,25 @@ rlc_pdu_send_opportunity(RLC *rlc,unsigned time_in_ms, void *buffer, int size) {
   return rlc->sdu_send(rlc->arg, time_in_ms, buffer, size);
 }
 
+int
+rlc_pdus_send_opportunity(RLC *rlc, unsigned time_in_ms, void *buffer, int size, int *pdu_sizes, int max_pdus) {
+  char *p = (char *)buffer;
+  int n = 0;
+  while (n < max_pdus) {
+    /* Room left after the MAC subheader of the largest PDU that fits */
+    int room = size - (size - 2 < 128 ? 2 : 3);
+    if (room <= 0)
+      break;
+    int pdu = rlc_pdu_send_opportunity(rlc, time_in_ms, p, room);
+    if (pdu <= 0)
+      break;
+    pdu_sizes[n++] = pdu;
+    p += pdu;
+    size -= pdu + (pdu < 128 ? 2 : 3);
+  }
+  return n;
+}
+
 void
 rlc_pdu_received(RLC *rlc, unsigned time_in_ms, const void *buffer, int size) {
   return rlc->sdu_recv(rlc->arg, time_in_ms, buffer, size);
@@ -52,3 +71,24 @@ void
 rlc_timer_tick(RLC *state, unsigned time_in_ms) {
   
 }
+
+void
+rlc_get_stats(RLC *state, struct rlc_stats *stats) {
+  memset(stats, 0, sizeof(*stats));
+}
+
+void
+rlc_get_buffer_status(RLC *state, struct rlc_buffer_status *status) {
+  memset(status, 0, sizeof(*status));
+}
+
+int
+rlc_trace_read(RLC *state, struct rlc_trace_event *events, int max_events) {
+  return 0;
+}
+
+int
+rlc_trace_write_pcap(RLC *state, const char *filename, int ueid, int lcid, int is_ue) {
+  errno = ENOSYS;
+  return -1;
+}
@@ -0,0 +1,122 @@
+// 3GPP LTE RRC: 4G Radio Resource Control interface
+#ifndef RRC_H
+#define RRC_H
+
+#include "rlc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /******** System Information broadcast *********/
+  // Encoded MIB and SIBs are turned into transport blocks once and only
+  // looked up when broadcasting. Per HamLTE fixed schedule SIB1 and
+  // the SystemInformation messages all go in subframe 0.
+
+#define RRC_SI_MIB 0
+#define RRC_SI_SIB1 1
+  // SystemInformation message of SchedulingInfo entry n is RRC_SI_MESSAGE + n
+#define RRC_SI_MESSAGE 2
+#define RRC_SI_MAX_MESSAGES 4
+
+  struct rrc_si;
+  typedef struct rrc_si RRC_SI;
+
+  struct rrc_si_transmission {
+    int type;
+    int redundancy_version;
+    const void *transport_block; // Valid until the next rrc_si_set_message()
+    int size;                    // Bytes: 3 for the MIB, a DCI format 1C size for the rest
+  };
+
+  DLL_PUBLIC RRC_SI *rrc_si_init(int si_window_length_in_ms);
+  DLL_PUBLIC void    rrc_si_free(RRC_SI *si);
+  // Set UPER encoded BCCH-BCH or BCCH-DL-SCH message. The systemFrameNumber
+  // bits of the MIB are filled in per frame. periodicity_in_frames is only
+  // used for SystemInformation messages. Returns -1 with errno EMSGSIZE if
+  // the message doesn't fit a transport block.
+  DLL_PUBLIC int     rrc_si_set_message(RRC_SI *si, int type, const void *encoded, int size_in_bits, int periodicity_in_frames);
+  DLL_PUBLIC int     rrc_si_remove_message(RRC_SI *si, int type);
+  // Incremented on every change, so that lower layers can tell when their
+  // own caches of coded and modulated SI are stale
+  DLL_PUBLIC unsigned rrc_si_version(RRC_SI *si);
+  // What to broadcast in a subframe. Returns the number of transmissions.
+  DLL_PUBLIC int     rrc_si_subframe(RRC_SI *si, unsigned sfn, unsigned subframe, struct rrc_si_transmission *transmissions, int max_transmissions);
+
+  /******** Connections *********/
+  // Connection setup, reconfiguration and release of many UEs by the base
+  // station. UE contexts and their RLC entities are allocated once by
+  // rrc_conn_init() and reused: a connection only resets them, and sets
+  // RLC parameters again only if the bearer's template has changed.
+  //
+  // RRCConnectionRequest on CCCH is answered with RRCConnectionSetup for
+  // SRB1. RRCConnectionSetupComplete on SRB1 is answered with
+  // RRCConnectionReconfiguration adding SRB2 and DRB1 for those with
+  // parameters set. Messages on SRB1 have PDCP headers without integrity.
+
+  // Bearers by logical channel, per HamLTE packets
+#define RRC_CONN_SRB1 1
+#define RRC_CONN_SRB2 2
+#define RRC_CONN_DRB1 3
+#define RRC_CONN_MAX_BEARERS 3
+
+#define RRC_CONN_IDLE 0
+#define RRC_CONN_SETUP 1           // RRCConnectionSetup sent
+#define RRC_CONN_RECONFIGURATION 2 // RRCConnectionReconfiguration sent
+#define RRC_CONN_CONNECTED 3
+#define RRC_CONN_RELEASING 4       // RRCConnectionRelease sent
+
+  // Supervision of UEs that stop answering, and longest wait for a release
+  // to be acknowledged
+#define RRC_CONN_SETUP_TIMEOUT_MS 2000
+#define RRC_CONN_RELEASE_TIMEOUT_MS 200
+
+  struct rrc_conn;
+  typedef struct rrc_conn RRC_CONN;
+
+  struct rrc_conn_stats {
+    uint64_t requests, setups, rejects, reconfigurations, connected;
+    uint64_t releases, timeouts, radio_link_failures;
+    uint64_t malformed, unsupported;
+  };
+
+  // DL-CCCH message to send to rnti with RLC TM
+  typedef void (*rrc_conn_ccch_send_fn)(void *arg, unsigned time_in_ms, int rnti, const void *data, size_t size);
+  // A bearer's RLC entity to connect to MAC. It's owned by RRC and valid
+  // until bearer_removed. RRC sets the callbacks of SRB1, the others are
+  // for the caller to set.
+  typedef void (*rrc_conn_bearer_fn)(void *arg, unsigned time_in_ms, int ue, int rnti, int lcid, RLC *rlc);
+  // dedicatedInfoNAS of RRCConnectionSetupComplete
+  typedef void (*rrc_conn_nas_received_fn)(void *arg, unsigned time_in_ms, int ue, const void *nas, size_t size);
+
+  DLL_PUBLIC RRC_CONN *rrc_conn_init(int max_ues);
+  DLL_PUBLIC void    rrc_conn_free(RRC_CONN *conn);
+  DLL_PUBLIC void    rrc_conn_set_callbacks(RRC_CONN *conn, void *arg,
+					    rrc_conn_ccch_send_fn ccch_send,
+					    rrc_conn_bearer_fn bearer_added,
+					    rrc_conn_bearer_fn bearer_removed,
+					    rrc_conn_nas_received_fn nas_received);
+  // RLC parameters of a bearer as for rlc_set_parameters(). They are parsed
+  // here once into the RLC-Config signalled to the UEs, so AM timers and
+  // poll limits have to be values of RLC-Config; pollPDU and pollByte may
+  // also be "infinity". Missing parameters are the SRB defaults of 36.331
+  // and rlc/trace=0, as traces of every UE would take a lot of memory.
+  // Only SRB1 is configured by default. Returns -1 with errno EINVAL.
+  DLL_PUBLIC int     rrc_conn_set_bearer_parameters(RRC_CONN *conn, int lcid, const char *envz, size_t envz_len);
+  // UL-CCCH message from rnti. Returns the UE or -1 and sets errno:
+  // EBADMSG, ENOTSUP for reestablishment or ENOSPC if all contexts are in
+  // use, in which case RRCConnectionReject was sent.
+  DLL_PUBLIC int     rrc_conn_ccch_received(RRC_CONN *conn, unsigned time_in_ms, int rnti, const void *data, size_t size);
+  // Sends RRCConnectionRelease. The context is freed when it's acknowledged.
+  DLL_PUBLIC int     rrc_conn_release(RRC_CONN *conn, unsigned time_in_ms, int ue);
+  // Frees contexts of UEs that didn't answer in time
+  DLL_PUBLIC void    rrc_conn_tick(RRC_CONN *conn, unsigned time_in_ms);
+  // UE by C-RNTI, -1 if none
+  DLL_PUBLIC int     rrc_conn_find(RRC_CONN *conn, int rnti);
+  DLL_PUBLIC int     rrc_conn_get_state(RRC_CONN *conn, int ue);
+  DLL_PUBLIC void    rrc_conn_get_stats(RRC_CONN *conn, struct rrc_conn_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,12 @@
+/*
+   UPER codecs of the 3GPP LTE RRC messages of rrc_asn1.hh
+
+   All of the code is generated by the compiler from the types; this only
+   makes sure it's done once for each message.
+*/
+#include "rrc_asn1.hh"
+
+#define RRC_ASN1_TEMPLATE(Message)					\
+  template int uper::encode_message(const rrc::Message &, void *, int);	\
+  template int uper::decode_message(rrc::Message &, const void *, int);
+RRC_ASN1_MESSAGES(RRC_ASN1_TEMPLATE)
@@ -0,0 +1,659 @@
+// 3GPP LTE RRC messages of EUTRAN_RRC.asn1 for the UPER codec of uper.hh
+//
+// Types and components are named as in the ASN.1 with - turned into _.
+// The messages HamLTE uses are modelled in full; other alternatives of
+// their CHOICEs and other OPTIONAL components are uper::unsupported.
+// Comments list the values of ENUMERATED types.
+//
+//   rrc::BCCH_DL_SCH_Message sib1;
+//   auto &c1 = sib1.message.emplace<0>();
+//   c1.emplace<1>().freqBandIndicator = 40;
+//   int bits = uper::encode_message(sib1, buffer, sizeof(buffer));
+#pragma once
+
+#include "uper.hh"
+
+namespace rrc {
+
+using std::optional;
+using uper::integer;
+using uper::enumerated;
+using uper::null;
+using uper::unsupported;
+using uper::bit_string;
+using uper::octet_string;
+using uper::sequence_of;
+using uper::choice;
+using uper::unbounded;
+
+/******
+ ** Information elements
+ **/
+typedef integer<0, 3> RRC_TransactionIdentifier;
+typedef integer<0, 9> MCC_MNC_Digit;
+typedef sequence_of<MCC_MNC_Digit, 3, 3> MCC;
+typedef sequence_of<MCC_MNC_Digit, 2, 3> MNC;
+
+struct PLMN_Identity {
+  optional<MCC> mcc;
+  MNC mnc;
+  UPER_SEQUENCE(false, mcc, mnc)
+};
+
+struct PLMN_IdentityInfo {
+  PLMN_Identity plmn_Identity;
+  enumerated<2> cellReservedForOperatorUse; // reserved, notReserved
+  UPER_SEQUENCE(false, plmn_Identity, cellReservedForOperatorUse)
+};
+
+typedef sequence_of<PLMN_IdentityInfo, 1, 6> PLMN_IdentityList;
+typedef bit_string<16> TrackingAreaCode;
+typedef bit_string<28> CellIdentity;
+typedef bit_string<27> CSG_Identity;
+typedef integer<-70, -22> Q_RxLevMin;
+typedef integer<-30, 33> P_Max;
+typedef integer<1, 64> FreqBandIndicator;
+typedef integer<0, 65535> ARFCN_ValueEUTRA;
+typedef integer<1, 32> AdditionalSpectrumEmission;
+typedef integer<0, 503> PhysCellId;
+typedef bit_string<16> C_RNTI;
+typedef bit_string<16> ShortMAC_I;
+typedef bit_string<8> MMEC;
+// Capacity of NAS messages carried in RRC
+typedef octet_string<0, unbounded, 256> DedicatedInfoNAS;
+
+// sibType3 ... sibType18-v1250, extension values sibType19-v1250 ...
+typedef enumerated<16, true> SIB_Type;
+typedef sequence_of<SIB_Type, 0, 31> SIB_MappingInfo;
+
+struct SchedulingInfo {
+  enumerated<7> si_Periodicity; // rf8, rf16, rf32, rf64, rf128, rf256, rf512
+  SIB_MappingInfo sib_MappingInfo;
+  UPER_SEQUENCE(false, si_Periodicity, sib_MappingInfo)
+};
+
+// No more SystemInformation messages than rrc_si broadcasts
+typedef sequence_of<SchedulingInfo, 1, 32, 4> SchedulingInfoList;
+
+struct TDD_Config {
+  enumerated<7> subframeAssignment; // sa0 ... sa6
+  enumerated<9> specialSubframePatterns; // ssp0 ... ssp8
+  UPER_SEQUENCE(false, subframeAssignment, specialSubframePatterns)
+};
+
+struct AC_BarringConfig {
+  enumerated<16> ac_BarringFactor; // p00, p05, p10, p15, p20, p25, p30, p40, p50 ... p95
+  enumerated<8> ac_BarringTime; // s4, s8, s16, s32, s64, s128, s256, s512
+  bit_string<5> ac_BarringForSpecialAC;
+  UPER_SEQUENCE(false, ac_BarringFactor, ac_BarringTime, ac_BarringForSpecialAC)
+};
+
+struct PowerRampingParameters {
+  enumerated<4> powerRampingStep; // dB0, dB2, dB4, dB6
+  enumerated<16> preambleInitialReceivedTargetPower; // dBm-120, dBm-118 ... dBm-90
+  UPER_SEQUENCE(false, powerRampingStep, preambleInitialReceivedTargetPower)
+};
+
+// n3, n4, n5, n6, n7, n8, n10, n20, n50, n100, n200
+typedef enumerated<11> PreambleTransMax;
+
+struct RACH_ConfigCommon {
+  struct PreambleInfo {
+    enumerated<16> numberOfRA_Preambles; // n4, n8 ... n64
+    struct PreamblesGroupAConfig {
+      enumerated<15> sizeOfRA_PreamblesGroupA; // n4, n8 ... n60
+      enumerated<4> messageSizeGroupA; // b56, b144, b208, b256
+      enumerated<8> messagePowerOffsetGroupB; // minusinfinity, dB0, dB5, dB8, dB10, dB12, dB15, dB18
+      UPER_SEQUENCE(true, sizeOfRA_PreamblesGroupA, messageSizeGroupA, messagePowerOffsetGroupB)
+    };
+    optional<PreamblesGroupAConfig> preamblesGroupAConfig;
+    UPER_SEQUENCE(false, numberOfRA_Preambles, preamblesGroupAConfig)
+  } preambleInfo;
+  PowerRampingParameters powerRampingParameters;
+  struct RA_SupervisionInfo {
+    PreambleTransMax preambleTransMax;
+    enumerated<8> ra_ResponseWindowSize; // sf2, sf3, sf4, sf5, sf6, sf7, sf8, sf10
+    enumerated<8> mac_ContentionResolutionTimer; // sf8, sf16 ... sf64
+    UPER_SEQUENCE(false, preambleTransMax, ra_ResponseWindowSize, mac_ContentionResolutionTimer)
+  } ra_SupervisionInfo;
+  integer<1, 8> maxHARQ_Msg3Tx;
+  UPER_SEQUENCE(true, preambleInfo, powerRampingParameters, ra_SupervisionInfo, maxHARQ_Msg3Tx)
+};
+
+struct BCCH_Config {
+  enumerated<4> modificationPeriodCoeff; // n2, n4, n8, n16
+  UPER_SEQUENCE(false, modificationPeriodCoeff)
+};
+
+struct PCCH_Config {
+  enumerated<4> defaultPagingCycle; // rf32, rf64, rf128, rf256
+  enumerated<8> nB; // fourT, twoT, oneT, halfT, quarterT, oneEighthT, oneSixteenthT, oneThirtySecondT
+  UPER_SEQUENCE(false, defaultPagingCycle, nB)
+};
+
+struct PRACH_ConfigInfo {
+  integer<0, 63> prach_ConfigIndex;
+  bool highSpeedFlag = false;
+  integer<0, 15> zeroCorrelationZoneConfig;
+  integer<0, 94> prach_FreqOffset;
+  UPER_SEQUENCE(false, prach_ConfigIndex, highSpeedFlag, zeroCorrelationZoneConfig, prach_FreqOffset)
+};
+
+struct PRACH_ConfigSIB {
+  integer<0, 837> rootSequenceIndex;
+  PRACH_ConfigInfo prach_ConfigInfo;
+  UPER_SEQUENCE(false, rootSequenceIndex, prach_ConfigInfo)
+};
+
+struct PDSCH_ConfigCommon {
+  integer<-60, 50> referenceSignalPower;
+  integer<0, 3> p_b;
+  UPER_SEQUENCE(false, referenceSignalPower, p_b)
+};
+
+struct UL_ReferenceSignalsPUSCH {
+  bool groupHoppingEnabled = false;
+  integer<0, 29> groupAssignmentPUSCH;
+  bool sequenceHoppingEnabled = false;
+  integer<0, 7> cyclicShift;
+  UPER_SEQUENCE(false, groupHoppingEnabled, groupAssignmentPUSCH, sequenceHoppingEnabled, cyclicShift)
+};
+
+struct PUSCH_ConfigCommon {
+  struct PUSCH_ConfigBasic {
+    integer<1, 4> n_SB;
+    enumerated<2> hoppingMode; // interSubFrame, intraAndInterSubFrame
+    integer<0, 98> pusch_HoppingOffset;
+    bool enable64QAM = false;
+    UPER_SEQUENCE(false, n_SB, hoppingMode, pusch_HoppingOffset, enable64QAM)
+  } pusch_ConfigBasic;
+  UL_ReferenceSignalsPUSCH ul_ReferenceSignalsPUSCH;
+  UPER_SEQUENCE(false, pusch_ConfigBasic, ul_ReferenceSignalsPUSCH)
+};
+
+struct PUCCH_ConfigCommon {
+  enumerated<3> deltaPUCCH_Shift; // ds1, ds2, ds3
+  integer<0, 98> nRB_CQI;
+  integer<0, 7> nCS_AN;
+  integer<0, 2047> n1PUCCH_AN;
+  UPER_SEQUENCE(false, deltaPUCCH_Shift, nRB_CQI, nCS_AN, n1PUCCH_AN)
+};
+
+struct SoundingRS_UL_ConfigCommon_setup {
+  enumerated<8> srs_BandwidthConfig; // bw0 ... bw7
+  enumerated<16> srs_SubframeConfig; // sc0 ... sc15
+  bool ackNackSRS_SimultaneousTransmission = false;
+  optional<enumerated<1>> srs_MaxUpPts; // true
+  UPER_SEQUENCE(false, srs_BandwidthConfig, srs_SubframeConfig, ackNackSRS_SimultaneousTransmission, srs_MaxUpPts)
+};
+
+// release, setup
+typedef choice<false, null, SoundingRS_UL_ConfigCommon_setup> SoundingRS_UL_ConfigCommon;
+
+struct DeltaFList_PUCCH {
+  enumerated<3> deltaF_PUCCH_Format1; // deltaF-2, deltaF0, deltaF2
+  enumerated<3> deltaF_PUCCH_Format1b; // deltaF1, deltaF3, deltaF5
+  enumerated<4> deltaF_PUCCH_Format2; // deltaF-2, deltaF0, deltaF1, deltaF2
+  enumerated<3> deltaF_PUCCH_Format2a; // deltaF-2, deltaF0, deltaF2
+  enumerated<3> deltaF_PUCCH_Format2b; // deltaF-2, deltaF0, deltaF2
+  UPER_SEQUENCE(false, deltaF_PUCCH_Format1, deltaF_PUCCH_Format1b, deltaF_PUCCH_Format2,
+		deltaF_PUCCH_Format2a, deltaF_PUCCH_Format2b)
+};
+
+struct UplinkPowerControlCommon {
+  integer<-126, 24> p0_NominalPUSCH;
+  enumerated<8> alpha; // al0, al04, al05, al06, al07, al08, al09, al1
+  integer<-127, -96> p0_NominalPUCCH;
+  DeltaFList_PUCCH deltaFList_PUCCH;
+  integer<-1, 6> deltaPreambleMsg3;
+  UPER_SEQUENCE(false, p0_NominalPUSCH, alpha, p0_NominalPUCCH, deltaFList_PUCCH, deltaPreambleMsg3)
+};
+
+struct RadioResourceConfigCommonSIB {
+  RACH_ConfigCommon rach_ConfigCommon;
+  BCCH_Config bcch_Config;
+  PCCH_Config pcch_Config;
+  PRACH_ConfigSIB prach_Config;
+  PDSCH_ConfigCommon pdsch_ConfigCommon;
+  PUSCH_ConfigCommon pusch_ConfigCommon;
+  PUCCH_ConfigCommon pucch_ConfigCommon;
+  SoundingRS_UL_ConfigCommon soundingRS_UL_ConfigCommon;
+  UplinkPowerControlCommon uplinkPowerControlCommon;
+  enumerated<2> ul_CyclicPrefixLength; // len1, len2
+  UPER_SEQUENCE(true, rach_ConfigCommon, bcch_Config, pcch_Config, prach_Config, pdsch_ConfigCommon,
+		pusch_ConfigCommon, pucch_ConfigCommon, soundingRS_UL_ConfigCommon,
+		uplinkPowerControlCommon, ul_CyclicPrefixLength)
+};
+
+struct UE_TimersAndConstants {
+  enumerated<8> t300; // ms100, ms200, ms300, ms400, ms600, ms1000, ms1500, ms2000
+  enumerated<8> t301; // as t300
+  enumerated<7> t310; // ms0, ms50, ms100, ms200, ms500, ms1000, ms2000
+  enumerated<8> n310; // n1, n2, n3, n4, n6, n8, n10, n20
+  enumerated<7> t311; // ms1000, ms3000, ms5000, ms10000, ms15000, ms20000, ms30000
+  enumerated<8> n311; // n1, n2, n3, n4, n5, n6, n8, n10
+  UPER_SEQUENCE(true, t300, t301, t310, n310, t311, n311)
+};
+
+struct MBSFN_SubframeConfig {
+  enumerated<6> radioframeAllocationPeriod; // n1, n2, n4, n8, n16, n32
+  integer<0, 7> radioframeAllocationOffset;
+  choice<false, bit_string<6>, bit_string<24>> subframeAllocation; // oneFrame, fourFrames
+  UPER_SEQUENCE(false, radioframeAllocationPeriod, radioframeAllocationOffset, subframeAllocation)
+};
+
+typedef sequence_of<MBSFN_SubframeConfig, 1, 8> MBSFN_SubframeConfigList;
+
+/******
+ ** Radio bearers
+ **/
+typedef enumerated<64> T_PollRetransmit; // ms5, ms10 ... ms250, ms300, ms350, ms400, ms450, ms500 ...
+typedef enumerated<8> PollPDU; // p4, p8, p16, p32, p64, p128, p256, pInfinity
+typedef enumerated<16> PollByte; // kB25, kB50, kB75, kB100, kB125, kB250, kB375, kB500, kB750 ... kBinfinity
+typedef enumerated<32> T_Reordering; // ms0, ms5 ... ms100, ms110 ... ms200
+typedef enumerated<64> T_StatusProhibit; // ms0, ms5 ... ms250, ms300, ms350, ms400, ms450, ms500 ...
+typedef enumerated<2> SN_FieldLength; // size5, size10
+
+struct UL_AM_RLC {
+  T_PollRetransmit t_PollRetransmit;
+  PollPDU pollPDU;
+  PollByte pollByte;
+  enumerated<8> maxRetxThreshold; // t1, t2, t3, t4, t6, t8, t16, t32
+  UPER_SEQUENCE(false, t_PollRetransmit, pollPDU, pollByte, maxRetxThreshold)
+};
+
+struct DL_AM_RLC {
+  T_Reordering t_Reordering;
+  T_StatusProhibit t_StatusProhibit;
+  UPER_SEQUENCE(false, t_Reordering, t_StatusProhibit)
+};
+
+struct UL_UM_RLC {
+  SN_FieldLength sn_FieldLength;
+  UPER_SEQUENCE(false, sn_FieldLength)
+};
+
+struct DL_UM_RLC {
+  SN_FieldLength sn_FieldLength;
+  T_Reordering t_Reordering;
+  UPER_SEQUENCE(false, sn_FieldLength, t_Reordering)
+};
+
+struct RLC_Config_am {
+  UL_AM_RLC ul_AM_RLC;
+  DL_AM_RLC dl_AM_RLC;
+  UPER_SEQUENCE(false, ul_AM_RLC, dl_AM_RLC)
+};
+
+struct RLC_Config_um_Bi_Directional {
+  UL_UM_RLC ul_UM_RLC;
+  DL_UM_RLC dl_UM_RLC;
+  UPER_SEQUENCE(false, ul_UM_RLC, dl_UM_RLC)
+};
+
+struct RLC_Config_um_Uni_Directional_UL {
+  UL_UM_RLC ul_UM_RLC;
+  UPER_SEQUENCE(false, ul_UM_RLC)
+};
+
+struct RLC_Config_um_Uni_Directional_DL {
+  DL_UM_RLC dl_UM_RLC;
+  UPER_SEQUENCE(false, dl_UM_RLC)
+};
+
+typedef choice<true, RLC_Config_am, RLC_Config_um_Bi_Directional,
+	       RLC_Config_um_Uni_Directional_UL, RLC_Config_um_Uni_Directional_DL> RLC_Config;
+
+struct LogicalChannelConfig {
+  struct UL_SpecificParameters {
+    integer<1, 16> priority;
+    // kBps0, kBps8, kBps16, kBps32, kBps64, kBps128, kBps256, infinity, kBps512-v1020 ...
+    enumerated<16> prioritisedBitRate;
+    enumerated<8> bucketSizeDuration; // ms50, ms100, ms150, ms300, ms500, ms1000
+    optional<integer<0, 3>> logicalChannelGroup;
+    UPER_SEQUENCE(false, priority, prioritisedBitRate, bucketSizeDuration, logicalChannelGroup)
+  };
+  optional<UL_SpecificParameters> ul_SpecificParameters;
+  UPER_SEQUENCE(true, ul_SpecificParameters)
+};
+
+struct SRB_ToAddMod {
+  integer<1, 2> srb_Identity;
+  optional<choice<false, RLC_Config, null>> rlc_Config; // explicitValue, defaultValue
+  optional<choice<false, LogicalChannelConfig, null>> logicalChannelConfig; // explicitValue, defaultValue
+  UPER_SEQUENCE(true, srb_Identity, rlc_Config, logicalChannelConfig)
+};
+
+typedef sequence_of<SRB_ToAddMod, 1, 2> SRB_ToAddModList;
+typedef integer<1, 32> DRB_Identity;
+
+struct PDCP_Config {
+  optional<enumerated<8>> discardTimer; // ms50, ms100, ms150, ms300, ms500, ms750, ms1500, infinity
+  struct RLC_AM {
+    bool statusReportRequired = false;
+    UPER_SEQUENCE(false, statusReportRequired)
+  };
+  optional<RLC_AM> rlc_AM;
+  struct RLC_UM {
+    enumerated<2> pdcp_SN_Size; // len7bits, len12bits
+    UPER_SEQUENCE(false, pdcp_SN_Size)
+  };
+  optional<RLC_UM> rlc_UM;
+  choice<false, null, unsupported> headerCompression; // notUsed, rohc
+  UPER_SEQUENCE(true, discardTimer, rlc_AM, rlc_UM, headerCompression)
+};
+
+struct DRB_ToAddMod {
+  optional<integer<0, 15>> eps_BearerIdentity;
+  DRB_Identity drb_Identity;
+  optional<PDCP_Config> pdcp_Config;
+  optional<RLC_Config> rlc_Config;
+  optional<integer<3, 10>> logicalChannelIdentity;
+  optional<LogicalChannelConfig> logicalChannelConfig;
+  UPER_SEQUENCE(true, eps_BearerIdentity, drb_Identity, pdcp_Config, rlc_Config,
+		logicalChannelIdentity, logicalChannelConfig)
+};
+
+typedef sequence_of<DRB_ToAddMod, 1, 11> DRB_ToAddModList;
+typedef sequence_of<DRB_Identity, 1, 11> DRB_ToReleaseList;
+
+struct RadioResourceConfigDedicated {
+  optional<SRB_ToAddModList> srb_ToAddModList;
+  optional<DRB_ToAddModList> drb_ToAddModList;
+  optional<DRB_ToReleaseList> drb_ToReleaseList;
+  optional<choice<false, unsupported, null>> mac_MainConfig; // explicitValue, defaultValue
+  optional<unsupported> sps_Config;
+  optional<unsupported> physicalConfigDedicated;
+  UPER_SEQUENCE(true, srb_ToAddModList, drb_ToAddModList, drb_ToReleaseList, mac_MainConfig,
+		sps_Config, physicalConfigDedicated)
+};
+
+/******
+ ** BCCH-BCH
+ **/
+struct PHICH_Config {
+  enumerated<2> phich_Duration; // normal, extended
+  enumerated<4> phich_Resource; // oneSixth, half, one, two
+  UPER_SEQUENCE(false, phich_Duration, phich_Resource)
+};
+
+struct MasterInformationBlock {
+  enumerated<6> dl_Bandwidth; // n6, n15, n25, n50, n75, n100
+  PHICH_Config phich_Config;
+  bit_string<8> systemFrameNumber;
+  integer<0, 31> schedulingInfoSIB1_BR_r13;
+  bit_string<5> spare;
+  UPER_SEQUENCE(false, dl_Bandwidth, phich_Config, systemFrameNumber, schedulingInfoSIB1_BR_r13, spare)
+};
+
+struct BCCH_BCH_Message {
+  MasterInformationBlock message;
+  UPER_SEQUENCE(false, message)
+};
+
+/******
+ ** BCCH-DL-SCH
+ **/
+struct SystemInformationBlockType1 {
+  struct CellAccessRelatedInfo {
+    PLMN_IdentityList plmn_IdentityList;
+    TrackingAreaCode trackingAreaCode;
+    CellIdentity cellIdentity;
+    enumerated<2> cellBarred; // barred, notBarred
+    enumerated<2> intraFreqReselection; // allowed, notAllowed
+    bool csg_Indication = false;
+    optional<CSG_Identity> csg_Identity;
+    UPER_SEQUENCE(false, plmn_IdentityList, trackingAreaCode, cellIdentity, cellBarred,
+		  intraFreqReselection, csg_Indication, csg_Identity)
+  } cellAccessRelatedInfo;
+  struct CellSelectionInfo {
+    Q_RxLevMin q_RxLevMin;
+    optional<integer<1, 8>> q_RxLevMinOffset;
+    UPER_SEQUENCE(false, q_RxLevMin, q_RxLevMinOffset)
+  } cellSelectionInfo;
+  optional<P_Max> p_Max;
+  FreqBandIndicator freqBandIndicator;
+  SchedulingInfoList schedulingInfoList;
+  optional<TDD_Config> tdd_Config;
+  enumerated<7> si_WindowLength; // ms1, ms2, ms5, ms10, ms15, ms20, ms40
+  integer<0, 31> systemInfoValueTag;
+  optional<unsupported> nonCriticalExtension;
+  UPER_SEQUENCE(false, cellAccessRelatedInfo, cellSelectionInfo, p_Max, freqBandIndicator,
+		schedulingInfoList, tdd_Config, si_WindowLength, systemInfoValueTag, nonCriticalExtension)
+};
+
+struct SystemInformationBlockType2 {
+  struct AC_BarringInfo {
+    bool ac_BarringForEmergency = false;
+    optional<AC_BarringConfig> ac_BarringForMO_Signalling;
+    optional<AC_BarringConfig> ac_BarringForMO_Data;
+    UPER_SEQUENCE(false, ac_BarringForEmergency, ac_BarringForMO_Signalling, ac_BarringForMO_Data)
+  };
+  optional<AC_BarringInfo> ac_BarringInfo;
+  RadioResourceConfigCommonSIB radioResourceConfigCommon;
+  UE_TimersAndConstants ue_TimersAndConstants;
+  struct FreqInfo {
+    optional<ARFCN_ValueEUTRA> ul_CarrierFreq;
+    optional<enumerated<6>> ul_Bandwidth; // n6, n15, n25, n50, n75, n100
+    AdditionalSpectrumEmission additionalSpectrumEmission;
+    UPER_SEQUENCE(false, ul_CarrierFreq, ul_Bandwidth, additionalSpectrumEmission)
+  } freqInfo;
+  optional<MBSFN_SubframeConfigList> mbsfn_SubframeConfigList;
+  enumerated<8> timeAlignmentTimerCommon; // sf500, sf750, sf1280, sf1920, sf2560, sf5120, sf10240, infinity
+  UPER_SEQUENCE(true, ac_BarringInfo, radioResourceConfigCommon, ue_TimersAndConstants, freqInfo,
+		mbsfn_SubframeConfigList, timeAlignmentTimerCommon)
+};
+
+struct SystemInformationBlockType9 {
+  optional<octet_string<1, 48>> hnb_Name;
+  UPER_SEQUENCE(true, hnb_Name)
+};
+
+// sib2, sib3 ... sib11
+typedef choice<true, SystemInformationBlockType2, unsupported, unsupported, unsupported,
+	       unsupported, unsupported, unsupported, SystemInformationBlockType9,
+	       unsupported, unsupported> SIB_TypeAndInfo;
+
+struct SystemInformation_r8_IEs {
+  sequence_of<SIB_TypeAndInfo, 1, 32, 4> sib_TypeAndInfo;
+  optional<unsupported> nonCriticalExtension;
+  UPER_SEQUENCE(false, sib_TypeAndInfo, nonCriticalExtension)
+};
+
+struct SystemInformation {
+  choice<false, SystemInformation_r8_IEs, null> criticalExtensions;
+  UPER_SEQUENCE(false, criticalExtensions)
+};
+
+struct BCCH_DL_SCH_Message {
+  // c1: systemInformation, systemInformationBlockType1; messageClassExtension
+  choice<false, choice<false, SystemInformation, SystemInformationBlockType1>, null> message;
+  UPER_SEQUENCE(false, message)
+};
+
+/******
+ ** CCCH
+ **/
+struct S_TMSI {
+  MMEC mmec;
+  bit_string<32> m_TMSI;
+  UPER_SEQUENCE(false, mmec, m_TMSI)
+};
+
+struct RRCConnectionRequest_r8_IEs {
+  choice<false, S_TMSI, bit_string<40>> ue_Identity; // s-TMSI, randomValue
+  // emergency, highPriorityAccess, mt-Access, mo-Signalling, mo-Data, delayTolerantAccess-v1020 ...
+  enumerated<8> establishmentCause;
+  bit_string<1> spare;
+  UPER_SEQUENCE(false, ue_Identity, establishmentCause, spare)
+};
+
+struct RRCConnectionRequest {
+  choice<false, RRCConnectionRequest_r8_IEs, null> criticalExtensions;
+  UPER_SEQUENCE(false, criticalExtensions)
+};
+
+struct ReestabUE_Identity {
+  C_RNTI c_RNTI;
+  PhysCellId physCellId;
+  ShortMAC_I shortMAC_I;
+  UPER_SEQUENCE(false, c_RNTI, physCellId, shortMAC_I)
+};
+
+struct RRCConnectionReestablishmentRequest_r8_IEs {
+  ReestabUE_Identity ue_Identity;
+  enumerated<4> reestablishmentCause; // reconfigurationFailure, handoverFailure, otherFailure
+  bit_string<2> spare;
+  UPER_SEQUENCE(false, ue_Identity, reestablishmentCause, spare)
+};
+
+struct RRCConnectionReestablishmentRequest {
+  choice<false, RRCConnectionReestablishmentRequest_r8_IEs, null> criticalExtensions;
+  UPER_SEQUENCE(false, criticalExtensions)
+};
+
+struct UL_CCCH_Message {
+  // c1: rrcConnectionReestablishmentRequest, rrcConnectionRequest; messageClassExtension
+  choice<false, choice<false, RRCConnectionReestablishmentRequest, RRCConnectionRequest>, unsupported> message;
+  UPER_SEQUENCE(false, message)
+};
+
+struct RRCConnectionSetup_r8_IEs {
+  RadioResourceConfigDedicated radioResourceConfigDedicated;
+  optional<unsupported> nonCriticalExtension;
+  UPER_SEQUENCE(false, radioResourceConfigDedicated, nonCriticalExtension)
+};
+
+struct RRCConnectionSetup {
+  RRC_TransactionIdentifier rrc_TransactionIdentifier;
+  // c1: rrcConnectionSetup-r8, spare7 ... spare1; criticalExtensionsFuture
+  choice<false, choice<false, RRCConnectionSetup_r8_IEs, null, null, null, null, null, null, null>,
+	 null> criticalExtensions;
+  UPER_SEQUENCE(false, rrc_TransactionIdentifier, criticalExtensions)
+};
+
+struct RRCConnectionReject_r8_IEs {
+  integer<1, 16> waitTime;
+  optional<unsupported> nonCriticalExtension;
+  UPER_SEQUENCE(false, waitTime, nonCriticalExtension)
+};
+
+struct RRCConnectionReject {
+  choice<false, choice<false, RRCConnectionReject_r8_IEs, null, null, null>, null> criticalExtensions;
+  UPER_SEQUENCE(false, criticalExtensions)
+};
+
+struct DL_CCCH_Message {
+  // c1: rrcConnectionReestablishment, rrcConnectionReestablishmentReject,
+  // rrcConnectionReject, rrcConnectionSetup; messageClassExtension
+  choice<false, choice<false, unsupported, unsupported, RRCConnectionReject, RRCConnectionSetup>, null> message;
+  UPER_SEQUENCE(false, message)
+};
+
+/******
+ ** DCCH
+ **/
+struct RegisteredMME {
+  optional<PLMN_Identity> plmn_Identity;
+  bit_string<16> mmegi;
+  MMEC mmec;
+  UPER_SEQUENCE(false, plmn_Identity, mmegi, mmec)
+};
+
+struct RRCConnectionSetupComplete_r8_IEs {
+  integer<1, 6> selectedPLMN_Identity;
+  optional<RegisteredMME> registeredMME;
+  DedicatedInfoNAS dedicatedInfoNAS;
+  optional<unsupported> nonCriticalExtension;
+  UPER_SEQUENCE(false, selectedPLMN_Identity, registeredMME, dedicatedInfoNAS, nonCriticalExtension)
+};
+
+struct RRCConnectionSetupComplete {
+  RRC_TransactionIdentifier rrc_TransactionIdentifier;
+  choice<false, choice<false, RRCConnectionSetupComplete_r8_IEs, null, null, null>, null> criticalExtensions;
+  UPER_SEQUENCE(false, rrc_TransactionIdentifier, criticalExtensions)
+};
+
+struct RRCConnectionReconfigurationComplete_r8_IEs {
+  optional<unsupported> nonCriticalExtension;
+  UPER_SEQUENCE(false, nonCriticalExtension)
+};
+
+struct RRCConnectionReconfigurationComplete {
+  RRC_TransactionIdentifier rrc_TransactionIdentifier;
+  choice<false, RRCConnectionReconfigurationComplete_r8_IEs, null> criticalExtensions;
+  UPER_SEQUENCE(false, rrc_TransactionIdentifier, criticalExtensions)
+};
+
+struct UL_DCCH_Message {
+  // c1: csfbParametersRequestCDMA2000, measurementReport,
+  // rrcConnectionReconfigurationComplete, rrcConnectionReestablishmentComplete,
+  // rrcConnectionSetupComplete, securityModeComplete ... ; messageClassExtension
+  choice<false, choice<false, unsupported, unsupported, RRCConnectionReconfigurationComplete,
+		       unsupported, RRCConnectionSetupComplete, unsupported, unsupported, unsupported,
+		       unsupported, unsupported, unsupported, unsupported, unsupported, unsupported,
+		       unsupported, unsupported>,
+	 unsupported> message;
+  UPER_SEQUENCE(false, message)
+};
+
+struct RRCConnectionReconfiguration_r8_IEs {
+  optional<unsupported> measConfig;
+  optional<unsupported> mobilityControlInfo;
+  optional<sequence_of<DedicatedInfoNAS, 1, 11, 2>> dedicatedInfoNASList;
+  optional<RadioResourceConfigDedicated> radioResourceConfigDedicated;
+  optional<unsupported> securityConfigHO;
+  optional<unsupported> nonCriticalExtension;
+  UPER_SEQUENCE(false, measConfig, mobilityControlInfo, dedicatedInfoNASList,
+		radioResourceConfigDedicated, securityConfigHO, nonCriticalExtension)
+};
+
+struct RRCConnectionReconfiguration {
+  RRC_TransactionIdentifier rrc_TransactionIdentifier;
+  choice<false, choice<false, RRCConnectionReconfiguration_r8_IEs, null, null, null, null, null, null, null>,
+	 null> criticalExtensions;
+  UPER_SEQUENCE(false, rrc_TransactionIdentifier, criticalExtensions)
+};
+
+struct RRCConnectionRelease_r8_IEs {
+  // loadBalancingTAUrequired, other, cs-FallbackHighPriority-v1020, rrc-Suspend-v1320
+  enumerated<4> releaseCause;
+  optional<unsupported> redirectedCarrierInfo;
+  optional<unsupported> idleModeMobilityControlInfo;
+  optional<unsupported> nonCriticalExtension;
+  UPER_SEQUENCE(false, releaseCause, redirectedCarrierInfo, idleModeMobilityControlInfo, nonCriticalExtension)
+};
+
+struct RRCConnectionRelease {
+  RRC_TransactionIdentifier rrc_TransactionIdentifier;
+  choice<false, choice<false, RRCConnectionRelease_r8_IEs, null, null, null>, null> criticalExtensions;
+  UPER_SEQUENCE(false, rrc_TransactionIdentifier, criticalExtensions)
+};
+
+struct DL_DCCH_Message {
+  // c1: csfbParametersResponseCDMA2000, dlInformationTransfer,
+  // handoverFromEUTRAPreparationRequest, mobilityFromEUTRACommand,
+  // rrcConnectionReconfiguration, rrcConnectionRelease, securityModeCommand ...
+  // spare3, spare2, spare1; messageClassExtension
+  choice<false, choice<false, unsupported, unsupported, unsupported, unsupported,
+		       RRCConnectionReconfiguration, RRCConnectionRelease, unsupported, unsupported,
+		       unsupported, unsupported, unsupported, unsupported, unsupported, null, null, null>,
+	 null> message;
+  UPER_SEQUENCE(false, message)
+};
+
+}
+
+// The codecs are instantiated once, in rrc_asn1.cc
+#define RRC_ASN1_MESSAGES(X)			\
+  X(BCCH_BCH_Message)				\
+  X(BCCH_DL_SCH_Message)			\
+  X(UL_CCCH_Message)				\
+  X(DL_CCCH_Message)				\
+  X(UL_DCCH_Message)				\
+  X(DL_DCCH_Message)
+
+#define RRC_ASN1_EXTERN_TEMPLATE(Message)					\
+  extern template int uper::encode_message(const rrc::Message &, void *, int);	\
+  extern template int uper::decode_message(rrc::Message &, const void *, int);
+RRC_ASN1_MESSAGES(RRC_ASN1_EXTERN_TEMPLATE)
@@ -0,0 +1,576 @@
+/*
+   Microbenchmarks for the RRC layer
+
+   Usage: rrc_bench [-t seconds] [-o results.json] [name filter]
+*/
+#include "rrc.h"
+#include "rrc_asn1.hh"
+#include "bench.hh"
+
+#include <vector>
+#include <boost/format.hpp>
+
+using boost::str;
+using boost::format;
+using std::vector;
+
+/******
+ ** Messages of mib.xml, sib1.dlsch.xml and sib2.dlsch.xml
+ **/
+static rrc::BCCH_BCH_Message
+xml_mib() {
+  rrc::BCCH_BCH_Message m;
+  m.message.dl_Bandwidth = 2; // n25
+  m.message.phich_Config.phich_Duration = 0; // normal
+  m.message.phich_Config.phich_Resource = 2; // one
+  return m;
+}
+
+static rrc::BCCH_DL_SCH_Message
+xml_sib1() {
+  rrc::BCCH_DL_SCH_Message m;
+  rrc::SystemInformationBlockType1 &sib1 = m.message.emplace<0>().emplace<1>();
+  rrc::PLMN_IdentityInfo plmn;
+  plmn.plmn_Identity.mcc.emplace();
+  plmn.plmn_Identity.mcc->size = 3;
+  plmn.plmn_Identity.mcc->items[0] = 9;
+  plmn.plmn_Identity.mcc->items[1] = 0;
+  plmn.plmn_Identity.mcc->items[2] = 1;
+  plmn.plmn_Identity.mnc.size = 2;
+  plmn.plmn_Identity.mnc[0] = 7;
+  plmn.plmn_Identity.mnc[1] = 0;
+  plmn.cellReservedForOperatorUse = 1; // notReserved
+  auto &access = sib1.cellAccessRelatedInfo;
+  access.plmn_IdentityList.size = 0;
+  access.plmn_IdentityList.push_back(plmn);
+  access.trackingAreaCode = 1;
+  access.cellIdentity = 1;
+  access.cellBarred = 1; // notBarred
+  access.intraFreqReselection = 0; // allowed
+  sib1.cellSelectionInfo.q_RxLevMin = -70;
+  sib1.p_Max = 3;
+  sib1.freqBandIndicator = 40;
+  rrc::SchedulingInfo scheduling;
+  scheduling.si_Periodicity = 0; // rf8
+  scheduling.sib_MappingInfo.push_back(6); // sibType9
+  sib1.schedulingInfoList.size = 0;
+  sib1.schedulingInfoList.push_back(scheduling);
+  sib1.tdd_Config.emplace();
+  sib1.tdd_Config->subframeAssignment = 3; // sa3
+  sib1.tdd_Config->specialSubframePatterns = 0; // ssp0
+  sib1.si_WindowLength = 0; // ms1
+  return m;
+}
+
+static rrc::BCCH_DL_SCH_Message
+xml_sib2() {
+  rrc::BCCH_DL_SCH_Message m;
+  auto &si = m.message.emplace<0>().emplace<0>().criticalExtensions.emplace<0>();
+  si.sib_TypeAndInfo.size = 2;
+  rrc::SystemInformationBlockType2 &sib2 = si.sib_TypeAndInfo[0].emplace<0>();
+  sib2.ac_BarringInfo.emplace().ac_BarringForEmergency = true;
+  auto &common = sib2.radioResourceConfigCommon;
+  auto &rach = common.rach_ConfigCommon;
+  rach.preambleInfo.numberOfRA_Preambles = 0; // n4
+  rach.powerRampingParameters.powerRampingStep = 0; // dB0
+  rach.powerRampingParameters.preambleInitialReceivedTargetPower = 0; // dBm-120
+  rach.ra_SupervisionInfo.preambleTransMax = 10; // n200
+  rach.ra_SupervisionInfo.ra_ResponseWindowSize = 7; // sf10
+  rach.ra_SupervisionInfo.mac_ContentionResolutionTimer = 0; // sf8
+  rach.maxHARQ_Msg3Tx = 1;
+  common.bcch_Config.modificationPeriodCoeff = 3; // n16
+  common.pcch_Config.defaultPagingCycle = 0; // rf32
+  common.pcch_Config.nB = 0; // fourT
+  common.pdsch_ConfigCommon.referenceSignalPower = -60;
+  common.pusch_ConfigCommon.pusch_ConfigBasic.n_SB = 1;
+  common.pucch_ConfigCommon.deltaPUCCH_Shift = 0; // ds1
+  common.soundingRS_UL_ConfigCommon.emplace<0>(); // release
+  auto &power = common.uplinkPowerControlCommon;
+  power.p0_NominalPUSCH = -126;
+  power.alpha = 0; // al0
+  power.p0_NominalPUCCH = -127;
+  power.deltaFList_PUCCH.deltaF_PUCCH_Format1 = 1; // deltaF0
+  power.deltaFList_PUCCH.deltaF_PUCCH_Format1b = 0; // deltaF1
+  power.deltaFList_PUCCH.deltaF_PUCCH_Format2 = 1; // deltaF0
+  power.deltaFList_PUCCH.deltaF_PUCCH_Format2a = 1; // deltaF0
+  power.deltaFList_PUCCH.deltaF_PUCCH_Format2b = 1; // deltaF0
+  power.deltaPreambleMsg3 = 0;
+  common.ul_CyclicPrefixLength = 0; // len1
+  auto &timers = sib2.ue_TimersAndConstants;
+  timers.t300 = timers.t301 = 0; // ms100
+  timers.t310 = 0; // ms0
+  timers.n310 = 0; // n1
+  timers.t311 = 0; // ms1000
+  timers.n311 = 0; // n1
+  sib2.freqInfo.additionalSpectrumEmission = 1;
+  sib2.timeAlignmentTimerCommon = 0; // sf500
+  rrc::SystemInformationBlockType9 &sib9 = si.sib_TypeAndInfo[1].emplace<7>();
+  sib9.hnb_Name.emplace().assign("OH2EWF", 6);
+  return m;
+}
+
+/******
+ ** Signalling of one connection
+ **/
+static rrc::UL_CCCH_Message
+connection_request() {
+  rrc::UL_CCCH_Message m;
+  auto &request = m.message.emplace<0>().emplace<1>().criticalExtensions.emplace<0>();
+  request.ue_Identity.emplace<1>(0x123456789aull); // randomValue
+  request.establishmentCause = 3; // mo-Signalling
+  return m;
+}
+
+static rrc::RLC_Config
+am_rlc_config() {
+  rrc::RLC_Config_am am;
+  am.ul_AM_RLC.t_PollRetransmit = 8; // ms45
+  am.ul_AM_RLC.pollPDU = 7; // pInfinity
+  am.ul_AM_RLC.pollByte = 14; // kBinfinity
+  am.ul_AM_RLC.maxRetxThreshold = 4; // t6
+  am.dl_AM_RLC.t_Reordering = 7; // ms35
+  am.dl_AM_RLC.t_StatusProhibit = 0; // ms0
+  return am;
+}
+
+static rrc::DL_CCCH_Message
+connection_setup() {
+  rrc::DL_CCCH_Message m;
+  auto &setup = m.message.emplace<0>().emplace<3>();
+  setup.rrc_TransactionIdentifier = 1;
+  auto &config = setup.criticalExtensions.emplace<0>().emplace<0>().radioResourceConfigDedicated;
+  rrc::SRB_ToAddMod srb1;
+  srb1.srb_Identity = 1;
+  srb1.rlc_Config.emplace(am_rlc_config());
+  srb1.logicalChannelConfig.emplace().emplace<1>(); // defaultValue
+  config.srb_ToAddModList.emplace().size = 0;
+  config.srb_ToAddModList->push_back(srb1);
+  config.mac_MainConfig.emplace().emplace<1>(); // defaultValue
+  return m;
+}
+
+static rrc::UL_DCCH_Message
+connection_setup_complete() {
+  rrc::UL_DCCH_Message m;
+  auto &complete = m.message.emplace<0>().emplace<4>();
+  complete.rrc_TransactionIdentifier = 1;
+  auto &ies = complete.criticalExtensions.emplace<0>().emplace<0>();
+  ies.selectedPLMN_Identity = 1;
+  // Attach request sized NAS message
+  uint8_t nas[40];
+  for (int i = 0; i < (int)sizeof(nas); ++i)
+    nas[i] = i;
+  ies.dedicatedInfoNAS.assign(nas, sizeof(nas));
+  return m;
+}
+
+static rrc::DL_DCCH_Message
+connection_reconfiguration() {
+  rrc::DL_DCCH_Message m;
+  auto &reconfiguration = m.message.emplace<0>().emplace<4>();
+  reconfiguration.rrc_TransactionIdentifier = 2;
+  auto &ies = reconfiguration.criticalExtensions.emplace<0>().emplace<0>();
+  auto &config = ies.radioResourceConfigDedicated.emplace();
+  rrc::DRB_ToAddMod drb;
+  drb.eps_BearerIdentity = 5;
+  drb.drb_Identity = 1;
+  drb.pdcp_Config.emplace().discardTimer = 7; // infinity
+  drb.pdcp_Config->rlc_AM.emplace().statusReportRequired = true;
+  drb.rlc_Config = am_rlc_config();
+  drb.logicalChannelIdentity = 3;
+  auto &ul = drb.logicalChannelConfig.emplace().ul_SpecificParameters.emplace();
+  ul.priority = 9;
+  ul.prioritisedBitRate = 7; // infinity
+  ul.bucketSizeDuration = 0; // ms50
+  ul.logicalChannelGroup = 3;
+  config.drb_ToAddModList.emplace().size = 0;
+  config.drb_ToAddModList->push_back(drb);
+  return m;
+}
+
+static rrc::DL_DCCH_Message
+connection_release() {
+  rrc::DL_DCCH_Message m;
+  auto &release = m.message.emplace<0>().emplace<5>();
+  release.rrc_TransactionIdentifier = 3;
+  release.criticalExtensions.emplace<0>().emplace<0>().releaseCause = 1; // other
+  return m;
+}
+
+/******
+ ** Codec
+ **/
+
+// Decoding and encoding again has to give the same bits
+template <typename Message>
+static int
+check_round_trip(const char *name, const Message &m, uint8_t *encoded, int size) {
+  int bits = uper::encode_message(m, encoded, size);
+  if (bits < 0) {
+    fprintf(stderr, "Encoding %s failed: %s\n", name, strerror(errno));
+    exit(1);
+  }
+  Message decoded;
+  uint8_t again[256];
+  int decoded_bits = uper::decode_message(decoded, encoded, size * 8);
+  if (decoded_bits != bits || uper::encode_message(decoded, again, sizeof(again)) != bits
+      || memcmp(encoded, again, (bits + 7) / 8)) {
+    fprintf(stderr, "%s didn't survive decoding\n", name);
+    exit(1);
+  }
+  return bits;
+}
+
+static void
+check_hex(const char *name, const uint8_t *encoded, int bits, const char *expected) {
+  char hex[512] = "";
+  for (int i = 0; i < (bits + 7) / 8; ++i)
+    sprintf(hex + 2 * i, "%02x", encoded[i]);
+  if (strcmp(hex, expected)) {
+    fprintf(stderr, "%s encoded as %s instead of %s\n", name, hex, expected);
+    exit(1);
+  }
+}
+
+// Encodings of the xml files worked out by hand from EUTRAN_RRC.asn1
+static const char *sib1_hex = "706404e10001000000180219c002660000";
+static const char *sib2_hex = "008110005703000000000000000000000000008a900000000e8a9e90648aae8c";
+
+static void
+check_codec() {
+  uint8_t encoded[256];
+  int bits = check_round_trip("mib.xml", xml_mib(), encoded, sizeof(encoded));
+  if (bits != 24)
+    exit(1);
+  check_hex("mib.xml", encoded, bits, "480000");
+  bits = check_round_trip("sib1.dlsch.xml", xml_sib1(), encoded, sizeof(encoded));
+  check_hex("sib1.dlsch.xml", encoded, bits, sib1_hex);
+  bits = check_round_trip("sib2.dlsch.xml", xml_sib2(), encoded, sizeof(encoded));
+  check_hex("sib2.dlsch.xml", encoded, bits, sib2_hex);
+
+  rrc::BCCH_DL_SCH_Message decoded;
+  if (uper::decode_message(decoded, encoded, bits) < 0) {
+    perror("sib2.dlsch.xml");
+    exit(1);
+  }
+  const auto &si = std::get<0>(std::get<0>(decoded.message)).criticalExtensions;
+  const auto &sibs = std::get<0>(si).sib_TypeAndInfo;
+  const auto &sib9 = std::get<7>(sibs[1]);
+  if (sibs.size != 2 || std::get<0>(sibs[0]).radioResourceConfigCommon.uplinkPowerControlCommon.p0_NominalPUSCH != -126
+      || sib9.hnb_Name->size != 6 || memcmp(sib9.hnb_Name->data, "OH2EWF", 6)) {
+    fprintf(stderr, "sib2.dlsch.xml decoded wrong\n");
+    exit(1);
+  }
+
+  check_round_trip("RRCConnectionRequest", connection_request(), encoded, sizeof(encoded));
+  check_round_trip("RRCConnectionSetup", connection_setup(), encoded, sizeof(encoded));
+  check_round_trip("RRCConnectionSetupComplete", connection_setup_complete(), encoded, sizeof(encoded));
+  check_round_trip("RRCConnectionReconfiguration", connection_reconfiguration(), encoded, sizeof(encoded));
+  check_round_trip("RRCConnectionRelease", connection_release(), encoded, sizeof(encoded));
+
+  // Truncated messages are rejected, not read past the end
+  bits = uper::encode_message(connection_reconfiguration(), encoded, sizeof(encoded));
+  rrc::DL_DCCH_Message truncated;
+  for (int i = 0; i < bits; ++i)
+    if (uper::decode_message(truncated, encoded, i) != -1 || errno != EBADMSG) {
+      fprintf(stderr, "RRCConnectionReconfiguration decoded from %d bits\n", i);
+      exit(1);
+    }
+}
+
+template <typename Message>
+static void
+bench_message(bench &b, const char *name, const Message &m) {
+  uint8_t encoded[256];
+  int bits = uper::encode_message(m, encoded, sizeof(encoded));
+  b.run(str(format("asn1/encode/%s") % name), [&]() {
+      bench_keep(uper::encode_message(m, encoded, sizeof(encoded)));
+    });
+  Message decoded;
+  b.run(str(format("asn1/decode/%s") % name), [&]() {
+      bench_keep(uper::decode_message(decoded, encoded, bits));
+    });
+}
+
+static void
+bench_asn1(bench &b) {
+  check_codec();
+  bench_message(b, "mib", xml_mib());
+  bench_message(b, "sib1", xml_sib1());
+  bench_message(b, "sib2_sib9", xml_sib2());
+  bench_message(b, "rrc_connection_request", connection_request());
+  bench_message(b, "rrc_connection_setup", connection_setup());
+  bench_message(b, "rrc_connection_setup_complete", connection_setup_complete());
+  bench_message(b, "rrc_connection_reconfiguration", connection_reconfiguration());
+  bench_message(b, "rrc_connection_release", connection_release());
+}
+
+/******
+ ** System Information
+ **/
+static void
+bench_si(bench &b) {
+  RRC_SI *si = rrc_si_init(1);
+  uint8_t mib[3], sib1[64], si_message[64];
+  rrc_si_set_message(si, RRC_SI_MIB, mib, uper::encode_message(xml_mib(), mib, sizeof(mib)), 0);
+  int sib1_bits = uper::encode_message(xml_sib1(), sib1, sizeof(sib1));
+  rrc_si_set_message(si, RRC_SI_SIB1, sib1, sib1_bits, 0);
+  rrc_si_set_message(si, RRC_SI_MESSAGE, si_message, uper::encode_message(xml_sib2(), si_message, sizeof(si_message)), 8);
+
+  // A whole SFN cycle, broadcasting by copying into the PHY's buffers
+  vector<uint8_t> phy(3 * 256);
+  b.run("si/subframes=10240", [&]() {
+      rrc_si_transmission transmissions[4];
+      for (unsigned sfn = 0; sfn < 1024; ++sfn) {
+	for (unsigned subframe = 0; subframe < 10; ++subframe) {
+	  int n = rrc_si_subframe(si, sfn, subframe, transmissions, 4);
+	  uint8_t *p = phy.data();
+	  for (int i = 0; i < n; ++i) {
+	    memcpy(p, transmissions[i].transport_block, transmissions[i].size);
+	    p += transmissions[i].size;
+	  }
+	}
+      }
+      bench_keep(phy);
+    });
+  // Configuration change
+  b.run("si/set_mib", [&]() { rrc_si_set_message(si, RRC_SI_MIB, mib, 24, 0); });
+  b.run("si/set_sib1", [&]() { rrc_si_set_message(si, RRC_SI_SIB1, sib1, sib1_bits, 0); });
+  rrc_si_free(si);
+}
+
+/******
+ ** Connections
+ **
+ ** A base station restart: every UE sends RRCConnectionRequest at once.
+ ** The UEs run RLC entities of their own and answer with encoded messages,
+ ** PDUs are moved between the peers once per millisecond.
+ **/
+struct sim_ue {
+  RLC *srb1;
+  RLC *enb_srb1;
+  int ue;
+  uint8_t ul[128]; // SRB1 PDCP PDU to send, one at a time
+  int ul_size;
+  bool released;
+};
+
+struct sim {
+  RRC_CONN *conn;
+  int n_ues;
+  vector<sim_ue> ues; // By C-RNTI
+  unsigned time;
+  uint8_t request[8];
+  int request_size;
+};
+
+template <typename Message>
+static void
+sim_ue_send(sim_ue &u, const Message &m) {
+  int bits = uper::encode_message(m, u.ul + 1, sizeof(u.ul) - 5);
+  if (bits < 0) {
+    fprintf(stderr, "Encoding UL-DCCH failed\n");
+    exit(1);
+  }
+  u.ul[0] = 0; // PDCP SN, unchecked
+  u.ul_size = 1 + (bits + 7) / 8 + 4;
+  memset(u.ul + u.ul_size - 4, 0, 4);
+}
+
+static void
+sim_ccch_send(void *arg, unsigned time_in_ms, int rnti, const void *data, size_t size) {
+  sim &s = *(sim *)arg;
+  sim_ue &u = s.ues[rnti];
+  rrc::DL_CCCH_Message m;
+  if (uper::decode_message(m, data, size * 8) >= 0 && std::get<0>(m.message).index() == 2)
+    return; // RRCConnectionReject
+  if (uper::decode_message(m, data, size * 8) < 0 || std::get<0>(m.message).index() != 3) {
+    fprintf(stderr, "UE %d: unexpected DL-CCCH message\n", rnti);
+    exit(1);
+  }
+  rlc_reset(u.srb1);
+  rrc::UL_DCCH_Message complete = connection_setup_complete();
+  std::get<4>(std::get<0>(complete.message)).rrc_TransactionIdentifier =
+    std::get<3>(std::get<0>(m.message)).rrc_TransactionIdentifier;
+  sim_ue_send(u, complete);
+}
+
+static void
+sim_bearer_added(void *arg, unsigned time_in_ms, int ue, int rnti, int lcid, RLC *rlc) {
+  sim &s = *(sim *)arg;
+  if (lcid == RRC_CONN_SRB1) {
+    s.ues[rnti].enb_srb1 = rlc;
+    s.ues[rnti].ue = ue;
+  }
+}
+
+static void
+sim_bearer_removed(void *arg, unsigned time_in_ms, int ue, int rnti, int lcid, RLC *rlc) {
+  sim &s = *(sim *)arg;
+  if (lcid == RRC_CONN_SRB1)
+    s.ues[rnti].enb_srb1 = NULL;
+}
+
+static int
+sim_ue_sdu_send(void *arg, unsigned time_in_ms, void *buffer, size_t size) {
+  sim_ue &u = *(sim_ue *)arg;
+  if (!u.ul_size || (size_t)u.ul_size > size)
+    return -1;
+  memcpy(buffer, u.ul, u.ul_size);
+  int n = u.ul_size;
+  u.ul_size = 0;
+  return n;
+}
+
+static void
+sim_ue_sdu_received(void *arg, unsigned time_in_ms, const void *buffer, size_t size) {
+  sim_ue &u = *(sim_ue *)arg;
+  rrc::DL_DCCH_Message m;
+  if (size < 5 || uper::decode_message(m, (const uint8_t *)buffer + 1, (size - 5) * 8) < 0) {
+    fprintf(stderr, "UE: undecodable DL-DCCH message\n");
+    exit(1);
+  }
+  auto &c1 = std::get<0>(m.message);
+  if (c1.index() == 4) {
+    const auto &reconfiguration = std::get<4>(c1);
+    const auto &config = *std::get<0>(std::get<0>(reconfiguration.criticalExtensions)).radioResourceConfigDedicated;
+    if (!config.srb_ToAddModList || !config.drb_ToAddModList
+	|| (*config.drb_ToAddModList)[0].logicalChannelIdentity != 3) {
+      fprintf(stderr, "UE: wrong RRCConnectionReconfiguration\n");
+      exit(1);
+    }
+    rrc::UL_DCCH_Message complete;
+    complete.message.emplace<0>().emplace<2>().rrc_TransactionIdentifier = reconfiguration.rrc_TransactionIdentifier;
+    sim_ue_send(u, complete);
+  } else if (c1.index() == 5) {
+    u.released = true;
+  }
+}
+
+// Moves PDUs both ways and returns once the RRC stats say done
+static void
+sim_run(sim &s, uint64_t rrc_conn_stats::*counter, uint64_t until) {
+  uint8_t buffer[1024];
+  int sizes[8];
+  rrc_conn_stats stats;
+  for (int ms = 0; ms < 1000; ++ms) {
+    rrc_conn_get_stats(s.conn, &stats);
+    if (stats.*counter >= until)
+      return;
+    ++s.time;
+    for (sim_ue &u : s.ues) {
+      if (!u.enb_srb1)
+	continue;
+      RLC *from[2] = { u.enb_srb1, u.srb1 }, *to[2] = { u.srb1, u.enb_srb1 };
+      for (int d = 0; d < 2; ++d) {
+	int n = rlc_pdus_send_opportunity(from[d], s.time, buffer, sizeof(buffer), sizes, 8);
+	const uint8_t *p = buffer;
+	for (int i = 0; i < n; p += sizes[i++])
+	  rlc_pdu_received(to[d], s.time, p, sizes[i]);
+      }
+    }
+    rrc_conn_tick(s.conn, s.time);
+  }
+  fprintf(stderr, "Connections stuck at %d of %d\n", (int)(stats.*counter), (int)until);
+  exit(1);
+}
+
+static void
+sim_reattach(sim &s) {
+  rrc_conn_stats stats;
+  rrc_conn_get_stats(s.conn, &stats);
+  for (int rnti = 1; rnti <= s.n_ues; ++rnti)
+    if (rrc_conn_ccch_received(s.conn, s.time, rnti, s.request, s.request_size) < 0) {
+      fprintf(stderr, "RRCConnectionRequest of %d: %s\n", rnti, strerror(errno));
+      exit(1);
+    }
+  sim_run(s, &rrc_conn_stats::connected, stats.connected + s.n_ues);
+  for (int rnti = 1; rnti <= s.n_ues; ++rnti)
+    if (rrc_conn_release(s.conn, s.time, s.ues[rnti].ue) < 0) {
+      fprintf(stderr, "Releasing %d: %s\n", rnti, strerror(errno));
+      exit(1);
+    }
+  sim_run(s, &rrc_conn_stats::releases, stats.releases + s.n_ues);
+}
+
+static void
+bench_conn(bench &b) {
+  const int n_ues = 1000;
+  static const char am[] = "t-PollRetransmit=45\0t-StatusProhibit=0\0rlc/trace=0";
+  static const char drb[] = "t-PollRetransmit=50\0pollPDU=32\0pollByte=25000\0statusReportRequired=1\0discardTimer=infinity";
+  sim s;
+  s.conn = rrc_conn_init(n_ues);
+  s.time = 0;
+  s.request_size = (uper::encode_message(connection_request(), s.request, sizeof(s.request)) + 7) / 8;
+  rrc_conn_set_callbacks(s.conn, &s, sim_ccch_send, sim_bearer_added, sim_bearer_removed, NULL);
+  if (rrc_conn_set_bearer_parameters(s.conn, RRC_CONN_SRB1, am, sizeof(am))
+      || rrc_conn_set_bearer_parameters(s.conn, RRC_CONN_SRB2, am, sizeof(am))
+      || rrc_conn_set_bearer_parameters(s.conn, RRC_CONN_DRB1, drb, sizeof(drb))) {
+    fprintf(stderr, "Bearer parameters rejected: %s\n", strerror(errno));
+    exit(1);
+  }
+  static const char not_signalled[] = "t-PollRetransmit=7";
+  if (rrc_conn_set_bearer_parameters(s.conn, RRC_CONN_DRB1, not_signalled, sizeof(not_signalled)) != -1) {
+    fprintf(stderr, "t-PollRetransmit=7 accepted\n");
+    exit(1);
+  }
+  s.n_ues = n_ues;
+  s.ues.resize(n_ues + 2); // C-RNTI 0 unused, the last one rejected
+  for (sim_ue &u : s.ues) {
+    u.srb1 = rlc_init();
+    rlc_set_parameters(u.srb1, am, sizeof(am));
+    rlc_am_set_callbacks(u.srb1, &u, sim_ue_sdu_send, sim_ue_sdu_received, NULL, NULL);
+  }
+
+  // Self check, with a UE beyond the pool rejected
+  sim_reattach(s);
+  rrc_conn_stats stats;
+  rrc_conn_get_stats(s.conn, &stats);
+  for (int rnti = 1; rnti <= n_ues; ++rnti)
+    if (!s.ues[rnti].released || rrc_conn_find(s.conn, rnti) != -1) {
+      fprintf(stderr, "UE %d not released\n", rnti);
+      exit(1);
+    }
+  if (stats.setups != (uint64_t)n_ues || stats.reconfigurations != (uint64_t)n_ues || stats.timeouts
+      || stats.malformed || stats.unsupported) {
+    fprintf(stderr, "Unexpected RRC connection stats\n");
+    exit(1);
+  }
+  for (int rnti = 1; rnti <= n_ues; ++rnti)
+    rrc_conn_ccch_received(s.conn, s.time, rnti, s.request, s.request_size);
+  if (rrc_conn_ccch_received(s.conn, s.time, n_ues + 1, s.request, s.request_size) != -1 || errno != ENOSPC) {
+    fprintf(stderr, "No RRCConnectionReject with all contexts in use\n");
+    exit(1);
+  }
+  for (int rnti = 1; rnti <= n_ues; ++rnti)
+    s.ues[rnti].enb_srb1 = NULL;
+  rrc_conn_tick(s.conn, s.time + RRC_CONN_SETUP_TIMEOUT_MS);
+  s.time += RRC_CONN_SETUP_TIMEOUT_MS;
+
+  // Setup, reconfiguration and release of all UEs
+  b.run(str(format("conn/reattach/ues=%d") % n_ues), [&]() { sim_reattach(s); });
+
+  // Bearer of a pooled context against a new RLC entity
+  RLC *rlc = rlc_init();
+  rlc_set_parameters(rlc, drb, sizeof(drb));
+  b.run("conn/bearer/pooled", [&]() { rlc_reset(rlc); });
+  b.run("conn/bearer/rlc_init", [&]() {
+      RLC *fresh = rlc_init();
+      rlc_set_parameters(fresh, drb, sizeof(drb));
+      rlc_free(fresh);
+    });
+  rlc_free(rlc);
+
+  for (sim_ue &u : s.ues)
+    rlc_free(u.srb1);
+  rrc_conn_free(s.conn);
+}
+
+int
+main(int argc, char **argv) {
+  bench b(argc, argv);
+  bench_asn1(b);
+  bench_si(b);
+  bench_conn(b);
+  return 0;
+}
@@ -0,0 +1,589 @@
+/*
+   Implement connection control of 3GPP LTE RRC for the base station
+
+   Bearer parameters are parsed and the messages encoded when parameters
+   are set, with rrc-TransactionIdentifier 0. Per UE only the identifier
+   bits are filled in, so a connection setup costs a copy and resetting
+   the RLC entities of a pooled context.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <argz.h>
+#include <envz.h>
+
+#include "rrc.h"
+#include "rrc_asn1.hh"
+
+using std::vector;
+
+// rrc-TransactionIdentifier comes after the message and c1 choice indices
+#define RRC_CONN_CCCH_TRANSACTION_OFFSET 3
+#define RRC_CONN_DCCH_TRANSACTION_OFFSET 5
+// PDCP Data PDU on SRBs: R R R SN(5) and a MAC-I, zero without integrity
+// protection
+#define RRC_CONN_PDCP_HEADER_SIZE 1
+#define RRC_CONN_PDCP_MAC_I_SIZE 4
+#define RRC_CONN_MAX_MESSAGE_SIZE 96
+#define RRC_CONN_QUEUE_SIZE 4
+// RRCConnectionReject waitTime goes round 1 .. 4 s to spread out retries
+#define RRC_CONN_REJECT_WAIT_TIMES 4
+
+static inline bool
+rrc_time_reached(unsigned now, unsigned then) {
+  return (int32_t)(now - then) >= 0;
+}
+
+struct rrc_conn_message {
+  int size; // Octets
+  uint8_t data[RRC_CONN_MAX_MESSAGE_SIZE];
+};
+
+template <typename Message>
+static int
+rrc_encode(const Message &m, rrc_conn_message &out) {
+  int bits = uper::encode_message(m, out.data, sizeof(out.data));
+  if (bits < 0)
+    return -1;
+  out.size = (bits + 7) / 8;
+  return 0;
+}
+
+static void
+rrc_set_transaction(uint8_t *data, int offset, unsigned transaction_id) {
+  bits b(data);
+  b.write_offset = offset;
+  b.push_bits(2, transaction_id); // Encoded as 0
+}
+
+/******
+ ** Bearer parameter templates
+ **
+ ** RLC-Config values in the units of RLC parameters. The defaults are
+ ** those of SRBs, 36.331 9.2.1.1.
+ **/
+static int
+rrc_t_poll_retransmit(unsigned i) { return i < 50 ? 5 * (i + 1) : i < 55 ? 300 + 50 * (i - 50) : -1; }
+static int
+rrc_t_status_prohibit(unsigned i) { return i < 51 ? 5 * i : i < 56 ? 300 + 50 * (i - 51) : -1; }
+static int
+rrc_t_reordering(unsigned i) { return i < 21 ? 5 * i : i < 31 ? 110 + 10 * (i - 21) : -1; }
+static int
+rrc_poll_pdu(unsigned i) { return i < 7 ? 4 << i : INT_MAX; }
+static int
+rrc_poll_byte(unsigned i) {
+  static const int kbytes[14] = { 25, 50, 75, 100, 125, 250, 375, 500, 750, 1000, 1250, 1500, 2000, 3000 };
+  return i < 14 ? 1000 * kbytes[i] : i == 14 ? INT_MAX : -1;
+}
+static int
+rrc_max_retx_threshold(unsigned i) {
+  static const int t[8] = { 1, 2, 3, 4, 6, 8, 16, 32 };
+  return t[i];
+}
+static int
+rrc_discard_timer(unsigned i) {
+  static const int ms[8] = { 50, 100, 150, 300, 500, 750, 1500, INT_MAX };
+  return ms[i];
+}
+
+struct rrc_parameter {
+  const char *name;
+  const char *default_value;
+  unsigned n_values;
+  int (*value)(unsigned index);
+};
+
+enum { RRC_T_POLL_RETRANSMIT, RRC_POLL_PDU, RRC_POLL_BYTE, RRC_MAX_RETX_THRESHOLD,
+       RRC_T_REORDERING, RRC_T_STATUS_PROHIBIT, RRC_AM_PARAMETERS };
+
+static const rrc_parameter rrc_am_parameters[RRC_AM_PARAMETERS] = {
+  { "t-PollRetransmit", "45", 64, rrc_t_poll_retransmit },
+  { "pollPDU", "infinity", 8, rrc_poll_pdu },
+  { "pollByte", "infinity", 16, rrc_poll_byte },
+  { "maxRetxThreshold", "4", 8, rrc_max_retx_threshold },
+  { "t-Reordering", "35", 32, rrc_t_reordering },
+  { "t-StatusProhibit", "0", 64, rrc_t_status_prohibit },
+};
+
+static const rrc_parameter rrc_discard_timer_parameter = { "discardTimer", NULL, 8, rrc_discard_timer };
+
+// Index of the enumeration value, -1 if there is none
+static int
+rrc_parameter_index(const rrc_parameter &p, const char *s) {
+  char *end;
+  long value = strcmp(s, "infinity") ? strtol(s, &end, 10) : INT_MAX;
+  if (value != INT_MAX && (end == s || *end))
+    return -1;
+  for (unsigned i = 0; i < p.n_values; ++i)
+    if (p.value(i) == value)
+      return i;
+  return -1;
+}
+
+struct rrc_bearer_template {
+  bool present;
+  unsigned version;
+  vector<char> envz; // Numeric values for rlc_set_parameters()
+  rrc::RLC_Config rlc_config;
+  rrc::PDCP_Config pdcp_config;
+};
+
+static int
+rrc_parse_template(rrc_bearer_template &t, const char *envz_in, size_t envz_in_len) {
+  char *envz = NULL; size_t envz_len = 0;
+  envz_merge(&envz, &envz_len, envz_in, envz_in_len, true);
+  if (!envz_get(envz, envz_len, "rlc/trace"))
+    envz_add(&envz, &envz_len, "rlc/trace", "0");
+  const char *mode = envz_get(envz, envz_len, "rlc/mode");
+  int index[RRC_AM_PARAMETERS];
+  int discard_timer = -1;
+  bool ok = !mode || !strcmp(mode, "AM");
+  for (int i = 0; ok && i < RRC_AM_PARAMETERS; ++i) {
+    const rrc_parameter &p = rrc_am_parameters[i];
+    const char *s = envz_get(envz, envz_len, p.name);
+    index[i] = rrc_parameter_index(p, s ? s : p.default_value);
+    if (index[i] < 0)
+      ok = false;
+    else {
+      char intbuf[32];
+      sprintf(intbuf, "%d", p.value(index[i]));
+      envz_add(&envz, &envz_len, p.name, intbuf);
+    }
+  }
+  const char *s = envz_get(envz, envz_len, rrc_discard_timer_parameter.name);
+  if (ok && s && (discard_timer = rrc_parameter_index(rrc_discard_timer_parameter, s)) < 0)
+    ok = false;
+  if (!ok) {
+    free(envz);
+    errno = EINVAL;
+    return -1;
+  }
+
+  rrc::RLC_Config_am am;
+  am.ul_AM_RLC.t_PollRetransmit = index[RRC_T_POLL_RETRANSMIT];
+  am.ul_AM_RLC.pollPDU = index[RRC_POLL_PDU];
+  am.ul_AM_RLC.pollByte = index[RRC_POLL_BYTE];
+  am.ul_AM_RLC.maxRetxThreshold = index[RRC_MAX_RETX_THRESHOLD];
+  am.dl_AM_RLC.t_Reordering = index[RRC_T_REORDERING];
+  am.dl_AM_RLC.t_StatusProhibit = index[RRC_T_STATUS_PROHIBIT];
+  t.rlc_config = am;
+  t.pdcp_config = rrc::PDCP_Config();
+  if (discard_timer >= 0)
+    t.pdcp_config.discardTimer = discard_timer;
+  s = envz_get(envz, envz_len, "statusReportRequired");
+  t.pdcp_config.rlc_AM.emplace().statusReportRequired = s && atoi(s);
+  t.envz.assign(envz, envz + envz_len);
+  free(envz);
+  return 0;
+}
+
+/******
+ ** Contexts
+ **
+ ** All UE contexts are allocated up front, with an RLC entity for every
+ ** bearer. Free contexts are kept on a stack of indices and UEs are looked
+ ** up by C-RNTI from a table of all 65536.
+ **/
+struct rrc_ue {
+  RRC_CONN *conn;
+  int index;
+  int state;
+  int rnti;
+  unsigned deadline;       // Supervision in states other than CONNECTED
+  unsigned transaction_id; // Of the latest message sent
+  unsigned pdcp_sn;        // Next on SRB1
+  unsigned release_sn;     // Of RRCConnectionRelease
+  RLC *rlc[RRC_CONN_MAX_BEARERS];
+  unsigned rlc_version[RRC_CONN_MAX_BEARERS]; // Template version set, 0 for none
+  bool bearer_up[RRC_CONN_MAX_BEARERS];
+  // PDCP PDUs waiting for SRB1 send opportunities
+  rrc_conn_message queue[RRC_CONN_QUEUE_SIZE];
+  unsigned queue_head, queue_count;
+};
+
+struct rrc_conn {
+  void *arg;
+  rrc_conn_ccch_send_fn ccch_send;
+  rrc_conn_bearer_fn bearer_added;
+  rrc_conn_bearer_fn bearer_removed;
+  rrc_conn_nas_received_fn nas_received;
+  vector<rrc_ue> ues;
+  vector<int> free_ues;
+  vector<int> ue_by_rnti;
+  rrc_bearer_template templates[RRC_CONN_MAX_BEARERS];
+  unsigned template_version;
+  rrc_conn_message setup, reconfiguration, release;
+  rrc_conn_message reject[RRC_CONN_REJECT_WAIT_TIMES];
+  bool reconfigure; // SRB2 or DRB1 configured
+  rrc_conn_stats stats;
+};
+
+static void rrc_srb1_sdu_received(void *arg, unsigned time_in_ms, const void *buffer, size_t size);
+static int rrc_srb1_sdu_send(void *arg, unsigned time_in_ms, void *buffer, size_t size);
+static void rrc_srb1_sdu_delivered(void *arg, unsigned time_in_ms, const void *buffer, size_t size);
+static void rrc_srb1_radio_link_failure(void *arg, unsigned time_in_ms);
+
+static int
+rrc_conn_encode_messages(RRC_CONN *conn) {
+  const rrc_bearer_template *t = conn->templates;
+
+  rrc::DL_CCCH_Message setup;
+  auto &config = setup.message.emplace<0>().emplace<3>()
+    .criticalExtensions.emplace<0>().emplace<0>().radioResourceConfigDedicated;
+  rrc::SRB_ToAddMod srb1;
+  srb1.srb_Identity = 1;
+  srb1.rlc_Config.emplace(t[RRC_CONN_SRB1 - 1].rlc_config);
+  srb1.logicalChannelConfig.emplace().emplace<1>(); // defaultValue
+  config.srb_ToAddModList.emplace().size = 0;
+  config.srb_ToAddModList->push_back(srb1);
+  config.mac_MainConfig.emplace().emplace<1>(); // defaultValue
+
+  rrc::DL_DCCH_Message reconfiguration;
+  auto &reconfigured = reconfiguration.message.emplace<0>().emplace<4>()
+    .criticalExtensions.emplace<0>().emplace<0>().radioResourceConfigDedicated.emplace();
+  if (t[RRC_CONN_SRB2 - 1].present) {
+    rrc::SRB_ToAddMod srb2;
+    srb2.srb_Identity = 2;
+    srb2.rlc_Config.emplace(t[RRC_CONN_SRB2 - 1].rlc_config);
+    srb2.logicalChannelConfig.emplace().emplace<1>();
+    reconfigured.srb_ToAddModList.emplace().size = 0;
+    reconfigured.srb_ToAddModList->push_back(srb2);
+  }
+  if (t[RRC_CONN_DRB1 - 1].present) {
+    // Default EPS bearer
+    rrc::DRB_ToAddMod drb;
+    drb.eps_BearerIdentity = 5;
+    drb.drb_Identity = 1;
+    drb.pdcp_Config = t[RRC_CONN_DRB1 - 1].pdcp_config;
+    drb.rlc_Config = t[RRC_CONN_DRB1 - 1].rlc_config;
+    drb.logicalChannelIdentity = RRC_CONN_DRB1;
+    auto &ul = drb.logicalChannelConfig.emplace().ul_SpecificParameters.emplace();
+    ul.priority = 9;
+    ul.prioritisedBitRate = 7; // infinity
+    ul.bucketSizeDuration = 0; // ms50
+    ul.logicalChannelGroup = 3;
+    reconfigured.drb_ToAddModList.emplace().size = 0;
+    reconfigured.drb_ToAddModList->push_back(drb);
+  }
+  conn->reconfigure = t[RRC_CONN_SRB2 - 1].present || t[RRC_CONN_DRB1 - 1].present;
+
+  rrc::DL_DCCH_Message release;
+  release.message.emplace<0>().emplace<5>()
+    .criticalExtensions.emplace<0>().emplace<0>().releaseCause = 1; // other
+
+  if (rrc_encode(setup, conn->setup) || rrc_encode(reconfiguration, conn->reconfiguration)
+      || rrc_encode(release, conn->release))
+    return -1;
+  for (int i = 0; i < RRC_CONN_REJECT_WAIT_TIMES; ++i) {
+    rrc::DL_CCCH_Message reject;
+    reject.message.emplace<0>().emplace<2>()
+      .criticalExtensions.emplace<0>().emplace<0>().waitTime = 1 + i;
+    if (rrc_encode(reject, conn->reject[i]))
+      return -1;
+  }
+  return 0;
+}
+
+RRC_CONN *
+rrc_conn_init(int max_ues) {
+  RRC_CONN *conn = new RRC_CONN();
+  conn->ues.resize(std::max(max_ues, 0));
+  for (int i = (int)conn->ues.size() - 1; i >= 0; --i) {
+    rrc_ue &ue = conn->ues[i];
+    ue.conn = conn;
+    ue.index = i;
+    for (int b = 0; b < RRC_CONN_MAX_BEARERS; ++b)
+      ue.rlc[b] = rlc_init();
+    conn->free_ues.push_back(i);
+  }
+  conn->ue_by_rnti.assign(65536, -1);
+  rrc_conn_set_bearer_parameters(conn, RRC_CONN_SRB1, NULL, 0);
+  return conn;
+}
+
+void
+rrc_conn_free(RRC_CONN *conn) {
+  for (rrc_ue &ue : conn->ues)
+    for (RLC *rlc : ue.rlc)
+      rlc_free(rlc);
+  delete conn;
+}
+
+void
+rrc_conn_set_callbacks(RRC_CONN *conn, void *arg, rrc_conn_ccch_send_fn ccch_send,
+		       rrc_conn_bearer_fn bearer_added, rrc_conn_bearer_fn bearer_removed,
+		       rrc_conn_nas_received_fn nas_received) {
+  conn->arg = arg;
+  conn->ccch_send = ccch_send;
+  conn->bearer_added = bearer_added;
+  conn->bearer_removed = bearer_removed;
+  conn->nas_received = nas_received;
+}
+
+// Contexts in use keep their bearers as they were set up
+int
+rrc_conn_set_bearer_parameters(RRC_CONN *conn, int lcid, const char *envz, size_t envz_len) {
+  if (lcid < 1 || lcid > RRC_CONN_MAX_BEARERS) {
+    errno = EINVAL;
+    return -1;
+  }
+  rrc_bearer_template parsed;
+  if (rrc_parse_template(parsed, envz, envz_len))
+    return -1;
+  parsed.present = true;
+  parsed.version = ++conn->template_version;
+  conn->templates[lcid - 1] = parsed;
+  return rrc_conn_encode_messages(conn);
+}
+
+static void
+rrc_ue_bearer_up(rrc_ue &ue, unsigned time_in_ms, int lcid) {
+  RRC_CONN *conn = ue.conn;
+  const rrc_bearer_template &t = conn->templates[lcid - 1];
+  RLC *rlc = ue.rlc[lcid - 1];
+  rlc_reset(rlc);
+  if (ue.rlc_version[lcid - 1] != t.version) {
+    rlc_set_parameters(rlc, t.envz.data(), t.envz.size());
+    ue.rlc_version[lcid - 1] = t.version;
+  }
+  if (lcid == RRC_CONN_SRB1)
+    rlc_am_set_callbacks(rlc, &ue, rrc_srb1_sdu_send, rrc_srb1_sdu_received,
+			 rrc_srb1_sdu_delivered, rrc_srb1_radio_link_failure);
+  else
+    rlc_am_set_callbacks(rlc, NULL, NULL, NULL, NULL, NULL);
+  ue.bearer_up[lcid - 1] = true;
+  if (conn->bearer_added)
+    conn->bearer_added(conn->arg, time_in_ms, ue.index, ue.rnti, lcid, rlc);
+}
+
+static void
+rrc_ue_free(rrc_ue &ue, unsigned time_in_ms) {
+  RRC_CONN *conn = ue.conn;
+  for (int lcid = RRC_CONN_MAX_BEARERS; lcid >= 1; --lcid) {
+    if (!ue.bearer_up[lcid - 1])
+      continue;
+    ue.bearer_up[lcid - 1] = false;
+    if (conn->bearer_removed)
+      conn->bearer_removed(conn->arg, time_in_ms, ue.index, ue.rnti, lcid, ue.rlc[lcid - 1]);
+  }
+  conn->ue_by_rnti[ue.rnti] = -1;
+  ue.state = RRC_CONN_IDLE;
+  ue.queue_count = 0;
+  conn->free_ues.push_back(ue.index);
+}
+
+// DL-DCCH message with the next transaction identifier
+static void
+rrc_ue_send(rrc_ue &ue, const rrc_conn_message &m) {
+  if (ue.queue_count == RRC_CONN_QUEUE_SIZE)
+    return; // The UE isn't receiving, supervision will free the context
+  rrc_conn_message &pdu = ue.queue[(ue.queue_head + ue.queue_count++) % RRC_CONN_QUEUE_SIZE];
+  ue.transaction_id = (ue.transaction_id + 1) % 4;
+  pdu.data[0] = ue.pdcp_sn++ % 32;
+  memcpy(pdu.data + RRC_CONN_PDCP_HEADER_SIZE, m.data, m.size);
+  rrc_set_transaction(pdu.data + RRC_CONN_PDCP_HEADER_SIZE, RRC_CONN_DCCH_TRANSACTION_OFFSET, ue.transaction_id);
+  memset(pdu.data + RRC_CONN_PDCP_HEADER_SIZE + m.size, 0, RRC_CONN_PDCP_MAC_I_SIZE);
+  pdu.size = RRC_CONN_PDCP_HEADER_SIZE + m.size + RRC_CONN_PDCP_MAC_I_SIZE;
+}
+
+static void
+rrc_ue_send_setup(rrc_ue &ue, unsigned time_in_ms) {
+  RRC_CONN *conn = ue.conn;
+  uint8_t data[RRC_CONN_MAX_MESSAGE_SIZE];
+  memcpy(data, conn->setup.data, conn->setup.size);
+  rrc_set_transaction(data, RRC_CONN_CCCH_TRANSACTION_OFFSET, ue.transaction_id);
+  if (conn->ccch_send)
+    conn->ccch_send(conn->arg, time_in_ms, ue.rnti, data, conn->setup.size);
+}
+
+int
+rrc_conn_ccch_received(RRC_CONN *conn, unsigned time_in_ms, int rnti, const void *data, size_t size) {
+  if (rnti < 0 || rnti >= (int)conn->ue_by_rnti.size()) {
+    errno = EINVAL;
+    return -1;
+  }
+  rrc::UL_CCCH_Message m;
+  if (uper::decode_message(m, data, std::min(size, (size_t)INT_MAX / 8) * 8) < 0) {
+    if (errno == ENOTSUP)
+      ++conn->stats.unsupported;
+    else
+      ++conn->stats.malformed;
+    return -1;
+  }
+  auto &c1 = std::get<0>(m.message);
+  if (c1.index() != 1 || std::get<1>(c1).criticalExtensions.index() != 0) {
+    ++conn->stats.unsupported;
+    errno = ENOTSUP;
+    return -1;
+  }
+  ++conn->stats.requests;
+
+  int i = conn->ue_by_rnti[rnti];
+  if (i >= 0) {
+    rrc_ue &ue = conn->ues[i];
+    // Our RRCConnectionSetup was lost
+    if (ue.state == RRC_CONN_SETUP) {
+      rrc_ue_send_setup(ue, time_in_ms);
+      return i;
+    }
+    // The C-RNTI is given to a new UE
+    rrc_ue_free(ue, time_in_ms);
+  }
+  if (conn->free_ues.empty()) {
+    const rrc_conn_message &reject = conn->reject[conn->stats.rejects++ % RRC_CONN_REJECT_WAIT_TIMES];
+    if (conn->ccch_send)
+      conn->ccch_send(conn->arg, time_in_ms, rnti, reject.data, reject.size);
+    errno = ENOSPC;
+    return -1;
+  }
+  i = conn->free_ues.back();
+  conn->free_ues.pop_back();
+  rrc_ue &ue = conn->ues[i];
+  conn->ue_by_rnti[rnti] = i;
+  ue.rnti = rnti;
+  ue.state = RRC_CONN_SETUP;
+  ue.deadline = time_in_ms + RRC_CONN_SETUP_TIMEOUT_MS;
+  ue.transaction_id = (ue.transaction_id + 1) % 4;
+  ue.pdcp_sn = 0;
+  ue.queue_head = ue.queue_count = 0;
+  rrc_ue_bearer_up(ue, time_in_ms, RRC_CONN_SRB1);
+  rrc_ue_send_setup(ue, time_in_ms);
+  ++conn->stats.setups;
+  return i;
+}
+
+int
+rrc_conn_release(RRC_CONN *conn, unsigned time_in_ms, int ue_index) {
+  if (ue_index < 0 || ue_index >= (int)conn->ues.size()
+      || conn->ues[ue_index].state == RRC_CONN_IDLE || conn->ues[ue_index].state == RRC_CONN_RELEASING) {
+    errno = EINVAL;
+    return -1;
+  }
+  rrc_ue &ue = conn->ues[ue_index];
+  ue.release_sn = ue.pdcp_sn % 32;
+  rrc_ue_send(ue, conn->release);
+  ue.state = RRC_CONN_RELEASING;
+  ue.deadline = time_in_ms + RRC_CONN_RELEASE_TIMEOUT_MS;
+  return 0;
+}
+
+void
+rrc_conn_tick(RRC_CONN *conn, unsigned time_in_ms) {
+  for (rrc_ue &ue : conn->ues) {
+    if (ue.state == RRC_CONN_IDLE || ue.state == RRC_CONN_CONNECTED
+	|| !rrc_time_reached(time_in_ms, ue.deadline))
+      continue;
+    if (ue.state == RRC_CONN_RELEASING)
+      ++conn->stats.releases;
+    else
+      ++conn->stats.timeouts;
+    rrc_ue_free(ue, time_in_ms);
+  }
+}
+
+int
+rrc_conn_find(RRC_CONN *conn, int rnti) {
+  if (rnti < 0 || rnti >= (int)conn->ue_by_rnti.size())
+    return -1;
+  return conn->ue_by_rnti[rnti];
+}
+
+int
+rrc_conn_get_state(RRC_CONN *conn, int ue) {
+  if (ue < 0 || ue >= (int)conn->ues.size())
+    return RRC_CONN_IDLE;
+  return conn->ues[ue].state;
+}
+
+void
+rrc_conn_get_stats(RRC_CONN *conn, struct rrc_conn_stats *stats) {
+  *stats = conn->stats;
+}
+
+/******
+ ** SRB1
+ **/
+static int
+rrc_srb1_sdu_send(void *arg, unsigned time_in_ms, void *buffer, size_t size) {
+  rrc_ue &ue = *(rrc_ue *)arg;
+  if (!ue.queue_count)
+    return -1;
+  const rrc_conn_message &pdu = ue.queue[ue.queue_head];
+  if ((size_t)pdu.size > size)
+    return -1;
+  memcpy(buffer, pdu.data, pdu.size);
+  ue.queue_head = (ue.queue_head + 1) % RRC_CONN_QUEUE_SIZE;
+  --ue.queue_count;
+  return pdu.size;
+}
+
+static void
+rrc_srb1_sdu_received(void *arg, unsigned time_in_ms, const void *buffer, size_t size) {
+  rrc_ue &ue = *(rrc_ue *)arg;
+  RRC_CONN *conn = ue.conn;
+  rrc::UL_DCCH_Message m;
+  if (size < RRC_CONN_PDCP_HEADER_SIZE + RRC_CONN_PDCP_MAC_I_SIZE) {
+    ++conn->stats.malformed;
+    return;
+  }
+  size -= RRC_CONN_PDCP_HEADER_SIZE + RRC_CONN_PDCP_MAC_I_SIZE;
+  if (uper::decode_message(m, (const uint8_t *)buffer + RRC_CONN_PDCP_HEADER_SIZE,
+			   std::min(size, (size_t)INT_MAX / 8) * 8) < 0) {
+    if (errno == ENOTSUP)
+      ++conn->stats.unsupported;
+    else
+      ++conn->stats.malformed;
+    return;
+  }
+  auto &c1 = std::get<0>(m.message);
+  if (c1.index() == 4 && ue.state == RRC_CONN_SETUP) {
+    const auto &complete = std::get<4>(c1);
+    if ((unsigned)complete.rrc_TransactionIdentifier != ue.transaction_id
+	|| complete.criticalExtensions.index() != 0 || std::get<0>(complete.criticalExtensions).index() != 0)
+      return;
+    const auto &nas = std::get<0>(std::get<0>(complete.criticalExtensions)).dedicatedInfoNAS;
+    if (conn->nas_received)
+      conn->nas_received(conn->arg, time_in_ms, ue.index, nas.data, nas.size);
+    if (!conn->reconfigure) {
+      ue.state = RRC_CONN_CONNECTED;
+      ++conn->stats.connected;
+      return;
+    }
+    for (int lcid = RRC_CONN_SRB2; lcid <= RRC_CONN_MAX_BEARERS; ++lcid)
+      if (conn->templates[lcid - 1].present)
+	rrc_ue_bearer_up(ue, time_in_ms, lcid);
+    rrc_ue_send(ue, conn->reconfiguration);
+    ue.state = RRC_CONN_RECONFIGURATION;
+    ue.deadline = time_in_ms + RRC_CONN_SETUP_TIMEOUT_MS;
+    ++conn->stats.reconfigurations;
+  } else if (c1.index() == 2 && ue.state == RRC_CONN_RECONFIGURATION) {
+    if ((unsigned)std::get<2>(c1).rrc_TransactionIdentifier != ue.transaction_id)
+      return;
+    ue.state = RRC_CONN_CONNECTED;
+    ++conn->stats.connected;
+  } else {
+    ++conn->stats.unsupported;
+  }
+}
+
+static void
+rrc_srb1_sdu_delivered(void *arg, unsigned time_in_ms, const void *buffer, size_t size) {
+  rrc_ue &ue = *(rrc_ue *)arg;
+  if (ue.state == RRC_CONN_RELEASING && size && *(const uint8_t *)buffer % 32 == ue.release_sn) {
+    ++ue.conn->stats.releases;
+    rrc_ue_free(ue, time_in_ms);
+  }
+}
+
+static void
+rrc_srb1_radio_link_failure(void *arg, unsigned time_in_ms) {
+  rrc_ue &ue = *(rrc_ue *)arg;
+  if (ue.state == RRC_CONN_IDLE)
+    return;
+  ++ue.conn->stats.radio_link_failures;
+  rrc_ue_free(ue, time_in_ms);
+}
@@ -0,0 +1,163 @@
+/*
+   Implement System Information broadcast of 3GPP LTE RRC
+
+   Everything that can be is done when a message is set: SIBs are padded
+   to a DCI format 1C transport block size and the MIB is prepared for
+   all 256 values of its systemFrameNumber field.
+*/
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "rrc.h"
+
+using std::vector;
+
+// BCCH-BCH: dl-Bandwidth 3, phich-Config 3, then the 8 most significant
+// bits of the SFN
+#define RRC_MIB_SIZE_IN_BITS 24
+#define RRC_MIB_SFN_OFFSET 6
+#define RRC_MIB_SFN_VALUES 256
+
+// Transport block sizes in bits for DCI format 1C, 36.213 Table 7.1.7.2.3-1
+static const int rrc_dci_1c_tbs[32] = {
+  40, 56, 72, 120, 136, 144, 176, 208, 224, 256, 280, 296, 328, 336, 392, 488,
+  552, 600, 632, 696, 776, 840, 904, 1000, 1064, 1128, 1224, 1288, 1384, 1480, 1608, 1736,
+};
+
+struct rrc_si_message {
+  bool present;
+  int periodicity_in_frames;
+  int size;                   // Bytes per transport block
+  vector<uint8_t> transport_blocks; // For the MIB one per SFN value
+};
+
+struct rrc_si {
+  int window_length_in_ms;
+  unsigned version;
+  rrc_si_message messages[RRC_SI_MESSAGE + RRC_SI_MAX_MESSAGES];
+};
+
+RRC_SI *
+rrc_si_init(int si_window_length_in_ms) {
+  RRC_SI *si = new RRC_SI();
+  si->window_length_in_ms = std::max(si_window_length_in_ms, 1);
+  return si;
+}
+
+void
+rrc_si_free(RRC_SI *si) {
+  delete si;
+}
+
+unsigned
+rrc_si_version(RRC_SI *si) {
+  return si->version;
+}
+
+static void
+rrc_put_bits(uint8_t *data, int offset, int n_bits, unsigned value) {
+  for (int i = 0; i < n_bits; ++i, ++offset) {
+    uint8_t mask = 0x80 >> (offset % 8);
+    if ((value >> (n_bits - 1 - i)) & 1)
+      data[offset / 8] |= mask;
+    else
+      data[offset / 8] &= ~mask;
+  }
+}
+
+int
+rrc_si_set_message(RRC_SI *si, int type, const void *encoded, int size_in_bits, int periodicity_in_frames) {
+  if (type < 0 || type >= RRC_SI_MESSAGE + RRC_SI_MAX_MESSAGES || size_in_bits < 0
+      || (type >= RRC_SI_MESSAGE && periodicity_in_frames <= 0)) {
+    errno = EINVAL;
+    return -1;
+  }
+  rrc_si_message &m = si->messages[type];
+  int size_in_bytes = (size_in_bits + 7) / 8;
+  if (type == RRC_SI_MIB) {
+    if (size_in_bits != RRC_MIB_SIZE_IN_BITS) {
+      errno = EMSGSIZE;
+      return -1;
+    }
+    m.size = RRC_MIB_SIZE_IN_BITS / 8;
+    m.transport_blocks.resize(RRC_MIB_SFN_VALUES * m.size);
+    for (int sfn = 0; sfn < RRC_MIB_SFN_VALUES; ++sfn) {
+      uint8_t *tb = &m.transport_blocks[sfn * m.size];
+      memcpy(tb, encoded, m.size);
+      rrc_put_bits(tb, RRC_MIB_SFN_OFFSET, 8, sfn);
+    }
+  } else {
+    const int *tbs = std::lower_bound(rrc_dci_1c_tbs, rrc_dci_1c_tbs + 32, size_in_bits);
+    if (tbs == rrc_dci_1c_tbs + 32) {
+      errno = EMSGSIZE;
+      return -1;
+    }
+    // Padded with zeros, which UPER decoders ignore
+    m.size = *tbs / 8;
+    m.transport_blocks.assign(m.size, 0);
+    memcpy(m.transport_blocks.data(), encoded, size_in_bytes);
+    if (size_in_bits % 8)
+      m.transport_blocks[size_in_bytes - 1] &= 0xff << (8 - size_in_bits % 8);
+  }
+  m.present = true;
+  m.periodicity_in_frames = periodicity_in_frames;
+  ++si->version;
+  return 0;
+}
+
+int
+rrc_si_remove_message(RRC_SI *si, int type) {
+  if (type < 0 || type >= RRC_SI_MESSAGE + RRC_SI_MAX_MESSAGES) {
+    errno = EINVAL;
+    return -1;
+  }
+  si->messages[type].present = false;
+  ++si->version;
+  return 0;
+}
+
+/******
+ ** Schedule
+ **
+ ** MIB in subframe 0 of every frame, a new SFN value every 4 frames.
+ ** SIB1 in subframe 0 of every even frame; 3GPP would use subframe 5.
+ ** SystemInformation message n in the n:th SI window of its period,
+ ** which is subframe 0 for the first one with the HamLTE 1 ms window.
+ ** Redundancy versions per 36.321 5.3.1: ceil(3k/2) mod 4.
+ **/
+static const int rrc_si_redundancy_versions[4] = { 0, 2, 3, 1 };
+
+int
+rrc_si_subframe(RRC_SI *si, unsigned sfn, unsigned subframe, struct rrc_si_transmission *transmissions, int max_transmissions) {
+  int n = 0;
+  auto add = [&](int type, int redundancy_version, const uint8_t *tb) {
+    if (n < max_transmissions)
+      transmissions[n++] = rrc_si_transmission { type, redundancy_version, tb, si->messages[type].size };
+  };
+  sfn %= 1024;
+
+  const rrc_si_message &mib = si->messages[RRC_SI_MIB];
+  if (subframe == 0 && mib.present)
+    add(RRC_SI_MIB, 0, &mib.transport_blocks[(sfn >> 2) * mib.size]);
+
+  const rrc_si_message &sib1 = si->messages[RRC_SI_SIB1];
+  if (subframe == 0 && sfn % 2 == 0 && sib1.present)
+    add(RRC_SI_SIB1, rrc_si_redundancy_versions[(sfn / 2) % 4], sib1.transport_blocks.data());
+
+  for (int i = 0; i < RRC_SI_MAX_MESSAGES; ++i) {
+    const rrc_si_message &m = si->messages[RRC_SI_MESSAGE + i];
+    if (!m.present)
+      continue;
+    // Window start of message i
+    unsigned x = i * si->window_length_in_ms;
+    unsigned frames_into_window = (sfn + m.periodicity_in_frames - x / 10 % m.periodicity_in_frames) % m.periodicity_in_frames;
+    unsigned ms_into_window = frames_into_window * 10 + subframe - x % 10;
+    if (frames_into_window * 10 + subframe < x % 10 || ms_into_window >= (unsigned)si->window_length_in_ms)
+      continue;
+    add(RRC_SI_MESSAGE + i, rrc_si_redundancy_versions[ms_into_window % 4], m.transport_blocks.data());
+  }
+  return n;
+}
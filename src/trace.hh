@@ -0,0 +1,137 @@
+// Binary protocol trace: a lock-free ring of fixed size events and a
+// pcap writer for exporting them to Wireshark.
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+/******
+ ** Overwriting single producer ring
+ **
+ ** The protocol thread fills in next() and commit()s it, never waiting. Any other thread
+ ** may drain() events it hasn't seen yet. Events overwritten before the
+ ** reader got to them are skipped and counted as lost: each slot carries the
+ ** count of the event in it, cleared before the producer touches the event.
+ **/
+template <typename Event>
+struct trace_ring {
+  trace_ring() : head(0), read_position(0), mask(0) {}
+  trace_ring(const trace_ring &) = delete;
+
+  // Not thread safe. Rounds up to a power of two, 0 disables tracing.
+  void resize(size_t n_events) {
+    size_t size = 1;
+    while (size < n_events)
+      size *= 2;
+    slots = std::vector<slot>(n_events ? size : 0);
+    mask = slots.size() - 1;
+    head.store(0, std::memory_order_relaxed);
+    read_position = 0;
+  }
+  bool enabled() const { return !slots.empty(); }
+
+  // Producer side: fill in the returned event, then commit()
+  Event &next() {
+    slot &s = slots[head.load(std::memory_order_relaxed) & mask];
+    s.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return s.event;
+  }
+  void commit() {
+    uint64_t count = head.load(std::memory_order_relaxed) + 1;
+    slots[(count - 1) & mask].sequence.store(count, std::memory_order_release);
+    head.store(count, std::memory_order_release);
+  }
+
+  // Consumer side. Returns number of events copied to out.
+  size_t drain(Event *out, size_t max_events, uint64_t *lost = NULL) {
+    if (!enabled())
+      return 0;
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t start = read_position;
+    if (end - start > slots.size())
+      start = end - slots.size();
+    if (end - start > max_events)
+      end = start + max_events;
+    size_t n = 0, skip = 0;
+    for (uint64_t i = start; i != end; ++i) {
+      slot &s = slots[i & mask];
+      if (s.sequence.load(std::memory_order_acquire) == i + 1) {
+	out[n] = s.event;
+	// Any of the producer's writes seen in the copy clears the sequence
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (s.sequence.load(std::memory_order_relaxed) == i + 1) {
+	  ++n;
+	  continue;
+	}
+      }
+      ++skip;
+    }
+    if (lost)
+      *lost = (start - read_position) + skip;
+    read_position = end;
+    return n;
+  }
+
+protected:
+  struct slot {
+    std::atomic<uint64_t> sequence{ 0 }; // Count of the event in it, 0 while written
+    Event event{};
+  };
+  std::vector<slot> slots;
+  std::atomic<uint64_t> head; // Count of events ever recorded
+  uint64_t read_position;     // Consumer's count of events seen
+  uint64_t mask;
+};
+
+/******
+ ** pcap output with raw IPv4 link type
+ **
+ ** Wireshark's LTE dissectors accept their framing as UDP payload when
+ ** the matching heuristic (e.g. "rlc_lte.heuristic_rlc_lte_over_udp")
+ ** is enabled.
+ **/
+#define PCAP_LINKTYPE_RAW 101
+#define PCAP_TRACE_UDP_PORT 9999
+
+static bool
+pcap_write_header(FILE *f) {
+  struct {
+    uint32_t magic; uint16_t major, minor; int32_t thiszone;
+    uint32_t sigfigs, snaplen, linktype;
+  } header = { 0xa1b2c3d4, 2, 4, 0, 0, 65535, PCAP_LINKTYPE_RAW };
+  return fwrite(&header, sizeof(header), 1, f) == 1;
+}
+
+// Write one IPv4/UDP packet. Only captured_length bytes of the payload
+// are in the file, but the packet claims its original length.
+static bool
+pcap_write_udp(FILE *f, unsigned time_in_ms, const uint8_t *payload, size_t captured_length, size_t original_length) {
+  uint8_t ip_udp[28] = {
+    0x45, 0, 0, 0, 0, 0, 0x40, 0, 64, 17, 0, 0,
+    127, 0, 0, 1, 127, 0, 0, 1,
+    PCAP_TRACE_UDP_PORT >> 8, PCAP_TRACE_UDP_PORT & 0xff,
+    PCAP_TRACE_UDP_PORT >> 8, PCAP_TRACE_UDP_PORT & 0xff,
+    0, 0, 0, 0 // UDP checksum 0 means none
+  };
+  size_t ip_length = sizeof(ip_udp) + original_length;
+  ip_udp[2] = ip_length >> 8; ip_udp[3] = ip_length;
+  size_t udp_length = ip_length - 20;
+  ip_udp[24] = udp_length >> 8; ip_udp[25] = udp_length;
+  uint32_t sum = 0;
+  for (int i = 0; i < 20; i += 2)
+    sum += (ip_udp[i] << 8) | ip_udp[i + 1];
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  ip_udp[10] = ~sum >> 8; ip_udp[11] = ~sum;
+
+  struct {
+    uint32_t ts_sec, ts_usec, incl_len, orig_len;
+  } record = { time_in_ms / 1000, (time_in_ms % 1000) * 1000,
+	       (uint32_t)(sizeof(ip_udp) + captured_length), (uint32_t)ip_length };
+  return fwrite(&record, sizeof(record), 1, f) == 1
+    && fwrite(ip_udp, sizeof(ip_udp), 1, f) == 1
+    && fwrite(payload, 1, captured_length, f) == captured_length;
+}
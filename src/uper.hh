@@ -0,0 +1,534 @@
+// ASN.1 Unaligned Packed Encoding Rules (X.691) as C++ types
+//
+// Every ASN.1 type is a C++ type with its constraints as template
+// parameters, so the encoder and decoder of a message are generated by
+// the compiler: field widths, length determinants and presence bitmaps
+// are all known at compile time. Nothing is allocated: SEQUENCE OF and
+// OCTET STRING values live in arrays of a fixed capacity, which may be
+// smaller than the ASN.1 upper bound.
+//
+// SEQUENCE types are structs naming their components with UPER_SEQUENCE.
+// OPTIONAL components are std::optional, CHOICE is uper::choice, a
+// std::variant. Extension additions are never encoded and are skipped
+// when decoded. Types that are not modelled are uper::unsupported, which
+// fails with ENOTSUP if a message actually has one.
+#pragma once
+
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <variant>
+#include <type_traits>
+
+#include "bitfield.hh"
+
+namespace uper {
+
+// Bits needed for values 0..range
+constexpr unsigned
+width_for(uint64_t range) {
+  unsigned n = 0;
+  for (; range; range >>= 1)
+    ++n;
+  return n;
+}
+
+// The same, certainly at compile time
+template <uint64_t Range> constexpr unsigned width = width_for(Range);
+
+// Upper bound of a size constraint without one
+constexpr unsigned unbounded = ~0u;
+
+/******
+ ** Bit cursors
+ **
+ ** The first failure is kept in error as an errno value; later calls do
+ ** nothing so a codec only needs to check once at the end.
+ **/
+struct writer {
+  bits b;
+  unsigned size_in_bits;
+  int error;
+  // bits ORs values in, so the buffer is cleared first
+  writer(uint8_t *data, unsigned size_in_bits) : b(data), size_in_bits(size_in_bits), error(0) {
+    memset(data, 0, (size_in_bits + 7) / 8);
+  }
+  void fail(int e) { if (!error) error = e; }
+  void put(unsigned n_bits, uint64_t value) {
+    if (error || b.write_offset + n_bits > size_in_bits) {
+      fail(EMSGSIZE);
+      return;
+    }
+    if (n_bits > 32) {
+      b.push_bits(n_bits - 32, value >> 32);
+      n_bits = 32;
+    }
+    b.push_bits(n_bits, (unsigned)value);
+  }
+  void put_octets(const uint8_t *octets, unsigned n) {
+    if (error || b.write_offset + n * 8ull > size_in_bits) {
+      fail(EMSGSIZE);
+      return;
+    }
+    if (b.write_offset % 8 == 0) {
+      memcpy(b.data + b.write_offset / 8, octets, n);
+      b.write_offset += n * 8;
+    } else {
+      for (unsigned i = 0; i < n; ++i)
+	b.push_bits(8, octets[i]);
+    }
+  }
+};
+
+struct reader {
+  bits b;
+  unsigned size_in_bits;
+  int error;
+  // bits is only read from
+  reader(const uint8_t *data, unsigned size_in_bits) : b(const_cast<uint8_t *>(data)), size_in_bits(size_in_bits), error(0) { }
+  void fail(int e) { if (!error) error = e; }
+  uint64_t get(unsigned n_bits) {
+    if (error || b.read_offset + n_bits > size_in_bits) {
+      fail(EBADMSG);
+      return 0;
+    }
+    uint64_t value = 0;
+    if (n_bits > 32) {
+      value = (uint64_t)(b / (n_bits - 32)) << 32;
+      n_bits = 32;
+    }
+    return value | (b / n_bits);
+  }
+  void get_octets(uint8_t *octets, unsigned n) {
+    if (error || b.read_offset + n * 8ull > size_in_bits) {
+      fail(EBADMSG);
+      return;
+    }
+    if (b.read_offset % 8 == 0) {
+      memcpy(octets, b.data + b.read_offset / 8, n);
+      b.read_offset += n * 8;
+    } else {
+      for (unsigned i = 0; i < n; ++i)
+	octets[i] = b / 8;
+    }
+  }
+  void skip(uint64_t n_bits) {
+    if (error || b.read_offset + n_bits > size_in_bits)
+      fail(EBADMSG);
+    else
+      b.read_offset += n_bits;
+  }
+};
+
+/******
+ ** Length determinants and small numbers, X.691 10.9 and 10.6
+ **
+ ** Lengths of 16K and more would be fragmented, which no capacity here
+ ** allows for.
+ **/
+inline void
+put_length(writer &w, unsigned n) {
+  if (n < 128)
+    w.put(8, n);
+  else if (n < 16384)
+    w.put(16, 0x8000 | n);
+  else
+    w.fail(EMSGSIZE);
+}
+
+inline unsigned
+get_length(reader &r) {
+  unsigned n = r.get(8);
+  if (n & 0x80) {
+    if (n & 0x40) {
+      r.fail(ENOTSUP);
+      return 0;
+    }
+    n = ((n & 0x3f) << 8) | r.get(8);
+  }
+  return n;
+}
+
+template <unsigned Lo, unsigned Hi>
+void
+put_constrained_length(writer &w, unsigned n) {
+  if (n < Lo || n > Hi)
+    w.fail(EINVAL);
+  else if (Hi == unbounded || Hi >= 65536)
+    put_length(w, n);
+  else
+    w.put(width<Hi - Lo>, n - Lo);
+}
+
+template <unsigned Lo, unsigned Hi>
+unsigned
+get_constrained_length(reader &r) {
+  unsigned n = Hi == unbounded || Hi >= 65536 ? get_length(r) : Lo + r.get(width<Hi - Lo>);
+  if (n < Lo || n > Hi)
+    r.fail(EBADMSG);
+  return n;
+}
+
+inline void
+put_normally_small(writer &w, unsigned n) {
+  if (n < 64) {
+    w.put(7, n);
+  } else {
+    w.put(1, 1);
+    unsigned octets = (width_for(n) + 7) / 8;
+    put_length(w, octets);
+    w.put(octets * 8, n);
+  }
+}
+
+inline unsigned
+get_normally_small(reader &r) {
+  if (!r.get(1))
+    return r.get(6);
+  unsigned octets = get_length(r);
+  if (octets > 4) {
+    r.fail(ENOTSUP);
+    return 0;
+  }
+  return r.get(octets * 8);
+}
+
+// Extension additions of a SEQUENCE: a bitmap of which are present, then
+// each as an open type with a length in octets
+inline void
+skip_extension_additions(reader &r) {
+  unsigned n = get_normally_small(r) + 1, present = 0;
+  for (unsigned i = 0; i < n && !r.error; ++i)
+    present += r.get(1);
+  for (unsigned i = 0; i < present && !r.error; ++i)
+    r.skip(get_length(r) * 8ull);
+}
+
+/******
+ ** Types
+ **/
+template <int Lo, int Hi>
+struct integer {
+  static_assert(Lo <= Hi, "empty range");
+  int value;
+  integer(int value = Lo) : value(value) { }
+  operator int() const { return value; }
+};
+
+// Values from Extensible on are extension values
+template <unsigned N, bool Extensible = false>
+struct enumerated {
+  unsigned value;
+  enumerated(unsigned value = 0) : value(value) { }
+  operator unsigned() const { return value; }
+};
+
+struct null { };
+struct unsupported { };
+
+template <unsigned N>
+struct bit_string {
+  static_assert(N <= 64, "bit strings are held in an integer");
+  uint64_t value;
+  bit_string(uint64_t value = 0) : value(value) { }
+  operator uint64_t() const { return value; }
+};
+
+template <unsigned Lo, unsigned Hi, unsigned Capacity = Hi>
+struct octet_string {
+  unsigned size = Lo;
+  uint8_t data[Capacity] = { };
+  bool assign(const void *octets, unsigned n) {
+    if (n < Lo || n > Hi || n > Capacity)
+      return false;
+    memcpy(data, octets, n);
+    size = n;
+    return true;
+  }
+};
+
+template <typename T, unsigned Lo, unsigned Hi, unsigned Capacity = Hi>
+struct sequence_of {
+  unsigned size = Lo;
+  T items[Capacity];
+  T &operator[](unsigned i) { return items[i]; }
+  const T &operator[](unsigned i) const { return items[i]; }
+  T *begin() { return items; }
+  T *end() { return items + size; }
+  const T *begin() const { return items; }
+  const T *end() const { return items + size; }
+  bool push_back(const T &item) {
+    if (size == Capacity || size == Hi)
+      return false;
+    items[size++] = item;
+    return true;
+  }
+};
+
+// Set an alternative with emplace<index>() when its type is not unique
+template <bool Extensible, typename... Alternatives>
+struct choice : std::variant<Alternatives...> {
+  using std::variant<Alternatives...>::variant;
+  using std::variant<Alternatives...>::operator=;
+};
+
+// Names the components of a SEQUENCE in order
+#define UPER_SEQUENCE(extensible, ...)					\
+  static constexpr bool uper_extensible = extensible;			\
+  template <typename Visitor> void uper_components(Visitor &&v) { v(__VA_ARGS__); } \
+  template <typename Visitor> void uper_components(Visitor &&v) const { v(__VA_ARGS__); }
+
+/******
+ ** Encoder
+ **/
+template <int Lo, int Hi>
+void
+encode(writer &w, const integer<Lo, Hi> &i) {
+  if (i.value < Lo || i.value > Hi)
+    w.fail(EINVAL);
+  else
+    w.put(width<(int64_t)Hi - Lo>, (int64_t)i.value - Lo);
+}
+
+template <unsigned N, bool Extensible>
+void
+encode(writer &w, const enumerated<N, Extensible> &e) {
+  if (Extensible)
+    w.put(1, e.value >= N);
+  if (e.value < N)
+    w.put(width<N - 1>, e.value);
+  else if (Extensible)
+    put_normally_small(w, e.value - N);
+  else
+    w.fail(EINVAL);
+}
+
+// Only for bool itself, an int must not turn into a BOOLEAN
+template <typename B>
+std::enable_if_t<std::is_same_v<B, bool>>
+encode(writer &w, const B &b) { w.put(1, b); }
+inline void encode(writer &, const null &) { }
+inline void encode(writer &w, const unsupported &) { w.fail(ENOTSUP); }
+
+template <unsigned N>
+void
+encode(writer &w, const bit_string<N> &s) {
+  if (N < 64 && s.value >> (N % 64))
+    w.fail(EINVAL);
+  else
+    w.put(N, s.value);
+}
+
+template <unsigned Lo, unsigned Hi, unsigned Capacity>
+void
+encode(writer &w, const octet_string<Lo, Hi, Capacity> &s) {
+  if (s.size > Capacity) {
+    w.fail(EINVAL);
+    return;
+  }
+  if (Lo != Hi)
+    put_constrained_length<Lo, Hi>(w, s.size);
+  w.put_octets(s.data, s.size);
+}
+
+template <typename T, unsigned Lo, unsigned Hi, unsigned Capacity>
+void
+encode(writer &w, const sequence_of<T, Lo, Hi, Capacity> &s) {
+  if (s.size > Capacity) {
+    w.fail(EINVAL);
+    return;
+  }
+  if (Lo != Hi)
+    put_constrained_length<Lo, Hi>(w, s.size);
+  else if (s.size != Lo)
+    w.fail(EINVAL);
+  for (unsigned i = 0; i < s.size; ++i)
+    encode(w, s.items[i]);
+}
+
+template <size_t I, typename Choice>
+void
+encode_alternative(writer &w, const Choice &c) {
+  if constexpr (I < std::variant_size_v<typename Choice::variant>) {
+    if (c.index() == I)
+      encode(w, std::get<I>(c));
+    else
+      encode_alternative<I + 1>(w, c);
+  }
+}
+
+template <bool Extensible, typename... Alternatives>
+void
+encode(writer &w, const choice<Extensible, Alternatives...> &c) {
+  if (Extensible)
+    w.put(1, 0);
+  w.put(width<sizeof...(Alternatives) - 1>, c.index());
+  encode_alternative<0>(w, c);
+}
+
+template <typename T> void encode_presence(writer &, const T &) { }
+template <typename T> void encode_presence(writer &w, const std::optional<T> &o) { w.put(1, o.has_value()); }
+template <typename T> void encode_component(writer &w, const T &t) { encode(w, t); }
+template <typename T> void encode_component(writer &w, const std::optional<T> &o) { if (o) encode(w, *o); }
+
+template <typename T>
+auto
+encode(writer &w, const T &sequence) -> decltype(T::uper_extensible, void()) {
+  if (T::uper_extensible)
+    w.put(1, 0);
+  sequence.uper_components([&w](const auto &... components) {
+      (encode_presence(w, components), ...);
+      (encode_component(w, components), ...);
+    });
+}
+
+/******
+ ** Decoder
+ **/
+template <int Lo, int Hi>
+void
+decode(reader &r, integer<Lo, Hi> &i) {
+  int64_t value = Lo + (int64_t)r.get(width<(int64_t)Hi - Lo>);
+  if (value > Hi)
+    r.fail(EBADMSG);
+  i.value = value;
+}
+
+template <unsigned N, bool Extensible>
+void
+decode(reader &r, enumerated<N, Extensible> &e) {
+  if (Extensible && r.get(1)) {
+    e.value = N + get_normally_small(r);
+    return;
+  }
+  e.value = r.get(width<N - 1>);
+  if (e.value >= N)
+    r.fail(EBADMSG);
+}
+
+template <typename B>
+std::enable_if_t<std::is_same_v<B, bool>>
+decode(reader &r, B &b) { b = r.get(1); }
+inline void decode(reader &, null &) { }
+inline void decode(reader &r, unsupported &) { r.fail(ENOTSUP); }
+
+template <unsigned N>
+void
+decode(reader &r, bit_string<N> &s) {
+  s.value = r.get(N);
+}
+
+template <unsigned Lo, unsigned Hi, unsigned Capacity>
+void
+decode(reader &r, octet_string<Lo, Hi, Capacity> &s) {
+  s.size = Lo == Hi ? Lo : get_constrained_length<Lo, Hi>(r);
+  if (s.size > Capacity) {
+    r.fail(ENOTSUP);
+    s.size = 0;
+  }
+  r.get_octets(s.data, s.size);
+}
+
+template <typename T, unsigned Lo, unsigned Hi, unsigned Capacity>
+void
+decode(reader &r, sequence_of<T, Lo, Hi, Capacity> &s) {
+  s.size = Lo == Hi ? Lo : get_constrained_length<Lo, Hi>(r);
+  if (s.size > Capacity) {
+    r.fail(ENOTSUP);
+    s.size = 0;
+  }
+  for (unsigned i = 0; i < s.size && !r.error; ++i)
+    decode(r, s.items[i]);
+}
+
+template <size_t I, typename Choice>
+void
+decode_alternative(reader &r, Choice &c, size_t index) {
+  if constexpr (I < std::variant_size_v<typename Choice::variant>) {
+    if (index == I) {
+      // Keeps the storage of the alternative when it doesn't change
+      if (c.index() != I)
+	c.template emplace<I>();
+      decode(r, std::get<I>(c));
+    } else {
+      decode_alternative<I + 1>(r, c, index);
+    }
+  }
+}
+
+template <bool Extensible, typename... Alternatives>
+void
+decode(reader &r, choice<Extensible, Alternatives...> &c) {
+  if (Extensible && r.get(1)) {
+    r.fail(ENOTSUP);
+    return;
+  }
+  size_t index = r.get(width<sizeof...(Alternatives) - 1>);
+  if (index >= sizeof...(Alternatives))
+    r.fail(EBADMSG);
+  else
+    decode_alternative<0>(r, c, index);
+}
+
+template <typename T> void decode_presence(reader &, T &) { }
+template <typename T>
+void
+decode_presence(reader &r, std::optional<T> &o) {
+  if (!r.get(1))
+    o.reset();
+  else if (!o)
+    o.emplace();
+}
+template <typename T> void decode_component(reader &r, T &t) { decode(r, t); }
+template <typename T> void decode_component(reader &r, std::optional<T> &o) { if (o) decode(r, *o); }
+
+template <typename T>
+auto
+decode(reader &r, T &sequence) -> decltype(T::uper_extensible, void()) {
+  bool extended = T::uper_extensible && r.get(1);
+  sequence.uper_components([&r](auto &... components) {
+      (decode_presence(r, components), ...);
+      (decode_component(r, components), ...);
+    });
+  if (extended)
+    skip_extension_additions(r);
+}
+
+/******
+ ** Messages
+ **/
+
+// Returns the size of the encoding in bits, -1 with errno EMSGSIZE if it
+// doesn't fit or EINVAL/ENOTSUP if the value can't be encoded
+template <typename Message>
+int
+encode_message(const Message &message, void *buffer, int size) {
+  writer w((uint8_t *)buffer, size * 8);
+  encode(w, message);
+  // An empty encoding is one zero octet, X.691 11.1
+  if (!w.error && w.b.write_offset == 0)
+    w.put(8, 0);
+  if (w.error) {
+    errno = w.error;
+    return -1;
+  }
+  return w.b.write_offset;
+}
+
+// Returns the number of bits used, anything after is padding. -1 with
+// errno EBADMSG if the message is malformed or ENOTSUP if it uses
+// something not modelled
+template <typename Message>
+int
+decode_message(Message &message, const void *data, int size_in_bits) {
+  reader r((const uint8_t *)data, size_in_bits);
+  decode(r, message);
+  if (r.error) {
+    errno = r.error;
+    return -1;
+  }
+  return r.b.read_offset;
+}
+
+}